@@ -5,6 +5,9 @@ namespace wangziqi2013 {
 namespace index_building_block {
 namespace bwtree {
 
+// Logical thread ID of the calling thread. See class ThreadContext
+thread_local size_t ThreadContext::thread_id = 0;
+
 } // namespace bwtree
 } // namespace index_building_block
 } // namespace wangziqi2013
\ No newline at end of file
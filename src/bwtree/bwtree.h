@@ -9,6 +9,22 @@
 
 #include "common.h"
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace wangziqi2013 {
 namespace index_building_block {
@@ -32,6 +48,19 @@ class UniqueKeyBase {
   static constexpr bool support_non_unique_key = false;
 };
 
+// * NonUniqueKeyBase - If a class inherits from this class, then it supports non-unique key
+class NonUniqueKeyBase {
+ public:
+  static constexpr bool support_non_unique_key = true;
+};
+
+// * KeyToString() - Prints a key for testing. Arithmetic keys go through std::to_string
+template <typename KeyType>
+inline typename std::enable_if<std::is_arithmetic<KeyType>::value, std::string>::type
+KeyToString(const KeyType &key) { return std::to_string(key); }
+// * KeyToString() - String keys are printed as they are
+inline std::string KeyToString(const std::string &key) { return key; }
+
 /*
  * BoundKey() - Represents low key and high key which can be infinities
  */
@@ -64,8 +93,8 @@ class BoundKey {
   inline static BoundKey GetInf() { return BoundKey{KeyType{}, true}; }
   // * Get() - Returns a key
   inline static BoundKey Get(const KeyType &key) { return BoundKey{key, false}; }
-  // * ToString() - For Testing purposes. Note that the key type must be compatible with std::to_string
-  inline std::string ToString() const { return IsInf() ? "Inf" : std::to_string(key); }
+  // * ToString() - For Testing purposes. The key type must have a KeyToString() overload
+  inline std::string ToString() const { return IsInf() ? "Inf" : KeyToString(key); }
 };
 
 // * class KeyPtrGreater() - Compares two key pointers
@@ -77,10 +106,324 @@ class KeyPtrGreater {
   }
 };
 
+/*
+ * class KeyEncoder - Encodes fields into a byte string whose memcmp() order is the order
+ *                    of the fields compared one by one
+ * 
+ * 1. Unsigned integers are written big-endian. Signed integers have the sign bit flipped
+ *    first, such that negative values are below positive ones
+ * 2. Floats have the sign bit flipped if positive, and all bits flipped if negative. -0.0 is
+ *    below 0.0, and NaNs with the sign bit cleared are above +Inf
+ * 3. Strings escape 0x00 as 0x00 0xFF and end with 0x00 0x00, so no encoding is a prefix of
+ *    another. Shorter strings are below their extensions, and later fields never affect 
+ *    the order of a string field
+ * 4. Composite keys are encoded by appending the fields in order. The result is either used
+ *    as a std::string key, e.g. in DefaultVarKeyBaseNode, or as a fixed size EncodedKey
+ */
+class KeyEncoder {
+ public:
+  KeyEncoder() : buffer{} {}
+
+  // * AppendInt() - Appends a signed or unsigned integer
+  template <typename T>
+  inline typename std::enable_if<std::is_integral<T>::value, KeyEncoder &>::type AppendInt(T value) {
+    using UnsignedType = typename std::make_unsigned<T>::type;
+    UnsignedType bits = static_cast<UnsignedType>(value);
+    if(std::is_signed<T>::value) { bits ^= static_cast<UnsignedType>(UnsignedType{1} << (sizeof(T) * 8 - 1)); }
+    AppendBigEndian(static_cast<uint64_t>(bits), sizeof(T));
+    return *this;
+  }
+
+  // * AppendFloat() - Appends a float or a double
+  template <typename T>
+  inline typename std::enable_if<std::is_floating_point<T>::value, KeyEncoder &>::type AppendFloat(T value) {
+    using BitsType = typename std::conditional<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>::type;
+    static_assert(sizeof(T) == sizeof(BitsType), "Only float and double are supported");
+    BitsType bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const BitsType sign = BitsType{1} << (sizeof(T) * 8 - 1);
+    bits = (bits & sign) ? ~bits : (bits ^ sign);
+    AppendBigEndian(static_cast<uint64_t>(bits), sizeof(T));
+    return *this;
+  }
+
+  // * AppendString() - Appends an escaped and terminated byte string
+  KeyEncoder &AppendString(const char *p, size_t size) {
+    for(size_t i = 0;i < size;i++) {
+      buffer.push_back(p[i]);
+      if(p[i] == '\0') { buffer.push_back('\xFF'); }
+    }
+    buffer.append(2, '\0');
+    return *this;
+  }
+  inline KeyEncoder &AppendString(const std::string &s) { return AppendString(s.data(), s.size()); }
+
+  // * GetString() - Returns the encoded bytes
+  inline const std::string &GetString() const { return buffer; }
+  // * Clear() - Starts a new key
+  inline void Clear() { buffer.clear(); }
+
+ private:
+  // * AppendBigEndian() - Appends the low size bytes of the value, highest byte first
+  inline void AppendBigEndian(uint64_t value, size_t size) {
+    for(size_t i = size;i > 0;i--) { buffer.push_back(static_cast<char>((value >> ((i - 1) * 8)) & 0xFF)); }
+  }
+
+  std::string buffer;
+};
+
+/*
+ * class KeyDecoder - Reads fields back from bytes written by KeyEncoder
+ * 
+ * Fields must be read in the order and types they are appended. Read functions
+ * return false if the bytes are not a valid encoding of the field
+ */
+class KeyDecoder {
+ public:
+  KeyDecoder(const void *pdata_p, size_t psize) : 
+    data_p{static_cast<const unsigned char *>(pdata_p)}, size{psize}, offset{0} {}
+
+  // * ReadInt() - Reads a signed or unsigned integer
+  template <typename T>
+  inline typename std::enable_if<std::is_integral<T>::value, bool>::type ReadInt(T *value_p) {
+    using UnsignedType = typename std::make_unsigned<T>::type;
+    uint64_t value;
+    if(ReadBigEndian(&value, sizeof(T)) == false) { return false; }
+    UnsignedType bits = static_cast<UnsignedType>(value);
+    if(std::is_signed<T>::value) { bits ^= static_cast<UnsignedType>(UnsignedType{1} << (sizeof(T) * 8 - 1)); }
+    *value_p = static_cast<T>(bits);
+    return true;
+  }
+
+  // * ReadFloat() - Reads a float or a double
+  template <typename T>
+  inline typename std::enable_if<std::is_floating_point<T>::value, bool>::type ReadFloat(T *value_p) {
+    using BitsType = typename std::conditional<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>::type;
+    uint64_t value;
+    if(ReadBigEndian(&value, sizeof(T)) == false) { return false; }
+    BitsType bits = static_cast<BitsType>(value);
+    const BitsType sign = BitsType{1} << (sizeof(T) * 8 - 1);
+    bits = (bits & sign) ? (bits ^ sign) : ~bits;
+    std::memcpy(value_p, &bits, sizeof(bits));
+    return true;
+  }
+
+  // * ReadString() - Reads a string until the terminator
+  bool ReadString(std::string *s_p) {
+    s_p->clear();
+    while(offset + 1 < size) {
+      unsigned char c = data_p[offset++];
+      if(c != 0x00) { 
+        s_p->push_back(static_cast<char>(c)); 
+        continue;
+      }
+      unsigned char next = data_p[offset++];
+      if(next == 0x00) { return true; }
+      else if(next != 0xFF) { return false; }
+      s_p->push_back('\0');
+    }
+    return false;
+  }
+
+  // * GetOffset() - Returns the number of bytes read
+  inline size_t GetOffset() const { return offset; }
+
+ private:
+  // * ReadBigEndian() - Reads size bytes, highest byte first
+  inline bool ReadBigEndian(uint64_t *value_p, size_t psize) {
+    if(offset + psize > size) { return false; }
+    uint64_t value = 0;
+    for(size_t i = 0;i < psize;i++) { value = (value << 8) | data_p[offset++]; }
+    *value_p = value;
+    return true;
+  }
+
+  const unsigned char *data_p;
+  size_t size;
+  size_t offset;
+};
+
+/*
+ * class EncodedKey - Fixed size key of encoded bytes, compared with memcmp()
+ * 
+ * 1. Shorter encodings are padded with zeros. Encodings of KeyEncoder are never a prefix 
+ *    of each other if the last field is a string or all fields have fixed sizes, so the 
+ *    padding does not change the order
+ * 2. Base nodes, bound keys and consolidators compare keys with the operators of the key
+ *    type. This replaces the field by field comparisons of composite keys with one
+ *    memcmp() of N bytes, which is inlined for small N
+ * 3. The key is trivially copyable, so it could be used in snapshots and logs
+ */
+template <size_t N>
+class EncodedKey {
+ public:
+  static constexpr size_t SIZE = N;
+  EncodedKey() { std::memset(data, 0, N); }
+  // * EncodedKey() - Copies and pads the encoding. The encoding must fit in N bytes
+  explicit EncodedKey(const KeyEncoder &encoder) : EncodedKey{} {
+    always_assert(encoder.GetString().size() <= N);
+    std::memcpy(data, encoder.GetString().data(), encoder.GetString().size());
+  }
+
+  // * Compare() - Returns negative, zero or positive if this key is <, == or > the other
+  inline int Compare(const EncodedKey &other) const { return std::memcmp(data, other.data, N); }
+  // * GetDecoder() - Returns a decoder of the fields
+  inline KeyDecoder GetDecoder() const { return KeyDecoder{data, N}; }
+  // * GetData() - Returns the bytes
+  inline const unsigned char *GetData() const { return data; }
+
+  inline bool operator<(const EncodedKey &other) const { return Compare(other) < 0; }
+  inline bool operator>(const EncodedKey &other) const { return Compare(other) > 0; }
+  inline bool operator==(const EncodedKey &other) const { return Compare(other) == 0; }
+  inline bool operator!=(const EncodedKey &other) const { return Compare(other) != 0; }
+  inline bool operator<=(const EncodedKey &other) const { return Compare(other) <= 0; }
+  inline bool operator>=(const EncodedKey &other) const { return Compare(other) >= 0; }
+
+ private:
+  unsigned char data[N];
+};
+
+// * KeyToString() - Encoded keys are printed as hex bytes
+template <size_t N>
+inline std::string KeyToString(const EncodedKey<N> &key) {
+  static const char *digit_list = "0123456789ABCDEF";
+  std::string ret{};
+  for(size_t i = 0;i < N;i++) {
+    ret.push_back(digit_list[key.GetData()[i] >> 4]);
+    ret.push_back(digit_list[key.GetData()[i] & 0xF]);
+  }
+  return ret;
+}
+
+/*
+ * class InlineArray - An array of N inline elements that moves to the heap when more are needed
+ *
+ * 1. The array does not track the number of elements. The owner calls Reserve() before
+ *    writing past the current capacity, and existing elements are kept on growth
+ * 2. Pointers to elements are invalidated by a growth
+ *
+ * This is used by consolidators whose lists are bounded by delta chain heights, which
+ * are only known at run time. The common case never allocates
+ */
+template <typename T, size_t N>
+class InlineArray {
+ public:
+  InlineArray() : data_p{inline_list}, capacity{N} {}
+  ~InlineArray() { if(data_p != inline_list) { delete[] data_p; } }
+  InlineArray(const InlineArray &) = delete;
+  InlineArray &operator=(const InlineArray &) = delete;
+
+  // * Reserve() - Makes sure the first n elements could be accessed
+  inline void Reserve(size_t n) { if(n > capacity) { Grow(n); } }
+  // * operator[]
+  inline T &operator[](size_t index) { assert(index < capacity); return data_p[index]; }
+  inline const T &operator[](size_t index) const { assert(index < capacity); return data_p[index]; }
+  // * Data() - Returns the pointer to the first element
+  inline T *Data() { return data_p; }
+  // * IsInline() - Whether the elements are still stored inline
+  inline bool IsInline() const { return data_p == inline_list; }
+
+ private:
+  // * Grow() - Moves elements to a heap array of at least n elements. The capacity is at least doubled
+  void Grow(size_t n) {
+    size_t new_capacity = std::max(n, capacity * 2);
+    T *new_data_p = new T[new_capacity];
+    std::copy(data_p, data_p + capacity, new_data_p);
+    if(data_p != inline_list) { delete[] data_p; }
+    data_p = new_data_p;
+    capacity = new_capacity;
+  }
+
+  T inline_list[N];
+  T *data_p;
+  size_t capacity;
+};
+
+/*
+ * class BoundedQueue - Lock-free multi-producer multi-consumer queue of SIZE elements
+ * 
+ * 1. Each cell has a sequence number, which tells whether the cell is ready to be
+ *    written or read at a given position. Producers and consumers claim positions 
+ *    with CAS on separate counters, and only wait for the cell they claimed
+ * 2. Push() fails if the queue is full, and Pop() fails if it is empty. Neither blocks
+ */
+template <typename T, size_t SIZE>
+class BoundedQueue {
+ public:
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  static_assert((SIZE & (SIZE - 1)) == 0, "Queue size must be a power of two");
+
+ private:
+  // * class CellType - An element, and the position at which it is written or read next
+  class CellType {
+   public:
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+ public:
+  BoundedQueue() : cell_list{new CellType[SIZE]}, enqueue_pos{0}, dequeue_pos{0} {
+    for(size_t i = 0;i < SIZE;i++) { cell_list[i].sequence.store(i, std::memory_order_relaxed); }
+  }
+  ~BoundedQueue() { delete[] cell_list; }
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  // * Push() - Appends an element. Returns false if the queue is full
+  bool Push(const T &data) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    CellType *cell_p;
+    while(true) {
+      cell_p = &cell_list[pos & (SIZE - 1)];
+      intptr_t diff = static_cast<intptr_t>(cell_p->sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos);
+      if(diff == 0) { 
+        if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; } 
+      } else if(diff < 0) { 
+        return false; 
+      } else { 
+        pos = enqueue_pos.load(std::memory_order_relaxed); 
+      }
+    }
+
+    cell_p->data = data;
+    cell_p->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // * Pop() - Removes the first element into the argument. Returns false if the queue is empty
+  bool Pop(T *data_p) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    CellType *cell_p;
+    while(true) {
+      cell_p = &cell_list[pos & (SIZE - 1)];
+      intptr_t diff = static_cast<intptr_t>(cell_p->sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos + 1);
+      if(diff == 0) { 
+        if(dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; } 
+      } else if(diff < 0) { 
+        return false; 
+      } else { 
+        pos = dequeue_pos.load(std::memory_order_relaxed); 
+      }
+    }
+
+    *data_p = cell_p->data;
+    cell_p->sequence.store(pos + SIZE, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  CellType *cell_list;
+  // Avoid false sharing between producers and consumers
+  char padding_0[CACHE_LINE_SIZE];
+  std::atomic<size_t> enqueue_pos;
+  char padding_1[CACHE_LINE_SIZE];
+  std::atomic<size_t> dequeue_pos;
+};
+
 /*
   * enum class NodeType - Defines the enum of node type
   */
-enum class NodeType : uint16_t {
+enum class NodeType : uint8_t {
   InnerBase = 1,
   InnerInsert,
   InnerDelete,
@@ -96,6 +439,26 @@ enum class NodeType : uint16_t {
   LeafMerge,
 };
 
+/*
+ * class ThreadContext - Stores the logical ID of the calling thread
+ *
+ * 1. Logical thread IDs are assigned by the caller, starting from 0. This is
+ *    consistent with StartThread() which passes the ID as the first argument
+ * 2. The ID is shared by all instances in the same process. Components that
+ *    keep per-thread states use it as the index into their per-thread arrays
+ * 3. Threads that never set their IDs have ID 0
+ */
+class ThreadContext {
+ public:
+  // * SetThreadID() - Sets the logical ID of the calling thread
+  inline static void SetThreadID(size_t pthread_id) { thread_id = pthread_id; }
+  // * GetThreadID() - Returns the logical ID of the calling thread
+  inline static size_t GetThreadID() { return thread_id; }
+ private:
+  // This is defined in bwtree.cpp
+  static thread_local size_t thread_id;
+};
+
 /*
  * class DefaultMappingTable - This class implements the minimal mapping table
  *                             which supports the allocation and CAS of node IDs
@@ -103,6 +466,8 @@ enum class NodeType : uint16_t {
  * 1. Release of node ID is not supported. Always allocate from the counter
  * 2. The mapping table is fixed sized. No bounds checking is performed under
  *    release mode. Under debug mode an error will be raised
+ * 3. The capacity given to Get() could limit the table to fewer IDs than TABLE_SIZE,
+ *    but the memory of TABLE_SIZE elements is always allocated
  * 
  * It accepts two template parameters: One to specify the element type. The atomic
  * type to the pointer of the element type is stored. Another to specify the 
@@ -126,8 +491,10 @@ class DefaultMappingTable {
    * The constructor is private to avoid allocating a mapping table on the stack
    * or directly putting it as a memory, as the table can be potentially large
    */
-  DefaultMappingTable() : 
+  DefaultMappingTable(size_t pcapacity) : 
+    capacity{pcapacity},
     next_slot{FIRST_NODE_ID} {
+    always_assert(capacity <= TABLE_SIZE);
     return;
   }
 
@@ -138,7 +505,7 @@ class DefaultMappingTable {
 
  public: 
   // * Get() - Allocate an instance of the mapping table
-  static DefaultMappingTable *Get() { return new DefaultMappingTable{}; }
+  static DefaultMappingTable *Get(size_t capacity = TABLE_SIZE) { return new DefaultMappingTable{capacity}; }
   // * Destroy() - The destructor of the mapping table instance
   static void Destroy(DefaultMappingTable *mapping_table_p) { delete mapping_table_p; }
 
@@ -152,7 +519,7 @@ class DefaultMappingTable {
     // Use atomic instruction to allocate slots
     NodeIDType slot = next_slot.fetch_add(1);
     // Only do this after the atomic inc
-    assert(slot < TABLE_SIZE);
+    assert(slot < capacity);
     mapping_table[slot] = node_p;
 
     return slot;
@@ -187,9 +554,15 @@ class DefaultMappingTable {
     return mapping_table[node_id].load();
   }
 
+  // * Prefetch() - Prefetches the slot of a node ID
+  inline void Prefetch(NodeIDType node_id) {
+    assert(node_id < TABLE_SIZE);
+    __builtin_prefetch(&mapping_table[node_id]);
+  }
+
   // * Reset() - Clear the content as well as the index
   void Reset() {
-    memset(mapping_table, 0x00, sizeof(mapping_table));
+    memset(static_cast<void *>(mapping_table), 0x00, sizeof(mapping_table));
     next_slot = NodeIDType{0};
     return;
   }
@@ -197,9 +570,406 @@ class DefaultMappingTable {
  private:
   // Fixed sized mapping table with atomic type as elements
   std::atomic<BaseNodeType *> mapping_table[TABLE_SIZE];
+  size_t capacity;
+  std::atomic<NodeIDType> next_slot;
+};
+
+/*
+ * class DefaultPagedMappingTable - Mapping table that grows in pages and recycles node IDs
+ * 
+ * 1. The capacity given to Get() is the upper bound of node IDs, which is TABLE_SIZE
+ *    by default. Slots are stored in pages of PAGE_SIZE elements, and the directory of
+ *    pages is sized by the capacity. A page is allocated when the first ID on it is 
+ *    handed out, and installed into the directory with CAS. Pages are only freed on destruction
+ * 2. Released node IDs are put into one of FREE_LIST_NUM free lists, selected by 
+ *    the logical thread ID of the caller, and are reused before new IDs are allocated.
+ *    Each free list is protected by a spin lock which is almost never contended
+ * 3. A node ID can only be released after no thread could still access it. The BwTree
+ *    guarantees this by releasing IDs of removed nodes from the epoch manager, and
+ *    by releasing IDs that were never published immediately
+ * 
+ * The interface is identical to DefaultMappingTable
+ */
+template <typename BaseNodeType, size_t TABLE_SIZE>
+class DefaultPagedMappingTable {
+ public:
+  using NodeIDType = uint64_t;
+  static constexpr NodeIDType INVALID_NODE_ID = static_cast<NodeIDType>(-1);
+  static constexpr NodeIDType FIRST_NODE_ID = 0;
+  // Number of slots per page, which must be a power of two
+  static constexpr size_t PAGE_SIZE = 4096;
+  static constexpr size_t FREE_LIST_NUM = 64;
+  static_assert((PAGE_SIZE & (PAGE_SIZE - 1)) == 0, "Page size must be a power of two");
+
+ private:
+  using SlotType = std::atomic<BaseNodeType *>;
+
+  // * class FreeListType - A list of released node IDs
+  class FreeListType {
+   public:
+    FreeListType() : id_list{} { lock.clear(); }
+    // * Push() * Pop() - Pop() returns INVALID_NODE_ID if the list is empty
+    void Push(NodeIDType node_id) { Lock(); id_list.push_back(node_id); Unlock(); }
+    NodeIDType Pop() {
+      NodeIDType node_id = INVALID_NODE_ID;
+      Lock();
+      if(id_list.size() != 0) { node_id = id_list.back(); id_list.pop_back(); }
+      Unlock();
+      return node_id;
+    }
+    // * Clear() - Not thread-safe
+    void Clear() { id_list.clear(); }
+    size_t GetSize() const { return id_list.size(); }
+   private:
+    inline void Lock() { while(lock.test_and_set(std::memory_order_acquire)) {} }
+    inline void Unlock() { lock.clear(std::memory_order_release); }
+
+    std::atomic_flag lock;
+    std::vector<NodeIDType> id_list;
+  };
+
+  // * DefaultPagedMappingTable() - Private Constructor
+  DefaultPagedMappingTable(size_t pcapacity) : 
+    capacity{pcapacity},
+    page_num{(pcapacity + PAGE_SIZE - 1) / PAGE_SIZE},
+    page_list{new std::atomic<SlotType *>[page_num]},
+    next_slot{FIRST_NODE_ID} {
+    for(size_t i = 0;i < page_num;i++) { page_list[i].store(nullptr); }
+    return;
+  }
+
+  // * ~DefaultPagedMappingTable() - Private Destructor
+  ~DefaultPagedMappingTable() { FreeAllPages(); delete[] page_list; }
+
+ public: 
+  // * Get() - Allocate an instance of the mapping table
+  static DefaultPagedMappingTable *Get(size_t capacity = TABLE_SIZE) { return new DefaultPagedMappingTable{capacity}; }
+  // * Destroy() - The destructor of the mapping table instance
+  static void Destroy(DefaultPagedMappingTable *mapping_table_p) { delete mapping_table_p; }
+
+  /*
+   * AllocateNodeID() - Allocate a slot and put the given node_p into it
+   * 
+   * Released IDs in the calling thread's free list are reused first
+   */
+  inline NodeIDType AllocateNodeID(BaseNodeType *node_p) {
+    NodeIDType slot = GetFreeList()->Pop();
+    if(slot == INVALID_NODE_ID) {
+      slot = next_slot.fetch_add(1);
+      assert(slot < capacity);
+    }
+
+    GetSlot(slot, true)->store(node_p);
+    return slot;
+  }
+
+  /*
+   * ReleaseNodeID() - Release the node ID such that it can be allocated again
+   * 
+   * The caller must make sure no thread could access the ID any more
+   */
+  inline void ReleaseNodeID(NodeIDType node_id) {
+    assert(node_id < next_slot.load());
+    GetSlot(node_id)->store(nullptr);
+    GetFreeList()->Push(node_id);
+    return;
+  }
+
+  /*
+   * CAS() - Performs compare and swap on a table element
+   */
+  inline bool CAS(NodeIDType node_id, 
+                  BaseNodeType *old_value, 
+                  BaseNodeType *new_value) {
+    return GetSlot(node_id)->compare_exchange_strong(old_value, new_value);
+  }
+
+  // * At() - Returns the content on a given index
+  inline BaseNodeType *At(NodeIDType node_id) { return GetSlot(node_id)->load(); }
+  // * Prefetch() - Prefetches the slot of a node ID
+  inline void Prefetch(NodeIDType node_id) { __builtin_prefetch(GetSlot(node_id)); }
+
+  // * Reset() - Clear the content as well as the index. Not thread-safe
+  void Reset() {
+    FreeAllPages();
+    for(size_t i = 0;i < FREE_LIST_NUM;i++) { free_list[i].Clear(); }
+    next_slot = NodeIDType{0};
+    return;
+  }
+
+  // * GetPageCount() - Returns the number of pages allocated
+  size_t GetPageCount() const {
+    size_t count = 0;
+    for(size_t i = 0;i < page_num;i++) { if(page_list[i].load() != nullptr) { count++; } }
+    return count;
+  }
+
+  // * GetFreeCount() - Returns the number of released IDs not yet reused. Not thread-safe
+  size_t GetFreeCount() const {
+    size_t count = 0;
+    for(size_t i = 0;i < FREE_LIST_NUM;i++) { count += free_list[i].GetSize(); }
+    return count;
+  }
+
+ private:
+  // * GetFreeList() - Returns the free list of the calling thread
+  inline FreeListType *GetFreeList() { return &free_list[ThreadContext::GetThreadID() % FREE_LIST_NUM]; }
+
+  /*
+   * GetSlot() - Returns the slot of a node ID
+   * 
+   * If allocate is true, the page is allocated if it does not exist. Otherwise
+   * the page must exist, because the ID must have been allocated before
+   */
+  inline SlotType *GetSlot(NodeIDType node_id, bool allocate = false) {
+    assert(node_id < capacity);
+    std::atomic<SlotType *> *page_p = &page_list[node_id / PAGE_SIZE];
+    SlotType *slot_list = page_p->load(std::memory_order_acquire);
+    if(slot_list == nullptr) {
+      assert(allocate == true);
+      (void)allocate;
+      SlotType *new_slot_list = new SlotType[PAGE_SIZE];
+      for(size_t i = 0;i < PAGE_SIZE;i++) { new_slot_list[i].store(nullptr, std::memory_order_relaxed); }
+      if(page_p->compare_exchange_strong(slot_list, new_slot_list)) {
+        slot_list = new_slot_list;
+      } else {
+        // Another thread has installed the page; slot_list is updated by the failed CAS
+        delete[] new_slot_list;
+      }
+    }
+
+    return &slot_list[node_id % PAGE_SIZE];
+  }
+
+  // * FreeAllPages() - Frees all pages. Not thread-safe
+  void FreeAllPages() {
+    for(size_t i = 0;i < page_num;i++) {
+      delete[] page_list[i].load();
+      page_list[i].store(nullptr);
+    }
+  }
+
+  size_t capacity;
+  size_t page_num;
+  std::atomic<SlotType *> *page_list;
   std::atomic<NodeIDType> next_slot;
+  FreeListType free_list[FREE_LIST_NUM];
+};
+
+// * enum class SlotLayout - How node IDs are mapped to slots of BlockMappingTable
+enum class SlotLayout { 
+  // Consecutive IDs are in consecutive slots
+  Dense, 
+  // Consecutive IDs are on different cache lines, without using more memory
+  Striped, 
+  // Every slot is on its own cache line
+  Padded 
+};
+
+// * enum class TableMemory - How the memory of BlockMappingTable is placed on NUMA nodes
+enum class TableMemory { 
+  // A page is placed on the node of the thread that first writes to it
+  FirstTouch, 
+  // Pages are interleaved across all nodes
+  Interleaved 
+};
+
+/*
+ * class BlockMappingTable - Mapping table with per-thread ID blocks and configurable slot layout
+ * 
+ * 1. Threads allocate node IDs from private blocks of BLOCK_SIZE IDs, and only take 
+ *    a new block from the shared counter when the block is used up. A block covers 
+ *    one memory page of slots
+ * 2. Slots are laid out as specified by LAYOUT, such that nodes created together by
+ *    one thread, e.g. split siblings, do not false share when CASed by different threads
+ * 3. The table is reserved with mmap() for the capacity given to Get(), which is 
+ *    TABLE_SIZE by default, and never touched on construction. With 
+ *    FirstTouch, pages of a block are placed on the node of the allocating thread.
+ *    With Interleaved, the kernel is asked to interleave pages with mbind(). This is 
+ *    best effort; the table works the same if the call is not supported
+ * 4. Released node IDs are reused like DefaultPagedMappingTable. Per-thread states 
+ *    are selected by the logical thread ID, and protected by spin locks which are
+ *    almost never contended
+ * 
+ * Use the Default* aliases below as the mapping table argument of BwTree
+ */
+template <typename BaseNodeType, size_t TABLE_SIZE, SlotLayout LAYOUT, TableMemory MEMORY>
+class BlockMappingTable {
+ public:
+  using NodeIDType = uint64_t;
+  static constexpr NodeIDType INVALID_NODE_ID = static_cast<NodeIDType>(-1);
+  static constexpr NodeIDType FIRST_NODE_ID = 0;
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  static constexpr size_t MEMORY_PAGE_SIZE = 4096;
+  static constexpr size_t THREAD_STATE_NUM = 128;
+  using SlotType = std::atomic<BaseNodeType *>;
+  // Number of slots on a cache line, and the number of IDs in a striping group
+  static constexpr size_t LINE_SLOT_NUM = CACHE_LINE_SIZE / sizeof(SlotType);
+  static constexpr size_t GROUP_SIZE = LINE_SLOT_NUM * LINE_SLOT_NUM;
+  // Number of bytes in the table for each ID
+  static constexpr size_t SLOT_STRIDE = (LAYOUT == SlotLayout::Padded) ? CACHE_LINE_SIZE : sizeof(SlotType);
+  static constexpr size_t BLOCK_SIZE = MEMORY_PAGE_SIZE / SLOT_STRIDE;
+  static_assert(BLOCK_SIZE % GROUP_SIZE == 0, "A block must consist of whole striping groups");
+
+ private:
+
+  // * class ThreadStateType - ID block and released IDs of a thread
+  class ThreadStateType {
+   public:
+    ThreadStateType() : next_id{INVALID_NODE_ID}, end_id{INVALID_NODE_ID}, free_list{} { lock.clear(); }
+    // Avoid false sharing between the states of adjacent threads
+    char padding[CACHE_LINE_SIZE];
+    std::atomic_flag lock;
+    NodeIDType next_id;
+    NodeIDType end_id;
+    std::vector<NodeIDType> free_list;
+    inline void Lock() { while(lock.test_and_set(std::memory_order_acquire)) {} }
+    inline void Unlock() { lock.clear(std::memory_order_release); }
+  };
+
+  // * BlockMappingTable() - Private Constructor. Reserves the memory of whole blocks without touching it
+  BlockMappingTable(size_t capacity) : 
+    id_num{(capacity + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE},
+    table_bytes{id_num * SLOT_STRIDE},
+    next_block{FIRST_NODE_ID} {
+    void *p = mmap(nullptr, table_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    always_assert(p != MAP_FAILED);
+    table_p = static_cast<unsigned char *>(p);
+    if(MEMORY == TableMemory::Interleaved) { Interleave(); }
+    return;
+  }
+
+  // * ~BlockMappingTable() - Private Destructor
+  ~BlockMappingTable() { munmap(table_p, table_bytes); }
+
+ public:
+  // * Get() - Allocate an instance of the mapping table
+  static BlockMappingTable *Get(size_t capacity = TABLE_SIZE) { return new BlockMappingTable{capacity}; }
+  // * Destroy() - The destructor of the mapping table instance
+  static void Destroy(BlockMappingTable *mapping_table_p) { delete mapping_table_p; }
+
+  /*
+   * AllocateNodeID() - Allocate a slot and put the given node_p into it
+   * 
+   * Released IDs of the calling thread are reused first, then IDs in the block
+   */
+  inline NodeIDType AllocateNodeID(BaseNodeType *node_p) {
+    ThreadStateType *state_p = GetThreadState();
+    NodeIDType node_id;
+    state_p->Lock();
+    if(state_p->free_list.size() != 0) {
+      node_id = state_p->free_list.back();
+      state_p->free_list.pop_back();
+    } else {
+      if(state_p->next_id == state_p->end_id) {
+        state_p->next_id = next_block.fetch_add(BLOCK_SIZE);
+        state_p->end_id = state_p->next_id + BLOCK_SIZE;
+        assert(state_p->next_id < id_num);
+      }
+      node_id = state_p->next_id++;
+    }
+    state_p->Unlock();
+
+    GetSlot(node_id)->store(node_p);
+    return node_id;
+  }
+
+  /*
+   * ReleaseNodeID() - Release the node ID such that it can be allocated again
+   * 
+   * The caller must make sure no thread could access the ID any more
+   */
+  inline void ReleaseNodeID(NodeIDType node_id) {
+    GetSlot(node_id)->store(nullptr);
+    ThreadStateType *state_p = GetThreadState();
+    state_p->Lock();
+    state_p->free_list.push_back(node_id);
+    state_p->Unlock();
+    return;
+  }
+
+  /*
+   * CAS() - Performs compare and swap on a table element
+   */
+  inline bool CAS(NodeIDType node_id, 
+                  BaseNodeType *old_value, 
+                  BaseNodeType *new_value) {
+    return GetSlot(node_id)->compare_exchange_strong(old_value, new_value);
+  }
+
+  // * At() - Returns the content on a given index
+  inline BaseNodeType *At(NodeIDType node_id) { return GetSlot(node_id)->load(); }
+  // * Prefetch() - Prefetches the slot of a node ID
+  inline void Prefetch(NodeIDType node_id) { __builtin_prefetch(GetSlot(node_id)); }
+
+  /*
+   * GetSlotOffset() - Returns the byte offset of the slot of a node ID in the table
+   * 
+   * With Striped layout, ID r in a group of GROUP_SIZE IDs is on line (r % LINE_SLOT_NUM) 
+   * of the group, such that every LINE_SLOT_NUM consecutive IDs are on different lines
+   */
+  inline static size_t GetSlotOffset(NodeIDType node_id) {
+    size_t index = node_id;
+    if(LAYOUT == SlotLayout::Striped) {
+      size_t offset = node_id % GROUP_SIZE;
+      index = node_id - offset + (offset % LINE_SLOT_NUM) * LINE_SLOT_NUM + offset / LINE_SLOT_NUM;
+    }
+    return index * SLOT_STRIDE;
+  }
+
+  /*
+   * Reset() - Clear the content as well as the index. Not thread-safe
+   * 
+   * Pages are given back to the kernel, and are zero filled on the next touch
+   */
+  void Reset() {
+    madvise(table_p, table_bytes, MADV_DONTNEED);
+    for(size_t i = 0;i < THREAD_STATE_NUM;i++) {
+      thread_state_list[i].next_id = thread_state_list[i].end_id = INVALID_NODE_ID;
+      thread_state_list[i].free_list.clear();
+    }
+    next_block = NodeIDType{0};
+    return;
+  }
+
+ private:
+  // * GetThreadState() - Returns the state of the calling thread
+  inline ThreadStateType *GetThreadState() { return &thread_state_list[ThreadContext::GetThreadID() % THREAD_STATE_NUM]; }
+
+  // * GetSlot() - Returns the slot of a node ID
+  inline SlotType *GetSlot(NodeIDType node_id) { 
+    assert(node_id < id_num);
+    return reinterpret_cast<SlotType *>(table_p + GetSlotOffset(node_id)); 
+  }
+
+  // * Interleave() - Asks the kernel to interleave the table across all NUMA nodes. Errors are ignored
+  void Interleave() {
+#if defined(__linux__) && defined(SYS_mbind)
+    // MPOL_INTERLEAVE in <numaif.h>. Nodes without memory are ignored by the kernel.
+    // The kernel reads one bit less than the number of bits passed
+    constexpr int MPOL_INTERLEAVE_MODE = 3;
+    unsigned long node_mask = ~0UL;
+    syscall(SYS_mbind, table_p, table_bytes, MPOL_INTERLEAVE_MODE, &node_mask, sizeof(node_mask) * 8 + 1, 0);
+#endif
+    return;
+  }
+
+  // Number of IDs and bytes reserved, which are rounded up to whole blocks
+  size_t id_num;
+  size_t table_bytes;
+  unsigned char *table_p;
+  std::atomic<NodeIDType> next_block;
+  ThreadStateType thread_state_list[THREAD_STATE_NUM];
 };
 
+// Mapping tables with per-thread ID blocks. See class BlockMappingTable
+template <typename BaseNodeType, size_t TABLE_SIZE>
+using DefaultStripedMappingTable = BlockMappingTable<BaseNodeType, TABLE_SIZE, SlotLayout::Striped, TableMemory::FirstTouch>;
+template <typename BaseNodeType, size_t TABLE_SIZE>
+using DefaultPaddedMappingTable = BlockMappingTable<BaseNodeType, TABLE_SIZE, SlotLayout::Padded, TableMemory::FirstTouch>;
+template <typename BaseNodeType, size_t TABLE_SIZE>
+using DefaultInterleavedMappingTable = BlockMappingTable<BaseNodeType, TABLE_SIZE, SlotLayout::Striped, TableMemory::Interleaved>;
+
 /*
  * class DefaultDeltaChainType - This class defines the storage of the delta chain
  * 
@@ -232,636 +1002,4687 @@ class DefaultDeltaChainType {
   IF_DEBUG(std::atomic<size_t> mem_usage);
 };
 
-template <typename, typename> class ExtendedNodeBase;
-
 /*
- * class NodeBase - Base class of base node and delta node types
+ * class DefaultSlabDeltaChainType - Allocates deltas from a slab inside the base node
  * 
- * Virtual node abstraction is defined in this class
+ * 1. The slab is a member of the base node, so deltas are stored next to the base node
+ *    in the same memory block. Allocation is a single atomic fetch-and-add on the 
+ *    bump offset, since multiple threads may append to the same node concurrently
+ * 2. Destroying a delta only calls the destructor. The memory is released as a 
+ *    whole together with the base node, which happens when the chain is freed 
+ *    after consolidation. Space of deltas whose CAS failed is therefore wasted
+ * 3. If the slab is exhausted, deltas are allocated from the heap as a fallback.
+ *    The address of the delta tells whether it should be deleted
+ * 4. SLAB_SIZE should cover the deltas appended before the height threshold is 
+ *    reached, plus a few failed CASes. It is added to the size of every base node
  */
-template <typename KeyType>
-class NodeBase {
+class DefaultSlabDeltaChainType {
  public:
-  using BoundKeyType = BoundKey<KeyType>;
-  using NodeSizeType = uint32_t;
-  using NodeHeightType = uint16_t;
+  static constexpr size_t SLAB_SIZE = 2048;
+  // Every delta starts at an address like malloc() does
+  static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
 
- protected:
   /*
-   * NodeBase() - Constructor
+   * DefaultSlabDeltaChainType() - Constructor
    */
-  NodeBase(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
-           BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p) :
-    type{ptype}, height{pheight}, size{psize},
-    low_key_p{plow_key_p}, high_key_p{phigh_key_p} {}
+  DefaultSlabDeltaChainType() : offset{0UL} {
+    IF_DEBUG(mem_usage.store(0UL));
+    return;
+  }
 
- public:
-  // * GetSize() - Returns the size
-  inline NodeSizeType GetSize() const { return size; }
-  // * GetDepth() - Returns the depth
-  inline NodeHeightType GetHeight() const { return height; }
-  // * GetType() - Returns the type enum
-  inline NodeType GetType() const { return type; }
-  // * GetHighKey() - Returns high key
-  inline BoundKeyType *GetHighKey() const { return high_key_p; }
-  // * SetHighKey() - Updates the high key of the node
-  inline void SetHighKey(BoundKeyType *phigh_key_p) { high_key_p = phigh_key_p; }
-  // * GetLowKey() - Returns low key
-  inline BoundKeyType *GetLowKey() const { return low_key_p; }
+  // * AllocateDelta() - Allocate a delta record of a given type
+  template <typename AllocDeltaNodeType, typename ...Args>
+  inline AllocDeltaNodeType *AllocateDelta(Args &&...args) {
+    constexpr size_t alloc_size = (sizeof(AllocDeltaNodeType) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    IF_DEBUG(mem_usage.fetch_add(alloc_size));
+    // Avoid the fetch-and-add if the slab is known to be full
+    if(offset.load(std::memory_order_relaxed) + alloc_size <= SLAB_SIZE) {
+      size_t alloc_offset = offset.fetch_add(alloc_size);
+      if(alloc_offset + alloc_size <= SLAB_SIZE) { return new (slab + alloc_offset) AllocDeltaNodeType{args...}; }
+    }
 
-  // * GetBase() - Returns the address of the base node
-  template <typename DeltaChainType>
-  inline ExtendedNodeBase<KeyType, DeltaChainType> *GetBase() {
-    return reinterpret_cast<ExtendedNodeBase<KeyType, DeltaChainType> *>(
-      reinterpret_cast<char *>(GetLowKey()) - ExtendedNodeBase<KeyType, DeltaChainType>::LOW_KEY_OFFSET); 
+    return new AllocDeltaNodeType{args...};
   }
 
-  // * KeyLargerThanNode() - Return whether a given key is larger than
-  //                         all keys in the node
-  inline bool KeyLargerThanNode(const KeyType &key) {
-    return high_key_p->IsInf() == false && *high_key_p <= key;
+  // * DestroyDelta() - Destroy a delta record; Only memory allocated from the heap is freed
+  template <typename DeltaNodeType>
+  inline void DestroyDelta(DeltaNodeType *delta_p) { 
+    if(IsInSlab(delta_p)) {
+      delta_p->~DeltaNodeType();
+    } else {
+      delete delta_p;
+    }
   }
 
-  // * KeySmallerThanNode() - Returns whether the given key is smaller than
-  //                          all keys in the node
-  inline bool KeySmallerThanNode(const KeyType &key) {
-    return low_key_p->IsInf() == false && *low_key_p > key;
+  // * IsInSlab() - Whether the given address is allocated from the slab
+  inline bool IsInSlab(const void *p) const {
+    return static_cast<const unsigned char *>(p) >= slab && static_cast<const unsigned char *>(p) < slab + SLAB_SIZE;
   }
 
-  // * KeyInNode() - Return whether a given key is within the node's range
-  inline bool KeyInNode(const KeyType &key) { 
-    return KeyLargerThanNode(key) == false && KeySmallerThanNode(key) == false;
+ private:
+  std::atomic<size_t> offset;
+  IF_DEBUG(std::atomic<size_t> mem_usage);
+  alignas(ALIGNMENT) unsigned char slab[SLAB_SIZE];
+};
+
+/*
+ * class SnapshotMappingType - Private file mapping of a snapshot
+ * 
+ * 1. The file is mapped with MAP_PRIVATE, such that writes are never written back. 
+ *    Pages are read from the file on the first access, and copied by the kernel on 
+ *    the first write
+ * 2. Base nodes in the mapping are not freed individually. The whole mapping is
+ *    unmapped on destruction
+ */
+class SnapshotMappingType {
+ public:
+  SnapshotMappingType() : base_p{nullptr}, size{0} {}
+  SnapshotMappingType(SnapshotMappingType &&other) : base_p{other.base_p}, size{other.size} { 
+    other.base_p = nullptr; 
+    other.size = 0;
+  }
+  SnapshotMappingType(const SnapshotMappingType &) = delete;
+  SnapshotMappingType &operator=(const SnapshotMappingType &) = delete;
+  ~SnapshotMappingType() { if(base_p != nullptr) { munmap(base_p, size); } }
+
+  // * Map() - Maps the file. Returns false if the file could not be opened or is empty
+  bool Map(const char *path) {
+    assert(base_p == nullptr);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) { return false; }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0) { close(fd); return false; }
+    void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // The mapping holds a reference to the file
+    close(fd);
+    if(p == MAP_FAILED) { return false; }
+    base_p = static_cast<unsigned char *>(p);
+    size = static_cast<size_t>(st.st_size);
+    return true;
+  }
+
+  // * GetBase() * GetSize() - Returns the address and the size of the mapping
+  inline unsigned char *GetBase() const { return base_p; }
+  inline size_t GetSize() const { return size; }
+  // * Contains() - Whether the address is in the mapping
+  inline bool Contains(const void *p) const {
+    return static_cast<const unsigned char *>(p) >= base_p && static_cast<const unsigned char *>(p) < base_p + size;
   }
 
  private:
-  // The following three are packed into a 64 bit integer
-  NodeType type;
-  // Height in the delta chain (0 means base node)
-  NodeHeightType height;
-  // Number of elements
-  NodeSizeType size;
-  BoundKeyType *low_key_p;
-  BoundKeyType *high_key_p;
+  unsigned char *base_p;
+  size_t size;
 };
 
-#define LEAF_INSERT_TYPE(KeyType, ValueType) \
-  DeltaNode<KeyType, KeyType, ValueType, char[0], char[0], char[0], char[0]>
-#define LEAF_DELETE_TYPE(KeyType, ValueType) \
-  DeltaNode<KeyType, KeyType, ValueType, char[0], char[0], char[0], char[0]>
-#define LEAF_SPLIT_TYPE(KeyType, NodeIDType) \
-  DeltaNode<KeyType, BoundKey<KeyType>, NodeIDType, char[0], char[0], char[0], char[0]>
-#define INNER_SPLIT_TYPE(KeyType, NodeIDType) \
-  DeltaNode<KeyType, BoundKey<KeyType>, NodeIDType, char[0], char[0], char[0], char[0]>
-#define LEAF_MERGE_TYPE(KeyType, NodeIDType) \
-  DeltaNode<KeyType, KeyType, NodeIDType, NodeBase<KeyType> *, char[0], char[0], char[0]>
-#define INNER_MERGE_TYPE(KeyType, NodeIDType) \
-  DeltaNode<KeyType, KeyType, NodeIDType, NodeBase<KeyType> *, char[0], char[0], char[0]>
-#define LEAF_REMOVE_TYPE(KeyType, NodeIDType) \
-  DeltaNode<KeyType, NodeIDType, char[0], char[0], char[0], char[0], char[0]>
-#define INNER_REMOVE_TYPE(KeyType, NodeIDType) \
-  DeltaNode<KeyType, NodeIDType, char[0], char[0], char[0], char[0], char[0]>
-#define INNER_INSERT_TYPE(KeyType, NodeIDType) \
-  DeltaNode<KeyType, KeyType, NodeIDType, BoundKey<KeyType>, char[0], char[0], char[0]>
-#define INNER_DELETE_TYPE(KeyType, NodeIDType) \
-  DeltaNode<KeyType, KeyType, NodeIDType, BoundKey<KeyType>, BoundKey<KeyType>, NodeIDType, char[0]>
-                                     //   ^ next key         ^ prev key         ^ prev ID
-
 /*
- * class DeltaNode - Stores the next node pointer
- * 
- * This class is heavily templatized. Different combinations of types
- * yield different delta types:
- * 
- * LeafInsertType/LeafDeleteType = 
- *   DeltaNode<KeyType, KeyType, ValueType, char[0], char[0], char[0], char[0]>
- * LeafSplitType/InnerSplitType = 
- *   DeltaNode<KeyType, BoundKey<KeyType>, NodeIDType, char[0], char[0], char[0], char[0]>
- * LeafMergeType/InnerMergeType = 
- *   DeltaNode<KeyType, KeyType, NodeIDType, NodeBase<KeyType> *, char[0], char[0], char[0]>
- * LeafRemoveType/InnerRemoveType = 
- *   DeltaNode<KeyType, NodeIDType, char[0], char[0], char[0], char[0], char[0]>
- * InnerInsertType = 
- *   DeltaNode<KeyType, KeyType, NodeIDType, BoundKey<KeyType>, char[0], char[0], char[0]>
- * InnerDeleteType = 
- *   DeltaNode<KeyType, KeyType, NodeIDType, BoundKey<KeyType>, BoundKey<KeyType>, NodeIDType, char[0]>
+ * class DefaultEpochManagerType - Epoch based memory reclamation
+ *
+ * 1. Threads announce the global epoch they observe on entering, and clear the
+ *    announcement on exit. Enter and exit can be nested, in which case only the
+ *    outermost pair changes the announcement
+ * 2. Retired objects are put into the garbage list of the calling thread, tagged
+ *    with the global epoch at the time of retirement. Since objects must have been
+ *    unlinked before they are retired, threads that announce a larger epoch can
+ *    never see them. An object is hence freed once all active threads have
+ *    announced epochs larger than its tag
+ * 3. Every RECLAIM_THRESHOLD retirements the calling thread advances the global
+ *    epoch and scans its own garbage list. Garbage lists are only accessed by the
+ *    owning thread, so no synchronization is needed except on the epochs
+ * 4. The number of threads is fixed at construction time. Threads must call
+ *    RegisterThread() with an ID smaller than that number before any other call
+ * 5. If offloading is enabled by SetOffload(), the calling thread hands its garbage
+ *    list over to a shared list instead of scanning it. The shared list is protected
+ *    by a latch, and is moved into the garbage list of the next thread calling Reclaim()
  */
-template <typename KeyType, 
-          typename T1, typename T2, typename T3, 
-          typename T4, typename T5, typename T6>
-class DeltaNode : public NodeBase<KeyType> {
+class DefaultEpochManagerType {
  public:
-  using BaseClassType = NodeBase<KeyType>;
-  using NodeSizeType = typename BaseClassType::NodeSizeType;
-  using NodeHeightType = typename BaseClassType::NodeHeightType;
-  using BoundKeyType = typename BaseClassType::BoundKeyType;
+  using EpochType = uint64_t;
+  // The first argument is the customized argument, and the second is the object
+  using FreeFuncType = void (*)(void *, void *);
+  // Threads not in any epoch announce this value, which is larger than all epochs
+  static constexpr EpochType INACTIVE_EPOCH = static_cast<EpochType>(-1);
+  static constexpr EpochType FIRST_EPOCH = 0;
+  static constexpr size_t RECLAIM_THRESHOLD = 128;
+  static constexpr size_t CACHE_LINE_SIZE = 64;
 
-  inline BaseClassType *GetNext() const { return next_node_p; }
+ private:
+  // * class GarbageNodeType - Retired object and the way it should be freed
+  class GarbageNodeType {
+   public:
+    void *node_p;
+    FreeFuncType free_func;
+    void *free_arg;
+    EpochType epoch;
+  };
 
-  //* DeltaNode() - Constructors
-  DeltaNode(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
-            BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
-            BaseClassType *pnext_node_p, 
-            const T1 &pt1) :
-    BaseClassType{ptype, pheight, psize, plow_key_p, phigh_key_p},
-    next_node_p{pnext_node_p}, 
-    t1{pt1} {}
-  
-  DeltaNode(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
-            BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
-            BaseClassType *pnext_node_p, 
-            const T1 &pt1, const T2 &pt2) :
-    BaseClassType{ptype, pheight, psize, plow_key_p, phigh_key_p},
-    next_node_p{pnext_node_p}, 
-    t1{pt1}, t2{pt2} {}
+  // * class ThreadStateType - Per-thread epoch and garbage list
+  class ThreadStateType {
+   public:
+    ThreadStateType() :
+      local_epoch{INACTIVE_EPOCH}, nest_level{0}, retire_count{0}, garbage_list{} {}
+    // Avoid false sharing between the epochs of adjacent threads
+    char padding[CACHE_LINE_SIZE];
+    std::atomic<EpochType> local_epoch;
+    // The following are only accessed by the owning thread
+    size_t nest_level;
+    size_t retire_count;
+    std::vector<GarbageNodeType> garbage_list;
+  };
 
-  DeltaNode(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
-            BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
-            BaseClassType *pnext_node_p, 
-            const T1 &pt1, const T2 &pt2, const T3 &pt3) :
-    BaseClassType{ptype, pheight, psize, plow_key_p, phigh_key_p},
-    next_node_p{pnext_node_p}, 
-    t1{pt1}, t2{pt2}, t3{pt3} {}
+ public:
+  /*
+   * class GuardType - Enters the epoch on construction and exits on destruction
+   */
+  class GuardType {
+   public:
+    GuardType(DefaultEpochManagerType *pmanager_p) : manager_p{pmanager_p} { manager_p->EnterEpoch(); }
+    ~GuardType() { manager_p->ExitEpoch(); }
+   private:
+    DefaultEpochManagerType *manager_p;
+  };
 
-  DeltaNode(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
-            BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
-            BaseClassType *pnext_node_p, 
-            const T1 &pt1, const T2 &pt2, const T3 &pt3,
-            const T4 &pt4, const T5 &pt5) :
-    BaseClassType{ptype, pheight, psize, plow_key_p, phigh_key_p},
-    next_node_p{pnext_node_p}, 
-    t1{pt1}, t2{pt2}, t3{pt3}, t4{pt4}, t5{pt5} {}
-  
-  // The following series of functions defines methods for retriving
-  // delta attributes according to delta type
-  inline T1 &GetInsertKey() { return t1; }
-  inline T1 &GetDeleteKey() { return t1; }
-  inline KeyType &GetSplitKey() { return t1.key; }
-  inline T1 &GetMergeKey() { return t1; }
-  inline T1 &GetRemoveNodeID() { return t1; }
-  // For split deltas, the high key points to a field inside the split delta
-  // So we must set the high key after the delta has been constructed
-  inline void SetSplitHighKey() { BaseClassType::SetHighKey(&t1); }
-  
-  inline T2 &GetInsertValue() { return t2; }
-  inline T2 &GetDeleteValue() { return t2; }
-  inline T2 &GetInsertNodeID() { return t2; }
-  inline T2 &GetDeleteNodeID() { return t2; }
-  inline T2 &GetSplitNodeID() { return t2; }
-  inline T2 &GetMergeNodeID() { return t2; }
+  /*
+   * DefaultEpochManagerType() - Constructor
+   */
+  DefaultEpochManagerType(size_t pthread_num) :
+    thread_num{pthread_num},
+    global_epoch{FIRST_EPOCH},
+    thread_state_list{new ThreadStateType[pthread_num]},
+    is_offloaded{false},
+    offload_latch{},
+    offload_list{},
+    offload_num{0} {
+    assert(thread_num > 0);
+    return;
+  }
 
-  inline T3 &GetMergeSibling() { return t3; }
-  inline T3 &GetNextKey() { return t3; }
+  /*
+   * ~DefaultEpochManagerType() - Destructor
+   *
+   * All garbage nodes are freed regardless of the epoch. This function must not
+   * be called concurrently with any other function
+   */
+  ~DefaultEpochManagerType() {
+    FreeAllGarbage();
+    delete[] thread_state_list;
+    return;
+  }
 
-  inline T4 &GetPrevKey() { return t4; }
-  inline T5 &GetPrevNodeID() { return t5; }
-  
-  static constexpr size_t T1_OFFSET = offsetof(DeltaNode, t1);
-  static constexpr size_t T2_OFFSET = offsetof(DeltaNode, t2);
-  static constexpr size_t T1_T2_OFFSET = T2_OFFSET - T1_OFFSET;
+  // * RegisterThread() - Sets the logical ID of the calling thread
+  inline void RegisterThread(size_t thread_id) {
+    always_assert(thread_id < thread_num);
+    ThreadContext::SetThreadID(thread_id);
+  }
 
-  // * GetT2FromT1() - Returns the T2 address given T1's address
-  static T2 *GetT2FromT1(T1 *p) { 
-    return reinterpret_cast<T2 *>(reinterpret_cast<char *>(p) + T1_T2_OFFSET);
+  // * GetThreadNum() - Returns the number of threads
+  inline size_t GetThreadNum() const { return thread_num; }
+  // * GetGlobalEpoch() - Returns the current global epoch
+  inline EpochType GetGlobalEpoch() const { return global_epoch.load(); }
+  // * SetOffload() - Whether retiring threads hand their garbage over to Reclaim() callers
+  inline void SetOffload(bool value) { is_offloaded.store(value); }
+  // * GetOffloadCount() - Returns the number of garbage nodes handed over but not yet taken
+  inline size_t GetOffloadCount() const { return offload_num.load(std::memory_order_relaxed); }
+
+  /*
+   * EnterEpoch() - Announces the global epoch
+   *
+   * The announcement is a seq_cst store, such that all later loads of shared
+   * pointers are ordered after it
+   */
+  inline void EnterEpoch() {
+    ThreadStateType *state_p = GetThreadState();
+    if(state_p->nest_level++ == 0) {
+      state_p->local_epoch.store(global_epoch.load());
+    }
   }
- private:
-  BaseClassType *next_node_p;
-  // Delta node elements
-  T1 t1; T2 t2; T3 t3; T4 t4; T5 t5; T6 t6;
-};
 
-// * class DeltaType - Declares the full type of deltas
-template <typename KeyType, typename ValueType, typename NodeIDType>
-class Delta {
- public:
-  using LeafInsertType = LEAF_INSERT_TYPE(KeyType, ValueType);
-  using LeafDeleteType = LEAF_DELETE_TYPE(KeyType, ValueType);
-  using LeafSplitType = LEAF_SPLIT_TYPE(KeyType, NodeIDType);
-  using LeafMergeType = LEAF_MERGE_TYPE(KeyType, NodeIDType);
-  using LeafRemoveType = LEAF_REMOVE_TYPE(KeyType, NodeIDType);
+  // * ExitEpoch() - Clears the announcement of the outermost enter
+  inline void ExitEpoch() {
+    ThreadStateType *state_p = GetThreadState();
+    assert(state_p->nest_level > 0);
+    if(--state_p->nest_level == 0) {
+      state_p->local_epoch.store(INACTIVE_EPOCH);
+    }
+  }
 
-  using InnerInsertType = INNER_INSERT_TYPE(KeyType, NodeIDType);
-  using InnerDeleteType = INNER_DELETE_TYPE(KeyType, NodeIDType);
-  using InnerSplitType = INNER_SPLIT_TYPE(KeyType, NodeIDType);
-  using InnerMergeType = INNER_MERGE_TYPE(KeyType, NodeIDType);
-  using InnerRemoveType = INNER_REMOVE_TYPE(KeyType, NodeIDType);
+  /*
+   * Retire() - Adds an object into the garbage list of the calling thread
+   *
+   * The object must already be unreachable from shared states. free_func will
+   * be called with free_arg and node_p after all readers have exited
+   */
+  void Retire(void *node_p, FreeFuncType free_func, void *free_arg) {
+    ThreadStateType *state_p = GetThreadState();
+    state_p->garbage_list.push_back(GarbageNodeType{node_p, free_func, free_arg, global_epoch.load()});
+    if(++state_p->retire_count >= RECLAIM_THRESHOLD) {
+      state_p->retire_count = 0;
+      global_epoch.fetch_add(1);
+      if(is_offloaded.load(std::memory_order_relaxed) == true) { HandOff(); }
+      else { Reclaim(); }
+    }
 
-  // Make sure we can always obtain T2 from T1's address
-  static_assert(LeafInsertType::T1_T2_OFFSET == LeafDeleteType::T1_T2_OFFSET, 
-                "Inconsistent layout of KeyType and ValueType between leaf insert and delete");
-  static_assert(InnerInsertType::T1_T2_OFFSET == InnerDeleteType::T1_T2_OFFSET, 
-                "Inconsistent layout of KeyType and NodeIDType between inner insert and delete");
-};
+    return;
+  }
 
-// * class ExtendedNodeBase - Type irrelevant part of the base node
-template <typename KeyType, typename DeltaChainType>
-class ExtendedNodeBase : public NodeBase<KeyType> {
- public:
-  using BaseClassType = NodeBase<KeyType>;
-  using NodeSizeType = typename BaseClassType::NodeSizeType;
-  using NodeHeightType = typename BaseClassType::NodeHeightType;
-  using BoundKeyType = typename BaseClassType::BoundKeyType;
+  /*
+   * HandOff() - Moves the garbage list of the calling thread to the shared list
+   *
+   * The capacity of the per-thread list is kept, such that later retirements
+   * do not allocate
+   */
+  void HandOff() {
+    std::vector<GarbageNodeType> &garbage_list = GetThreadState()->garbage_list;
+    if(garbage_list.empty() == true) { return; }
+    std::lock_guard<std::mutex> guard{offload_latch};
+    offload_list.insert(offload_list.end(), garbage_list.begin(), garbage_list.end());
+    offload_num.store(offload_list.size(), std::memory_order_relaxed);
+    garbage_list.clear();
+    return;
+  }
 
-  // This is the offset of the low key from the beginning of the object
-  static constexpr size_t LOW_KEY_OFFSET = offsetof(ExtendedNodeBase, low_key_addr);
+  /*
+   * Reclaim() - Frees garbage nodes of the calling thread that are no longer visible
+   *
+   * Garbage handed over by other threads is first moved into the list of the calling
+   * thread. Tags are hence not sorted, and all nodes whose tags are smaller than the
+   * minimum active epoch are freed. The remaining nodes are compacted in place
+   */
+  void Reclaim() {
+    ThreadStateType *state_p = GetThreadState();
+    std::vector<GarbageNodeType> &garbage_list = state_p->garbage_list;
+    if(offload_num.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> guard{offload_latch};
+      garbage_list.insert(garbage_list.end(), offload_list.begin(), offload_list.end());
+      offload_list.clear();
+      offload_num.store(0, std::memory_order_relaxed);
+    }
 
-  // * ExtendedNodeBase() - Constructor
-  ExtendedNodeBase(NodeType ptype, 
-                   NodeHeightType pheight,
-                   NodeSizeType psize,
-                   const BoundKeyType &plow_key,
-                   const BoundKeyType &phigh_key) : 
-    BaseClassType{ptype, pheight, psize, &low_key, &high_key},
-    low_key{plow_key},
-    high_key{phigh_key},
-    delta_chain{} {}
+    EpochType min_epoch = GetMinActiveEpoch();
+    size_t kept_num = 0;
+    for(size_t i = 0;i < garbage_list.size();i++) {
+      GarbageNodeType &garbage_node = garbage_list[i];
+      if(garbage_node.epoch < min_epoch) { 
+        garbage_node.free_func(garbage_node.free_arg, garbage_node.node_p); 
+      } else { 
+        garbage_list[kept_num++] = garbage_node; 
+      }
+    }
 
-  // * AllocateDelta() - Wrapping around the delta chain
-  template <typename AllocDeltaNodeType, typename ...Args>
-  inline AllocDeltaNodeType *AllocateDelta(Args &&...args) {
-    return delta_chain.AllocateDelta<AllocDeltaNodeType>(args...);
+    garbage_list.resize(kept_num);
+    return;
   }
 
-  // * DestroyDelta() - Wrapping around the delta chain
-  template <typename AllocDeltaNodeType>
-  inline void DestroyDelta(AllocDeltaNodeType *node_p) {
-    return delta_chain.DestroyDelta<AllocDeltaNodeType>(node_p);
+  /*
+   * FreeAllGarbage() - Frees all garbage nodes of all threads regardless of the epoch
+   *
+   * This function is not thread-safe, and should only be called when the
+   * owner of the epoch manager is being destroyed
+   */
+  void FreeAllGarbage() {
+    for(size_t i = 0;i < thread_num;i++) {
+      for(GarbageNodeType &garbage_node : thread_state_list[i].garbage_list) {
+        garbage_node.free_func(garbage_node.free_arg, garbage_node.node_p);
+      }
+      thread_state_list[i].garbage_list.clear();
+    }
+
+    for(GarbageNodeType &garbage_node : offload_list) {
+      garbage_node.free_func(garbage_node.free_arg, garbage_node.node_p);
+    }
+    offload_list.clear();
+    offload_num.store(0);
+    return;
+  }
+
+  // * GetGarbageCount() - Returns the number of unfreed garbage nodes. Not thread-safe
+  size_t GetGarbageCount() const {
+    size_t count = 0;
+    for(size_t i = 0;i < thread_num;i++) { count += thread_state_list[i].garbage_list.size(); }
+    return count + offload_list.size();
   }
 
-  // This data member does not space but it has the same address as the low key
-  char low_key_addr[0];
  private:
-  // Instances of low and high keys
-  BoundKeyType low_key;
-  BoundKeyType high_key;
-  DeltaChainType delta_chain;
+  // * GetThreadState() - Returns the state object of the calling thread
+  inline ThreadStateType *GetThreadState() {
+    assert(ThreadContext::GetThreadID() < thread_num);
+    return thread_state_list + ThreadContext::GetThreadID();
+  }
+
+  // * GetMinActiveEpoch() - Returns the minimum announced epoch (INACTIVE_EPOCH if none)
+  EpochType GetMinActiveEpoch() const {
+    EpochType min_epoch = INACTIVE_EPOCH;
+    for(size_t i = 0;i < thread_num;i++) {
+      EpochType epoch = thread_state_list[i].local_epoch.load();
+      if(epoch < min_epoch) { min_epoch = epoch; }
+    }
+
+    return min_epoch;
+  }
+
+  size_t thread_num;
+  std::atomic<EpochType> global_epoch;
+  ThreadStateType *thread_state_list;
+  // Garbage handed over by HandOff(). offload_num mirrors its size for unlatched checks
+  std::atomic<bool> is_offloaded;
+  std::mutex offload_latch;
+  std::vector<GarbageNodeType> offload_list;
+  std::atomic<size_t> offload_num;
+};
+
+// * enum class StatsCounter - Events counted by the stats policy of BwTree
+enum class StatsCounter {
+  // Append*() calls on the mapping table, and those whose CAS failed
+  Append = 0,
+  AppendFailure,
+  // Consolidations installed on each level, and those whose CAS failed
+  LeafConsolidation,
+  InnerConsolidation,
+  ConsolidationFailure,
+  // SMOs started, and unfinished SMOs finished by traversals (help-along)
+  SplitStart,
+  RemoveStart,
+  HelpSplit,
+  HelpInnerDelete,
+  // Consolidations pushed to background workers (BwTree::StartMaintenance())
+  DeferredConsolidation,
+  // Chains given to and freed by the epoch manager
+  Retire,
+  Free,
+  CounterNum,
 };
 
 /*
- * class DefaultBaseNode - This class defines the way key and values are stored
- *                         in the base node
+ * class DefaultNullStatsType - Stats policy that records nothing
  * 
- * 1. Delta allocation is defined in delta chain class
- * 2. Node consolidation is defined in node consolidator class
- * 3. Only unique key is supported; Non-unique key must be implemented
- *    outside the index
- * 4. The node should not expose its storage of keys and values to the external
- *    That requires that no method for accessing internal storage other than
- *    individual keys and values are provided. Iterators are not available.
- *    Search routine should only return an index rather than raw pointer
- * 5. Non-unique key support should be expposed by a constexpr var
- *    and the caller is responsible for checking consistency between 
- *    feature supports
+ * All functions are empty, and are optimized away. This is the default of BwTree
  */
-template <typename _KeyType, 
-          typename _ValueType, 
-          typename _DeltaChainType>
-class DefaultBaseNode : public ExtendedNodeBase<_KeyType, _DeltaChainType>, public UniqueKeyBase {
+class DefaultNullStatsType {
  public:
-  using KeyType = _KeyType;
-  using ValueType = _ValueType;
-  using DeltaChainType = _DeltaChainType;
-  using BaseClassType = ExtendedNodeBase<KeyType, DeltaChainType>;
-  using BaseBaseClassType = typename BaseClassType::BaseClassType;
-  using NodeSizeType = typename BaseBaseClassType::NodeSizeType;
-  using NodeHeightType = typename BaseBaseClassType::NodeHeightType;
-  using BoundKeyType = typename BaseBaseClassType::BoundKeyType;
+  static constexpr bool ENABLED = false;
+  DefaultNullStatsType(size_t) {}
+  inline void Count(StatsCounter, uint64_t = 1) {}
+  inline void CountAlloc(NodeType, size_t) {}
+  inline void CountHeight(size_t) {}
+};
+
+/*
+ * class DefaultTreeStatsType - Stats policy with per-thread counters
+ * 
+ * 1. Each thread writes its own counters, which are padded to avoid false sharing.
+ *    Counters are updated with relaxed loads and stores rather than atomic increments,
+ *    since there is only one writer
+ * 2. Counters are aggregated on demand. Results are approximate while the tree is
+ *    being modified
+ * 3. In addition to StatsCounter, the height of leaf chains returned by traversals is
+ *    recorded as a histogram, and bytes allocated are recorded for each node type.
+ *    The size of base nodes is returned by their GetAllocatedSize()
+ */
+class DefaultTreeStatsType {
+ public:
+  static constexpr bool ENABLED = true;
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  // Heights larger than the last bucket are counted in the last bucket
+  static constexpr size_t HEIGHT_BUCKET_NUM = 33;
+  static constexpr size_t NODE_TYPE_NUM = static_cast<size_t>(NodeType::LeafMerge) + 1;
+  static constexpr size_t COUNTER_NUM = static_cast<size_t>(StatsCounter::CounterNum);
+
  private:
-  // * DefaultBaseNode() - Private Constructor
-  DefaultBaseNode(NodeType ptype, 
-                  NodeHeightType pheight,
-                  NodeSizeType psize,
-                  const BoundKeyType &plow_key,
-                  const BoundKeyType &phigh_key) :
-    BaseClassType{ptype, pheight, psize, plow_key, phigh_key} {
-    return;
-  } 
-  
-  // * ~DefaultBaseNode() - Private Destructor
-  ~DefaultBaseNode() {}
+  // * class ThreadStatsType - Counters of a thread
+  class ThreadStatsType {
+   public:
+    ThreadStatsType() { Reset(); }
+    // Avoid false sharing between the counters of adjacent threads
+    char padding[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> counter_list[COUNTER_NUM];
+    std::atomic<uint64_t> height_list[HEIGHT_BUCKET_NUM];
+    std::atomic<uint64_t> alloc_list[NODE_TYPE_NUM];
+    void Reset() {
+      for(auto &counter : counter_list) { counter.store(0); }
+      for(auto &counter : height_list) { counter.store(0); }
+      for(auto &counter : alloc_list) { counter.store(0); }
+    }
+  };
+
+  // * Add() - Updates a counter owned by the calling thread
+  inline static void Add(std::atomic<uint64_t> *counter_p, uint64_t delta) { 
+    counter_p->store(counter_p->load(std::memory_order_relaxed) + delta, std::memory_order_relaxed); 
+  }
+
+  // * Sum() - Adds up a counter of all threads
+  template <size_t N>
+  inline uint64_t Sum(std::atomic<uint64_t> (ThreadStatsType::*list)[N], size_t index) const {
+    uint64_t sum = 0;
+    for(size_t i = 0;i < thread_num;i++) { sum += (thread_stats_list[i].*list)[index].load(std::memory_order_relaxed); }
+    return sum;
+  }
+
+ public:
+  // * DefaultTreeStatsType() - Constructor. The number of threads is the same as the epoch manager
+  DefaultTreeStatsType(size_t pthread_num) : 
+    thread_num{pthread_num}, thread_stats_list{new ThreadStatsType[pthread_num]} {}
+  ~DefaultTreeStatsType() { delete[] thread_stats_list; }
+  DefaultTreeStatsType(const DefaultTreeStatsType &) = delete;
+  DefaultTreeStatsType &operator=(const DefaultTreeStatsType &) = delete;
+
+  // * Count() - Adds to an event counter
+  inline void Count(StatsCounter counter, uint64_t delta = 1) { 
+    Add(&GetThreadStats()->counter_list[static_cast<size_t>(counter)], delta); 
+  }
+  // * CountAlloc() - Adds the number of bytes allocated for a node type
+  inline void CountAlloc(NodeType type, size_t size) { Add(&GetThreadStats()->alloc_list[static_cast<size_t>(type)], size); }
+  // * CountHeight() - Records the height of a leaf chain
+  inline void CountHeight(size_t height) { 
+    Add(&GetThreadStats()->height_list[std::min(height, HEIGHT_BUCKET_NUM - 1)], 1); 
+  }
+
+  // * GetCount() - Returns the total of an event counter
+  inline uint64_t GetCount(StatsCounter counter) const { 
+    return Sum(&ThreadStatsType::counter_list, static_cast<size_t>(counter)); 
+  }
+  // * GetAllocBytes() - Returns the total bytes allocated for a node type
+  inline uint64_t GetAllocBytes(NodeType type) const { return Sum(&ThreadStatsType::alloc_list, static_cast<size_t>(type)); }
+  // * GetHeightCount() - Returns the number of traversals that found a leaf chain of the height
+  inline uint64_t GetHeightCount(size_t height) const { 
+    return Sum(&ThreadStatsType::height_list, std::min(height, HEIGHT_BUCKET_NUM - 1)); 
+  }
+  // * GetGarbageBacklog() - Returns the number of retired chains not yet freed
+  inline uint64_t GetGarbageBacklog() const { 
+    uint64_t retired = GetCount(StatsCounter::Retire), freed = GetCount(StatsCounter::Free);
+    return retired > freed ? retired - freed : 0;
+  }
+
+  // * Reset() - Clears all counters. Not thread-safe
+  void Reset() { for(size_t i = 0;i < thread_num;i++) { thread_stats_list[i].Reset(); } }
+
+  // * ToString() - Returns all non-zero counters as a JSON object
+  std::string ToString() const {
+    static const char *counter_name_list[] = {
+      "append", "append_failure", "leaf_consolidation", "inner_consolidation", "consolidation_failure",
+      "split_start", "remove_start", "help_split", "help_inner_delete", "deferred_consolidation", "retire", "free",
+    };
+    static_assert(sizeof(counter_name_list) / sizeof(counter_name_list[0]) == COUNTER_NUM, "Missing counter names");
+    std::string ret = "{";
+    for(size_t i = 0;i < COUNTER_NUM;i++) {
+      ret += std::string{i == 0 ? "" : ", "} + "\"" + counter_name_list[i] + "\": " + 
+             std::to_string(GetCount(static_cast<StatsCounter>(i)));
+    }
+    ret += ", \"garbage_backlog\": " + std::to_string(GetGarbageBacklog()) + ", \"leaf_height\": [";
+    for(size_t i = 0;i < HEIGHT_BUCKET_NUM;i++) { ret += (i == 0 ? "" : ", ") + std::to_string(GetHeightCount(i)); }
+    ret += "], \"alloc_bytes\": {";
+    bool first = true;
+    for(size_t i = 0;i < NODE_TYPE_NUM;i++) {
+      uint64_t bytes = GetAllocBytes(static_cast<NodeType>(i));
+      if(bytes == 0) { continue; }
+      ret += std::string{first ? "" : ", "} + "\"" + std::to_string(i) + "\": " + std::to_string(bytes);
+      first = false;
+    }
+    return ret + "}}";
+  }
+
+ private:
+  // * GetThreadStats() - Returns the counters of the calling thread
+  inline ThreadStatsType *GetThreadStats() {
+    assert(ThreadContext::GetThreadID() < thread_num);
+    return thread_stats_list + ThreadContext::GetThreadID();
+  }
+
+  size_t thread_num;
+  ThreadStatsType *thread_stats_list;
+};
+
+// * enum class LogRecordType - Type of mutations in the write-ahead log
+enum class LogRecordType : uint32_t {
+  Insert = 0,
+  Delete,
+};
+
+/*
+ * class DefaultNullLogType - Log policy that logs nothing
+ * 
+ * All functions are empty, and are optimized away. This is the default of BwTree
+ */
+class DefaultNullLogType {
+ public:
+  static constexpr bool ENABLED = false;
+  DefaultNullLogType(size_t) {}
+  inline uint64_t GetSequence() { return 0; }
+  inline void Abort() {}
+  inline uint64_t GetNextSequence() const { return 0; }
+  inline void SetNextSequence(uint64_t) {}
+  template <typename KeyType, typename ValueType>
+  inline void Log(LogRecordType, uint64_t, const KeyType &, const ValueType &) {}
+};
+
+/*
+ * class DefaultGroupCommitLogType - Write-ahead log policy with group commit
+ * 
+ * 1. Each attempt of a mutation takes a sequence number from a global counter after
+ *    the leaf is read and before the CAS. A CAS only succeeds on the chain it has read,
+ *    so on the same key, the order of sequence numbers is the order of mutations
+ * 2. Records are written after the CAS succeeds into the ring buffer of the calling
+ *    thread, which has a single producer and a single consumer, without locks. 
+ *    Writers wait for the flusher if the buffer is full. If the CAS fails, the 
+ *    sequence number is given up by Abort()
+ * 3. The flusher collects the records of all threads into one write followed by one
+ *    fdatasync(), every flush interval or whenever the pending bytes of a thread reach
+ *    the flush size
+ * 4. Sequence numbers between GetSequence() and Log() or Abort() are announced by their
+ *    threads. Before collecting the records, the flusher takes the minimum of the
+ *    announcements and the next sequence number. All smaller sequence numbers have been
+ *    logged or aborted, so the minimum becomes the durable sequence after the sync. 
+ *    WaitDurable() waits for it instead of the records of the calling thread, because 
+ *    a mutation may depend on a mutation of another thread with a smaller sequence number
+ * 5. Replay() sorts the records by sequence number, because records of different
+ *    threads are not in their order in the file. A torn record at the end is ignored
+ * 6. Start() and Stop() must not be called concurrently with mutations. Records are 
+ *    not written if the flusher is not running
+ */
+class DefaultGroupCommitLogType {
+ public:
+  static constexpr bool ENABLED = true;
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  static constexpr size_t BUFFER_SIZE = 1024 * 1024;
+  static constexpr size_t DEFAULT_FLUSH_INTERVAL_US = 1000;
+  static constexpr size_t DEFAULT_FLUSH_SIZE = 64 * 1024;
+  static constexpr size_t FLUSHER_IDLE_US = 20;
+  // Announced by threads that hold no sequence number
+  static constexpr uint64_t INACTIVE_SEQUENCE = static_cast<uint64_t>(-1);
+
+  // * class RecordHeaderType - Prefix of records. The key and the value follow it
+  class RecordHeaderType {
+   public:
+    uint64_t sequence;
+    LogRecordType type;
+    // Bytes of the key and the value
+    uint32_t size;
+  };
+
+ private:
+  // * class ThreadBufferType - Ring buffer of a thread. Positions are never wrapped
+  class ThreadBufferType {
+   public:
+    ThreadBufferType() : head{0}, tail{0}, active_sequence{INACTIVE_SEQUENCE}, last_sequence{0} {}
+    // Avoid false sharing between the positions of adjacent threads
+    char padding[CACHE_LINE_SIZE];
+    // Bytes before the head have been synced. Written by the flusher
+    std::atomic<uint64_t> head;
+    char head_padding[CACHE_LINE_SIZE];
+    // Written by the owner thread
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> active_sequence;
+    // One after the sequence number of the last record. Only accessed by the owner thread
+    uint64_t last_sequence;
+    char tail_padding[CACHE_LINE_SIZE];
+    unsigned char data[BUFFER_SIZE];
+  };
 
  public:
+  // * DefaultGroupCommitLogType() - Constructor. The number of threads is the same as the epoch manager
+  DefaultGroupCommitLogType(size_t pthread_num) : 
+    thread_num{pthread_num}, buffer_list{new ThreadBufferType[pthread_num]}, 
+    next_sequence{0}, durable_sequence{0}, fd{-1}, stop{false}, flusher{} {}
+  ~DefaultGroupCommitLogType() { 
+    if(IsRunning()) { Stop(); }
+    delete[] buffer_list; 
+  }
+  DefaultGroupCommitLogType(const DefaultGroupCommitLogType &) = delete;
+  DefaultGroupCommitLogType &operator=(const DefaultGroupCommitLogType &) = delete;
+
   /*
-   * Get() - Returns a base node with extended storage for key and value pairs
+   * Start() - Opens the log file for appending and starts the flusher
    * 
-   * 1. The size of the node is determined at run time
-   * 2. We allocate the sizeof() the class plus the extra storage for key and 
-   *    values
+   * Batches are flushed every flush_interval_us, or once a thread has flush_size
+   * pending bytes. Returns false if the file could not be opened
    */
-  static DefaultBaseNode *Get(NodeType ptype, 
-                              NodeSizeType psize,
-                              const BoundKeyType &plow_key,
-                              const BoundKeyType &phigh_key) {
-    assert(ptype == NodeType::InnerBase || ptype == NodeType::LeafBase);
-    // Size for key value pairs and size for the structure itself
-    size_t extra_size = size_t{psize} * (sizeof(KeyType) + sizeof(ValueType));
-    size_t total_size = extra_size + sizeof(DefaultBaseNode);
+  bool Start(const char *path, size_t flush_interval_us = DEFAULT_FLUSH_INTERVAL_US, size_t flush_size = DEFAULT_FLUSH_SIZE) {
+    assert(IsRunning() == false && flush_size > 0);
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd < 0) { return false; }
+    stop.store(false);
+    flusher = std::thread{[this, flush_interval_us, flush_size]() { FlusherLoop(flush_interval_us, flush_size); }};
+    return true;
+  }
 
-    void *p = new unsigned char[total_size];
-    DefaultBaseNode *node_p = \
-      static_cast<DefaultBaseNode *>(
-        new (p) DefaultBaseNode{ptype, NodeHeightType{0}, psize, plow_key, phigh_key});
-    
-    // Call constructor on each key and value element using placement new
-    for(NodeSizeType i = 0;i < psize;i++) {
-      new (&node_p->KeyAt(i)) KeyType{};
-      new (&node_p->ValueAt(i)) ValueType{};
-    }
-    
-    return node_p;
+  // * Stop() - Flushes all pending records, stops the flusher and closes the file
+  void Stop() {
+    assert(IsRunning());
+    stop.store(true);
+    flusher.join();
+    close(fd);
+    fd = -1;
   }
 
+  // * IsRunning() - Whether records are written
+  inline bool IsRunning() const { return fd >= 0; }
+
   /*
-   * Destroy() - Frees the memory and calls destructor
+   * GetSequence() - Returns the sequence number of a mutation. Called before the CAS
    * 
-   * 1. The delta chain's destructor will be called in this case. Make sure
-   *    all delta chain elements have been destroyed before this is called
+   * A lower bound is announced before the counter is incremented, such that the 
+   * flusher could not miss the sequence number if it has read a larger counter
    */
-  static void Destroy(DefaultBaseNode *node_p) {
-    node_p->~DefaultBaseNode();
-    delete[] reinterpret_cast<unsigned char *>(node_p);
-    return;
+  inline uint64_t GetSequence() { 
+    ThreadBufferType *buffer_p = GetThreadBuffer();
+    buffer_p->active_sequence.store(next_sequence.load());
+    uint64_t sequence = next_sequence.fetch_add(1);
+    buffer_p->active_sequence.store(sequence);
+    return sequence;
+  }
+  // * Abort() - Gives up the sequence number of the calling thread after a failed CAS
+  inline void Abort() { GetThreadBuffer()->active_sequence.store(INACTIVE_SEQUENCE); }
+  // * GetNextSequence() - Returns the sequence number of the next mutation
+  inline uint64_t GetNextSequence() const { return next_sequence.load(); }
+  // * GetDurableSequence() - Returns the sequence number below which all mutations are durable
+  inline uint64_t GetDurableSequence() const { return durable_sequence.load(); }
+  // * SetNextSequence() - Restores the counter after reopening or replaying. Not thread-safe
+  inline void SetNextSequence(uint64_t sequence) { 
+    next_sequence.store(sequence); 
+    durable_sequence.store(sequence);
   }
 
-  // * KeyAt() - Access key on a particular index
-  inline KeyType &KeyAt(int index) { return KeyBegin()[index]; }
-  // * ValueAt() - Access value on a particular index
-  inline ValueType &ValueAt(int index) {
-    assert(static_cast<NodeSizeType>(index) < BaseBaseClassType::GetSize());
-    return ValueBegin()[index];
+  /*
+   * Log() - Writes a record into the buffer of the calling thread
+   * 
+   * The record is durable after the flusher syncs it, which could be waited for by 
+   * WaitDurable(). The announcement is cleared after the record is published. Both the
+   * key and the value type must be trivially copyable
+   */
+  template <typename KeyType, typename ValueType>
+  void Log(LogRecordType type, uint64_t sequence, const KeyType &key, const ValueType &value) {
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value, 
+                  "Only trivially copyable keys and values could be logged");
+    ThreadBufferType *buffer_p = GetThreadBuffer();
+    if(IsRunning() == false) { 
+      buffer_p->active_sequence.store(INACTIVE_SEQUENCE);
+      return; 
+    }
+    RecordHeaderType header{sequence, type, static_cast<uint32_t>(sizeof(KeyType) + sizeof(ValueType))};
+    uint64_t tail = buffer_p->tail.load(std::memory_order_relaxed);
+    const size_t size = sizeof(header) + header.size;
+    // The flusher is running, so the buffer is eventually drained
+    while(tail + size - buffer_p->head.load(std::memory_order_acquire) > BUFFER_SIZE) { std::this_thread::yield(); }
+    Copy(buffer_p, tail, &header, sizeof(header));
+    Copy(buffer_p, tail + sizeof(header), &key, sizeof(KeyType));
+    Copy(buffer_p, tail + sizeof(header) + sizeof(KeyType), &value, sizeof(ValueType));
+    buffer_p->tail.store(tail + size, std::memory_order_release);
+    buffer_p->active_sequence.store(INACTIVE_SEQUENCE);
+    buffer_p->last_sequence = sequence + 1;
   }
 
   /*
-   * Search() - Find the lower bound item of a search key
+   * WaitDurable() - Waits until the records of the calling thread are durable
    * 
-   * The lower bound item I is defined as the largest I such that key >= I
-   * We implement this using std::upper_bound and then decrement by 1. 
-   * std::upper_bound finds the smallest I' such that key < I'. If no such
-   * I' exists, which means the key is >= all items, it returns end()
+   * All mutations with smaller sequence numbers, including those of other threads, are
+   * also durable after it returns
    */
-  int Search(const KeyType &key) {
-    assert(BaseBaseClassType::KeyInNode(key));
-    // Note that the first key do not need to be searched for both leaf and 
-    // inner nodes
-    int ret = (std::upper_bound(KeyBegin() + 1, KeyEnd(), key) - KeyBegin()) - 1;
-    assert(ret >= 0 && ret < static_cast<int>(BaseBaseClassType::GetSize()));
-    return ret;
+  void WaitDurable() {
+    uint64_t sequence = GetThreadBuffer()->last_sequence;
+    while(durable_sequence.load() < sequence) { std::this_thread::yield(); }
   }
 
-  // * PointSearch() - Returns the index if exact match is found or -1 otherwise
-  int PointSearch(const KeyType &key) {
-    int index = Search(key);
-    return KeyAt(index) == key ? index : -1;
+  /*
+   * Replay() - Calls the callback with (type, key, value) on records in sequence order
+   * 
+   * 1. Records before the begin sequence, e.g. those in a checkpoint, are skipped
+   * 2. The sequence number after the last record, which is at least the begin sequence,
+   *    is stored into next_sequence_p. Returns false if the file could not be read or 
+   *    has records of other key and value types
+   */
+  template <typename KeyType, typename ValueType, typename CallbackType>
+  static bool Replay(const char *path, uint64_t begin_sequence, CallbackType callback, uint64_t *next_sequence_p) {
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value, 
+                  "Only trivially copyable keys and values could be logged");
+    constexpr size_t record_size = sizeof(RecordHeaderType) + sizeof(KeyType) + sizeof(ValueType);
+    FILE *fp = fopen(path, "rb");
+    if(fp == nullptr) { return false; }
+    std::vector<unsigned char> data{};
+    unsigned char chunk[4096];
+    size_t size;
+    while((size = fread(chunk, 1, sizeof(chunk), fp)) > 0) { data.insert(data.end(), chunk, chunk + size); }
+    bool success = ferror(fp) == 0;
+    fclose(fp);
+    if(success == false) { return false; }
+
+    // Offsets of records, sorted by sequence numbers
+    std::vector<std::pair<uint64_t, size_t>> order{};
+    for(size_t offset = 0;offset + record_size <= data.size();offset += record_size) {
+      RecordHeaderType header;
+      std::memcpy(&header, data.data() + offset, sizeof(header));
+      if(header.size != sizeof(KeyType) + sizeof(ValueType)) { return false; }
+      if(header.sequence >= begin_sequence) { order.emplace_back(header.sequence, offset); }
+    }
+    std::sort(order.begin(), order.end());
+    *next_sequence_p = begin_sequence;
+    for(const auto &item : order) {
+      RecordHeaderType header;
+      KeyType key;
+      ValueType value;
+      std::memcpy(&header, data.data() + item.second, sizeof(header));
+      std::memcpy(&key, data.data() + item.second + sizeof(header), sizeof(KeyType));
+      std::memcpy(&value, data.data() + item.second + sizeof(header) + sizeof(KeyType), sizeof(ValueType));
+      callback(header.type, key, value);
+      *next_sequence_p = header.sequence + 1;
+    }
+    return true;
+  }
+
+ private:
+  // * Copy() - Copies bytes into the ring buffer at a position
+  inline static void Copy(ThreadBufferType *buffer_p, uint64_t pos, const void *p, size_t size) {
+    size_t offset = static_cast<size_t>(pos % BUFFER_SIZE);
+    size_t first = std::min(size, BUFFER_SIZE - offset);
+    std::memcpy(buffer_p->data + offset, p, first);
+    std::memcpy(buffer_p->data, static_cast<const unsigned char *>(p) + first, size - first);
   }
 
   /*
-   * Split() - Split the node into two smaller halves
+   * Flush() - Writes the pending records of all threads as one batch and syncs it
    * 
-   * 1. Only unique key split is supported. For non-unique keys please override
-   *    this method in a derived class
-   * 2. The split point is chosen as the middle of the node. The current node
-   *    is not changed, and we copy the upper half of the content into another
-   *    node and return it
-   * 3. The node size must be greater than 1. Otherwise assertion fails
-   * 4. The low key of the upper half is set to the split key. The high key
-   *    of the upper is the same as the current node. The current node's high
-   *    key should be updated by the split delta
+   * Heads are advanced after the sync, which releases the space to writers. Records of 
+   * a thread are never split between batches. The durable sequence is taken before the
+   * tails, and is published even if there is no record, e.g. after Abort()
    */
-  DefaultBaseNode *Split() {
-    NodeSizeType old_size = BaseBaseClassType::GetSize();
-    assert(old_size > 1);
-    // The index of the split key which is also the low key of the new node
-    NodeSizeType pivot = old_size / 2;
-    NodeSizeType new_size = old_size - pivot;
-    // Note that low key for new node is always not inf
-    DefaultBaseNode *node_p = \
-      Get(BaseBaseClassType::GetType(), new_size, 
-          {KeyAt(static_cast<int>(pivot)), false}, *BaseBaseClassType::GetHighKey());
-    // Copy the upper half of the current node into the new node
-    std::copy(KeyBegin() + pivot, KeyEnd(), node_p->KeyBegin());
-    std::copy(ValueBegin() + pivot, ValueEnd(), node_p->ValueBegin());
+  void Flush() {
+    uint64_t sequence = next_sequence.load();
+    for(size_t i = 0;i < thread_num;i++) { sequence = std::min(sequence, buffer_list[i].active_sequence.load()); }
+    std::vector<uint64_t> tail_list(thread_num);
+    batch.clear();
+    for(size_t i = 0;i < thread_num;i++) {
+      ThreadBufferType *buffer_p = buffer_list + i;
+      uint64_t head = buffer_p->head.load(std::memory_order_relaxed);
+      tail_list[i] = buffer_p->tail.load(std::memory_order_acquire);
+      size_t offset = static_cast<size_t>(head % BUFFER_SIZE), size = static_cast<size_t>(tail_list[i] - head);
+      size_t first = std::min(size, BUFFER_SIZE - offset);
+      batch.insert(batch.end(), buffer_p->data + offset, buffer_p->data + offset + first);
+      batch.insert(batch.end(), buffer_p->data, buffer_p->data + size - first);
+    }
+    if(batch.empty()) { 
+      PublishDurable(sequence);
+      return; 
+    }
+    size_t written = 0;
+    while(written < batch.size()) {
+      ssize_t ret = write(fd, batch.data() + written, batch.size() - written);
+      always_assert(ret > 0);
+      written += static_cast<size_t>(ret);
+    }
+    always_assert(fdatasync(fd) == 0);
+    for(size_t i = 0;i < thread_num;i++) { buffer_list[i].head.store(tail_list[i], std::memory_order_release); }
+    PublishDurable(sequence);
+  }
 
-    return node_p;
+  /*
+   * PublishDurable() - Advances the durable sequence. Only called by the flusher
+   * 
+   * A thread that announced a lower bound before the previous flush could announce a
+   * smaller number than the durable sequence, which is then not decreased
+   */
+  inline void PublishDurable(uint64_t sequence) {
+    if(sequence > durable_sequence.load(std::memory_order_relaxed)) { durable_sequence.store(sequence); }
   }
- public:
-  
- private:
-  // * KeyBegin() - Return the first pointer for values
-  inline KeyType *KeyBegin() { return key_begin; }
-  // * KeyEnd() - Return the first out-of-bound pointer for keys
-  inline KeyType *KeyEnd() { return key_begin + BaseBaseClassType::GetSize(); }
-  // * ValueBegin() - Return the first pointer for values
-  inline ValueType *ValueBegin() { return reinterpret_cast<ValueType *>(KeyEnd()); }
-  // * ValueEnd() - Return the first out-of-bound pointer for values
-  inline ValueType *ValueEnd() { return ValueBegin() + BaseBaseClassType::GetSize(); }
 
-  // This member does not take any storage, but let us obtain the address
-  // of the memory address after all class members
-  KeyType key_begin[0];
+  // * GetPendingSize() - Returns the largest number of unflushed bytes of a thread
+  size_t GetPendingSize() const {
+    size_t size = 0;
+    for(size_t i = 0;i < thread_num;i++) {
+      size = std::max(size, static_cast<size_t>(buffer_list[i].tail.load(std::memory_order_relaxed) - 
+                                                buffer_list[i].head.load(std::memory_order_relaxed)));
+    }
+    return size;
+  }
+
+  // * FlusherLoop() - Body of the flusher. Pending records are flushed on stop
+  void FlusherLoop(size_t flush_interval_us, size_t flush_size) {
+    auto last = std::chrono::steady_clock::now();
+    while(stop.load() == false) {
+      auto now = std::chrono::steady_clock::now();
+      if(GetPendingSize() >= flush_size || now - last >= std::chrono::microseconds{flush_interval_us}) {
+        Flush();
+        last = now;
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds{size_t{FLUSHER_IDLE_US}});
+      }
+    }
+    Flush();
+  }
+
+  // * GetThreadBuffer() - Returns the buffer of the calling thread
+  inline ThreadBufferType *GetThreadBuffer() {
+    assert(ThreadContext::GetThreadID() < thread_num);
+    return buffer_list + ThreadContext::GetThreadID();
+  }
+
+  size_t thread_num;
+  ThreadBufferType *buffer_list;
+  std::atomic<uint64_t> next_sequence;
+  std::atomic<uint64_t> durable_sequence;
+  int fd;
+  std::atomic<bool> stop;
+  std::thread flusher;
+  // Only used by the flusher
+  std::vector<unsigned char> batch;
 };
 
-/* 
- * class TraverseHandlerBase - The base class of traverse handlers
- * 
- * All traverse handlers must inherit from this class. They do not have to implement
- * all methods (and most of them don't). For detailed template of derived handlers
- * please refer to traverser class
+// * enum class TraceOp - Operations sampled by the tracer
+enum class TraceOp : uint8_t {
+  Insert = 0,
+  Delete,
+  Lookup,
+  OpNum,
+};
+
+/*
+ * class DefaultNullTracerType - Tracer policy that traces nothing
  * 
- * 1. "finished" is set if the traverse should end
- * 2. next_p is set to the next pointer the traverse must go if it has not finished
- * 3. Init() is called at the beginning of the traverse, including recursive traverses
+ * All functions are empty, and are optimized away. This is the default of BwTree
  */
-template <typename KeyType, typename ValueType, typename NodeIDType, 
-          typename DeltaChainType>
-class TraverseHandlerBase {
+class DefaultNullTracerType {
  public:
-  using NodeBaseType = NodeBase<KeyType>;
-  using DeltaType = Delta<KeyType, ValueType, NodeIDType>;
-  using LeafBaseType = DefaultBaseNode<KeyType, ValueType, DeltaChainType>;
-  using InnerBaseType = DefaultBaseNode<KeyType, NodeIDType, DeltaChainType>;
+  static constexpr bool ENABLED = false;
+  // * class GuardType - Traces an operation from construction to destruction
+  class GuardType {
+   public:
+    GuardType(DefaultNullTracerType *, TraceOp) {}
+  };
+  DefaultNullTracerType(size_t) {}
+  inline void TraceNode(uint64_t, size_t) {}
+  inline void TraceRetry(uint64_t) {}
+};
 
-  // * TraverseHandlerBase() - Constructor
-  TraverseHandlerBase() :
-    finished{false}, next_p{nullptr} {}
+/*
+ * class DefaultSamplingTracerType - Tracer policy that samples one in N operations
+ * 
+ * 1. For a sampled operation, the node IDs visited by the traversal and the height of
+ *    their delta chains, the number of failed CAS and the wall time are recorded. The
+ *    last TRACE_BUFFER_SIZE traces of each thread are kept
+ * 2. The heatmap counts for each node ID the visits of sampled operations, the sum of
+ *    chain heights seen by them, and failed CAS of all operations. Failed CAS are rare
+ *    and are exactly the contention we look for, so they are not sampled
+ * 3. Each thread writes its own state, guarded by a lock that is only taken when a
+ *    sampled operation finishes, on a failed CAS, and by the dump functions
+ * 4. The heatmap is dumped as CSV or JSON, with the hottest nodes first. Node IDs are
+ *    reused after nodes are removed, so the heatmap should be reset after merges
+ */
+class DefaultSamplingTracerType {
+ public:
+  static constexpr bool ENABLED = true;
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  static constexpr size_t DEFAULT_SAMPLE_INTERVAL = 64;
+  static constexpr size_t TRACE_BUFFER_SIZE = 1024;
+  // Visits after this are counted in the trace but not recorded
+  static constexpr size_t MAX_TRACE_DEPTH = 32;
+
+  // * class TraceType - A sampled operation
+  class TraceType {
+   public:
+    TraceOp op;
+    uint32_t retry_num;
+    uint32_t visit_num;
+    uint64_t time_ns;
+    uint64_t node_id_list[MAX_TRACE_DEPTH];
+    uint64_t height_list[MAX_TRACE_DEPTH];
+  };
 
-  // Handler functions. If not used in the derived class just leave them undefined
-  void HandleLeafBase(LeafBaseType *node_p) { Fail(); }
-  void HandleInnerBase(InnerBaseType *node_p) { Fail(); }
+  // * class HeatType - Counters of a node ID in the heatmap
+  class HeatType {
+   public:
+    uint64_t visit_num;
+    uint64_t height_sum;
+    uint64_t retry_num;
+    // * GetWeight() - Used to sort the heatmap. Each failed CAS costs an extra traversal
+    inline uint64_t GetWeight() const { return visit_num + retry_num; }
+  };
 
-  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { Fail(); }
-  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { Fail(); }
+ private:
+  // * class ThreadTracerType - States of a thread
+  class ThreadTracerType {
+   public:
+    ThreadTracerType() : op_count{0}, is_active{false}, trace_count{0} {}
+    // Avoid false sharing between the states of adjacent threads
+    char padding[CACHE_LINE_SIZE];
+    // Only accessed by the owner thread
+    uint64_t op_count;
+    bool is_active;
+    std::chrono::steady_clock::time_point start;
+    TraceType current;
+    // Guarded by the lock
+    std::mutex lock;
+    uint64_t trace_count;
+    std::vector<TraceType> trace_list;
+    std::unordered_map<uint64_t, HeatType> heatmap;
+  };
 
-  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { Fail(); }
-  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { Fail(); }
+ public:
+  /*
+   * class GuardType - Traces an operation from construction to destruction
+   * 
+   * If the operation is not sampled, only the operation counter is updated
+   */
+  class GuardType {
+   public:
+    GuardType(DefaultSamplingTracerType *ptracer_p, TraceOp op) : tracer_p{ptracer_p} { tracer_p->Begin(op); }
+    ~GuardType() { tracer_p->End(); }
+   private:
+    DefaultSamplingTracerType *tracer_p;
+  };
 
-  void HandleLeafISplit(typename DeltaType::LeafSplitType *node_p) { Fail(); }
-  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { Fail(); }
+  // * DefaultSamplingTracerType() - Constructor. The number of threads is the same as the epoch manager
+  DefaultSamplingTracerType(size_t pthread_num) : 
+    thread_num{pthread_num}, sample_interval{DEFAULT_SAMPLE_INTERVAL}, 
+    thread_tracer_list{new ThreadTracerType[pthread_num]} {}
+  ~DefaultSamplingTracerType() { delete[] thread_tracer_list; }
+  DefaultSamplingTracerType(const DefaultSamplingTracerType &) = delete;
+  DefaultSamplingTracerType &operator=(const DefaultSamplingTracerType &) = delete;
+
+  // * SetSampleInterval() - One in every interval operations of each thread is sampled. Not thread-safe
+  inline void SetSampleInterval(size_t interval) { 
+    assert(interval > 0);
+    sample_interval = interval; 
+  }
 
-  bool HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { Fail(); return false; }
-  bool HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { Fail(); return false; }
+  // * TraceNode() - Records a node visited by the traversal of a sampled operation
+  inline void TraceNode(uint64_t node_id, size_t height) {
+    ThreadTracerType *tracer_p = GetThreadTracer();
+    if(tracer_p->is_active == false) { return; }
+    TraceType &trace = tracer_p->current;
+    if(trace.visit_num < MAX_TRACE_DEPTH) {
+      trace.node_id_list[trace.visit_num] = node_id;
+      trace.height_list[trace.visit_num] = height;
+    }
+    trace.visit_num++;
+  }
 
-  void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { Fail(); }
-  void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { Fail(); }
+  // * TraceRetry() - Records a failed CAS on the node. Called by all operations
+  void TraceRetry(uint64_t node_id) {
+    ThreadTracerType *tracer_p = GetThreadTracer();
+    if(tracer_p->is_active) { tracer_p->current.retry_num++; }
+    std::lock_guard<std::mutex> guard{tracer_p->lock};
+    tracer_p->heatmap[node_id].retry_num++;
+  }
 
-  // * GetNext() - Returns the next pointer
+  // * GetTraceList() - Returns the kept traces of all threads. Traces of a thread are oldest first
+  std::vector<TraceType> GetTraceList() {
+    std::vector<TraceType> ret{};
+    for(size_t i = 0;i < thread_num;i++) {
+      ThreadTracerType *tracer_p = thread_tracer_list + i;
+      std::lock_guard<std::mutex> guard{tracer_p->lock};
+      size_t size = tracer_p->trace_list.size();
+      for(size_t j = 0;j < size;j++) { ret.push_back(tracer_p->trace_list[(tracer_p->trace_count + j) % size]); }
+    }
+    return ret;
+  }
+
+  // * GetHeatmap() - Returns the merged heatmap of all threads, sorted by weight in descending order
+  std::vector<std::pair<uint64_t, HeatType>> GetHeatmap() {
+    std::unordered_map<uint64_t, HeatType> heatmap{};
+    for(size_t i = 0;i < thread_num;i++) {
+      ThreadTracerType *tracer_p = thread_tracer_list + i;
+      std::lock_guard<std::mutex> guard{tracer_p->lock};
+      for(const auto &item : tracer_p->heatmap) {
+        HeatType &heat = heatmap[item.first];
+        heat.visit_num += item.second.visit_num;
+        heat.height_sum += item.second.height_sum;
+        heat.retry_num += item.second.retry_num;
+      }
+    }
+    std::vector<std::pair<uint64_t, HeatType>> ret{heatmap.begin(), heatmap.end()};
+    std::sort(ret.begin(), ret.end(), [](const std::pair<uint64_t, HeatType> &a, const std::pair<uint64_t, HeatType> &b) {
+      return a.second.GetWeight() != b.second.GetWeight() ? a.second.GetWeight() > b.second.GetWeight() : a.first < b.first; 
+    });
+    return ret;
+  }
+
+  // * ToHeatmapCSV() - Returns the heatmap as CSV with a header line
+  std::string ToHeatmapCSV() {
+    std::string ret = "node_id,visit_num,height_sum,retry_num\n";
+    for(const auto &item : GetHeatmap()) {
+      ret += std::to_string(item.first) + "," + std::to_string(item.second.visit_num) + "," + 
+             std::to_string(item.second.height_sum) + "," + std::to_string(item.second.retry_num) + "\n";
+    }
+    return ret;
+  }
+
+  // * ToHeatmapJSON() - Returns the heatmap as a JSON array of objects
+  std::string ToHeatmapJSON() {
+    std::string ret = "[";
+    bool first = true;
+    for(const auto &item : GetHeatmap()) {
+      ret += std::string{first ? "" : ", "} + "{\"node_id\": " + std::to_string(item.first) + 
+             ", \"visit_num\": " + std::to_string(item.second.visit_num) + 
+             ", \"height_sum\": " + std::to_string(item.second.height_sum) + 
+             ", \"retry_num\": " + std::to_string(item.second.retry_num) + "}";
+      first = false;
+    }
+    return ret + "]";
+  }
+
+  // * ToTraceJSON() - Returns the kept traces as a JSON array. Paths are [node ID, height] pairs
+  std::string ToTraceJSON() {
+    static const char *op_name_list[] = {"insert", "delete", "lookup"};
+    static_assert(sizeof(op_name_list) / sizeof(op_name_list[0]) == static_cast<size_t>(TraceOp::OpNum), "Missing op names");
+    std::string ret = "[";
+    bool first = true;
+    for(const TraceType &trace : GetTraceList()) {
+      ret += std::string{first ? "" : ", "} + "{\"op\": \"" + op_name_list[static_cast<size_t>(trace.op)] + 
+             "\", \"time_ns\": " + std::to_string(trace.time_ns) + ", \"retry_num\": " + std::to_string(trace.retry_num) + 
+             ", \"visit_num\": " + std::to_string(trace.visit_num) + ", \"path\": [";
+      for(size_t i = 0;i < std::min(size_t{trace.visit_num}, size_t{MAX_TRACE_DEPTH});i++) {
+        ret += (i == 0 ? "[" : ", [") + std::to_string(trace.node_id_list[i]) + ", " + std::to_string(trace.height_list[i]) + "]";
+      }
+      ret += "]}";
+      first = false;
+    }
+    return ret + "]";
+  }
+
+  // * Reset() - Clears all traces and the heatmap. Not thread-safe
+  void Reset() {
+    for(size_t i = 0;i < thread_num;i++) {
+      thread_tracer_list[i].trace_count = 0;
+      thread_tracer_list[i].trace_list.clear();
+      thread_tracer_list[i].heatmap.clear();
+    }
+  }
+
+ private:
+  // * Begin() - Starts a trace if the operation is sampled
+  inline void Begin(TraceOp op) {
+    ThreadTracerType *tracer_p = GetThreadTracer();
+    // Nested operations, e.g. batches, are traced as the outermost one
+    if(tracer_p->is_active || tracer_p->op_count++ % sample_interval != 0) { return; }
+    tracer_p->is_active = true;
+    tracer_p->current.op = op;
+    tracer_p->current.retry_num = 0;
+    tracer_p->current.visit_num = 0;
+    tracer_p->start = std::chrono::steady_clock::now();
+  }
+
+  // * End() - Finishes the trace and adds the visits to the heatmap
+  void End() {
+    ThreadTracerType *tracer_p = GetThreadTracer();
+    if(tracer_p->is_active == false) { return; }
+    tracer_p->is_active = false;
+    TraceType &trace = tracer_p->current;
+    trace.time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - tracer_p->start).count());
+    std::lock_guard<std::mutex> guard{tracer_p->lock};
+    for(size_t i = 0;i < std::min(size_t{trace.visit_num}, size_t{MAX_TRACE_DEPTH});i++) {
+      HeatType &heat = tracer_p->heatmap[trace.node_id_list[i]];
+      heat.visit_num++;
+      heat.height_sum += trace.height_list[i];
+    }
+    if(tracer_p->trace_list.size() < TRACE_BUFFER_SIZE) { tracer_p->trace_list.push_back(trace); }
+    else { tracer_p->trace_list[tracer_p->trace_count % TRACE_BUFFER_SIZE] = trace; }
+    tracer_p->trace_count++;
+  }
+
+  // * GetThreadTracer() - Returns the states of the calling thread
+  inline ThreadTracerType *GetThreadTracer() {
+    assert(ThreadContext::GetThreadID() < thread_num);
+    return thread_tracer_list + ThreadContext::GetThreadID();
+  }
+
+  size_t thread_num;
+  size_t sample_interval;
+  ThreadTracerType *thread_tracer_list;
+};
+
+/*
+ * class StaticConfig - Config policy of BwTree with thresholds fixed at compile time
+ *
+ * 1. A delta chain is consolidated if the height reaches the height threshold of its level
+ * 2. Base nodes are split if the size reaches the split threshold, and virtual nodes
+ *    are merged into the left sibling if the size is below the merge threshold.
+ *    The merge threshold must be smaller than half of the split threshold
+ * 3. Bulk loading builds nodes of 3/4 of the split threshold, which leaves room for
+ *    inserts before split
+ * 4. TABLE_SIZE is the number of node IDs in the mapping table
+ * 5. RETRY_BACKOFF_LIMIT is the maximum number of pause instructions between retries
+ *    of a failed leaf append. See class RetryBackoff
+ *
+ * All getters are constexpr, so thresholds are compiled into the tree as constants.
+ * DefaultStaticConfigType below is the default of BwTree
+ */
+template <size_t LEAF_HEIGHT_THRESHOLD = 24, size_t INNER_HEIGHT_THRESHOLD = 2,
+          size_t LEAF_SPLIT_THRESHOLD = 128, size_t LEAF_MERGE_THRESHOLD = 16,
+          size_t INNER_SPLIT_THRESHOLD = 64, size_t INNER_MERGE_THRESHOLD = 8,
+          size_t TABLE_SIZE = 1204 * 1024 * 16, size_t RETRY_BACKOFF_LIMIT = 64>
+class StaticConfig {
+ public:
+  // Lists of consolidators are inline up to this height
+  static constexpr size_t HEIGHT_CAPACITY = \
+    LEAF_HEIGHT_THRESHOLD > INNER_HEIGHT_THRESHOLD ? LEAF_HEIGHT_THRESHOLD : INNER_HEIGHT_THRESHOLD;
+  // Template argument of the mapping table
+  static constexpr size_t MAPPING_TABLE_CAPACITY = TABLE_SIZE;
+  static_assert(LEAF_HEIGHT_THRESHOLD > 0 && INNER_HEIGHT_THRESHOLD > 0, "Height threshold must not be zero");
+  static_assert(LEAF_HEIGHT_THRESHOLD <= UINT16_MAX / 2 && INNER_HEIGHT_THRESHOLD <= UINT16_MAX / 2, "Height threshold is too large");
+  static_assert(LEAF_MERGE_THRESHOLD * 2 < LEAF_SPLIT_THRESHOLD, "Leaf merge threshold is too large");
+  static_assert(INNER_MERGE_THRESHOLD * 2 < INNER_SPLIT_THRESHOLD, "Inner merge threshold is too large");
+  static_assert(LEAF_SPLIT_THRESHOLD * 3 / 4 > LEAF_MERGE_THRESHOLD * 2, "Leaf load size is too small");
+  static_assert(INNER_SPLIT_THRESHOLD * 3 / 4 > INNER_MERGE_THRESHOLD * 2, "Inner load size is too small");
+
+  static constexpr size_t GetLeafHeightThreshold() { return LEAF_HEIGHT_THRESHOLD; }
+  static constexpr size_t GetInnerHeightThreshold() { return INNER_HEIGHT_THRESHOLD; }
+  static constexpr size_t GetLeafSplitThreshold() { return LEAF_SPLIT_THRESHOLD; }
+  static constexpr size_t GetLeafMergeThreshold() { return LEAF_MERGE_THRESHOLD; }
+  static constexpr size_t GetInnerSplitThreshold() { return INNER_SPLIT_THRESHOLD; }
+  static constexpr size_t GetInnerMergeThreshold() { return INNER_MERGE_THRESHOLD; }
+  static constexpr size_t GetLeafLoadSize() { return LEAF_SPLIT_THRESHOLD * 3 / 4; }
+  static constexpr size_t GetInnerLoadSize() { return INNER_SPLIT_THRESHOLD * 3 / 4; }
+  static constexpr size_t GetMappingTableSize() { return TABLE_SIZE; }
+  static constexpr size_t GetRetryBackoffLimit() { return RETRY_BACKOFF_LIMIT; }
+  // * Validate() - Thresholds are checked at compile time
+  static void Validate() {}
+};
+
+using DefaultStaticConfigType = StaticConfig<>;
+
+/*
+ * class DefaultRuntimeConfigType - Config policy of BwTree with thresholds set for each tree
+ *
+ * 1. Thresholds have the same meaning as StaticConfig, and default to those of
+ *    DefaultStaticConfigType. Setters return the object, so they could be chained
+ * 2. Thresholds are checked by Validate() when the tree is constructed
+ * 3. Consolidators keep their lists inline for heights up to HEIGHT_CAPACITY, and move
+ *    them to the heap for longer chains
+ * 4. The mapping table size could exceed MAPPING_TABLE_CAPACITY only if the mapping table
+ *    allocates memory by the capacity given to Get(). DefaultMappingTable does not
+ */
+class DefaultRuntimeConfigType {
+ public:
+  using DefaultType = DefaultStaticConfigType;
+  static constexpr size_t HEIGHT_CAPACITY = DefaultType::HEIGHT_CAPACITY;
+  static constexpr size_t MAPPING_TABLE_CAPACITY = DefaultType::MAPPING_TABLE_CAPACITY;
+  // Heights are stored in NodeHeightType of NodeBase, and leave room for height policies
+  static constexpr size_t MAX_HEIGHT_THRESHOLD = UINT16_MAX / 2;
+
+  DefaultRuntimeConfigType() :
+    leaf_height_threshold{DefaultType::GetLeafHeightThreshold()},
+    inner_height_threshold{DefaultType::GetInnerHeightThreshold()},
+    leaf_split_threshold{DefaultType::GetLeafSplitThreshold()},
+    leaf_merge_threshold{DefaultType::GetLeafMergeThreshold()},
+    inner_split_threshold{DefaultType::GetInnerSplitThreshold()},
+    inner_merge_threshold{DefaultType::GetInnerMergeThreshold()},
+    mapping_table_size{DefaultType::GetMappingTableSize()},
+    retry_backoff_limit{DefaultType::GetRetryBackoffLimit()} {}
+
+  // * Set*() - Sets a threshold
+  DefaultRuntimeConfigType &SetLeafHeightThreshold(size_t threshold) { leaf_height_threshold = threshold; return *this; }
+  DefaultRuntimeConfigType &SetInnerHeightThreshold(size_t threshold) { inner_height_threshold = threshold; return *this; }
+  // * SetLeafNodeSize() * SetInnerNodeSize() - Sets the split and merge thresholds of a level
+  DefaultRuntimeConfigType &SetLeafNodeSize(size_t split_threshold, size_t merge_threshold) {
+    leaf_split_threshold = split_threshold;
+    leaf_merge_threshold = merge_threshold;
+    return *this;
+  }
+  DefaultRuntimeConfigType &SetInnerNodeSize(size_t split_threshold, size_t merge_threshold) {
+    inner_split_threshold = split_threshold;
+    inner_merge_threshold = merge_threshold;
+    return *this;
+  }
+  DefaultRuntimeConfigType &SetMappingTableSize(size_t size) { mapping_table_size = size; return *this; }
+  DefaultRuntimeConfigType &SetRetryBackoffLimit(size_t limit) { retry_backoff_limit = limit; return *this; }
+
+  inline size_t GetLeafHeightThreshold() const { return leaf_height_threshold; }
+  inline size_t GetInnerHeightThreshold() const { return inner_height_threshold; }
+  inline size_t GetLeafSplitThreshold() const { return leaf_split_threshold; }
+  inline size_t GetLeafMergeThreshold() const { return leaf_merge_threshold; }
+  inline size_t GetInnerSplitThreshold() const { return inner_split_threshold; }
+  inline size_t GetInnerMergeThreshold() const { return inner_merge_threshold; }
+  inline size_t GetLeafLoadSize() const { return leaf_split_threshold * 3 / 4; }
+  inline size_t GetInnerLoadSize() const { return inner_split_threshold * 3 / 4; }
+  inline size_t GetMappingTableSize() const { return mapping_table_size; }
+  inline size_t GetRetryBackoffLimit() const { return retry_backoff_limit; }
+
+  // * Validate() - Checks the same conditions as StaticConfig. Errors are not recoverable
+  void Validate() const {
+    always_assert(leaf_height_threshold > 0 && leaf_height_threshold <= MAX_HEIGHT_THRESHOLD);
+    always_assert(inner_height_threshold > 0 && inner_height_threshold <= MAX_HEIGHT_THRESHOLD);
+    always_assert(leaf_merge_threshold * 2 < leaf_split_threshold);
+    always_assert(inner_merge_threshold * 2 < inner_split_threshold);
+    always_assert(GetLeafLoadSize() > leaf_merge_threshold * 2);
+    always_assert(GetInnerLoadSize() > inner_merge_threshold * 2);
+    always_assert(leaf_split_threshold <= UINT32_MAX && inner_split_threshold <= UINT32_MAX);
+    always_assert(mapping_table_size > 0);
+  }
+
+ private:
+  size_t leaf_height_threshold;
+  size_t inner_height_threshold;
+  size_t leaf_split_threshold;
+  size_t leaf_merge_threshold;
+  size_t inner_split_threshold;
+  size_t inner_merge_threshold;
+  size_t mapping_table_size;
+  size_t retry_backoff_limit;
+};
+
+/*
+ * class DefaultHeightPolicyType - Consolidation policy that uses the height threshold of the config
+ * 
+ * All functions are trivial, and are optimized away. This is the default of BwTree
+ */
+class DefaultHeightPolicyType {
+ public:
+  static constexpr bool ENABLED = false;
+  inline void CountRead(uint64_t, size_t) {}
+  inline void CountAppend(uint64_t) {}
+  inline size_t GetLeafHeightThreshold(uint64_t, size_t threshold) const { return threshold; }
+};
+
+/*
+ * class AdaptiveHeightPolicy - Consolidation policy that adapts the height threshold of leaves to their workload
+ * 
+ * 1. Each leaf has two counters: the read cost, which is the number of deltas passed by
+ *    lookups, and the number of appends. They are stored in a table of SLOT_NUM slots
+ *    indexed by node ID, and leaves on the same slot share counters. Counters are updated 
+ *    with relaxed loads and stores, so they are approximate under concurrency
+ * 2. Lookups on consolidated leaves cost nothing and are not counted, such that read-only
+ *    workloads do not write the table once chains are consolidated
+ * 3. Both counters of a slot are halved when the sum reaches DECAY_THRESHOLD, so the 
+ *    policy follows changes of the workload
+ * 4. A leaf is read-hot if each delta is read more than READ_HOT_RATIO times on average.
+ *    The threshold is divided by THRESHOLD_FACTOR, and the chain is consolidated eagerly.
+ *    A leaf is write-hot if each delta is read less than once. The threshold is 
+ *    multiplied by THRESHOLD_FACTOR, and consolidations are saved for longer chains
+ * 5. Inner nodes are read by every traversal, so their threshold is not changed
+ * 
+ * Use DefaultAdaptiveHeightPolicyType below as the policy argument of BwTree
+ */
+template <size_t SLOT_NUM>
+class AdaptiveHeightPolicy {
+ public:
+  static constexpr bool ENABLED = true;
+  static constexpr uint32_t DECAY_THRESHOLD = 4096;
+  // Counters below this sum do not change the threshold
+  static constexpr uint32_t MIN_SAMPLE = 16;
+  static constexpr uint32_t READ_HOT_RATIO = 8;
+  static constexpr size_t THRESHOLD_FACTOR = 2;
+  static constexpr size_t MIN_HEIGHT_THRESHOLD = 2;
+  static_assert((SLOT_NUM & (SLOT_NUM - 1)) == 0, "Number of slots must be a power of two");
+
+ private:
+  // * class SlotType - Counters of leaves on a slot
+  class SlotType {
+   public:
+    SlotType() : read_cost{0}, append_count{0} {}
+    std::atomic<uint32_t> read_cost;
+    std::atomic<uint32_t> append_count;
+  };
+
+ public:
+  AdaptiveHeightPolicy() : slot_list{new SlotType[SLOT_NUM]} {}
+  ~AdaptiveHeightPolicy() { delete[] slot_list; }
+  AdaptiveHeightPolicy(const AdaptiveHeightPolicy &) = delete;
+  AdaptiveHeightPolicy &operator=(const AdaptiveHeightPolicy &) = delete;
+
+  // * CountRead() - Records a lookup that passed a leaf chain of the height
+  inline void CountRead(uint64_t node_id, size_t height) { 
+    if(height == 0) { return; }
+    SlotType *slot_p = GetSlot(node_id);
+    Add(&slot_p->read_cost, slot_p, static_cast<uint32_t>(height));
+  }
+  // * CountAppend() - Records an append on the leaf
+  inline void CountAppend(uint64_t node_id) { 
+    SlotType *slot_p = GetSlot(node_id);
+    Add(&slot_p->append_count, slot_p, 1); 
+  }
+
+  // * GetLeafHeightThreshold() - Returns the threshold of the leaf, given the threshold of the config
+  inline size_t GetLeafHeightThreshold(uint64_t node_id, size_t threshold) const {
+    const SlotType *slot_p = GetSlot(node_id);
+    uint32_t read_cost = slot_p->read_cost.load(std::memory_order_relaxed);
+    uint32_t append_count = slot_p->append_count.load(std::memory_order_relaxed);
+    if(read_cost + append_count < MIN_SAMPLE) { return threshold; }
+    else if(read_cost > append_count * READ_HOT_RATIO) { return std::max(size_t{MIN_HEIGHT_THRESHOLD}, threshold / THRESHOLD_FACTOR); }
+    else if(read_cost < append_count) { return threshold * THRESHOLD_FACTOR; }
+    return threshold;
+  }
+
+  // * Reset() - Clears all counters. Not thread-safe
+  void Reset() {
+    for(size_t i = 0;i < SLOT_NUM;i++) { 
+      slot_list[i].read_cost.store(0);
+      slot_list[i].append_count.store(0); 
+    }
+  }
+
+ private:
+  inline SlotType *GetSlot(uint64_t node_id) const { return &slot_list[node_id & (SLOT_NUM - 1)]; }
+
+  // * Add() - Adds to a counter of the slot, and halves both counters if the sum is large
+  inline static void Add(std::atomic<uint32_t> *counter_p, SlotType *slot_p, uint32_t delta) {
+    counter_p->store(counter_p->load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    uint32_t read_cost = slot_p->read_cost.load(std::memory_order_relaxed);
+    uint32_t append_count = slot_p->append_count.load(std::memory_order_relaxed);
+    if(read_cost + append_count >= DECAY_THRESHOLD) {
+      slot_p->read_cost.store(read_cost / 2, std::memory_order_relaxed);
+      slot_p->append_count.store(append_count / 2, std::memory_order_relaxed);
+    }
+  }
+
+  SlotType *slot_list;
+};
+
+using DefaultAdaptiveHeightPolicyType = AdaptiveHeightPolicy<65536>;
+
+template <typename, typename> class ExtendedNodeBase;
+template <typename> class DeltaNodeBase;
+template <typename> class SMODeltaNodeBase;
+
+/*
+ * class NodeBase - Base class of base node and delta node types
+ * 
+ * 1. Virtual node abstraction is defined in this class
+ * 2. The low key pointer always points to the low key of the base node at the end of
+ *    the chain, which also locates the base node. The high key is only stored by base 
+ *    nodes, split and merge deltas. Other deltas inherit the one of the next node
+ */
+template <typename KeyType>
+class NodeBase {
+ public:
+  using BoundKeyType = BoundKey<KeyType>;
+  using NodeSizeType = uint32_t;
+  using NodeHeightType = uint16_t;
+  // Base node offset recorded in deltas if it is not known
+  static constexpr NodeSizeType INVALID_OFFSET = ~NodeSizeType{0};
+
+ protected:
+  /*
+   * NodeBase() - Constructor
+   */
+  NodeBase(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
+           BoundKeyType *plow_key_p, bool pbase_high_key) :
+    type{ptype}, base_high_key{pbase_high_key}, height{pheight}, size{psize},
+    low_key_p{plow_key_p} {}
+
+  // * SetHeader() - Resets the fields given to the constructor, except the type
+  inline void SetHeader(NodeHeightType pheight, NodeSizeType psize, BoundKeyType *plow_key_p, bool pbase_high_key) {
+    base_high_key = pbase_high_key;
+    height = pheight;
+    size = psize;
+    low_key_p = plow_key_p;
+  }
+
+ public:
+  // * GetSize() - Returns the size
+  inline NodeSizeType GetSize() const { return size; }
+  // * GetDepth() - Returns the depth
+  inline NodeHeightType GetHeight() const { return height; }
+  // * GetType() - Returns the type enum
+  inline NodeType GetType() const { return type; }
+  // * IsLeaf() - Whether the node is a leaf base node or leaf delta
+  inline bool IsLeaf() const { return type >= NodeType::LeafBase; }
+  // * IsSMO() - Whether the node is a split or merge delta, which stores its own high key
+  inline bool IsSMO() const { return IsSMO(type); }
+  inline static bool IsSMO(NodeType type) {
+    return type == NodeType::LeafSplit || type == NodeType::LeafMerge || 
+           type == NodeType::InnerSplit || type == NodeType::InnerMerge;
+  }
+  // * HasBaseHighKey() - Whether the high key is the one stored in the base node
+  inline bool HasBaseHighKey() const { return base_high_key; }
+  // * GetHighKey() - Returns high key. Walks to the split or merge delta if it is not the base one
+  inline BoundKeyType *GetHighKey() const;
+  // * GetLowKey() - Returns low key
+  inline BoundKeyType *GetLowKey() const { return low_key_p; }
+
+  // * GetBase() - Returns the address of the base node
+  template <typename DeltaChainType>
+  inline ExtendedNodeBase<KeyType, DeltaChainType> *GetBase() {
+    return reinterpret_cast<ExtendedNodeBase<KeyType, DeltaChainType> *>(
+      reinterpret_cast<char *>(GetLowKey()) - ExtendedNodeBase<KeyType, DeltaChainType>::LOW_KEY_OFFSET); 
+  }
+
+  // * KeyLargerThanNode() - Return whether a given key is larger than
+  //                         all keys in the node
+  inline bool KeyLargerThanNode(const KeyType &key) {
+    BoundKeyType *high_key_p = GetHighKey();
+    return high_key_p->IsInf() == false && *high_key_p <= key;
+  }
+
+  // * KeySmallerThanNode() - Returns whether the given key is smaller than
+  //                          all keys in the node
+  inline bool KeySmallerThanNode(const KeyType &key) {
+    return low_key_p->IsInf() == false && *low_key_p > key;
+  }
+
+  // * KeyInNode() - Return whether a given key is within the node's range
+  inline bool KeyInNode(const KeyType &key) { 
+    return KeyLargerThanNode(key) == false && KeySmallerThanNode(key) == false;
+  }
+
+ private:
+  // The following four are packed into a 64 bit integer
+  NodeType type;
+  // Whether the high key follows the low key in the base node
+  bool base_high_key;
+  // Height in the delta chain (0 means base node)
+  NodeHeightType height;
+  // Number of elements
+  NodeSizeType size;
+  BoundKeyType *low_key_p;
+};
+
+/*
+ * class DeltaNodeBase - Common header of delta nodes
+ * 
+ * Deltas other than split and merge do not store the high key. If the next node
+ * has the base node's high key, so does the delta, and GetHighKey() does not walk
+ */
+template <typename KeyType>
+class DeltaNodeBase : public NodeBase<KeyType> {
+ public:
+  using BaseClassType = NodeBase<KeyType>;
+  using NodeSizeType = typename BaseClassType::NodeSizeType;
+  using NodeHeightType = typename BaseClassType::NodeHeightType;
+  using BoundKeyType = typename BaseClassType::BoundKeyType;
+
+  inline BaseClassType *GetNext() const { return next_node_p; }
+
+  /*
+   * Relink() - Points a delta at another next node, as if it were constructed on it
+   *
+   * This is only valid for deltas whose CAS failed, which have never been seen by 
+   * other threads. Split and merge deltas store their own high key, and are not relinked
+   */
+  inline void Relink(BaseClassType *pnext_node_p, NodeHeightType pheight, NodeSizeType psize) {
+    assert(BaseClassType::IsSMO() == false);
+    BaseClassType::SetHeader(pheight, psize, pnext_node_p->GetLowKey(), pnext_node_p->HasBaseHighKey());
+    next_node_p = pnext_node_p;
+  }
+
+ protected:
+  // * DeltaNodeBase() - Constructor of deltas that inherit the high key of the next node
+  DeltaNodeBase(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
+                BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
+                BaseClassType *pnext_node_p) :
+    BaseClassType{ptype, pheight, psize, plow_key_p, pnext_node_p->HasBaseHighKey()},
+    next_node_p{pnext_node_p} {
+    assert(BaseClassType::IsSMO(ptype) == false);
+    assert(phigh_key_p == nullptr || phigh_key_p == pnext_node_p->GetHighKey());
+    (void)phigh_key_p;
+  }
+
+  // * DeltaNodeBase() - Constructor of split and merge deltas
+  DeltaNodeBase(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
+                BoundKeyType *plow_key_p, BaseClassType *pnext_node_p) :
+    BaseClassType{ptype, pheight, psize, plow_key_p, false},
+    next_node_p{pnext_node_p} {
+    assert(BaseClassType::IsSMO(ptype));
+  }
+
+ private:
+  BaseClassType *next_node_p;
+};
+
+// * class SMODeltaNodeBase - Header of split and merge deltas, which change the high key
+template <typename KeyType>
+class SMODeltaNodeBase : public DeltaNodeBase<KeyType> {
+ public:
+  using BaseClassType = NodeBase<KeyType>;
+  using NodeSizeType = typename BaseClassType::NodeSizeType;
+  using NodeHeightType = typename BaseClassType::NodeHeightType;
+  using BoundKeyType = typename BaseClassType::BoundKeyType;
+
+  // * GetSMOHighKey() - Returns the high key stored in the delta
+  inline BoundKeyType *GetSMOHighKey() const { return high_key_p; }
+  // * SetHighKey() - Updates the high key of the delta
+  inline void SetHighKey(BoundKeyType *phigh_key_p) { high_key_p = phigh_key_p; }
+
+ protected:
+  SMODeltaNodeBase(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
+                   BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
+                   BaseClassType *pnext_node_p) :
+    DeltaNodeBase<KeyType>{ptype, pheight, psize, plow_key_p, pnext_node_p},
+    high_key_p{phigh_key_p} {}
+
+ private:
+  BoundKeyType *high_key_p;
+};
+
+// The high key of base nodes is stored right after the low key. See ExtendedNodeBase
+template <typename KeyType>
+inline typename NodeBase<KeyType>::BoundKeyType *NodeBase<KeyType>::GetHighKey() const {
+  if(base_high_key) { return low_key_p + 1; }
+  const NodeBase *node_p = this;
+  while(node_p->IsSMO() == false) { node_p = static_cast<const DeltaNodeBase<KeyType> *>(node_p)->GetNext(); }
+  return static_cast<const SMODeltaNodeBase<KeyType> *>(node_p)->GetSMOHighKey();
+}
+
+/*
+ * class DeltaKeyFilter - Bloom-like filter of the keys of leaf insert and delete deltas
+ * 
+ * 1. Every leaf insert and delete delta stores the filter of its own key and all leaf
+ *    insert and delete keys below it in the chain. A searcher whose key is not in the 
+ *    filter goes directly to the base node
+ * 2. Split and remove deltas do not change the filter. Merge deltas make it full, because 
+ *    the base node of the chain does not cover the keys in the sibling
+ * 3. Each key sets one bit. Hash values are mixed, because std::hash of integers is 
+ *    the identity function
+ */
+template <typename KeyType>
+class DeltaKeyFilter {
+ public:
+  using FilterType = uint32_t;
+  static constexpr FilterType EMPTY = 0;
+  static constexpr FilterType FULL = ~FilterType{0};
+  // The top 5 bits of the mixed hash select one of the 32 bits
+  static constexpr int HASH_SHIFT = 59;
+
+  // * GetBit() - Returns the bit of the key
+  inline static FilterType GetBit(const KeyType &key) {
+    uint64_t hash = static_cast<uint64_t>(std::hash<KeyType>{}(key)) * 0x9E3779B97F4A7C15UL;
+    return FilterType{1} << (hash >> HASH_SHIFT);
+  }
+  // * Add() - Returns the filter with the key added
+  inline static FilterType Add(FilterType filter, const KeyType &key) { return filter | GetBit(key); }
+  // * MayContain() - Returns false if the key is definitely not in the filter
+  inline static bool MayContain(FilterType filter, const KeyType &key) { return (filter & GetBit(key)) != 0; }
+};
+
+#define LEAF_INSERT_TYPE(KeyType, ValueType) \
+  DeltaNode<KeyType, KeyType, ValueType, char[0], char[0], \
+            typename DeltaKeyFilter<KeyType>::FilterType, typename NodeBase<KeyType>::NodeSizeType>
+#define LEAF_DELETE_TYPE(KeyType, ValueType) \
+  DeltaNode<KeyType, KeyType, ValueType, char[0], char[0], \
+            typename DeltaKeyFilter<KeyType>::FilterType, typename NodeBase<KeyType>::NodeSizeType>
+#define LEAF_SPLIT_TYPE(KeyType, NodeIDType) \
+  DeltaNode<KeyType, BoundKey<KeyType>, NodeIDType, char[0], char[0], char[0], char[0], true>
+#define INNER_SPLIT_TYPE(KeyType, NodeIDType) \
+  DeltaNode<KeyType, BoundKey<KeyType>, NodeIDType, char[0], char[0], char[0], char[0], true>
+#define LEAF_MERGE_TYPE(KeyType, NodeIDType) \
+  DeltaNode<KeyType, KeyType, NodeIDType, NodeBase<KeyType> *, char[0], char[0], char[0], true>
+#define INNER_MERGE_TYPE(KeyType, NodeIDType) \
+  DeltaNode<KeyType, KeyType, NodeIDType, NodeBase<KeyType> *, char[0], char[0], char[0], true>
+#define LEAF_REMOVE_TYPE(KeyType, NodeIDType) \
+  DeltaNode<KeyType, NodeIDType, char[0], char[0], char[0], char[0], char[0]>
+#define INNER_REMOVE_TYPE(KeyType, NodeIDType) \
+  DeltaNode<KeyType, NodeIDType, char[0], char[0], char[0], char[0], char[0]>
+#define INNER_INSERT_TYPE(KeyType, NodeIDType) \
+  DeltaNode<KeyType, KeyType, NodeIDType, BoundKey<KeyType>, char[0], char[0], typename NodeBase<KeyType>::NodeSizeType>
+#define INNER_DELETE_TYPE(KeyType, NodeIDType) \
+  DeltaNode<KeyType, KeyType, NodeIDType, BoundKey<KeyType>, BoundKey<KeyType>, NodeIDType, typename NodeBase<KeyType>::NodeSizeType>
+                                     //   ^ next key         ^ prev key         ^ prev ID   ^ base offset
+
+/*
+ * class DeltaNode - Stores the delta attributes after the header
+ * 
+ * This class is heavily templatized. Different combinations of types
+ * yield different delta types:
+ * 
+ * LeafInsertType/LeafDeleteType = 
+ *   DeltaNode<KeyType, KeyType, ValueType, char[0], char[0], FilterType, NodeSizeType>
+ * LeafSplitType/InnerSplitType = 
+ *   DeltaNode<KeyType, BoundKey<KeyType>, NodeIDType, char[0], char[0], char[0], char[0], true>
+ * LeafMergeType/InnerMergeType = 
+ *   DeltaNode<KeyType, KeyType, NodeIDType, NodeBase<KeyType> *, char[0], char[0], char[0], true>
+ * LeafRemoveType/InnerRemoveType = 
+ *   DeltaNode<KeyType, NodeIDType, char[0], char[0], char[0], char[0], char[0]>
+ * InnerInsertType = 
+ *   DeltaNode<KeyType, KeyType, NodeIDType, BoundKey<KeyType>, char[0], char[0], NodeSizeType>
+ * InnerDeleteType = 
+ *   DeltaNode<KeyType, KeyType, NodeIDType, BoundKey<KeyType>, BoundKey<KeyType>, NodeIDType, NodeSizeType>
+ *
+ * HAS_HIGH_KEY selects the header that stores the high key, which is only used by
+ * split and merge deltas
+ */
+template <typename KeyType, 
+          typename T1, typename T2, typename T3, 
+          typename T4, typename T5, typename T6,
+          bool HAS_HIGH_KEY = false>
+class DeltaNode : public std::conditional<HAS_HIGH_KEY, SMODeltaNodeBase<KeyType>, DeltaNodeBase<KeyType>>::type {
+ public:
+  using HeaderType = typename std::conditional<HAS_HIGH_KEY, SMODeltaNodeBase<KeyType>, DeltaNodeBase<KeyType>>::type;
+  using BaseClassType = NodeBase<KeyType>;
+  using NodeSizeType = typename BaseClassType::NodeSizeType;
+  using NodeHeightType = typename BaseClassType::NodeHeightType;
+  using BoundKeyType = typename BaseClassType::BoundKeyType;
+
+  //* DeltaNode() - Constructors
+  DeltaNode(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
+            BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
+            BaseClassType *pnext_node_p, 
+            const T1 &pt1) :
+    HeaderType{ptype, pheight, psize, plow_key_p, phigh_key_p, pnext_node_p},
+    t1{pt1} {}
+  
+  DeltaNode(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
+            BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
+            BaseClassType *pnext_node_p, 
+            const T1 &pt1, const T2 &pt2) :
+    HeaderType{ptype, pheight, psize, plow_key_p, phigh_key_p, pnext_node_p},
+    t1{pt1}, t2{pt2} {}
+
+  DeltaNode(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
+            BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
+            BaseClassType *pnext_node_p, 
+            const T1 &pt1, const T2 &pt2, const T3 &pt3) :
+    HeaderType{ptype, pheight, psize, plow_key_p, phigh_key_p, pnext_node_p},
+    t1{pt1}, t2{pt2}, t3{pt3} {}
+
+  DeltaNode(NodeType ptype, NodeHeightType pheight, NodeSizeType psize,
+            BoundKeyType *plow_key_p, BoundKeyType *phigh_key_p,
+            BaseClassType *pnext_node_p, 
+            const T1 &pt1, const T2 &pt2, const T3 &pt3,
+            const T4 &pt4, const T5 &pt5) :
+    HeaderType{ptype, pheight, psize, plow_key_p, phigh_key_p, pnext_node_p},
+    t1{pt1}, t2{pt2}, t3{pt3}, t4{pt4}, t5{pt5} {}
+  
+  // The following series of functions defines methods for retriving
+  // delta attributes according to delta type
+  inline T1 &GetInsertKey() { return t1; }
+  inline T1 &GetDeleteKey() { return t1; }
+  inline KeyType &GetSplitKey() { return t1.key; }
+  inline T1 &GetMergeKey() { return t1; }
+  inline T1 &GetRemoveNodeID() { return t1; }
+  // For split deltas, the high key points to a field inside the split delta
+  // So we must set the high key after the delta has been constructed
+  inline void SetSplitHighKey() { HeaderType::SetHighKey(&t1); }
+  
+  inline T2 &GetInsertValue() { return t2; }
+  inline T2 &GetDeleteValue() { return t2; }
+  inline T2 &GetInsertNodeID() { return t2; }
+  inline T2 &GetDeleteNodeID() { return t2; }
+  inline T2 &GetSplitNodeID() { return t2; }
+  inline T2 &GetMergeNodeID() { return t2; }
+
+  inline T3 &GetMergeSibling() { return t3; }
+  inline T3 &GetNextKey() { return t3; }
+
+  inline T4 &GetPrevKey() { return t4; }
+  inline T5 &GetPrevNodeID() { return t5; }
+  // Leaf insert and delete deltas store the key filter of the chain. See DeltaKeyFilter
+  inline T5 &GetKeyFilter() { return t5; }
+
+  // Insert and delete deltas record the result of Search() on the key in the base node
+  // of the chain, or INVALID_OFFSET. Searchers use it to narrow the base node search
+  inline T6 &GetBaseOffset() { return t6; }
+  
+  static constexpr size_t T1_OFFSET = offsetof(DeltaNode, t1);
+  static constexpr size_t T2_OFFSET = offsetof(DeltaNode, t2);
+  static constexpr size_t T1_T2_OFFSET = T2_OFFSET - T1_OFFSET;
+
+  // * GetT2FromT1() - Returns the T2 address given T1's address
+  static T2 *GetT2FromT1(T1 *p) { 
+    return reinterpret_cast<T2 *>(reinterpret_cast<char *>(p) + T1_T2_OFFSET);
+  }
+ private:
+  // Delta node elements
+  T1 t1; T2 t2; T3 t3; T4 t4; T5 t5; T6 t6;
+};
+
+// * class DeltaType - Declares the full type of deltas
+template <typename KeyType, typename ValueType, typename NodeIDType>
+class Delta {
+ public:
+  using LeafInsertType = LEAF_INSERT_TYPE(KeyType, ValueType);
+  using LeafDeleteType = LEAF_DELETE_TYPE(KeyType, ValueType);
+  using LeafSplitType = LEAF_SPLIT_TYPE(KeyType, NodeIDType);
+  using LeafMergeType = LEAF_MERGE_TYPE(KeyType, NodeIDType);
+  using LeafRemoveType = LEAF_REMOVE_TYPE(KeyType, NodeIDType);
+
+  using InnerInsertType = INNER_INSERT_TYPE(KeyType, NodeIDType);
+  using InnerDeleteType = INNER_DELETE_TYPE(KeyType, NodeIDType);
+  using InnerSplitType = INNER_SPLIT_TYPE(KeyType, NodeIDType);
+  using InnerMergeType = INNER_MERGE_TYPE(KeyType, NodeIDType);
+  using InnerRemoveType = INNER_REMOVE_TYPE(KeyType, NodeIDType);
+
+  // Make sure we can always obtain T2 from T1's address
+  static_assert(LeafInsertType::T1_T2_OFFSET == LeafDeleteType::T1_T2_OFFSET, 
+                "Inconsistent layout of KeyType and ValueType between leaf insert and delete");
+  static_assert(InnerInsertType::T1_T2_OFFSET == InnerDeleteType::T1_T2_OFFSET, 
+                "Inconsistent layout of KeyType and NodeIDType between inner insert and delete");
+};
+
+// * class ExtendedNodeBase - Type irrelevant part of the base node
+template <typename KeyType, typename DeltaChainType>
+class ExtendedNodeBase : public NodeBase<KeyType> {
+ public:
+  using BaseClassType = NodeBase<KeyType>;
+  using NodeSizeType = typename BaseClassType::NodeSizeType;
+  using NodeHeightType = typename BaseClassType::NodeHeightType;
+  using BoundKeyType = typename BaseClassType::BoundKeyType;
+
+  // This is the offset of the low key from the beginning of the object
+  static constexpr size_t LOW_KEY_OFFSET = offsetof(ExtendedNodeBase, low_key_addr);
+
+  // * class ImageHeaderType - Pointer-free header of base node images in snapshots
+  class ImageHeaderType {
+   public:
+    NodeType type;
+    NodeSizeType size;
+    BoundKeyType low_key;
+    BoundKeyType high_key;
+  };
+
+  // * ExtendedNodeBase() - Constructor
+  ExtendedNodeBase(NodeType ptype, 
+                   NodeHeightType pheight,
+                   NodeSizeType psize,
+                   const BoundKeyType &plow_key,
+                   const BoundKeyType &phigh_key) : 
+    BaseClassType{ptype, pheight, psize, &low_key, true},
+    low_key{plow_key},
+    high_key{phigh_key},
+    delta_chain{} {
+    static_assert(offsetof(ExtendedNodeBase, high_key) == LOW_KEY_OFFSET + sizeof(BoundKeyType), 
+                  "The high key must follow the low key");
+  }
+
+  // * AllocateDelta() - Wrapping around the delta chain
+  template <typename AllocDeltaNodeType, typename ...Args>
+  inline AllocDeltaNodeType *AllocateDelta(Args &&...args) {
+    return delta_chain.template AllocateDelta<AllocDeltaNodeType>(args...);
+  }
+
+  // * DestroyDelta() - Wrapping around the delta chain
+  template <typename AllocDeltaNodeType>
+  inline void DestroyDelta(AllocDeltaNodeType *node_p) {
+    return delta_chain.template DestroyDelta<AllocDeltaNodeType>(node_p);
+  }
+
+  // * GetDeltaChain() - Returns the delta chain instance
+  inline DeltaChainType *GetDeltaChain() { return &delta_chain; }
+
+  // This data member does not space but it has the same address as the low key
+  char low_key_addr[0];
+ private:
+  // Instances of low and high keys
+  BoundKeyType low_key;
+  BoundKeyType high_key;
+  DeltaChainType delta_chain;
+};
+
+/*
+ * class ArraySearch - Finds the upper bound of a key in a sorted key array
+ * 
+ * The generic version is std::upper_bound. Integer keys have specializations below
+ * that use SIMD instructions if the compiler enables them (SIMD=AVX2 or SIMD=AVX512)
+ */
+template <typename KeyType>
+class ArraySearch {
+ public:
+  // * UpperBound() - Returns the first element that is larger than the key, or last if none
+  inline static KeyType *UpperBound(KeyType *first, KeyType *last, const KeyType &key) {
+    return std::upper_bound(first, last, key);
+  }
+};
+
+#ifdef __AVX2__
+/*
+ * class SimdArraySearch - Hybrid binary and SIMD linear search on integer arrays
+ * 
+ * 1. Binary search narrows the range down to LINEAR_THRESHOLD elements. Small nodes
+ *    skip this step entirely
+ * 2. The remaining range is scanned LANE_NUM elements at a time. Since the array is
+ *    sorted, elements larger than the key in a vector form a suffix, and the number
+ *    of them gives the position of the upper bound
+ * 3. SimdOpsType defines the vector width and the comparison of an element type
+ */
+template <typename KeyType, typename SimdOpsType>
+class SimdArraySearch {
+ public:
+  static constexpr size_t LANE_NUM = SimdOpsType::LANE_NUM;
+  static constexpr size_t LINEAR_THRESHOLD = LANE_NUM * 4;
+
+  // * UpperBound() - Returns the first element that is larger than the key, or last if none
+  inline static KeyType *UpperBound(KeyType *first, KeyType *last, const KeyType &key) {
+    while(static_cast<size_t>(last - first) > LINEAR_THRESHOLD) {
+      KeyType *mid = first + (last - first) / 2;
+      if(key < *mid) { last = mid; } else { first = mid + 1; }
+    }
+
+    typename SimdOpsType::VectorType key_v = SimdOpsType::Broadcast(key);
+    while(static_cast<size_t>(last - first) >= LANE_NUM) {
+      size_t greater_num = SimdOpsType::CountGreater(first, key_v);
+      if(greater_num != 0) { return first + (LANE_NUM - greater_num); }
+      first += LANE_NUM;
+    }
+
+    while(first != last && !(key < *first)) { first++; }
+    return first;
+  }
+};
+
+#ifdef __AVX512F__
+// * class SimdInt32Ops * SimdInt64Ops * SimdUInt64Ops - AVX-512 comparisons
+class SimdInt32Ops {
+ public:
+  using VectorType = __m512i;
+  static constexpr size_t LANE_NUM = 16;
+  inline static VectorType Broadcast(int32_t key) { return _mm512_set1_epi32(key); }
+  inline static size_t CountGreater(const int32_t *p, VectorType key_v) {
+    return __builtin_popcount(_mm512_cmpgt_epi32_mask(_mm512_loadu_si512(p), key_v));
+  }
+};
+
+class SimdInt64Ops {
+ public:
+  using VectorType = __m512i;
+  static constexpr size_t LANE_NUM = 8;
+  inline static VectorType Broadcast(int64_t key) { return _mm512_set1_epi64(key); }
+  inline static size_t CountGreater(const int64_t *p, VectorType key_v) {
+    return __builtin_popcount(_mm512_cmpgt_epi64_mask(_mm512_loadu_si512(p), key_v));
+  }
+};
+
+class SimdUInt64Ops {
+ public:
+  using VectorType = __m512i;
+  static constexpr size_t LANE_NUM = 8;
+  inline static VectorType Broadcast(uint64_t key) { return _mm512_set1_epi64(static_cast<int64_t>(key)); }
+  inline static size_t CountGreater(const uint64_t *p, VectorType key_v) {
+    return __builtin_popcount(_mm512_cmpgt_epu64_mask(_mm512_loadu_si512(p), key_v));
+  }
+};
+#else
+// * class SimdInt32Ops * SimdInt64Ops * SimdUInt64Ops - AVX2 comparisons
+class SimdInt32Ops {
+ public:
+  using VectorType = __m256i;
+  static constexpr size_t LANE_NUM = 8;
+  inline static VectorType Broadcast(int32_t key) { return _mm256_set1_epi32(key); }
+  inline static size_t CountGreater(const int32_t *p, VectorType key_v) {
+    __m256i cmp_v = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), key_v);
+    return __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(cmp_v)));
+  }
+};
+
+class SimdInt64Ops {
+ public:
+  using VectorType = __m256i;
+  static constexpr size_t LANE_NUM = 4;
+  inline static VectorType Broadcast(int64_t key) { return _mm256_set1_epi64x(key); }
+  inline static size_t CountGreater(const int64_t *p, VectorType key_v) {
+    __m256i cmp_v = _mm256_cmpgt_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), key_v);
+    return __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(cmp_v)));
+  }
+};
+
+// AVX2 only has signed comparison. Flipping the sign bit maps unsigned order to signed order
+class SimdUInt64Ops {
+ public:
+  using VectorType = __m256i;
+  static constexpr size_t LANE_NUM = 4;
+  inline static VectorType SignBit() { return _mm256_set1_epi64x(static_cast<int64_t>(0x8000000000000000UL)); }
+  inline static VectorType Broadcast(uint64_t key) { 
+    return _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(key)), SignBit()); 
+  }
+  inline static size_t CountGreater(const uint64_t *p, VectorType key_v) {
+    __m256i data_v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), SignBit());
+    return __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(data_v, key_v))));
+  }
+};
+#endif
+
+template <>
+class ArraySearch<int32_t> : public SimdArraySearch<int32_t, SimdInt32Ops> {};
+template <>
+class ArraySearch<int64_t> : public SimdArraySearch<int64_t, SimdInt64Ops> {};
+template <>
+class ArraySearch<uint64_t> : public SimdArraySearch<uint64_t, SimdUInt64Ops> {};
+#endif
+
+/*
+ * class DefaultBaseNode - This class defines the way key and values are stored
+ *                         in the base node
+ * 
+ * 1. Delta allocation is defined in delta chain class
+ * 2. Node consolidation is defined in node consolidator class
+ * 3. Only unique key is supported; Non-unique key must be implemented
+ *    outside the index
+ * 4. The node should not expose its storage of keys and values to the external
+ *    That requires that no method for accessing internal storage other than
+ *    individual keys and values are provided. Iterators are not available.
+ *    Search routine should only return an index rather than raw pointer
+ * 5. Non-unique key support should be expposed by a constexpr var
+ *    and the caller is responsible for checking consistency between 
+ *    feature supports
+ */
+template <typename _KeyType, 
+          typename _ValueType, 
+          typename _DeltaChainType>
+class DefaultBaseNode : public ExtendedNodeBase<_KeyType, _DeltaChainType>, public UniqueKeyBase {
+ public:
+  using KeyType = _KeyType;
+  using ValueType = _ValueType;
+  using DeltaChainType = _DeltaChainType;
+  using BaseClassType = ExtendedNodeBase<KeyType, DeltaChainType>;
+  using BaseBaseClassType = typename BaseClassType::BaseClassType;
+  using NodeSizeType = typename BaseBaseClassType::NodeSizeType;
+  using NodeHeightType = typename BaseBaseClassType::NodeHeightType;
+  using BoundKeyType = typename BaseBaseClassType::BoundKeyType;
+  using ImageHeaderType = typename BaseClassType::ImageHeaderType;
+  // KeyAt() returns this type, and scan iterators return keys as ConstKeyRefType
+  using KeyRefType = KeyType &;
+  using ConstKeyRefType = const KeyType &;
+ private:
+  // * DefaultBaseNode() - Private Constructor
+  DefaultBaseNode(NodeType ptype, 
+                  NodeHeightType pheight,
+                  NodeSizeType psize,
+                  const BoundKeyType &plow_key,
+                  const BoundKeyType &phigh_key) :
+    BaseClassType{ptype, pheight, psize, plow_key, phigh_key} {
+    return;
+  } 
+  
+  // * ~DefaultBaseNode() - Private Destructor
+  ~DefaultBaseNode() {}
+
+ public:
+  /*
+   * Get() - Returns a base node with extended storage for key and value pairs
+   * 
+   * 1. The size of the node is determined at run time
+   * 2. We allocate the sizeof() the class plus the extra storage for key and 
+   *    values
+   */
+  static DefaultBaseNode *Get(NodeType ptype, 
+                              NodeSizeType psize,
+                              const BoundKeyType &plow_key,
+                              const BoundKeyType &phigh_key) {
+    assert(ptype == NodeType::InnerBase || ptype == NodeType::LeafBase);
+    // Size for key value pairs and size for the structure itself
+    size_t extra_size = size_t{psize} * (sizeof(KeyType) + sizeof(ValueType));
+    size_t total_size = extra_size + sizeof(DefaultBaseNode);
+
+    void *p = new unsigned char[total_size];
+    DefaultBaseNode *node_p = \
+      static_cast<DefaultBaseNode *>(
+        new (p) DefaultBaseNode{ptype, NodeHeightType{0}, psize, plow_key, phigh_key});
+    
+    // Call constructor on each key and value element using placement new
+    for(NodeSizeType i = 0;i < psize;i++) {
+      new (&node_p->KeyAt(i)) KeyType{};
+      new (&node_p->ValueAt(i)) ValueType{};
+    }
+    
+    return node_p;
+  }
+
+  /*
+   * Destroy() - Frees the memory and calls destructor
+   * 
+   * 1. The delta chain's destructor will be called in this case. Make sure
+   *    all delta chain elements have been destroyed before this is called
+   */
+  static void Destroy(DefaultBaseNode *node_p) {
+    node_p->~DefaultBaseNode();
+    delete[] reinterpret_cast<unsigned char *>(node_p);
+    return;
+  }
+
+  // * KeyAt() - Access key on a particular index
+  inline KeyType &KeyAt(int index) { return KeyBegin()[index]; }
+  // * ValueAt() - Access value on a particular index
+  inline ValueType &ValueAt(int index) {
+    assert(static_cast<NodeSizeType>(index) < BaseBaseClassType::GetSize());
+    return ValueBegin()[index];
+  }
+  // * GetAllocatedSize() - Returns the number of bytes allocated for the node
+  inline size_t GetAllocatedSize() const { 
+    return sizeof(DefaultBaseNode) + size_t{BaseBaseClassType::GetSize()} * (sizeof(KeyType) + sizeof(ValueType));
+  }
+
+  /*
+   * StoreImage() - Writes the node into GetAllocatedSize() bytes as a snapshot image
+   * 
+   * 1. Keys and values are copied as they are laid out after KeyBegin(). The header is 
+   *    replaced by ImageHeaderType, and the rest of it is zeroed, so there is no pointer
+   * 2. Both the key and the value type must be trivially copyable
+   */
+  void StoreImage(unsigned char *p) {
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value, 
+                  "Only trivially copyable keys and values could be stored in snapshots");
+    const size_t header_size = GetHeaderSize();
+    std::memset(p, 0, header_size);
+    new (p) ImageHeaderType{BaseBaseClassType::GetType(), BaseBaseClassType::GetSize(), 
+                            *BaseBaseClassType::GetLowKey(), *BaseBaseClassType::GetHighKey()};
+    std::memcpy(p + header_size, KeyBegin(), GetAllocatedSize() - header_size);
+  }
+
+  /*
+   * LoadImage() - Constructs a node in place on an image written by StoreImage()
+   * 
+   * 1. Only the header is written. Keys and values are used where they are
+   * 2. Returns nullptr if the image is not a base node or has more than limit bytes
+   * 3. The node must not be passed to Destroy(), because the memory belongs to the image
+   */
+  static DefaultBaseNode *LoadImage(unsigned char *p, size_t limit) {
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value, 
+                  "Only trivially copyable keys and values could be loaded from snapshots");
+    if(limit < sizeof(DefaultBaseNode)) { return nullptr; }
+    ImageHeaderType header = *reinterpret_cast<ImageHeaderType *>(p);
+    if(header.type != NodeType::LeafBase && header.type != NodeType::InnerBase) { return nullptr; }
+    if((limit - sizeof(DefaultBaseNode)) / (sizeof(KeyType) + sizeof(ValueType)) < size_t{header.size}) { return nullptr; }
+    return new (p) DefaultBaseNode{header.type, NodeHeightType{0}, header.size, header.low_key, header.high_key};
+  }
+
+  /*
+   * Search() - Find the lower bound item of a search key
+   * 
+   * The lower bound item I is defined as the largest I such that key >= I
+   * We implement this using std::upper_bound and then decrement by 1. 
+   * std::upper_bound finds the smallest I' such that key < I'. If no such
+   * I' exists, which means the key is >= all items, it returns end()
+   * ArraySearch uses SIMD search instead of std::upper_bound for integer keys
+   */
+  int Search(const KeyType &key) {
+    assert(BaseBaseClassType::KeyInNode(key));
+    // Note that the first key do not need to be searched for both leaf and 
+    // inner nodes
+    int ret = (ArraySearch<KeyType>::UpperBound(KeyBegin() + 1, KeyEnd(), key) - KeyBegin()) - 1;
+    assert(ret >= 0 && ret < static_cast<int>(BaseBaseClassType::GetSize()));
+    return ret;
+  }
+
+  // * Search() - Like Search(), but the caller knows the result is within [first, last]
+  int Search(const KeyType &key, NodeSizeType first, NodeSizeType last) {
+    assert(first <= last && last < BaseBaseClassType::GetSize());
+    int ret = (ArraySearch<KeyType>::UpperBound(KeyBegin() + first + 1, KeyBegin() + last + 1, key) - KeyBegin()) - 1;
+    assert(ret == Search(key));
+    return ret;
+  }
+
+  // * PointSearch() - Returns the index if exact match is found or -1 otherwise
+  int PointSearch(const KeyType &key) {
+    int index = Search(key);
+    return KeyAt(index) == key ? index : -1;
+  }
+
+  /*
+   * Split() - Split the node into two smaller halves
+   * 
+   * 1. Only unique key split is supported. For non-unique keys please override
+   *    this method in a derived class
+   * 2. The split point is chosen as the middle of the node. The current node
+   *    is not changed, and we copy the upper half of the content into another
+   *    node and return it
+   * 3. The node size must be greater than 1. Otherwise assertion fails
+   * 4. The low key of the upper half is set to the split key. The high key
+   *    of the upper is the same as the current node. The current node's high
+   *    key should be updated by the split delta
+   */
+  DefaultBaseNode *Split() {
+    NodeSizeType old_size = BaseBaseClassType::GetSize();
+    assert(old_size > 1);
+    // The index of the split key which is also the low key of the new node
+    NodeSizeType pivot = old_size / 2;
+    NodeSizeType new_size = old_size - pivot;
+    // Note that low key for new node is always not inf
+    DefaultBaseNode *node_p = \
+      Get(BaseBaseClassType::GetType(), new_size, 
+          {KeyAt(static_cast<int>(pivot)), false}, *BaseBaseClassType::GetHighKey());
+    // Copy the upper half of the current node into the new node
+    std::copy(KeyBegin() + pivot, KeyEnd(), node_p->KeyBegin());
+    std::copy(ValueBegin() + pivot, ValueEnd(), node_p->ValueBegin());
+
+    return node_p;
+  }
+ public:
+  // * GetHeaderSize() - Returns the offset of keys from the beginning of the node
+  inline static size_t GetHeaderSize() { return offsetof(DefaultBaseNode, key_begin); }
+  
+ private:
+  // * KeyBegin() - Return the first pointer for values
+  inline KeyType *KeyBegin() { return key_begin; }
+  // * KeyEnd() - Return the first out-of-bound pointer for keys
+  inline KeyType *KeyEnd() { return key_begin + BaseBaseClassType::GetSize(); }
+  // * ValueBegin() - Return the first pointer for values
+  inline ValueType *ValueBegin() { return reinterpret_cast<ValueType *>(KeyEnd()); }
+  // * ValueEnd() - Return the first out-of-bound pointer for values
+  inline ValueType *ValueEnd() { return ValueBegin() + BaseBaseClassType::GetSize(); }
+
+  // This member does not take any storage, but let us obtain the address
+  // of the memory address after all class members
+  KeyType key_begin[0];
+};
+
+/*
+ * class DefaultVarKeyBaseNode - Base node for variable-length keys with prefix compression
+ * 
+ * 1. KeyType must be a byte string type like std::string, i.e. it has data(), size() and
+ *    a (const char *, size_t) constructor. Keys are ordered as by std::string::compare()
+ * 2. All keys in [low key, high key) start with the common prefix of the two bounds, so the
+ *    prefix is stored once in the node and stripped from the keys. It is empty if either
+ *    bound is Inf. BaseNodeBuilder narrowing the high key later keeps the prefix valid
+ * 3. Each slot holds the first HEAD_SIZE bytes of the suffix as a big-endian integer, which
+ *    orders the same way as the bytes. The rest of the suffix is in the key heap. Searches
+ *    compare heads, and only read the heap if two heads are equal
+ * 4. Slot 0 stores the full key without stripping, because inner nodes keep an unused
+ *    key there which may be out of the node's range
+ * 5. Key lengths are not known in Get(), so the key heap is allocated separately and grows
+ *    as keys are written. Base nodes are read-only after they are published
+ * 6. KeyAt() returns a KeyRef, which compares with and converts to KeyType, and writes the
+ *    key on assignment. Scan iterators return copies of keys
+ */
+template <typename _KeyType, 
+          typename _ValueType, 
+          typename _DeltaChainType>
+class DefaultVarKeyBaseNode : public ExtendedNodeBase<_KeyType, _DeltaChainType>, public UniqueKeyBase {
+ public:
+  using KeyType = _KeyType;
+  using ValueType = _ValueType;
+  using DeltaChainType = _DeltaChainType;
+  using BaseClassType = ExtendedNodeBase<KeyType, DeltaChainType>;
+  using BaseBaseClassType = typename BaseClassType::BaseClassType;
+  using NodeSizeType = typename BaseBaseClassType::NodeSizeType;
+  using NodeHeightType = typename BaseBaseClassType::NodeHeightType;
+  using BoundKeyType = typename BaseBaseClassType::BoundKeyType;
+  class KeyRef;
+  using KeyRefType = KeyRef;
+  using ConstKeyRefType = KeyType;
+
+  // Number of suffix bytes in the head of a slot
+  static constexpr size_t HEAD_SIZE = sizeof(uint64_t);
+  // Initial key heap size per slot. The heap doubles when it is full
+  static constexpr size_t HEAP_BYTES_PER_KEY = 16;
+
+  // * class KeyRef - Refers to the key in a slot
+  class KeyRef {
+   public:
+    KeyRef(DefaultVarKeyBaseNode *pnode_p, int pindex) : node_p{pnode_p}, index{pindex} {}
+    KeyRef(const KeyRef &) = default;
+    // * operator KeyType() - Returns a copy of the key
+    inline operator KeyType() const { return node_p->CopyKey(index); }
+    // * operator=() - Writes the key into the slot
+    inline KeyRef &operator=(const KeyType &key) { node_p->WriteKey(index, key); return *this; }
+    inline KeyRef &operator=(const KeyRef &other) { return *this = other.node_p->CopyKey(other.index); }
+    // * Compare() - Returns negative, zero or positive if the slot is <, == or > the key
+    inline int Compare(const KeyType &key) const { return node_p->CompareKey(index, key); }
+
+    friend inline bool operator<(const KeyRef &a, const KeyType &b) { return a.Compare(b) < 0; }
+    friend inline bool operator>(const KeyRef &a, const KeyType &b) { return a.Compare(b) > 0; }
+    friend inline bool operator==(const KeyRef &a, const KeyType &b) { return a.Compare(b) == 0; }
+    friend inline bool operator!=(const KeyRef &a, const KeyType &b) { return a.Compare(b) != 0; }
+    friend inline bool operator<=(const KeyRef &a, const KeyType &b) { return a.Compare(b) <= 0; }
+    friend inline bool operator>=(const KeyRef &a, const KeyType &b) { return a.Compare(b) >= 0; }
+    friend inline bool operator<(const KeyType &a, const KeyRef &b) { return b.Compare(a) > 0; }
+    friend inline bool operator>(const KeyType &a, const KeyRef &b) { return b.Compare(a) < 0; }
+    friend inline bool operator==(const KeyType &a, const KeyRef &b) { return b.Compare(a) == 0; }
+    friend inline bool operator!=(const KeyType &a, const KeyRef &b) { return b.Compare(a) != 0; }
+    friend inline bool operator<=(const KeyType &a, const KeyRef &b) { return b.Compare(a) >= 0; }
+    friend inline bool operator>=(const KeyType &a, const KeyRef &b) { return b.Compare(a) <= 0; }
+   private:
+    DefaultVarKeyBaseNode *node_p;
+    int index;
+  };
+
+ private:
+  // * class Slot - Head of the suffix, and the offset and length of the suffix in the key heap
+  class Slot {
+   public:
+    uint64_t head;
+    uint32_t offset;
+    uint32_t length;
+  };
+  static_assert(alignof(ValueType) <= alignof(Slot), "Values must not need a larger alignment than slots");
+
+  // * DefaultVarKeyBaseNode() - Private Constructor
+  DefaultVarKeyBaseNode(NodeType ptype, 
+                        NodeHeightType pheight,
+                        NodeSizeType psize,
+                        const BoundKeyType &plow_key,
+                        const BoundKeyType &phigh_key) :
+    BaseClassType{ptype, pheight, psize, plow_key, phigh_key},
+    prefix_length{0}, heap_size{0}, heap_capacity{0}, heap_p{nullptr} {
+    return;
+  } 
+  
+  // * ~DefaultVarKeyBaseNode() - Private Destructor
+  ~DefaultVarKeyBaseNode() { delete[] heap_p; }
+
+ public:
+  /*
+   * Get() - Returns a base node with slots and values
+   * 
+   * 1. The shared prefix is computed from the low and high keys, and is copied to the
+   *    beginning of the key heap
+   * 2. Slots are initialized as empty keys
+   */
+  static DefaultVarKeyBaseNode *Get(NodeType ptype, 
+                                    NodeSizeType psize,
+                                    const BoundKeyType &plow_key,
+                                    const BoundKeyType &phigh_key) {
+    assert(ptype == NodeType::InnerBase || ptype == NodeType::LeafBase);
+    size_t extra_size = size_t{psize} * (sizeof(Slot) + sizeof(ValueType));
+    size_t total_size = extra_size + sizeof(DefaultVarKeyBaseNode);
+
+    void *p = new unsigned char[total_size];
+    DefaultVarKeyBaseNode *node_p = \
+      static_cast<DefaultVarKeyBaseNode *>(
+        new (p) DefaultVarKeyBaseNode{ptype, NodeHeightType{0}, psize, plow_key, phigh_key});
+    
+    for(NodeSizeType i = 0;i < psize;i++) {
+      new (&node_p->SlotAt(i)) Slot{0, 0, 0};
+      new (&node_p->ValueAt(i)) ValueType{};
+    }
+
+    if(!plow_key.IsInf() && !phigh_key.IsInf()) {
+      const KeyType &low_key = plow_key.key, &high_key = phigh_key.key;
+      size_t length = std::min(low_key.size(), high_key.size());
+      while(node_p->prefix_length < length && 
+            low_key.data()[node_p->prefix_length] == high_key.data()[node_p->prefix_length]) {
+        node_p->prefix_length++;
+      }
+    }
+    node_p->Reserve(node_p->prefix_length + size_t{psize} * HEAP_BYTES_PER_KEY);
+    if(node_p->prefix_length != 0) {
+      std::memcpy(node_p->heap_p, plow_key.key.data(), node_p->prefix_length);
+      node_p->heap_size = node_p->prefix_length;
+    }
+    
+    return node_p;
+  }
+
+  /*
+   * Destroy() - Frees the memory and calls destructor
+   * 
+   * 1. The delta chain's destructor will be called in this case. Make sure
+   *    all delta chain elements have been destroyed before this is called
+   */
+  static void Destroy(DefaultVarKeyBaseNode *node_p) {
+    for(NodeSizeType i = 0;i < node_p->GetSize();i++) { node_p->ValueAt(i).~ValueType(); }
+    node_p->~DefaultVarKeyBaseNode();
+    delete[] reinterpret_cast<unsigned char *>(node_p);
+    return;
+  }
+
+  // * KeyAt() - Access key on a particular index
+  inline KeyRef KeyAt(int index) { 
+    assert(static_cast<NodeSizeType>(index) < BaseBaseClassType::GetSize());
+    return KeyRef{this, index};
+  }
+  // * ValueAt() - Access value on a particular index
+  inline ValueType &ValueAt(int index) {
+    assert(static_cast<NodeSizeType>(index) < BaseBaseClassType::GetSize());
+    return ValueBegin()[index];
+  }
+  // * GetPrefixLength() - Returns the number of bytes stripped from keys other than the first
+  inline size_t GetPrefixLength() const { return prefix_length; }
+  // * GetAllocatedSize() - Returns the number of bytes allocated for the node and the key heap
+  inline size_t GetAllocatedSize() const { 
+    return sizeof(DefaultVarKeyBaseNode) + size_t{BaseBaseClassType::GetSize()} * (sizeof(Slot) + sizeof(ValueType)) + heap_capacity;
+  }
+
+  /*
+   * Search() - Find the lower bound item of a search key
+   * 
+   * Like DefaultBaseNode::Search(), this is the upper bound minus 1, and the first
+   * key is skipped. The key is in the node, so it starts with the prefix
+   */
+  int Search(const KeyType &key) { return Search(key, 0, BaseBaseClassType::GetSize() - 1); }
+  // * Search() - Like Search(), but the caller knows the result is within [first, last]
+  int Search(const KeyType &key, NodeSizeType first, NodeSizeType last) {
+    assert(BaseBaseClassType::KeyInNode(key));
+    assert(key.size() >= prefix_length && std::memcmp(key.data(), heap_p, prefix_length) == 0);
+    assert(first <= last && last < BaseBaseClassType::GetSize());
+    const char *data = key.data() + prefix_length;
+    size_t length = key.size() - prefix_length;
+    uint64_t head = GetHead(data, length);
+    int low = static_cast<int>(first) + 1, high = static_cast<int>(last) + 1;
+    while(low < high) {
+      int mid = (low + high) / 2;
+      if(CompareSuffix(SlotAt(mid), head, data, length) <= 0) { low = mid + 1; }
+      else { high = mid; }
+    }
+    return low - 1;
+  }
+
+  // * PointSearch() - Returns the index if exact match is found or -1 otherwise
+  int PointSearch(const KeyType &key) {
+    int index = Search(key);
+    return KeyAt(index) == key ? index : -1;
+  }
+
+  /*
+   * Split() - Split the node into two smaller halves
+   * 
+   * This is the same as DefaultBaseNode::Split(). Keys are copied one by one, since
+   * the upper half may have a longer prefix
+   */
+  DefaultVarKeyBaseNode *Split() {
+    NodeSizeType old_size = BaseBaseClassType::GetSize();
+    assert(old_size > 1);
+    NodeSizeType pivot = old_size / 2;
+    NodeSizeType new_size = old_size - pivot;
+    DefaultVarKeyBaseNode *node_p = \
+      Get(BaseBaseClassType::GetType(), new_size, 
+          {CopyKey(static_cast<int>(pivot)), false}, *BaseBaseClassType::GetHighKey());
+    for(NodeSizeType i = pivot;i < old_size;i++) {
+      node_p->WriteKey(static_cast<int>(i - pivot), CopyKey(static_cast<int>(i)));
+      node_p->ValueAt(static_cast<int>(i - pivot)) = ValueAt(static_cast<int>(i));
+    }
+
+    return node_p;
+  }
+
+ private:
+  // * SlotAt() - Access a slot on a particular index
+  inline Slot &SlotAt(int index) { return reinterpret_cast<Slot *>(slot_begin)[index]; }
+  // * ValueBegin() - Return the first pointer for values
+  inline ValueType *ValueBegin() { 
+    return reinterpret_cast<ValueType *>(slot_begin + sizeof(Slot) * BaseBaseClassType::GetSize()); 
+  }
+  // * GetSkip() - Returns the number of prefix bytes not stored in a slot
+  inline size_t GetSkip(int index) const { return index == 0 ? 0 : prefix_length; }
+
+  // * GetHead() - Returns the first HEAD_SIZE bytes as a big-endian integer, padded with zeros
+  inline static uint64_t GetHead(const char *data, size_t length) {
+    uint64_t head = 0;
+    for(size_t i = 0;i < HEAD_SIZE;i++) {
+      head = (head << 8) | (i < length ? static_cast<unsigned char>(data[i]) : 0);
+    }
+    return head;
+  }
+
+  /*
+   * CompareSuffix() - Compares a slot with a suffix whose head is given
+   * 
+   * If the heads are equal and either suffix fits in the head, the shorter one is a
+   * prefix of the other, because the head is padded with zeros
+   */
+  inline int CompareSuffix(const Slot &slot, uint64_t head, const char *data, size_t length) const {
+    if(slot.head != head) { return slot.head < head ? -1 : 1; }
+    size_t min_length = std::min(size_t{slot.length}, length);
+    if(min_length > HEAD_SIZE) {
+      int ret = std::memcmp(heap_p + slot.offset, data + HEAD_SIZE, min_length - HEAD_SIZE);
+      if(ret != 0) { return ret; }
+    }
+    return slot.length < length ? -1 : (slot.length > length ? 1 : 0);
+  }
+
+  // * CompareKey() - Compares the key in a slot with any key
+  int CompareKey(int index, const KeyType &key) {
+    const char *data = key.data();
+    size_t length = key.size();
+    size_t skip = GetSkip(index);
+    if(skip != 0) {
+      int ret = std::memcmp(heap_p, data, std::min(skip, length));
+      if(ret != 0) { return ret; }
+      else if(length < skip) { return 1; }
+      data += skip;
+      length -= skip;
+    }
+    return CompareSuffix(SlotAt(index), GetHead(data, length), data, length);
+  }
+
+  // * CopyKey() - Returns the full key in a slot
+  KeyType CopyKey(int index) {
+    const Slot &slot = SlotAt(index);
+    size_t skip = GetSkip(index);
+    InlineArray<char, 64> buffer;
+    buffer.Reserve(skip + slot.length);
+    std::memcpy(buffer.Data(), heap_p, skip);
+    for(size_t i = 0;i < std::min(size_t{slot.length}, size_t{HEAD_SIZE});i++) {
+      buffer[skip + i] = static_cast<char>(slot.head >> (8 * (HEAD_SIZE - 1 - i)));
+    }
+    if(slot.length > HEAD_SIZE) { 
+      std::memcpy(buffer.Data() + skip + HEAD_SIZE, heap_p + slot.offset, slot.length - HEAD_SIZE); 
+    }
+    return KeyType(buffer.Data(), skip + slot.length);
+  }
+
+  // * WriteKey() - Writes a key into a slot. Bytes after the head are appended to the key heap
+  void WriteKey(int index, const KeyType &key) {
+    size_t skip = GetSkip(index);
+    assert(key.size() >= skip && std::memcmp(key.data(), heap_p, skip) == 0);
+    const char *data = key.data() + skip;
+    size_t length = key.size() - skip;
+    assert(length <= UINT32_MAX);
+    Slot &slot = SlotAt(index);
+    slot.head = GetHead(data, length);
+    slot.length = static_cast<uint32_t>(length);
+    slot.offset = 0;
+    if(length > HEAD_SIZE) {
+      Reserve(heap_size + length - HEAD_SIZE);
+      std::memcpy(heap_p + heap_size, data + HEAD_SIZE, length - HEAD_SIZE);
+      slot.offset = static_cast<uint32_t>(heap_size);
+      heap_size += length - HEAD_SIZE;
+    }
+  }
+
+  // * Reserve() - Makes sure the key heap has at least the given number of bytes
+  void Reserve(size_t size) {
+    if(size <= heap_capacity) { return; }
+    assert(size <= UINT32_MAX);
+    size_t capacity = std::max(size, size_t{heap_capacity} * 2);
+    char *p = new char[capacity];
+    if(heap_p != nullptr) { std::memcpy(p, heap_p, heap_size); delete[] heap_p; }
+    heap_p = p;
+    heap_capacity = static_cast<uint32_t>(capacity);
+  }
+
+  // Number of prefix bytes at the beginning of the heap
+  uint32_t prefix_length;
+  uint32_t heap_size;
+  uint32_t heap_capacity;
+  char *heap_p;
+  // Slots are followed by values
+  alignas(Slot) unsigned char slot_begin[0];
+};
+
+/*
+ * class DefaultNonUniqueBaseNode - Base node for non-unique keys, storing values in runs
+ * 
+ * 1. Each distinct key is stored once, followed by the end index of its run. Values of all
+ *    runs are stored in key order after that. The size of the node is the number of values
+ * 2. Items are still indexed by their values: KeyAt() returns the key of the run containing
+ *    the value, such that iterators and scans work as with unique nodes. Run-level methods
+ *    (GetRunNum(), RunKeyAt() etc.) are used by the non-unique consolidator and searcher
+ * 3. Get() with the number of keys equal to the size (the default) gives one value per key,
+ *    and items could be written in any order through KeyAt() and ValueAt(). Inner nodes are 
+ *    always like this. Otherwise the node must be filled in key order by Append()
+ * 4. Split() only splits between runs, at the boundary closest to the middle. A node with
+ *    a single key cannot be split, in which case nullptr is returned
+ * 5. ValueType must support operator==, since delete deltas match both the key and the value
+ */
+template <typename _KeyType, 
+          typename _ValueType, 
+          typename _DeltaChainType>
+class DefaultNonUniqueBaseNode : public ExtendedNodeBase<_KeyType, _DeltaChainType>, public NonUniqueKeyBase {
+ public:
+  using KeyType = _KeyType;
+  using ValueType = _ValueType;
+  using DeltaChainType = _DeltaChainType;
+  using BaseClassType = ExtendedNodeBase<KeyType, DeltaChainType>;
+  using BaseBaseClassType = typename BaseClassType::BaseClassType;
+  using NodeSizeType = typename BaseBaseClassType::NodeSizeType;
+  using NodeHeightType = typename BaseBaseClassType::NodeHeightType;
+  using BoundKeyType = typename BaseBaseClassType::BoundKeyType;
+  using KeyRefType = KeyType &;
+  using ConstKeyRefType = const KeyType &;
+  static_assert(alignof(ValueType) <= alignof(BoundKeyType *), "Values must not need a larger alignment than the node");
+ private:
+  // * DefaultNonUniqueBaseNode() - Private Constructor
+  DefaultNonUniqueBaseNode(NodeType ptype, 
+                           NodeHeightType pheight,
+                           NodeSizeType psize,
+                           NodeSizeType pkey_num,
+                           const BoundKeyType &plow_key,
+                           const BoundKeyType &phigh_key) :
+    BaseClassType{ptype, pheight, psize, plow_key, phigh_key},
+    key_num{pkey_num}, append_key_num{0}, append_size{0} {
+    return;
+  } 
+  
+  // * ~DefaultNonUniqueBaseNode() - Private Destructor
+  ~DefaultNonUniqueBaseNode() {}
+
+ public:
+  /*
+   * Get() - Returns a base node with psize values and pkey_num keys
+   * 
+   * Runs are initialized as one value per key. If there are fewer keys than values,
+   * Append() overwrites the runs
+   */
+  static DefaultNonUniqueBaseNode *Get(NodeType ptype, 
+                                       NodeSizeType psize,
+                                       const BoundKeyType &plow_key,
+                                       const BoundKeyType &phigh_key,
+                                       NodeSizeType pkey_num) {
+    assert(ptype == NodeType::InnerBase || ptype == NodeType::LeafBase);
+    assert(pkey_num <= psize && (pkey_num != 0 || psize == 0));
+    size_t total_size = sizeof(DefaultNonUniqueBaseNode) + GetExtraSize(psize, pkey_num);
+
+    void *p = new unsigned char[total_size];
+    DefaultNonUniqueBaseNode *node_p = \
+      static_cast<DefaultNonUniqueBaseNode *>(
+        new (p) DefaultNonUniqueBaseNode{ptype, NodeHeightType{0}, psize, pkey_num, plow_key, phigh_key});
+    
+    for(NodeSizeType i = 0;i < pkey_num;i++) {
+      new (&node_p->RunKeyAt(i)) KeyType{};
+      node_p->RunEndBegin()[i] = i + 1;
+    }
+    for(NodeSizeType i = 0;i < psize;i++) { new (&node_p->ValueAt(i)) ValueType{}; }
+    
+    return node_p;
+  }
+  // * Get() - Returns a base node with one value per key
+  static DefaultNonUniqueBaseNode *Get(NodeType ptype, 
+                                       NodeSizeType psize,
+                                       const BoundKeyType &plow_key,
+                                       const BoundKeyType &phigh_key) {
+    return Get(ptype, psize, plow_key, phigh_key, psize);
+  }
+
+  /*
+   * Destroy() - Frees the memory and calls destructor
+   * 
+   * 1. The delta chain's destructor will be called in this case. Make sure
+   *    all delta chain elements have been destroyed before this is called
+   */
+  static void Destroy(DefaultNonUniqueBaseNode *node_p) {
+    for(NodeSizeType i = 0;i < node_p->key_num;i++) { node_p->RunKeyAt(i).~KeyType(); }
+    for(NodeSizeType i = 0;i < node_p->GetSize();i++) { node_p->ValueAt(i).~ValueType(); }
+    node_p->~DefaultNonUniqueBaseNode();
+    delete[] reinterpret_cast<unsigned char *>(node_p);
+    return;
+  }
+
+  // * GetRunNum() - Returns the number of keys
+  inline NodeSizeType GetRunNum() const { return key_num; }
+  // * RunKeyAt() - Access the key of a run
+  inline KeyType &RunKeyAt(NodeSizeType run) { assert(run < key_num); return KeyBegin()[run]; }
+  // * GetRunBegin() * GetRunEnd() - Returns the index of the first value and the index after the last
+  inline NodeSizeType GetRunBegin(NodeSizeType run) { return run == 0 ? NodeSizeType{0} : GetRunEnd(run - 1); }
+  inline NodeSizeType GetRunEnd(NodeSizeType run) { assert(run < key_num); return RunEndBegin()[run]; }
+  // * GetRun() - Returns the run containing the value on the index
+  inline NodeSizeType GetRun(int index) {
+    assert(static_cast<NodeSizeType>(index) < BaseBaseClassType::GetSize());
+    if(key_num == BaseBaseClassType::GetSize()) { return static_cast<NodeSizeType>(index); }
+    return static_cast<NodeSizeType>(
+      std::upper_bound(RunEndBegin(), RunEndBegin() + key_num, static_cast<NodeSizeType>(index)) - RunEndBegin());
+  }
+
+  // * KeyAt() - Access the key of the value on a particular index
+  inline KeyType &KeyAt(int index) { return RunKeyAt(GetRun(index)); }
+  // * ValueAt() - Access value on a particular index
+  inline ValueType &ValueAt(int index) {
+    assert(static_cast<NodeSizeType>(index) < BaseBaseClassType::GetSize());
+    return ValueBegin()[index];
+  }
+  // * GetAllocatedSize() - Returns the number of bytes allocated for the node
+  inline size_t GetAllocatedSize() const { 
+    return sizeof(DefaultNonUniqueBaseNode) + GetExtraSize(BaseBaseClassType::GetSize(), key_num);
+  }
+
+  /*
+   * Append() - Appends a value to the run of the key, or starts a new run
+   * 
+   * Keys must be appended in order, and the node must have been allocated with the 
+   * exact number of values and keys
+   */
+  void Append(const KeyType &key, const ValueType &value) {
+    assert(append_size < BaseBaseClassType::GetSize());
+    if(append_key_num == 0 || !(RunKeyAt(append_key_num - 1) == key)) {
+      assert(append_key_num == 0 || RunKeyAt(append_key_num - 1) < key);
+      RunKeyAt(append_key_num) = key;
+      append_key_num++;
+    }
+    ValueAt(static_cast<int>(append_size)) = value;
+    append_size++;
+    RunEndBegin()[append_key_num - 1] = append_size;
+  }
+
+  /*
+   * SearchRun() - Returns the run of the lower bound of the search key
+   * 
+   * This is the largest run whose key is <= the search key, like DefaultBaseNode::Search().
+   * The first key is not searched. If the caller knows Search() is within [first, last], 
+   * only the runs of the two values are searched
+   */
+  NodeSizeType SearchRun(const KeyType &key) { return SearchRun(key, 0, BaseBaseClassType::GetSize() - 1); }
+  NodeSizeType SearchRun(const KeyType &key, NodeSizeType first, NodeSizeType last) {
+    assert(BaseBaseClassType::KeyInNode(key) && key_num != 0);
+    assert(first <= last && last < BaseBaseClassType::GetSize());
+    NodeSizeType first_run = GetRun(static_cast<int>(first)), last_run = GetRun(static_cast<int>(last));
+    return static_cast<NodeSizeType>(
+      (ArraySearch<KeyType>::UpperBound(KeyBegin() + first_run + 1, KeyBegin() + last_run + 1, key) - KeyBegin()) - 1);
+  }
+  // * PointSearchRun() - Returns the run of the key if exact match is found or -1 otherwise
+  int PointSearchRun(const KeyType &key) {
+    NodeSizeType run = SearchRun(key);
+    return RunKeyAt(run) == key ? static_cast<int>(run) : -1;
+  }
+  // * Search() - Returns the last value of the run found by SearchRun(). Inner nodes have one value per key
+  int Search(const KeyType &key) { return static_cast<int>(GetRunEnd(SearchRun(key))) - 1; }
+  int Search(const KeyType &key, NodeSizeType first, NodeSizeType last) { 
+    return static_cast<int>(GetRunEnd(SearchRun(key, first, last))) - 1; 
+  }
+  // * PointSearch() - Returns the first value of the key if exact match is found or -1 otherwise
+  int PointSearch(const KeyType &key) {
+    int run = PointSearchRun(key);
+    return run == -1 ? -1 : static_cast<int>(GetRunBegin(static_cast<NodeSizeType>(run)));
+  }
+
+  /*
+   * Split() - Split the node into two smaller halves between two runs
+   * 
+   * 1. The boundary closest to the middle is chosen. With one value per key, this is the 
+   *    same as DefaultBaseNode::Split()
+   * 2. Returns nullptr if the node only has one key
+   */
+  DefaultNonUniqueBaseNode *Split() {
+    NodeSizeType old_size = BaseBaseClassType::GetSize();
+    assert(old_size > 1);
+    NodeSizeType middle = old_size / 2;
+    NodeSizeType run = GetRun(static_cast<int>(middle));
+    NodeSizeType lower = GetRunBegin(run), upper = GetRunEnd(run);
+    if(lower == 0 || (upper != old_size && upper - middle < middle - lower)) { run++; }
+    if(run == 0 || run == key_num) { return nullptr; }
+    NodeSizeType pivot = GetRunBegin(run);
+    DefaultNonUniqueBaseNode *node_p = \
+      Get(BaseBaseClassType::GetType(), old_size - pivot, 
+          {RunKeyAt(run), false}, *BaseBaseClassType::GetHighKey(), key_num - run);
+    for(NodeSizeType i = pivot;i < old_size;i++) { 
+      node_p->Append(KeyAt(static_cast<int>(i)), ValueAt(static_cast<int>(i))); 
+    }
+
+    return node_p;
+  }
+
+ private:
+  // * AlignUp() - Rounds the offset up to a multiple of the alignment
+  inline static size_t AlignUp(size_t offset, size_t alignment) { return (offset + alignment - 1) / alignment * alignment; }
+  // * GetRunEndOffset() * GetValueOffset() - Returns the offset of run end indices and values from keys
+  inline static size_t GetRunEndOffset(NodeSizeType key_num) { 
+    return AlignUp(size_t{key_num} * sizeof(KeyType), alignof(NodeSizeType)); 
+  }
+  inline static size_t GetValueOffset(NodeSizeType key_num) { 
+    return AlignUp(GetRunEndOffset(key_num) + size_t{key_num} * sizeof(NodeSizeType), alignof(ValueType)); 
+  }
+  // * GetExtraSize() - Returns the number of bytes for keys, runs and values
+  inline static size_t GetExtraSize(NodeSizeType size, NodeSizeType key_num) {
+    return GetValueOffset(key_num) + size_t{size} * sizeof(ValueType);
+  }
+  // * KeyBegin() - Return the first pointer for keys
+  inline KeyType *KeyBegin() { return key_begin; }
+  // * RunEndBegin() - Return the first pointer for the end indices of runs
+  inline NodeSizeType *RunEndBegin() { 
+    return reinterpret_cast<NodeSizeType *>(reinterpret_cast<unsigned char *>(key_begin) + GetRunEndOffset(key_num)); 
+  }
+  // * ValueBegin() - Return the first pointer for values
+  inline ValueType *ValueBegin() { 
+    return reinterpret_cast<ValueType *>(reinterpret_cast<unsigned char *>(key_begin) + GetValueOffset(key_num)); 
+  }
+  
+  // Number of keys (runs)
+  NodeSizeType key_num;
+  // Number of keys and values appended by Append()
+  NodeSizeType append_key_num;
+  NodeSizeType append_size;
+  // This member does not take any storage, but let us obtain the address
+  // of the memory address after all class members. Offsets of runs and 
+  // values are aligned relative to it
+  alignas(BoundKeyType *) alignas(KeyType) KeyType key_begin[0];
+};
+
+/* 
+ * class TraverseHandlerBase - The base class of traverse handlers
+ * 
+ * All traverse handlers must inherit from this class. They do not have to implement
+ * all methods (and most of them don't). For detailed template of derived handlers
+ * please refer to traverser class
+ * 
+ * 1. "finished" is set if the traverse should end
+ * 2. next_p is set to the next pointer the traverse must go if it has not finished
+ * 3. Init() is called at the beginning of the traverse, including recursive traverses
+ */
+template <typename KeyType, typename ValueType, typename NodeIDType, 
+          typename DeltaChainType, template <typename, typename, typename> typename BaseNode>
+class TraverseHandlerBase {
+ public:
+  using NodeBaseType = NodeBase<KeyType>;
+  using DeltaType = Delta<KeyType, ValueType, NodeIDType>;
+  using LeafBaseType = BaseNode<KeyType, ValueType, DeltaChainType>;
+  using InnerBaseType = BaseNode<KeyType, NodeIDType, DeltaChainType>;
+
+  // * TraverseHandlerBase() - Constructor
+  TraverseHandlerBase() :
+    finished{false}, next_p{nullptr} {}
+
+  // Handler functions. If not used in the derived class just leave them undefined
+  void HandleLeafBase(LeafBaseType *node_p) { Fail(); }
+  void HandleInnerBase(InnerBaseType *node_p) { Fail(); }
+
+  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { Fail(); }
+  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { Fail(); }
+
+  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { Fail(); }
+  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { Fail(); }
+
+  void HandleLeafISplit(typename DeltaType::LeafSplitType *node_p) { Fail(); }
+  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { Fail(); }
+
+  bool HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { Fail(); return false; }
+  bool HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { Fail(); return false; }
+
+  void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { Fail(); }
+  void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { Fail(); }
+
+  // * GetNext() - Returns the next pointer
   inline NodeBaseType *GetNext() { return next_p; }
   // * Finished() - Returns true if the traverse terminates
   inline bool Finished() { return finished; }
  private:
-  // * Fail() - Called if the handler is not defined
-  inline void Fail() { assert(false && "Unknown delta nodes"); }
+  // * Fail() - Called if the handler is not defined
+  inline void Fail() { assert(false && "Unknown delta nodes"); }
+
+ protected:
+  bool finished;
+  NodeBaseType *next_p;
+};
+
+/*
+ * class DeltaChainTraverser - This class implements a state machine for abstracting 
+ *                             away details of delta chain traversal. 
+ * 
+ * The TraverseHandlerType is a template argument that defines states and functions
+ * for handling deltas and base nodes. Details of interfacing with the 
+ * call back type is presented below:
+ * 
+  // Template arguments can be adjusted according to the needs, but the following are required
+  template <typename KeyType, typename ValueType, typename NodeIDType, 
+            typename DeltaChainType, template <typename, typename, typename> typename BaseNode>
+  class TraverseHandlerType : public TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode> {
+  public:
+    using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>;
+    using NodeBaseType = typename BaseClassType::NodeBaseType;
+    using DeltaType = typename BaseClassType::DeltaType;
+    using LeafBaseType = typename BaseClassType::LeafBaseType;
+    using InnerBaseType = typename BaseClassType::InnerBaseType;
+    // Note: Change the class name
+    using DeltaChainTraverserType = \                                               |------  Change It ---------| 
+      DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, >>>>>TraverseHandlerType<<<<< >
+
+    TraverseHandlerType() : TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>{} {}
+
+    void HandleLeafBase(LeafBaseType *node_p) { }
+    void HandleInnerBase(InnerBaseType *node_p) { }
+
+    void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { }
+    void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { }
+
+    void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { }
+    void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { }
+
+    void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { }
+    void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { }
+
+    void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { }
+    void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { }
+
+    void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { }
+    void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { }
+
+    // * GetNext() - Interface for accessing next_p
+    NodeBaseType *&GetNext() { return BaseClassType::next_p; }
+    // * Finished() - Interface for accessing finished
+    bool &Finished() { return BaseClassType::finished; }
+  };
+ * 
+ * 1. Base nodes must be the terminating node because they do not have next pointer.
+ * 2. If merge nodes must be accessed recursively (e.g. node consolidation), then
+ *    the traverser must perform this in the merge handler itself, and set finished
+ *    flag to true
+ */
+template <typename KeyType, typename ValueType, typename NodeIDType, 
+          typename DeltaChainType, template <typename, typename, typename> typename BaseNode, 
+          typename TraverseHandlerType>
+class DeltaChainTraverser {
+ public:
+  using DeltaType = Delta<KeyType, ValueType, NodeIDType>;
+  using NodeBaseType = NodeBase<KeyType>;
+  using LeafBaseType = BaseNode<KeyType, ValueType, DeltaChainType>;
+  using InnerBaseType = BaseNode<KeyType, NodeIDType, DeltaChainType>;
+
+  // * Traverse() - Starts traversing the delta chain
+  static void Traverse(NodeBaseType *node_p, TraverseHandlerType *handler_p) {
+    while(true) {
+      NodeType type = node_p->GetType();
+      switch(type) {
+        case NodeType::LeafBase:
+          handler_p->HandleLeafBase(static_cast<LeafBaseType *>(node_p));
+          assert(handler_p->Finished() == true);
+          break;
+        case NodeType::InnerBase:
+          handler_p->HandleInnerBase(static_cast<InnerBaseType *>(node_p));
+          assert(handler_p->Finished() == true);
+          break;
+        case NodeType::LeafInsert:
+          handler_p->HandleLeafInsert(static_cast<typename DeltaType::LeafInsertType *>(node_p));
+          break;
+        case NodeType::InnerInsert:
+          handler_p->HandleInnerInsert(static_cast<typename DeltaType::InnerInsertType *>(node_p));
+          break;
+        case NodeType::LeafDelete:
+          handler_p->HandleLeafDelete(static_cast<typename DeltaType::LeafDeleteType *>(node_p));
+          break;
+        case NodeType::InnerDelete:
+          handler_p->HandleInnerDelete(static_cast<typename DeltaType::InnerDeleteType *>(node_p));
+          break;
+        case NodeType::LeafSplit:
+          handler_p->HandleLeafSplit(static_cast<typename DeltaType::LeafSplitType *>(node_p));
+          break;
+        case NodeType::InnerSplit:
+          handler_p->HandleInnerSplit(static_cast<typename DeltaType::InnerSplitType *>(node_p));
+          break;
+        case NodeType::LeafMerge: 
+          handler_p->HandleLeafMerge(static_cast<typename DeltaType::LeafMergeType *>(node_p));
+          assert(handler_p->Finished());
+          return;
+        case NodeType::InnerMerge:
+          handler_p->HandleInnerMerge(static_cast<typename DeltaType::InnerMergeType *>(node_p));
+          assert(handler_p->Finished());
+          return;
+        case NodeType::LeafRemove:
+          handler_p->HandleLeafRemove(static_cast<typename DeltaType::LeafRemoveType *>(node_p));
+          break;
+        case NodeType::InnerRemove:
+          handler_p->HandleInnerRemove(static_cast<typename DeltaType::InnerRemoveType *>(node_p));
+          break;
+        default:
+          assert(false && "Unknown node type during traversal");
+      } // switch
+
+      // If the handler says to stop then break
+      if(handler_p->Finished()) {
+        break;
+      } else {
+        node_p = handler_p->GetNext();
+      }
+    } // while
+
+    return;
+  }
+};
+
+/*
+ * class RetryBackoff - Exponential backoff between retries of a failed CAS
+ *
+ * 1. Pause() spins for 1, 2, 4, ... pause instructions, up to the limit given by
+ *    the config. A limit of 0 disables backoff
+ * 2. Once the limit is reached, the thread also yields, such that the thread that
+ *    won the CAS could run if cores are oversubscribed
+ */
+class RetryBackoff {
+ public:
+  // * RetryBackoff() - Constructor. One object is used by the retries of one operation
+  RetryBackoff(size_t plimit) : limit{plimit}, spin_num{1} {}
+
+  // * Pause() - Called after each failed CAS
+  inline void Pause() {
+    if(limit == 0) { return; }
+    for(size_t i = 0;i < spin_num;i++) { CpuRelax(); }
+    if(spin_num < limit) { spin_num = std::min(spin_num * 2, limit); }
+    else { std::this_thread::yield(); }
+  }
+  // * GetSpinNum() - Returns the number of pause instructions of the next Pause()
+  inline size_t GetSpinNum() const { return spin_num; }
+
+  // * CpuRelax() - Hints the core that the thread is spinning
+  inline static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+ private:
+  size_t limit;
+  size_t spin_num;
+};
+
+/*
+ * class AppendHelper - Helper class that acts as a proxy for appending deltas
+ * 
+ * 1. We decouple the appending of deltas from node base or mapping table class
+ *    to modularize the design, because this step is largely independent from
+ *    the design choices of the mapping table or the node base
+ * 2. The appending functions returns nullptr if the CAS succeeds, in which case
+ *    the internal node_p is updated to reflect the updated view of the node
+ *    The internal node can be accessed using GetNode()
+ * 3. If CAS fails, the delta node is returned. The caller could either choose to
+ *    destroy it, or retry the CAS
+ * 4. Leaf insert and delete deltas returned by a failed append could be given to the
+ *    next append of the same key, which relinks the delta at the new view of the node
+ *    instead of allocating another one. The delta is only reused if the node still has
+ *    the same base node, since it may have been allocated from the base node's slab
+ */
+template <typename KeyType, typename ValueType,
+          typename MappingTableType, typename DeltaChainType, typename StatsType = DefaultNullStatsType>
+class AppendHelper {
+ public:
+  using NodeIDType = typename MappingTableType::NodeIDType;
+  using DeltaType = Delta<KeyType, ValueType, NodeIDType>;
+  using NodeBaseType = NodeBase<KeyType>;
+  using NodeSizeType = typename NodeBaseType::NodeSizeType;
+  using NodeHeightType = typename NodeBaseType::NodeHeightType;
+  using ExtendedBaseType = ExtendedNodeBase<KeyType, DeltaChainType>;
+  using BoundKeyType = typename ExtendedBaseType::BoundKeyType;
+  using LeafInsertType = typename DeltaType::LeafInsertType;
+  using LeafDeleteType = typename DeltaType::LeafDeleteType;
+  using LeafSplitType = typename DeltaType::LeafSplitType;
+  using LeafMergeType = typename DeltaType::LeafMergeType;
+  using LeafRemoveType = typename DeltaType::LeafRemoveType;
+  using InnerInsertType = typename DeltaType::InnerInsertType;
+  using InnerDeleteType = typename DeltaType::InnerDeleteType;
+  using InnerSplitType = typename DeltaType::InnerSplitType;
+  using InnerMergeType = typename DeltaType::InnerMergeType;
+  using InnerRemoveType = typename DeltaType::InnerRemoveType;
+  using KeyFilterType = DeltaKeyFilter<KeyType>;
+  using FilterType = typename KeyFilterType::FilterType;
+
+  // This is required for using the low key to determine the delta chain
+  static constexpr size_t LOW_KEY_OFFSET = offsetof(ExtendedBaseType, low_key_addr);
+
+  // * AppendHelper() - Constructor. CAS results and allocations are recorded if the stats are given
+  AppendHelper(NodeIDType pnode_id, NodeBaseType *pnode_p, MappingTableType *ptable_p, StatsType *pstats_p = nullptr) : 
+    node_id{pnode_id}, node_p{pnode_p}, table_p{ptable_p}, stats_p{pstats_p} {}
+
+  // * GetBase() - Returns a pointer to the base node of the delta chain
+  inline ExtendedBaseType *GetBase() { return node_p->template GetBase<DeltaChainType>(); }
+  
+  // * DestroyDelta() - Calls the delta chain of the delta's own base node to destroy it (only applicable to deltas allocated by this class)
+  template <typename DeltaNodeType>
+  inline static void DestroyDelta(DeltaNodeType *delta_p) { 
+    delta_p->template GetBase<DeltaChainType>()->template DestroyDelta<DeltaNodeType>(delta_p); 
+  }
+  
+  /*
+   * AppendLeafInsert() - Appends a leaf insert delta. The base offset is the result of Search() on the base node
+   *
+   * retry_p is the delta returned by the last failed append of the key, or nullptr.
+   * It is either reused or destroyed
+   */
+  inline LeafInsertType *AppendLeafInsert(const KeyType &key, const ValueType &value, 
+                                          NodeSizeType base_offset = NodeBaseType::INVALID_OFFSET,
+                                          LeafInsertType *retry_p = nullptr) {
+    assert(node_p->KeyInNode(key));
+    LeafInsertType *delta_p = RelinkDelta(retry_p, node_p->GetHeight() + 1, node_p->GetSize() + 1);
+    if(delta_p == nullptr) {
+      // NOTE: For some strange reasons the compiler could not deduce the type of this
+      // template function call. We explicitly specify the height type
+      delta_p = GetBase()->template AllocateDelta<LeafInsertType, NodeType, NodeHeightType>(
+        NodeType::LeafInsert, node_p->GetHeight() + 1, node_p->GetSize() + 1,
+        node_p->GetLowKey(), node_p->GetHighKey(), node_p,
+        key, value);
+    } else {
+      delta_p->GetInsertValue() = value;
+    }
+    delta_p->GetBaseOffset() = base_offset;
+    delta_p->GetKeyFilter() = KeyFilterType::Add(GetKeyFilter(node_p), key);
+    return Install(delta_p);
+  }
+
+  // * AppendLeafDelete() - Appends a leaf delete delta. retry_p is the same as AppendLeafInsert()
+  inline LeafDeleteType *AppendLeafDelete(const KeyType &key, const ValueType &value, 
+                                          NodeSizeType base_offset = NodeBaseType::INVALID_OFFSET,
+                                          LeafDeleteType *retry_p = nullptr) {
+    assert(node_p->KeyInNode(key));
+    LeafDeleteType *delta_p = RelinkDelta(retry_p, node_p->GetHeight() + 1, node_p->GetSize() - 1);
+    if(delta_p == nullptr) {
+      delta_p = GetBase()->template AllocateDelta<LeafDeleteType, NodeType, NodeHeightType>(
+        NodeType::LeafDelete, node_p->GetHeight() + 1, node_p->GetSize() - 1,
+        node_p->GetLowKey(), node_p->GetHighKey(), node_p,
+        key, value);
+    } else {
+      // With unique keys, the value found by the retry could be different
+      delta_p->GetDeleteValue() = value;
+    }
+    delta_p->GetBaseOffset() = base_offset;
+    delta_p->GetKeyFilter() = KeyFilterType::Add(GetKeyFilter(node_p), key);
+    return Install(delta_p);
+  }
+
+  // * AppendLeafSplit() - Appends a leaf split delta
+  inline LeafSplitType *AppendLeafSplit(const KeyType &key, NodeIDType sibling_id, NodeSizeType new_size) {
+    LeafSplitType *delta_p = GetBase()->template AllocateDelta<LeafSplitType, NodeType, NodeHeightType>(
+      NodeType::LeafSplit, node_p->GetHeight(), node_p->GetSize() - new_size,
+      node_p->GetLowKey(), nullptr, node_p,
+      BoundKeyType::Get(key), sibling_id);
+    // Special code here to set the high key of the delta chain to the split key
+    // which itself is a bound key
+    delta_p->SetSplitHighKey();
+    return Install(delta_p);
+  }
+
+  // * AppendLeafMerge() - Appends a leaf merge delta
+  //                       The merge delta itself counts towards the height, such that only base nodes have height 0
+  inline LeafMergeType *AppendLeafMerge(const KeyType &key, NodeIDType sibling_id, NodeBaseType *sibling_p) {
+    LeafMergeType *delta_p = GetBase()->template AllocateDelta<LeafMergeType, NodeType, NodeHeightType>(
+      NodeType::LeafMerge, node_p->GetHeight() + sibling_p->GetHeight() + 1, node_p->GetSize() + sibling_p->GetSize(),
+      node_p->GetLowKey(), sibling_p->GetHighKey(), node_p,
+      key, sibling_id, sibling_p);
+    return Install(delta_p);
+  }
+
+  // * AppendLeafRemove() - Appends a leaf remove delta
+  inline LeafRemoveType *AppendLeafRemove(NodeIDType removed_id) {
+    LeafRemoveType *delta_p = GetBase()->template AllocateDelta<LeafRemoveType, NodeType, NodeHeightType>(
+      NodeType::LeafRemove, node_p->GetHeight(), node_p->GetSize(),
+      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
+      removed_id);
+    return Install(delta_p);
+  }
+
+  // * AppendInnerInsert() - Appends inner insert delta
+  inline InnerInsertType *AppendInnerInsert(const KeyType &key, const NodeIDType &value, 
+                                            const BoundKeyType &next_key, 
+                                            NodeSizeType base_offset = NodeBaseType::INVALID_OFFSET) {
+    assert(node_p->KeyInNode(key));
+    InnerInsertType *delta_p = GetBase()->template AllocateDelta<InnerInsertType, NodeType, NodeHeightType>(
+      NodeType::InnerInsert, node_p->GetHeight() + 1, node_p->GetSize() + 1,
+      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
+      key, value, next_key);
+    delta_p->GetBaseOffset() = base_offset;
+    return Install(delta_p);
+  }
+
+  // * AppendInnerDelete() - Appends inner delete delta
+  inline InnerDeleteType *AppendInnerDelete(const KeyType &key, const NodeIDType &value, 
+                                            const BoundKeyType &next_key, 
+                                            const BoundKeyType &prev_key, const NodeIDType &prev_id,
+                                            NodeSizeType base_offset = NodeBaseType::INVALID_OFFSET) {
+    assert(node_p->KeyInNode(key));
+    InnerDeleteType *delta_p = GetBase()->template AllocateDelta<InnerDeleteType, NodeType, NodeHeightType>(
+      NodeType::InnerDelete, node_p->GetHeight() + 1, node_p->GetSize() - 1,
+      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
+      key, value, next_key, prev_key, prev_id);
+    delta_p->GetBaseOffset() = base_offset;
+    return Install(delta_p);
+  }
+
+  // * AppendInnerSplit() - Appends inner split delta
+  inline InnerSplitType *AppendInnerSplit(const KeyType &key, NodeIDType sibling_id, NodeSizeType new_size) {
+    assert(node_p->KeyInNode(key));
+    InnerSplitType *delta_p = GetBase()->template AllocateDelta<InnerSplitType, NodeType, NodeHeightType>(
+      NodeType::InnerSplit, node_p->GetHeight(), node_p->GetSize() - new_size,
+      node_p->GetLowKey(), nullptr, node_p,
+      BoundKeyType::Get(key), sibling_id);
+    delta_p->SetSplitHighKey();
+    return Install(delta_p);
+  }
+
+  // * AppendInnerMerge() - Appends a inner merge delta
+  inline InnerMergeType *AppendInnerMerge(const KeyType &key, NodeIDType sibling_id, NodeBaseType *sibling_p) {
+    InnerMergeType *delta_p = GetBase()->template AllocateDelta<InnerMergeType, NodeType, NodeHeightType>(
+      NodeType::InnerMerge, node_p->GetHeight() + sibling_p->GetHeight() + 1, node_p->GetSize() + sibling_p->GetSize(),
+      node_p->GetLowKey(), sibling_p->GetHighKey(), node_p,
+      key, sibling_id, sibling_p);
+    return Install(delta_p);
+  }
+
+  // * AppendInnerRemove() - Appends a inner remove delta
+  inline InnerRemoveType *AppendInnerRemove(NodeIDType removed_id) {
+    InnerRemoveType *delta_p = GetBase()->template AllocateDelta<InnerRemoveType, NodeType, NodeHeightType>(
+      NodeType::InnerRemove, node_p->GetHeight(), node_p->GetSize(),
+      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
+      removed_id);
+    return Install(delta_p);
+  }
+
+  // * GetNode() - Returns the node pointer
+  NodeBaseType *GetNode() { return node_p; }
+
+  // * GetKeyFilter() - Returns the key filter of a leaf chain. Split and remove deltas are skipped
+  static FilterType GetKeyFilter(NodeBaseType *chain_p) {
+    while(true) {
+      switch(chain_p->GetType()) {
+        case NodeType::LeafBase: return KeyFilterType::EMPTY;
+        case NodeType::LeafInsert: return static_cast<LeafInsertType *>(chain_p)->GetKeyFilter();
+        case NodeType::LeafDelete: return static_cast<LeafDeleteType *>(chain_p)->GetKeyFilter();
+        case NodeType::LeafMerge: return KeyFilterType::FULL;
+        default:
+          assert(chain_p->GetType() == NodeType::LeafSplit || chain_p->GetType() == NodeType::LeafRemove);
+          chain_p = static_cast<DeltaNodeBase<KeyType> *>(chain_p)->GetNext();
+      }
+    }
+  }
+
+ private:
+  /*
+   * RelinkDelta() - Relinks the delta of a failed append at the current view of the node
+   *
+   * Returns nullptr if there is no delta, or if it is destroyed because the base node
+   * has been replaced, in which case the caller allocates a new one
+   */
+  template <typename DeltaNodeType>
+  inline DeltaNodeType *RelinkDelta(DeltaNodeType *retry_p, NodeHeightType height, NodeSizeType size) {
+    if(retry_p == nullptr) { return nullptr; }
+    if(retry_p->template GetBase<DeltaChainType>() != GetBase()) {
+      DestroyDelta(retry_p);
+      return nullptr;
+    }
+
+    retry_p->Relink(node_p, height, size);
+    return retry_p;
+  }
+
+  // * Install() - CASes the delta into the mapping table. Returns nullptr on success or the delta otherwise
+  //               Allocations are only counted for installed deltas, which are counted once even if reused
+  template <typename DeltaNodeType>
+  inline DeltaNodeType *Install(DeltaNodeType *delta_p) {
+    bool success = table_p->CAS(node_id, node_p, delta_p);
+    if(StatsType::ENABLED && stats_p != nullptr) {
+      stats_p->Count(StatsCounter::Append);
+      if(success) { stats_p->CountAlloc(delta_p->GetType(), sizeof(DeltaNodeType)); }
+      else { stats_p->Count(StatsCounter::AppendFailure); }
+    }
+    return success ? (node_p = delta_p, nullptr) : delta_p;
+  }
+
+  NodeIDType node_id;
+  NodeBaseType *node_p;
+  MappingTableType *table_p;
+  StatsType *stats_p;
+};
+
+/* 
+ * class DeltaChainFreeHelper - Frees a delta chain using delta chain's customized free method
+ * 
+ * 1. This method is usually called within the garbage collector. Delta nodes will be freed 
+ *    immediately
+ * 2. Base nodes in the snapshot mapping, if given, are not freed
+ */
+template <typename KeyType, typename ValueType,
+          typename MappingTableType, typename DeltaChainType, 
+          template <typename, typename, typename> typename BaseNode>
+class DeltaChainFreeHelper : 
+  public TraverseHandlerBase<KeyType, ValueType, typename MappingTableType::NodeIDType, DeltaChainType, BaseNode> {
+ public:
+  using NodeIDType = typename MappingTableType::NodeIDType;
+  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>;
+  using NodeBaseType = typename BaseClassType::NodeBaseType;
+  using DeltaType = typename BaseClassType::DeltaType;
+  using LeafBaseType = typename BaseClassType::LeafBaseType;
+  using InnerBaseType = typename BaseClassType::InnerBaseType;
+  using ExtendedBaseType = ExtendedNodeBase<KeyType, DeltaChainType>;
+  using DeltaChainTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, DeltaChainFreeHelper>;
+
+  // * DeltaChainFreeHelper() - Constructor
+  DeltaChainFreeHelper(MappingTableType *ptable_p, const SnapshotMappingType *psnapshot_p = nullptr) : 
+    TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>{},
+    table_p{ptable_p}, snapshot_p{psnapshot_p} {}
+
+  NodeBaseType *&GetNext() { return BaseClassType::next_p; }
+  bool &Finished() { return BaseClassType::finished; }
+  // * GetBase() - Returns a pointer to the base node of the delta chain
+  inline ExtendedBaseType *GetBase(NodeBaseType *node_p) { return node_p->template GetBase<DeltaChainType>(); }
+
+  void HandleLeafBase(LeafBaseType *node_p) { 
+    if(IsMapped(node_p) == false) { LeafBaseType::Destroy(node_p); }
+    Finished() = true; 
+  }
+  void HandleInnerBase(InnerBaseType *node_p) { 
+    if(IsMapped(node_p) == false) { InnerBaseType::Destroy(node_p); }
+    Finished() = true; 
+  }
+  // * IsMapped() - Whether the base node is in the snapshot mapping
+  inline bool IsMapped(NodeBaseType *node_p) const { return snapshot_p != nullptr && snapshot_p->Contains(node_p); }
+
+  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { 
+    GetNext() = node_p->GetNext(); 
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafInsertType>(node_p);
+  }
+  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { 
+    GetNext() = node_p->GetNext(); 
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerInsertType>(node_p);
+  }
+
+  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { 
+    GetNext() = node_p->GetNext(); 
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafDeleteType>(node_p);
+  }
+  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { 
+    GetNext() = node_p->GetNext(); 
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerDeleteType>(node_p);
+  }
+
+  void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { 
+    GetNext() = node_p->GetNext(); 
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafSplitType>(node_p);
+  }
+  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { 
+    GetNext() = node_p->GetNext(); 
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerSplitType>(node_p);
+  }
+
+  // Special for merge because we recursively traverse it
+  // The merge delta is destroyed first, because its storage may belong to the base node
+  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { 
+    NodeBaseType *next_p = node_p->GetNext();
+    NodeBaseType *sibling_p = node_p->GetMergeSibling();
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafMergeType>(node_p);
+    DeltaChainTraverserType::Traverse(next_p, this);
+    Finished() = false;
+    DeltaChainTraverserType::Traverse(sibling_p, this);
+  }
+  void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { 
+    NodeBaseType *next_p = node_p->GetNext();
+    NodeBaseType *sibling_p = node_p->GetMergeSibling();
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerMergeType>(node_p);
+    DeltaChainTraverserType::Traverse(next_p, this);
+    Finished() = false;
+    DeltaChainTraverserType::Traverse(sibling_p, this);
+  }
+
+  void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { 
+    GetNext() = node_p->GetNext(); 
+    table_p->ReleaseNodeID(node_p->GetRemoveNodeID());
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafRemoveType>(node_p); 
+  }
+  void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { 
+    GetNext() = node_p->GetNext(); 
+    table_p->ReleaseNodeID(node_p->GetRemoveNodeID());
+    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerRemoveType>(node_p); 
+  }
+
+  MappingTableType *table_p;
+  const SnapshotMappingType *snapshot_p;
+};
+
+// * class BaseNodeIterator - Provides a set of interfaces for iterating on base nodes
+template <typename _BaseNodeType>
+class BaseNodeIterator {
+ public:
+  // Referred to by external classes
+  using BaseNodeType = _BaseNodeType;
+  using NodeSizeType = typename BaseNodeType::NodeSizeType;
+  using KeyType = typename BaseNodeType::KeyType;
+  using ValueType = typename BaseNodeType::ValueType;
+  // * BaseNodeIterator() - Constructors
+  BaseNodeIterator(BaseNodeType *pnode_p) : node_p{pnode_p}, index{0} {}
+  BaseNodeIterator() : node_p{nullptr}, index{0} {}
+
+  // * Inited() - Returns false if the node has not been initialized
+  inline bool Inited() { return node_p != nullptr; }
+  // * IsEnd() - Whether the iterator has finished iterating over the node
+  inline bool IsEnd() { return index == node_p->GetSize(); }
+  inline BaseNodeType *GetNode() { return node_p; }
+  inline typename BaseNodeType::KeyRefType GetKey() { assert(!IsEnd()); return node_p->KeyAt(index); }
+  inline ValueType &GetValue() { assert(!IsEnd()); return node_p->ValueAt(index); }
+  // * Next() - Advance to the next key
+  inline void Next() { assert(index < node_p->GetSize()); index++; }
+  // * Append() - Appends a key and value to the current position and advance
+  inline void Append(const KeyType &key, const ValueType &value) { GetKey() = key; GetValue() = value; Next(); }
+  
+  BaseNodeType *node_p;
+  NodeSizeType index;
+};
+
+/*
+ * class BaseNodeBuilder - Appends sorted items into a new base node, which is optionally split
+ * 
+ * 1. The total number of items must be known in advance
+ * 2. If the node is split, the lower node takes the first half of the items, like 
+ *    DefaultBaseNode::Split() does. When it is full, the upper node is allocated 
+ *    with the next key as the low key, and the high key of the lower node is set 
+ *    to the same key. Every item is therefore copied only once
+ */
+template <typename _BaseNodeType>
+class BaseNodeBuilder {
+ public:
+  using BaseNodeType = _BaseNodeType;
+  using NodeSizeType = typename BaseNodeType::NodeSizeType;
+  using KeyType = typename BaseNodeType::KeyType;
+  using ValueType = typename BaseNodeType::ValueType;
+  using BoundKeyType = typename BaseNodeType::BoundKeyType;
+  using IteratorType = BaseNodeIterator<BaseNodeType>;
+
+  // * BaseNodeBuilder() - Constructor. The node is split if is_split is true
+  BaseNodeBuilder(NodeType ptype, NodeSizeType psize, const BoundKeyType &plow_key, const BoundKeyType &phigh_key, bool is_split) :
+    type{ptype}, 
+    upper_size{is_split ? static_cast<NodeSizeType>(psize - psize / 2) : NodeSizeType{0}},
+    high_key{phigh_key},
+    it{BaseNodeType::Get(ptype, static_cast<NodeSizeType>(psize - upper_size), plow_key, phigh_key)},
+    node_p{it.GetNode()},
+    sibling_p{nullptr} { assert(is_split == false || psize > 1); }
+
+  // * Append() - Appends a key and value, and switches to the upper node when the lower one is full
+  inline void Append(const KeyType &key, const ValueType &value) {
+    if(it.IsEnd()) {
+      assert(sibling_p == nullptr && upper_size != 0);
+      sibling_p = BaseNodeType::Get(type, upper_size, BoundKeyType::Get(key), high_key);
+      *node_p->GetHighKey() = BoundKeyType::Get(key);
+      it = IteratorType{sibling_p};
+    }
+    it.Append(key, value);
+  }
+
+  // * IsEnd() - Whether all items have been appended
+  inline bool IsEnd() { return it.IsEnd() && (upper_size == 0 || sibling_p != nullptr); }
+  // * GetNode() * GetSibling() - Returns the lower node and the upper node (nullptr if not split)
+  inline BaseNodeType *GetNode() const { return node_p; }
+  inline BaseNodeType *GetSibling() const { return sibling_p; }
+
+ private:
+  NodeType type;
+  NodeSizeType upper_size;
+  BoundKeyType high_key;
+  IteratorType it;
+  BaseNodeType *node_p;
+  BaseNodeType *sibling_p;
+};
+
+/* 
+ * class DefaultConsolidator - Implements consolidation algorithm
+ * 
+ * The consolidation algorithm uses two lists: inserted list and deleted list
+ * The routine traverses down the delta chain in the normal order. For insert
+ * deltas, the keys are first tested against the deleted list to see if it is 
+ * already deleted. If not, then it is added into the inserted list after testing
+ * for duplication. For delete deltas, they are tested against the inserted list,
+ * and then added to the deleted list after a duplicated key test if both tests 
+ * return negative.
+ * 
+ * On the base level, the inserted list is first sorted, from largest to smallest.
+ * Then a two-way merge is performed to derive the new node. Each data item in the
+ * base node is also tested against the deleted list.
+ * 
+ * Split nodes change the current high key of the virtual node. The updated high
+ * key should be recorded. When traversing the base node and the delta chain, 
+ * keys larger than the current high key will be ignored, as they belong to 
+ * the split sibling.
+ * 
+ * Merge nodes are processed recursively. Contexts should be saved and restored 
+ * before and after the recursion. For example, the current high key will be 
+ * saved and restored before and after both siblings are traversed. As an optimization,
+ * the deleted list could also be restored, as we know the two siblings will not share
+ * any deleted item. The left branch is bounded by the merge key, since inserted keys
+ * above the merge delta may belong to the right branch.
+ */
+template <typename KeyType, typename ValueType,
+          typename NodeIDType, typename DeltaChainType, 
+          template <typename, typename, typename> typename BaseNode,
+          size_t HEIGHT_THRESHOLD>
+class DefaultConsolidator : 
+  public TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>,
+  public UniqueKeyBase {
+ public:
+  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>;
+  using NodeBaseType = typename BaseClassType::NodeBaseType;
+  using DeltaType = typename BaseClassType::DeltaType;
+  using LeafBaseType = typename BaseClassType::LeafBaseType;
+  using InnerBaseType = typename BaseClassType::InnerBaseType;
+  using NodeHeightType = typename NodeBaseType::NodeHeightType;
+  using NodeSizeType = typename NodeBaseType::NodeSizeType;
+  using DeltaChainTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, DefaultConsolidator>;
+  using KeyPtrGreaterType = KeyPtrGreater<KeyType>;
+
+  using LeafNodeIteratorType = BaseNodeIterator<LeafBaseType>;
+  using InnerNodeIteratorType = BaseNodeIterator<InnerBaseType>;
+
+  // * DefaultConsolidator() - Constructor. This consolidator never splits, and ignores the split size
+  DefaultConsolidator(NodeBaseType *pold_node_p, NodeSizeType = NodeSizeType{0}) : 
+    TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>{},
+    inserted_list{},
+    deleted_list{},
+    inserted_num{0},
+    deleted_num{0},
+    current_high_key_p{nullptr},
+    old_node_p{pold_node_p},
+    item_counter{0},
+    counter_p{nullptr},
+    new_leaf_node_it{} { assert(new_inner_node_it.GetNode() == nullptr); }
+
+  NodeBaseType *&GetNext() { return BaseClassType::next_p; }
+  bool &Finished() { return BaseClassType::finished; }
+  /* 
+   * SortInsertedList() - Sorts a given list of keys
+   * 
+   * 1. Keys are sorted from larger to smaller
+   * 2. The reason for reversed ordering is that we could use the inserted list as a stack
+   *    during the merge, without having to adjust the starting point
+   */
+  inline void SortInsertedList() { std::sort(inserted_list.Data(), inserted_list.Data() + inserted_num, KeyPtrGreaterType{}); }
+  // * IsInList() - Whether the key is in the inserted set
+  bool IsInList(const KeyType &key, KeyType **key_list_p, size_t num) {
+    for(size_t i = 0;i < num;i++) { if(key == *key_list_p[i]) { return true; } }
+    return false;
+  }
+  // * IsInserted() - Whether the key is in the inserted set
+  inline bool IsInserted(const KeyType &key) { return IsInList(key, inserted_list.Data(), inserted_num); }
+  // * IsDeleted() - Whether the key is in the deleted set
+  inline bool IsDeleted(const KeyType &key) { return IsInList(key, deleted_list.Data(), deleted_num); }
+  // * Insert() - Adds a key into the inserted list
+  void Insert(KeyType *key_p) {
+    if(IsDeleted(*key_p) == false && IsInserted(*key_p) == false) {
+      if(current_high_key_p == nullptr || *key_p < *current_high_key_p) {
+        inserted_list.Reserve(inserted_num + 1);
+        inserted_list[inserted_num] = key_p;
+        inserted_num++;
+      }
+    }
+  }
+  // * Delete() - Adds a key into the deleted list
+  void Delete(KeyType *key_p) {
+    if(IsInserted(*key_p) == false && IsDeleted(*key_p) == false) {
+      if(current_high_key_p == nullptr || *key_p < *current_high_key_p) {
+        deleted_list.Reserve(deleted_num + 1);
+        deleted_list[deleted_num] = key_p;
+        deleted_num++;
+      }
+    }
+  }
+  // * InInsertedListEmpty() - Returns true if it is empty
+  inline bool IsInsertListEmpty() const { return inserted_num == 0; }
+  // * InsertTop() - Returns the key at the top of the inserted list (we maintain it as a stack)
+  inline KeyType &TopKey() { assert(IsInsertListEmpty() == false); return *inserted_list[inserted_num - 1]; }
+  // * TopValue() - Returns the value on the top
+  inline ValueType &TopValue() { 
+    assert(IsInsertListEmpty() == false); 
+    return *DeltaType::LeafInsertType::GetT2FromT1(inserted_list[inserted_num - 1]); 
+  }
+  // * TopNodeID() - Returns the NodeID on the top
+  inline NodeIDType &TopNodeID() { 
+    assert(IsInsertListEmpty() == false); 
+    return *DeltaType::InnerInsertType::GetT2FromT1(inserted_list[inserted_num - 1]);   
+  }
+  
+  // * TopPayload() - Returns the payload (node ID for value) based on the key pointer
+  template <typename BaseNodeType, typename DeltaInsertType>
+  inline typename BaseNodeType::ValueType &TopPayload() { 
+    assert(IsInsertListEmpty() == false); 
+    return *DeltaInsertType::GetT2FromT1(inserted_list[inserted_num - 1]);   
+  }
+
+  // * InsertPop() - Pop an element from the insert list
+  inline void InsertPop() { assert(IsInsertListEmpty() == false); inserted_num--; }
+
+  // * IsTopInBound() * IsBaseInBound() - Whether the key on the top or the base node is still less than the current high key
+  inline bool IsTopInBound() { return current_high_key_p == nullptr || (TopKey() < *current_high_key_p); }
+  template <typename IteratorType>
+  inline bool IsBaseInBound(IteratorType it) { return current_high_key_p == nullptr || (it.GetKey() < *current_high_key_p); }
+
+  // * IsTopStopped() * IsBaseStopped() - Whether the insert list or the base node has been exhausted
+  inline bool IsTopStopped() { return IsInsertListEmpty() || !IsTopInBound(); }
+  template <typename IteratorType>
+  inline bool IsBaseStopped(IteratorType it) { return it.IsEnd() || !IsBaseInBound(it); }
+
+  /* 
+   * MergeLoop() - Merges an insert list and a base node
+   * 
+   * 1. IteratorType is the type of the iterator. This argument can be deduced
+   * 2. DeltaInsertType is either leaf insert delta type or inner insert delta type
+   *    It is used to fetch the payload (either node ID or value type) from the key's pointer
+   * 3. For inner base nodes, since the low key could be -Inf, we do not compare the first
+   *    key-NodeID item. It is only dropped if the low key is not -Inf and has been deleted
+   *    or inserted again by deltas, which happens to the right branch of a merge
+   * 4. If a key is both in the base node and in the inserted list, it must have been deleted
+   *    and then inserted again. The inserted one is more recent and replaces the base item
+   */
+  template <typename DeltaInsertType, typename BaseNodeType, typename TargetType>
+  void MergeLoop(BaseNodeType *node_p, TargetType *target_it_p) {
+    assert(node_p->GetType() == NodeType::InnerBase || node_p->GetType() == NodeType::LeafBase);
+    // The iterator wrappes an index with the node pointer
+    BaseNodeIterator<BaseNodeType> it{node_p};
+    // If the low key is -Inf, and we know it is inner node, then ignore the first item
+    if(node_p->GetType() == NodeType::InnerBase) {
+      assert(it.IsEnd() == false);
+      typename BaseNodeType::BoundKeyType *low_key_p = node_p->GetLowKey();
+      if(low_key_p->IsInf() || (!IsDeleted(low_key_p->key) && !IsInserted(low_key_p->key))) {
+        target_it_p->Append(node_p->KeyAt(0), node_p->ValueAt(0));
+      }
+      it.Next();
+    }
+
+    while(1) {
+      bool insert_list_stop = IsTopStopped();
+      bool old_base_stop = IsBaseStopped(it);
+      if(insert_list_stop && old_base_stop) {
+        dbg_printf("Both stop\n");
+        // Both are finished
+        break;
+      } else if(insert_list_stop) {
+        dbg_printf("Flush old base\n");
+        // Copy old base items, only if they are not deleted by deltas
+        while(!IsBaseStopped(it)) {
+          if(!IsDeleted(it.GetKey())) {
+            target_it_p->Append(it.GetKey(), it.GetValue());
+          }
+
+          it.Next();
+        }
+      } else if(old_base_stop) {
+        dbg_printf("Flush insert stack\n");
+        // Copy insert list
+        while(!IsTopStopped()) {
+          target_it_p->Append(TopKey(), TopPayload<BaseNodeType, DeltaInsertType>());
+          InsertPop();
+        }
+      } else {
+        // Only test and try to insert non-deleted keys
+        if(IsDeleted(it.GetKey())) {
+          it.Next();
+        } else {
+          // Two-way merge
+          if(it.GetKey() == TopKey()) {
+            it.Next();
+          } else if(it.GetKey() > TopKey()) {
+            target_it_p->Append(TopKey(), TopPayload<BaseNodeType, DeltaInsertType>());
+            InsertPop();
+          } else {
+            target_it_p->Append(it.GetKey(), it.GetValue());
+            it.Next();
+          }
+        }
+      }
+    }
+
+    return;
+  }
+
+  // * class ItemCounter - Target of MergeLoop() that only counts the items
+  class ItemCounter {
+   public:
+    template <typename K, typename V>
+    inline void Append(const K &, const V &) { item_num++; }
+    size_t item_num;
+  };
+
+  /*
+   * CountItems() - Returns the exact number of items after consolidating the chain
+   * 
+   * 1. The first base node is reached before the other branches of a merge, so the
+   *    size is counted by a separate consolidator in counting mode, which merges every
+   *    branch into an ItemCounter without copying items
+   * 2. The virtual size of the chain is not used, since it could be wrong after merges
+   *    and deltas on the same key. DefaultSortedConsolidator counts the size without
+   *    traversing the chain twice
+   */
+  static NodeSizeType CountItems(NodeBaseType *node_p) {
+    DefaultConsolidator ct{node_p};
+    ct.counter_p = &ct.item_counter;
+    DeltaChainTraverserType::Traverse(node_p, &ct);
+    return static_cast<NodeSizeType>(ct.item_counter.item_num);
+  }
+
+  void HandleLeafBase(LeafBaseType *node_p) { 
+    dbg_printf("Handle leaf base\n");
+    SortInsertedList();
+    if(counter_p != nullptr) {
+      MergeLoop<typename DeltaType::LeafInsertType>(node_p, counter_p);
+    } else {
+      if(!new_leaf_node_it.Inited()) {
+        NodeSizeType new_size = CountItems(old_node_p);
+        new_leaf_node_it = LeafNodeIteratorType{static_cast<LeafBaseType *>(
+          LeafBaseType::Get(NodeType::LeafBase, new_size, *old_node_p->GetLowKey(), *old_node_p->GetHighKey()))};
+        dbg_printf("Creating new leaf node. Size = %lu\n", (uint64_t)new_size);
+      }
+      MergeLoop<typename DeltaType::LeafInsertType>(node_p, &new_leaf_node_it);
+    }
+
+    Finished() = true; 
+    return;
+  }
+
+  void HandleInnerBase(InnerBaseType *node_p) { 
+    SortInsertedList();
+    if(counter_p != nullptr) {
+      MergeLoop<typename DeltaType::InnerInsertType>(node_p, counter_p);
+    } else {
+      if(!new_inner_node_it.Inited()) {
+        NodeSizeType new_size = CountItems(old_node_p);
+        new_inner_node_it = InnerNodeIteratorType{static_cast<InnerBaseType *>(
+          InnerBaseType::Get(NodeType::InnerBase, new_size, *old_node_p->GetLowKey(), *old_node_p->GetHighKey()))};
+        dbg_printf("Creating new inner node. Size = %lu\n", (uint64_t)new_size);
+      }
+      MergeLoop<typename DeltaType::InnerInsertType>(node_p, &new_inner_node_it);
+    }
+
+    Finished() = true; 
+    return;
+  }
+
+  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { GetNext() = node_p->GetNext(); Insert(&node_p->GetInsertKey()); }
+  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { GetNext() = node_p->GetNext(); Insert(&node_p->GetInsertKey()); }
+
+  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { GetNext() = node_p->GetNext(); Delete(&node_p->GetDeleteKey()); }
+  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { GetNext() = node_p->GetNext(); Delete(&node_p->GetDeleteKey()); }
+
+  void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { GetNext() = node_p->GetNext(); current_high_key_p = &node_p->GetSplitKey(); }
+  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { GetNext() = node_p->GetNext(); current_high_key_p = &node_p->GetSplitKey(); }
+
+  // * BoundByMergeKey() - Limits the left branch of a merge to keys smaller than the merge key
+  //                       Inserted keys above the merge that belong to the right branch stay in the list
+  inline void BoundByMergeKey(KeyType *merge_key_p) {
+    if(current_high_key_p == nullptr || *merge_key_p < *current_high_key_p) { current_high_key_p = merge_key_p; }
+  }
+
+  // Special for merge because we recursively traverse it
+  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { 
+    // Save this such that we do not need to compare
+    size_t saved_deleted_num = deleted_num;
+    KeyType *saved_high_key_p = current_high_key_p;
+    BoundByMergeKey(&node_p->GetMergeKey());
+    DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
+    deleted_num = saved_deleted_num;
+    current_high_key_p = saved_high_key_p;
+    Finished() = false;
+    DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this);
+  }
+  void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { 
+    size_t saved_deleted_num = deleted_num;
+    KeyType *saved_high_key_p = current_high_key_p;
+    BoundByMergeKey(&node_p->GetMergeKey());
+    DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
+    deleted_num = saved_deleted_num;
+    current_high_key_p = saved_high_key_p;
+    Finished() = false;
+    DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this);
+  }
+
+  // Remove deltas only appear as the sibling branch of a merge, and do not change the content
+  void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { GetNext() = node_p->GetNext(); }
+  void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { GetNext() = node_p->GetNext(); }
+
+  // * GetNewLeafBase() * GetNewInnerBase() - Returns the node after consolidation
+  LeafBaseType *GetNewLeafBase() { return new_leaf_node_it.GetNode(); }
+  InnerBaseType *GetNewInnerBase() { return new_inner_node_it.GetNode(); }
+  // * GetNewLeafSibling() * GetNewInnerSibling() - Returns the upper half if the node is split
+  LeafBaseType *GetNewLeafSibling() { return nullptr; }
+  InnerBaseType *GetNewInnerSibling() { return nullptr; }
+
+ private:
+  // A list of pointers to keys within deltas. The chain height is only a hint
+  // of the length, since thresholds are set at run time
+  InlineArray<KeyType *, HEIGHT_THRESHOLD> inserted_list;
+  InlineArray<KeyType *, HEIGHT_THRESHOLD> deleted_list;
+  size_t inserted_num;
+  size_t deleted_num;
+  // The current high key on the branch
+  // If nullptr then did not see a split node yet (can be +Inf),
+  // in which case all elements are processed
+  KeyType *current_high_key_p;
+  // The node before consolidation
+  NodeBaseType *old_node_p;
+  // Items are only counted by CountItems() if the counter is given
+  ItemCounter item_counter;
+  ItemCounter *counter_p;
+  // The node after consolidation
+  union {
+    LeafNodeIteratorType new_leaf_node_it;
+    InnerNodeIteratorType new_inner_node_it;
+  };
+};
+
+/* 
+ * class DefaultSortedConsolidator - Consolidation with sorted delta sets
+ * 
+ * DefaultConsolidator tests every delta and every base node key against the inserted
+ * and deleted lists linearly, which is O(n * h). This consolidator instead:
+ * 
+ * 1. Records insert and delete deltas in the traversal order without testing them.
+ *    Keys not smaller than the current high key are ignored as in DefaultConsolidator
+ * 2. On the base level, the recorded deltas within the current bounds are sorted by key
+ *    and then by the traversal order. Only the first delta on a key is kept, since
+ *    it is the most recent one. This yields sorted inserted and deleted lists
+ * 3. The exact size of the new node is counted by binary searching the deltas in the
+ *    base node, such that the node is neither over nor under allocated even if the 
+ *    virtual size tracked by the deltas is inaccurate
+ * 4. After the whole chain is traversed, the new node is allocated, and each base node 
+ *    is merged with its inserted list and deleted list in one pass, since all three 
+ *    are sorted. The total cost is O(n + h log h)
+ * 5. If the exact size reaches the split size given to the constructor, both halves
+ *    of the split are written directly, instead of splitting the consolidated node
+ *    afterwards which copies the upper half again
+ * 
+ * Merge deltas are handled recursively. The left branch is bounded by the merge key
+ * from above, and the right branch by the merge key from below. Deltas recorded inside
+ * the left branch are discarded before traversing the right branch, as the two 
+ * siblings do not share any key. Each base node is recorded as a branch, in key order.
+ */
+template <typename KeyType, typename ValueType,
+          typename NodeIDType, typename DeltaChainType, 
+          template <typename, typename, typename> typename BaseNode,
+          size_t HEIGHT_THRESHOLD>
+class DefaultSortedConsolidator : 
+  public TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>,
+  public UniqueKeyBase {
+ public:
+  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>;
+  using NodeBaseType = typename BaseClassType::NodeBaseType;
+  using DeltaType = typename BaseClassType::DeltaType;
+  using LeafBaseType = typename BaseClassType::LeafBaseType;
+  using InnerBaseType = typename BaseClassType::InnerBaseType;
+  using NodeHeightType = typename NodeBaseType::NodeHeightType;
+  using NodeSizeType = typename NodeBaseType::NodeSizeType;
+  using DeltaChainTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, DefaultSortedConsolidator>;
+
+  using LeafNodeBuilderType = BaseNodeBuilder<LeafBaseType>;
+  using InnerNodeBuilderType = BaseNodeBuilder<InnerBaseType>;
+
+  // Deltas are not deduplicated while traversing, and merge deltas add up the height
+  // of both siblings, so we leave more room than the height threshold. Longer chains
+  // move the lists to the heap
+  static constexpr size_t DELTA_LIST_SIZE = HEIGHT_THRESHOLD * 4;
+  // Each merge delta adds one branch, and counts towards the height
+  static constexpr size_t BRANCH_LIST_SIZE = DELTA_LIST_SIZE;
+
+  // * class DeltaItem - A key in an insert or delete delta. The address gives the traversal order
+  class DeltaItem {
+   public:
+    KeyType *key_p;
+    bool is_insert;
+  };
+
+  // * class DeltaItemPtrLess - Orders delta items by key, and then by the traversal order
+  class DeltaItemPtrLess {
+   public:
+    inline bool operator()(const DeltaItem *p1, const DeltaItem *p2) const {
+      return *p1->key_p < *p2->key_p || (!(*p2->key_p < *p1->key_p) && p1 < p2);
+    }
+  };
+
+  // * class Branch - A base node reached by the traversal, with its bound and sorted lists
+  class Branch {
+   public:
+    NodeBaseType *node_p;
+    KeyType *high_key_p;
+    size_t inserted_begin;
+    size_t inserted_end;
+    size_t deleted_begin;
+    size_t deleted_end;
+  };
+
+  // * DefaultSortedConsolidator() - Constructor. The new node is split if its size reaches 
+  //                                 psplit_size. 0 means never split
+  DefaultSortedConsolidator(NodeBaseType *pold_node_p, NodeSizeType psplit_size = NodeSizeType{0}) : 
+    TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>{},
+    delta_num{0}, inserted_num{0}, deleted_num{0}, branch_num{0}, new_size{0}, merge_depth{0},
+    inserted_index{0}, inserted_end{0}, deleted_index{0}, deleted_end{0},
+    current_low_key_p{nullptr},
+    current_high_key_p{nullptr},
+    old_node_p{pold_node_p},
+    split_size{psplit_size},
+    new_node_p{nullptr},
+    new_sibling_p{nullptr} {}
+
+  NodeBaseType *&GetNext() { return BaseClassType::next_p; }
+  bool &Finished() { return BaseClassType::finished; }
+
+  // * GetNewSize() - Returns the exact size of the node after consolidation
+  inline NodeSizeType GetNewSize() const { return new_size; }
+  // * IsInBound() - Whether the key is within the bounds of the current branch
+  inline bool IsInBound(const KeyType &key) const {
+    return (current_low_key_p == nullptr || !(key < *current_low_key_p)) && 
+           (current_high_key_p == nullptr || key < *current_high_key_p);
+  }
+  // * Record() - Records a key in an insert or delete delta
+  inline void Record(KeyType *key_p, bool is_insert) {
+    if(current_high_key_p == nullptr || *key_p < *current_high_key_p) {
+      delta_list.Reserve(delta_num + 1);
+      delta_list[delta_num].key_p = key_p;
+      delta_list[delta_num].is_insert = is_insert;
+      delta_num++;
+    }
+  }
+
+  /*
+   * BuildSortedList() - Appends sorted inserted and deleted lists of the current branch
+   * 
+   * 1. Only deltas within the bounds of the current branch are used
+   * 2. For deltas on the same key, the one seen first during the traversal wins
+   */
+  void BuildSortedList() {
+    InlineArray<DeltaItem *, DELTA_LIST_SIZE> item_list{};
+    item_list.Reserve(delta_num);
+    inserted_list.Reserve(inserted_num + delta_num);
+    deleted_list.Reserve(deleted_num + delta_num);
+    size_t item_num = 0;
+    for(size_t i = 0;i < delta_num;i++) {
+      if(IsInBound(*delta_list[i].key_p)) { item_list[item_num++] = &delta_list[i]; }
+    }
+
+    std::sort(item_list.Data(), item_list.Data() + item_num, DeltaItemPtrLess{});
+    for(size_t i = 0;i < item_num;i++) {
+      if(i != 0 && *item_list[i]->key_p == *item_list[i - 1]->key_p) { continue; }
+      if(item_list[i]->is_insert) { inserted_list[inserted_num++] = item_list[i]->key_p; } 
+      else { deleted_list[deleted_num++] = item_list[i]->key_p; }
+    }
+
+    return;
+  }
+
+  // * LowerBound() - Returns the first index not less than the key, starting from the given index
+  template <typename BaseNodeType>
+  inline static NodeSizeType LowerBound(BaseNodeType *node_p, NodeSizeType first, const KeyType &key) {
+    NodeSizeType last = node_p->GetSize();
+    while(first < last) {
+      NodeSizeType mid = first + (last - first) / 2;
+      if(node_p->KeyAt(mid) < key) { first = mid + 1; } else { last = mid; }
+    }
+    return first;
+  }
+
+  /*
+   * AddBranch() - Records a base node and counts the number of items it contributes
+   * 
+   * 1. Base items not smaller than the current high key belong to the split sibling
+   * 2. A deleted key is only subtracted if it is in the base node. An inserted key is
+   *    only added if it is not, since otherwise it replaces the base item
+   * 3. For inner base nodes, the first item is not searched, and it is dropped if the low
+   *    key is not -Inf and has been deleted or inserted again. This is consistent 
+   *    with MergeLoop()
+   */
+  template <typename BaseNodeType>
+  void AddBranch(BaseNodeType *node_p) {
+    branch_list.Reserve(branch_num + 1);
+    Branch *branch_p = &branch_list[branch_num++];
+    branch_p->node_p = node_p;
+    branch_p->high_key_p = current_high_key_p;
+    branch_p->inserted_begin = inserted_num;
+    branch_p->deleted_begin = deleted_num;
+    BuildSortedList();
+    branch_p->inserted_end = inserted_num;
+    branch_p->deleted_end = deleted_num;
+
+    NodeSizeType first = 0;
+    if(node_p->GetType() == NodeType::InnerBase) {
+      typename BaseNodeType::BoundKeyType *low_key_p = node_p->GetLowKey();
+      bool is_dropped = !low_key_p->IsInf() && 
+        ((branch_p->inserted_begin != branch_p->inserted_end && *inserted_list[branch_p->inserted_begin] == low_key_p->key) ||
+         (branch_p->deleted_begin != branch_p->deleted_end && *deleted_list[branch_p->deleted_begin] == low_key_p->key));
+      if(is_dropped == false) { new_size++; }
+      first = 1;
+    }
+
+    NodeSizeType last = current_high_key_p == nullptr ? node_p->GetSize() : LowerBound(node_p, first, *current_high_key_p);
+    new_size += last - first;
+    for(size_t i = branch_p->deleted_begin;i < branch_p->deleted_end;i++) {
+      NodeSizeType index = LowerBound(node_p, first, *deleted_list[i]);
+      if(index < last && node_p->KeyAt(index) == *deleted_list[i]) { new_size--; }
+    }
+    for(size_t i = branch_p->inserted_begin;i < branch_p->inserted_end;i++) {
+      NodeSizeType index = LowerBound(node_p, first, *inserted_list[i]);
+      if(index == last || !(node_p->KeyAt(index) == *inserted_list[i])) { new_size++; }
+    }
+
+    return;
+  }
+
+  /*
+   * BuildNewBase() - Allocates the new node with the exact size and merges all branches
+   * 
+   * This is called after the whole delta chain is traversed
+   */
+  template <typename DeltaInsertType, typename NodeBuilderType>
+  void BuildNewBase() {
+    using BaseNodeType = typename NodeBuilderType::BaseNodeType;
+    NodeBuilderType builder{old_node_p->IsLeaf() ? NodeType::LeafBase : NodeType::InnerBase, 
+                            new_size, *old_node_p->GetLowKey(), *old_node_p->GetHighKey(),
+                            split_size != 0 && new_size >= split_size};
+    NodeBuilderType *target_it_p = &builder;
+    for(size_t i = 0;i < branch_num;i++) {
+      Branch *branch_p = &branch_list[i];
+      current_high_key_p = branch_p->high_key_p;
+      inserted_index = branch_p->inserted_begin;
+      inserted_end = branch_p->inserted_end;
+      deleted_index = branch_p->deleted_begin;
+      deleted_end = branch_p->deleted_end;
+      MergeLoop<DeltaInsertType>(static_cast<BaseNodeType *>(branch_p->node_p), target_it_p);
+    }
+
+    assert(builder.IsEnd());
+    new_node_p = builder.GetNode();
+    new_sibling_p = builder.GetSibling();
+    return;
+  }
+
+  // * Finish() - Builds the new node if the outermost traversal has finished
+  void Finish() {
+    if(merge_depth != 0) { return; }
+    if(old_node_p->IsLeaf()) {
+      BuildNewBase<typename DeltaType::LeafInsertType, LeafNodeBuilderType>();
+    } else {
+      BuildNewBase<typename DeltaType::InnerInsertType, InnerNodeBuilderType>();
+    }
+    return;
+  }
+
+  /*
+   * IsDeleted() - Whether the key is in the deleted list
+   * 
+   * Keys must be queried in ascending order, since the cursor only moves forward
+   */
+  inline bool IsDeleted(const KeyType &key) {
+    while(deleted_index < deleted_end && *deleted_list[deleted_index] < key) { deleted_index++; }
+    return deleted_index < deleted_end && *deleted_list[deleted_index] == key;
+  }
+  // * IsInsertListEmpty() - Returns true if all inserted keys have been merged
+  inline bool IsInsertListEmpty() const { return inserted_index == inserted_end; }
+  // * TopKey() - Returns the smallest inserted key not yet merged
+  inline KeyType &TopKey() { assert(IsInsertListEmpty() == false); return *inserted_list[inserted_index]; }
+  // * TopPayload() - Returns the payload (node ID for value) based on the key pointer
+  template <typename BaseNodeType, typename DeltaInsertType>
+  inline typename BaseNodeType::ValueType &TopPayload() { 
+    assert(IsInsertListEmpty() == false); 
+    return *DeltaInsertType::GetT2FromT1(inserted_list[inserted_index]);   
+  }
+  // * InsertPop() - Moves to the next inserted key
+  inline void InsertPop() { assert(IsInsertListEmpty() == false); inserted_index++; }
+
+  // * IsBaseStopped() - Whether the base node is exhausted, or the key is out of the current bound
+  template <typename IteratorType>
+  inline bool IsBaseStopped(IteratorType it) { 
+    return it.IsEnd() || (current_high_key_p != nullptr && !(it.GetKey() < *current_high_key_p)); 
+  }
+
+  /* 
+   * MergeLoop() - Merges the inserted list, the deleted list and a base node
+   * 
+   * 1. For inner base nodes, the first item is only dropped if the low key is not
+   *    -Inf and has been deleted or inserted again by deltas
+   * 2. If a key is both in the base node and in the inserted list, the inserted 
+   *    one replaces the base item
+   */
+  template <typename DeltaInsertType, typename BaseNodeType, typename TargetType>
+  void MergeLoop(BaseNodeType *node_p, TargetType *target_it_p) {
+    assert(node_p->GetType() == NodeType::InnerBase || node_p->GetType() == NodeType::LeafBase);
+    BaseNodeIterator<BaseNodeType> it{node_p};
+    if(node_p->GetType() == NodeType::InnerBase) {
+      assert(it.IsEnd() == false);
+      typename BaseNodeType::BoundKeyType *low_key_p = node_p->GetLowKey();
+      if(low_key_p->IsInf() || 
+         (!IsDeleted(low_key_p->key) && (IsInsertListEmpty() || !(TopKey() == low_key_p->key)))) {
+        target_it_p->Append(node_p->KeyAt(0), node_p->ValueAt(0));
+      }
+      it.Next();
+    }
+
+    while(!IsBaseStopped(it)) {
+      if(IsDeleted(it.GetKey())) {
+        it.Next();
+        continue;
+      }
+
+      // Inserted keys smaller than the base key go first
+      while(!IsInsertListEmpty() && TopKey() < it.GetKey()) {
+        target_it_p->Append(TopKey(), TopPayload<BaseNodeType, DeltaInsertType>());
+        InsertPop();
+      }
+
+      if(IsInsertListEmpty() || !(TopKey() == it.GetKey())) {
+        target_it_p->Append(it.GetKey(), it.GetValue());
+      }
+      it.Next();
+    }
+
+    while(!IsInsertListEmpty()) {
+      target_it_p->Append(TopKey(), TopPayload<BaseNodeType, DeltaInsertType>());
+      InsertPop();
+    }
+
+    return;
+  }
+
+  void HandleLeafBase(LeafBaseType *node_p) { AddBranch(node_p); Finish(); Finished() = true; }
+  void HandleInnerBase(InnerBaseType *node_p) { AddBranch(node_p); Finish(); Finished() = true; }
+
+  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { GetNext() = node_p->GetNext(); Record(&node_p->GetInsertKey(), true); }
+  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { GetNext() = node_p->GetNext(); Record(&node_p->GetInsertKey(), true); }
+
+  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { GetNext() = node_p->GetNext(); Record(&node_p->GetDeleteKey(), false); }
+  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { GetNext() = node_p->GetNext(); Record(&node_p->GetDeleteKey(), false); }
+
+  void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { GetNext() = node_p->GetNext(); current_high_key_p = &node_p->GetSplitKey(); }
+  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { GetNext() = node_p->GetNext(); current_high_key_p = &node_p->GetSplitKey(); }
+
+  // * HandleMerge() - Traverses the left branch and then the right branch of a merge delta
+  template <typename DeltaMergeType>
+  void HandleMerge(DeltaMergeType *node_p) {
+    size_t saved_delta_num = delta_num;
+    KeyType *saved_low_key_p = current_low_key_p;
+    KeyType *saved_high_key_p = current_high_key_p;
+    if(current_high_key_p == nullptr || node_p->GetMergeKey() < *current_high_key_p) { 
+      current_high_key_p = &node_p->GetMergeKey(); 
+    }
+    merge_depth++;
+    DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
+    delta_num = saved_delta_num;
+    current_high_key_p = saved_high_key_p;
+    current_low_key_p = &node_p->GetMergeKey();
+    Finished() = false;
+    DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this);
+    current_low_key_p = saved_low_key_p;
+    merge_depth--;
+    Finish();
+    return;
+  }
+
+  // Special for merge because we recursively traverse it
+  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { HandleMerge(node_p); }
+  void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { HandleMerge(node_p); }
+
+  // Remove deltas only appear as the sibling branch of a merge, and do not change the content
+  void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { GetNext() = node_p->GetNext(); }
+  void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { GetNext() = node_p->GetNext(); }
+
+  // * GetNewLeafBase() * GetNewInnerBase() - Returns the node after consolidation (the lower half if split)
+  LeafBaseType *GetNewLeafBase() { return static_cast<LeafBaseType *>(new_node_p); }
+  InnerBaseType *GetNewInnerBase() { return static_cast<InnerBaseType *>(new_node_p); }
+  // * GetNewLeafSibling() * GetNewInnerSibling() - Returns the upper half if the node is split
+  LeafBaseType *GetNewLeafSibling() { return static_cast<LeafBaseType *>(new_sibling_p); }
+  InnerBaseType *GetNewInnerSibling() { return static_cast<InnerBaseType *>(new_sibling_p); }
+
+ private:
+  // Insert and delete deltas in the traversal order
+  InlineArray<DeltaItem, DELTA_LIST_SIZE> delta_list;
+  size_t delta_num;
+  // Sorted lists of keys. Each branch owns a range of both lists
+  InlineArray<KeyType *, DELTA_LIST_SIZE> inserted_list;
+  InlineArray<KeyType *, DELTA_LIST_SIZE> deleted_list;
+  size_t inserted_num;
+  size_t deleted_num;
+  // Base nodes in key order, and the exact size of the new node
+  InlineArray<Branch, BRANCH_LIST_SIZE> branch_list;
+  size_t branch_num;
+  NodeSizeType new_size;
+  // The number of merge deltas being traversed recursively
+  size_t merge_depth;
+  // Merge cursors on the lists of the branch being merged
+  size_t inserted_index;
+  size_t inserted_end;
+  size_t deleted_index;
+  size_t deleted_end;
+  // The bounds of the current branch. nullptr means the bound of the node
+  KeyType *current_low_key_p;
+  KeyType *current_high_key_p;
+  // The node before consolidation
+  NodeBaseType *old_node_p;
+  NodeSizeType split_size;
+  // The node after consolidation, and the upper half if it is split
+  NodeBaseType *new_node_p;
+  NodeBaseType *new_sibling_p;
+};
+
+/* 
+ * class DefaultNonUniqueConsolidator - Consolidation of non-unique leaf nodes
+ * 
+ * Inner nodes always have unique keys, and are consolidated by DefaultConsolidator.
+ * Leaf deltas are recorded and sorted like DefaultSortedConsolidator, except that
+ * deltas are matched on both the key and the value:
+ * 
+ * 1. For deltas on the same key and value, the one seen first during the traversal
+ *    wins. Deltas on the same key with different values are all kept
+ * 2. A base value is dropped if a winning delta has the same key and value. If it is an
+ *    insert delta, the pair is emitted from the delta instead, after the base values of 
+ *    the run. Inserted values of a run are emitted in the order they were inserted
+ * 3. After the whole chain is traversed, a counting pass finds the exact number of values
+ *    and runs, and a second pass appends them to the new node run by run
+ * 
+ * Merge deltas are handled as in DefaultSortedConsolidator. The new node is never split, 
+ * since TraverseToLeaf() splits it between runs afterwards
+ */
+template <typename KeyType, typename ValueType,
+          typename NodeIDType, typename DeltaChainType, 
+          template <typename, typename, typename> typename BaseNode,
+          size_t HEIGHT_THRESHOLD>
+class DefaultNonUniqueConsolidator : 
+  public DefaultConsolidator<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, HEIGHT_THRESHOLD> {
+ public:
+  using BaseClassType = DefaultConsolidator<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, HEIGHT_THRESHOLD>;
+  using NodeBaseType = typename BaseClassType::NodeBaseType;
+  using DeltaType = typename BaseClassType::DeltaType;
+  using LeafBaseType = typename BaseClassType::LeafBaseType;
+  using InnerBaseType = typename BaseClassType::InnerBaseType;
+  using NodeSizeType = typename NodeBaseType::NodeSizeType;
+  using DeltaChainTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, DefaultNonUniqueConsolidator>;
+  // Hides the flag inherited from DefaultConsolidator
+  static constexpr bool support_non_unique_key = true;
+  static constexpr size_t DELTA_LIST_SIZE = HEIGHT_THRESHOLD * 4;
+  static constexpr size_t BRANCH_LIST_SIZE = DELTA_LIST_SIZE;
+
+  // * class DeltaItem - A key in an insert or delete delta. The value follows the key in the delta
+  class DeltaItem {
+   public:
+    KeyType *key_p;
+    bool is_insert;
+    // * GetValue() - Returns the value of the delta
+    inline ValueType &GetValue() const { return *DeltaType::LeafInsertType::GetT2FromT1(key_p); }
+  };
+
+  // * class DeltaItemPtrLess - Orders delta items by key, and then by the traversal order
+  class DeltaItemPtrLess {
+   public:
+    inline bool operator()(const DeltaItem *p1, const DeltaItem *p2) const {
+      return *p1->key_p < *p2->key_p || (!(*p2->key_p < *p1->key_p) && p1 < p2);
+    }
+  };
+
+  // * class Branch - A leaf base node reached by the traversal, with its bound and sorted deltas
+  class Branch {
+   public:
+    LeafBaseType *node_p;
+    KeyType *high_key_p;
+    size_t item_begin;
+    size_t item_end;
+  };
+
+  // * class CountingTarget - Counts the values and runs appended, without writing them
+  class CountingTarget {
+   public:
+    CountingTarget() : size{0}, key_num{0}, last_key_p{nullptr} {}
+    inline void Append(const KeyType &key, const ValueType &) {
+      if(last_key_p == nullptr || !(*last_key_p == key)) { key_num++; }
+      last_key_p = &key;
+      size++;
+    }
 
- protected:
-  bool finished;
-  NodeBaseType *next_p;
+    NodeSizeType size;
+    NodeSizeType key_num;
+    // Keys are either in base nodes or in deltas, which outlive the consolidation
+    const KeyType *last_key_p;
+  };
+
+  // * DefaultNonUniqueConsolidator() - Constructor. The split size is ignored
+  DefaultNonUniqueConsolidator(NodeBaseType *pold_node_p, NodeSizeType = NodeSizeType{0}) : 
+    BaseClassType{pold_node_p},
+    delta_num{0}, item_num{0}, branch_num{0}, merge_depth{0},
+    current_low_key_p{nullptr},
+    current_high_key_p{nullptr},
+    old_node_p{pold_node_p},
+    new_node_p{nullptr} {}
+
+  NodeBaseType *&GetNext() { return BaseClassType::GetNext(); }
+  bool &Finished() { return BaseClassType::Finished(); }
+
+  // * IsInBound() - Whether the key is within the bounds of the current branch
+  inline bool IsInBound(const KeyType &key) const {
+    return (current_low_key_p == nullptr || !(key < *current_low_key_p)) && 
+           (current_high_key_p == nullptr || key < *current_high_key_p);
+  }
+  // * Record() - Records an insert or delete delta
+  inline void Record(KeyType *key_p, bool is_insert) {
+    if(current_high_key_p == nullptr || *key_p < *current_high_key_p) {
+      delta_list.Reserve(delta_num + 1);
+      delta_list[delta_num].key_p = key_p;
+      delta_list[delta_num].is_insert = is_insert;
+      delta_num++;
+    }
+  }
+
+  /*
+   * AddBranch() - Records a base node and appends the sorted deltas of the current branch
+   * 
+   * Deltas are sorted by key and then by the traversal order. A delta is dropped if an
+   * earlier one in the same key group has the same value
+   */
+  void AddBranch(LeafBaseType *node_p) {
+    branch_list.Reserve(branch_num + 1);
+    Branch *branch_p = &branch_list[branch_num++];
+    branch_p->node_p = node_p;
+    branch_p->high_key_p = current_high_key_p;
+    branch_p->item_begin = item_num;
+
+    InlineArray<DeltaItem *, DELTA_LIST_SIZE> sort_list{};
+    sort_list.Reserve(delta_num);
+    item_list.Reserve(item_num + delta_num);
+    size_t sort_num = 0;
+    for(size_t i = 0;i < delta_num;i++) {
+      if(IsInBound(*delta_list[i].key_p)) { sort_list[sort_num++] = &delta_list[i]; }
+    }
+
+    std::sort(sort_list.Data(), sort_list.Data() + sort_num, DeltaItemPtrLess{});
+    size_t group_begin = item_num;
+    for(size_t i = 0;i < sort_num;i++) {
+      if(i == 0 || !(*sort_list[i]->key_p == *sort_list[i - 1]->key_p)) { group_begin = item_num; }
+      if(IsInItems(sort_list[i]->GetValue(), group_begin, item_num) == false) { item_list[item_num++] = *sort_list[i]; }
+    }
+
+    branch_p->item_end = item_num;
+    return;
+  }
+
+  // * IsInItems() - Whether a sorted delta in the range has the value. The range must be on the same key
+  inline bool IsInItems(const ValueType &value, size_t begin, size_t end) {
+    for(size_t i = begin;i < end;i++) { if(item_list[i].GetValue() == value) { return true; } }
+    return false;
+  }
+  // * GetGroupEnd() - Returns the end of sorted deltas on the same key as the one on the index
+  inline size_t GetGroupEnd(size_t index, size_t end) {
+    size_t group_end = index + 1;
+    while(group_end < end && *item_list[group_end].key_p == *item_list[index].key_p) { group_end++; }
+    return group_end;
+  }
+  // * AppendInserted() - Appends inserted pairs in a group, from the oldest to the most recent
+  template <typename TargetType>
+  inline void AppendInserted(size_t begin, size_t end, TargetType *target_p) {
+    for(size_t i = end;i > begin;i--) {
+      if(item_list[i - 1].is_insert) { target_p->Append(*item_list[i - 1].key_p, item_list[i - 1].GetValue()); }
+    }
+  }
+
+  /* 
+   * MergeBranch() - Merges the sorted deltas and the base node of a branch run by run
+   * 
+   * Runs not smaller than the high key of the branch belong to the split sibling
+   */
+  template <typename TargetType>
+  void MergeBranch(Branch *branch_p, TargetType *target_p) {
+    LeafBaseType *node_p = branch_p->node_p;
+    size_t item = branch_p->item_begin;
+    size_t end = branch_p->item_end;
+    for(NodeSizeType run = 0;run < node_p->GetRunNum();run++) {
+      const KeyType &key = node_p->RunKeyAt(run);
+      if(branch_p->high_key_p != nullptr && !(key < *branch_p->high_key_p)) { break; }
+      // Inserted keys smaller than the run go first
+      while(item < end && *item_list[item].key_p < key) {
+        size_t group_end = GetGroupEnd(item, end);
+        AppendInserted(item, group_end, target_p);
+        item = group_end;
+      }
+
+      size_t group_begin = item;
+      if(item < end && *item_list[item].key_p == key) { item = GetGroupEnd(item, end); }
+      for(NodeSizeType i = node_p->GetRunBegin(run);i < node_p->GetRunEnd(run);i++) {
+        ValueType &value = node_p->ValueAt(static_cast<int>(i));
+        if(IsInItems(value, group_begin, item) == false) { target_p->Append(key, value); }
+      }
+      AppendInserted(group_begin, item, target_p);
+    }
+
+    while(item < end) {
+      size_t group_end = GetGroupEnd(item, end);
+      AppendInserted(item, group_end, target_p);
+      item = group_end;
+    }
+
+    return;
+  }
+
+  // * Finish() - Counts and builds the new node if the outermost traversal has finished
+  void Finish() {
+    if(merge_depth != 0) { return; }
+    CountingTarget counter{};
+    for(size_t i = 0;i < branch_num;i++) { MergeBranch(&branch_list[i], &counter); }
+    new_node_p = LeafBaseType::Get(NodeType::LeafBase, counter.size, 
+                                   *old_node_p->GetLowKey(), *old_node_p->GetHighKey(), counter.key_num);
+    for(size_t i = 0;i < branch_num;i++) { MergeBranch(&branch_list[i], new_node_p); }
+    return;
+  }
+
+  void HandleLeafBase(LeafBaseType *node_p) { AddBranch(node_p); Finish(); Finished() = true; }
+
+  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { GetNext() = node_p->GetNext(); Record(&node_p->GetInsertKey(), true); }
+  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { GetNext() = node_p->GetNext(); Record(&node_p->GetDeleteKey(), false); }
+  void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { GetNext() = node_p->GetNext(); current_high_key_p = &node_p->GetSplitKey(); }
+
+  // Special for merge because we recursively traverse it
+  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { 
+    size_t saved_delta_num = delta_num;
+    KeyType *saved_low_key_p = current_low_key_p;
+    KeyType *saved_high_key_p = current_high_key_p;
+    if(current_high_key_p == nullptr || node_p->GetMergeKey() < *current_high_key_p) { 
+      current_high_key_p = &node_p->GetMergeKey(); 
+    }
+    merge_depth++;
+    DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
+    delta_num = saved_delta_num;
+    current_high_key_p = saved_high_key_p;
+    current_low_key_p = &node_p->GetMergeKey();
+    Finished() = false;
+    DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this);
+    current_low_key_p = saved_low_key_p;
+    merge_depth--;
+    Finish();
+  }
+  void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { GetNext() = node_p->GetNext(); }
+
+  // * GetNewLeafBase() - Returns the leaf node after consolidation
+  LeafBaseType *GetNewLeafBase() { return new_node_p; }
+
+ private:
+  // Insert and delete deltas in the traversal order
+  InlineArray<DeltaItem, DELTA_LIST_SIZE> delta_list;
+  size_t delta_num;
+  // Sorted deltas. Each branch owns a range
+  InlineArray<DeltaItem, DELTA_LIST_SIZE> item_list;
+  size_t item_num;
+  // Base nodes in key order
+  InlineArray<Branch, BRANCH_LIST_SIZE> branch_list;
+  size_t branch_num;
+  // The number of merge deltas being traversed recursively
+  size_t merge_depth;
+  // The bounds of the current branch. nullptr means the bound of the node
+  KeyType *current_low_key_p;
+  KeyType *current_high_key_p;
+  // The node before consolidation
+  NodeBaseType *old_node_p;
+  // The node after consolidation
+  LeafBaseType *new_node_p;
 };
 
 /*
- * class DeltaChainTraverser - This class implements a state machine for abstracting 
- *                             away details of delta chain traversal. 
- * 
- * The TraverseHandlerType is a template argument that defines states and functions
- * for handling deltas and base nodes. Details of interfacing with the 
- * call back type is presented below:
+ * class ValueSearcher - Searches using a key and returns the value or node ID
  * 
-  // Template arguments can be adjusted according to the needs, but the following are required
-  template <typename KeyType, typename ValueType, typename NodeIDType, 
-            typename DeltaChainType, template <typename, typename, typename> typename BaseNode>
-  class TraverseHandlerType : public TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType> {
-  public:
-    using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>;
-    using NodeBaseType = typename BaseClassType::NodeBaseType;
-    using DeltaType = typename BaseClassType::DeltaType;
-    using LeafBaseType = typename BaseClassType::LeafBaseType;
-    using InnerBaseType = typename BaseClassType::InnerBaseType;
-    // Note: Change the class name
-    using DeltaChainTraverserType = \                                               |------  Change It ---------| 
-      DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, >>>>>TraverseHandlerType<<<<< >
+ * 1. On leaf nodes, the searcher stops at the first insert or delete delta on
+ *    the key. If it reaches the base node then a point search is performed.
+ *    The value pointer is nullptr if the key does not exist
+ * 2. On inner nodes, the searcher stops at the first insert delta whose range
+ *    covers the key, or the first delete delta whose merged range covers the key.
+ *    Otherwise the base node is searched. The result is the node ID of the next level
+ * 3. Merge deltas are followed by searching only the branch that covers the key.
+ *    Split deltas and remove deltas do not affect the result, because the caller
+ *    must have already checked that the key is within the range of the node
+ * 4. Insert and delete deltas record the offset of their key in the base node. Since
+ *    Search() is monotonic, a search key smaller than the delta key is found at or
+ *    before that offset, and otherwise at or after it. Passing a delta narrows the 
+ *    range of the final Search() on the base node. Offsets are relative to the base
+ *    node of the chain, so the range is reset when the merge sibling is traversed
+ * 5. GetBaseOffset() returns the offset of the search key in the base node of the chain, 
+ *    which is recorded in the delta appended after the search
+ * 6. Leaf deltas carry a key filter of the chain below them. If the key is not in it,
+ *    the rest of the deltas are skipped and the base node is searched directly
+ */
+template <typename KeyType, typename ValueType,
+          typename MappingTableType, typename DeltaChainType, 
+          template <typename, typename, typename> typename BaseNode>
+class ValueSearcher : 
+  public TraverseHandlerBase<KeyType, ValueType, typename MappingTableType::NodeIDType, DeltaChainType, BaseNode>,
+  public UniqueKeyBase {
+ public:
+  using NodeIDType = typename MappingTableType::NodeIDType;
+  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>;
+  using NodeBaseType = typename BaseClassType::NodeBaseType;
+  using DeltaType = typename BaseClassType::DeltaType;
+  using LeafBaseType = typename BaseClassType::LeafBaseType;
+  using InnerBaseType = typename BaseClassType::InnerBaseType;
+  using NodeHeightType = typename NodeBaseType::NodeHeightType;
+  using NodeSizeType = typename NodeBaseType::NodeSizeType;
+  using BoundKeyType = typename NodeBaseType::BoundKeyType;
+  using DeltaChainTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, ValueSearcher>;
+  static constexpr NodeIDType INVALID_NODE_ID = MappingTableType::INVALID_NODE_ID;
 
-    TraverseHandlerType() : TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>{} {}
+  static constexpr NodeSizeType INVALID_OFFSET = NodeBaseType::INVALID_OFFSET;
 
-    void HandleLeafBase(LeafBaseType *node_p) { }
-    void HandleInnerBase(InnerBaseType *node_p) { }
+  // * ValueSearcher() - Constructor
+  ValueSearcher(const KeyType &pkey) : 
+    TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>{},
+    key{pkey}, next_id{INVALID_NODE_ID}, value_p{nullptr}, 
+    first{0}, last{INVALID_OFFSET}, base_offset{INVALID_OFFSET}, in_sibling{false} {}
 
-    void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { }
-    void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { }
+  NodeBaseType *&GetNext() { return BaseClassType::next_p; }
+  bool &Finished() { return BaseClassType::finished; }
 
-    void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { }
-    void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { }
+  // * GetValue() - Returns the value pointer, or nullptr if not found (leaf only)
+  inline ValueType *GetValue() const { return value_p; }
+  // * GetNextID() - Returns the node ID of the next level (inner only)
+  inline NodeIDType GetNextID() const { return next_id; }
+  // * GetBaseOffset() - Returns the offset of the key in the base node of the chain, or INVALID_OFFSET
+  inline NodeSizeType GetBaseOffset() const { return base_offset; }
+
+  // * Narrow() - Narrows the search range on the base node by the offset recorded in a delta
+  inline void Narrow(const KeyType &delta_key, NodeSizeType offset) {
+    if(offset == INVALID_OFFSET) { return; }
+    if(key < delta_key) { last = std::min(last, offset); } else { first = std::max(first, offset); }
+  }
+  // * SetBaseOffset() - Takes the offset of a delta on the search key, if it is for the base node of the chain
+  inline void SetBaseOffset(NodeSizeType offset) { if(in_sibling == false) { base_offset = offset; } }
+  // * SearchBase() - Searches the base node within the narrowed range
+  template <typename BaseNodeType>
+  inline int SearchBase(BaseNodeType *node_p) {
+    int index = node_p->Search(key, first, std::min(last, static_cast<NodeSizeType>(node_p->GetSize() - 1)));
+    SetBaseOffset(static_cast<NodeSizeType>(index));
+    return index;
+  }
+  // * EnterSibling() - Resets the range before traversing the merge sibling, whose base node is different
+  inline void EnterSibling() { first = 0; last = INVALID_OFFSET; in_sibling = true; }
+  // * FollowLeafDelta() - Goes to the base node directly if no delta below has the key. See DeltaKeyFilter
+  template <typename DeltaNodeType>
+  inline void FollowLeafDelta(DeltaNodeType *node_p) {
+    if(DeltaKeyFilter<KeyType>::MayContain(node_p->GetKeyFilter(), key)) { GetNext() = node_p->GetNext(); }
+    else { GetNext() = node_p->template GetBase<DeltaChainType>(); }
+  }
 
-    void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { }
-    void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { }
+  // * InLowerBound() * InUpperBound() - Whether the key is within the bounds. Inf means -Inf and +Inf resp.
+  inline bool InLowerBound(const BoundKeyType &low_key) const { return low_key.IsInf() || low_key <= key; }
+  inline bool InUpperBound(const BoundKeyType &high_key) const { return high_key.IsInf() || high_key > key; }
 
-    void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { }
-    void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { }
+  void HandleLeafBase(LeafBaseType *node_p) { 
+    // Empty leaf nodes could not be searched
+    if(node_p->GetSize() != 0) {
+      int index = SearchBase(node_p);
+      if(node_p->KeyAt(index) == key) { value_p = &node_p->ValueAt(index); }
+    }
 
-    void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { }
-    void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { }
+    Finished() = true; 
+    return;
+  }
 
-    // * GetNext() - Interface for accessing next_p
-    NodeBaseType *&GetNext() { return BaseClassType::next_p; }
-    // * Finished() - Interface for accessing finished
-    bool &Finished() { return BaseClassType::finished; }
-  };
+  void HandleInnerBase(InnerBaseType *node_p) { 
+    next_id = node_p->ValueAt(SearchBase(node_p));
+    Finished() = true; 
+    return;
+  }
+
+  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { 
+    if(node_p->GetInsertKey() == key) { 
+      value_p = &node_p->GetInsertValue(); 
+      SetBaseOffset(node_p->GetBaseOffset());
+      Finished() = true; 
+    }
+    Narrow(node_p->GetInsertKey(), node_p->GetBaseOffset());
+    FollowLeafDelta(node_p);
+  }
+  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { 
+    if(key >= node_p->GetInsertKey() && InUpperBound(node_p->GetNextKey())) { next_id = node_p->GetInsertNodeID(); Finished() = true; }
+    Narrow(node_p->GetInsertKey(), node_p->GetBaseOffset());
+    GetNext() = node_p->GetNext();  
+  }
+
+  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { 
+    if(node_p->GetDeleteKey() == key) { 
+      value_p = nullptr; 
+      SetBaseOffset(node_p->GetBaseOffset());
+      Finished() = true; 
+    }
+    Narrow(node_p->GetDeleteKey(), node_p->GetBaseOffset());
+    FollowLeafDelta(node_p);
+  }
+  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { 
+    // After deletion, the range [prev key, next key) belongs to the previous node ID
+    if(InLowerBound(node_p->GetPrevKey()) && InUpperBound(node_p->GetNextKey())) { next_id = node_p->GetPrevNodeID(); Finished() = true; }
+    Narrow(node_p->GetDeleteKey(), node_p->GetBaseOffset());
+    GetNext() = node_p->GetNext();  
+  }
+
+  void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { GetNext() = node_p->GetNext(); }
+  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { GetNext() = node_p->GetNext(); }
+
+  // Only the branch that covers the search key is traversed
+  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { HandleMerge(node_p); }
+  void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { HandleMerge(node_p); }
+  template <typename DeltaMergeType>
+  inline void HandleMerge(DeltaMergeType *node_p) {
+    if(key >= node_p->GetMergeKey()) { 
+      EnterSibling();
+      DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this); 
+    } else {
+      DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
+    }
+  }
+
+  void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { GetNext() = node_p->GetNext(); }
+  void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { GetNext() = node_p->GetNext(); }
+
+ protected:
+  // The search key
+  KeyType key;
+  // Node id to the next level
+  NodeIDType next_id;
+  // Value that matches the key
+  ValueType *value_p;
+  // The range of Search() on the base node, narrowed by deltas
+  NodeSizeType first;
+  NodeSizeType last;
+  // The offset of the key in the base node of the chain
+  NodeSizeType base_offset;
+  // Whether a merge sibling is being traversed
+  bool in_sibling;
+};
+
+/*
+ * class NonUniqueValueSearcher - Searches values of a non-unique key
  * 
- * 1. Base nodes must be the terminating node because they do not have next pointer.
- * 2. If merge nodes must be accessed recursively (e.g. node consolidation), then
- *    the traverser must perform this in the merge handler itself, and set finished
- *    flag to true
+ * 1. Without a target value, all values of the key are collected. A value in an insert
+ *    delta is only collected if no more recent delta on the key has the same value, and
+ *    a value in the base node if no delta on the key has it. GetValue() returns the first
+ * 2. With a target value, only the pair is searched. The first insert or delete delta 
+ *    on the pair decides the result. Otherwise the run of the key in the base node is searched
+ * 3. Inner nodes are searched as in ValueSearcher
  */
-template <typename KeyType, typename ValueType, typename NodeIDType, 
-          typename DeltaChainType, template <typename, typename, typename> typename BaseNode, 
-          typename TraverseHandlerType>
-class DeltaChainTraverser {
+template <typename KeyType, typename ValueType,
+          typename MappingTableType, typename DeltaChainType, 
+          template <typename, typename, typename> typename BaseNode>
+class NonUniqueValueSearcher : 
+  public ValueSearcher<KeyType, ValueType, MappingTableType, DeltaChainType, BaseNode> {
  public:
-  using DeltaType = Delta<KeyType, ValueType, NodeIDType>;
-  using NodeBaseType = NodeBase<KeyType>;
-  using LeafBaseType = BaseNode<KeyType, ValueType, DeltaChainType>;
-  using InnerBaseType = BaseNode<KeyType, NodeIDType, DeltaChainType>;
+  using BaseClassType = ValueSearcher<KeyType, ValueType, MappingTableType, DeltaChainType, BaseNode>;
+  using DeltaType = typename BaseClassType::DeltaType;
+  using LeafBaseType = typename BaseClassType::LeafBaseType;
+  using NodeSizeType = typename BaseClassType::NodeSizeType;
+  using DeltaChainTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, typename BaseClassType::NodeIDType, DeltaChainType, BaseNode, NonUniqueValueSearcher>;
+  // Hides the flag inherited from ValueSearcher
+  static constexpr bool support_non_unique_key = true;
+  // Number of values and delta values stored inline
+  static constexpr size_t INLINE_VALUE_NUM = 16;
+
+  // * NonUniqueValueSearcher() - Constructor. target_p is the value to search, or nullptr for all values
+  NonUniqueValueSearcher(const KeyType &pkey, const ValueType *ptarget_p = nullptr) : 
+    BaseClassType{pkey}, target_p{ptarget_p}, value_num{0}, seen_num{0} {}
+
+  // * GetValueNum() * GetValueAt() - Returns the number of values found, and each of them
+  inline size_t GetValueNum() const { return value_num; }
+  inline ValueType *GetValueAt(size_t index) { assert(index < value_num); return value_list[index]; }
+
+  // * IsTarget() - Whether the value is searched
+  inline bool IsTarget(const ValueType &value) const { return target_p == nullptr || *target_p == value; }
+  // * IsSeen() - Whether the value is in a more recent delta on the key
+  inline bool IsSeen(const ValueType &value) {
+    for(size_t i = 0;i < seen_num;i++) { if(*seen_list[i] == value) { return true; } }
+    return false;
+  }
+  // * AddValue() - Adds a value to the result. The traverse finishes if a target value is given
+  inline void AddValue(ValueType *value_p) {
+    if(value_num == 0) { BaseClassType::value_p = value_p; }
+    value_list.Reserve(value_num + 1);
+    value_list[value_num++] = value_p;
+    if(target_p != nullptr) { BaseClassType::Finished() = true; }
+  }
+  /*
+   * HandleDelta() - Adds the value of an insert delta if it is not seen, and records it as seen
+   * 
+   * The offset narrows the base node search as in ValueSearcher. If a target value is given
+   * and the traverse finishes at the delta, the offset is the base offset of the key
+   */
+  template <typename DeltaNodeType>
+  inline void HandleDelta(DeltaNodeType *node_p, const KeyType &delta_key, ValueType *delta_value_p, bool is_insert) {
+    BaseClassType::Narrow(delta_key, node_p->GetBaseOffset());
+    if(!(delta_key == BaseClassType::key) || !IsTarget(*delta_value_p) || IsSeen(*delta_value_p)) { return; }
+    if(is_insert) { AddValue(delta_value_p); } else if(target_p != nullptr) { BaseClassType::Finished() = true; }
+    if(BaseClassType::Finished()) { BaseClassType::SetBaseOffset(node_p->GetBaseOffset()); }
+    seen_list.Reserve(seen_num + 1);
+    seen_list[seen_num++] = delta_value_p;
+  }
 
-  // * Traverse() - Starts traversing the delta chain
-  static void Traverse(NodeBaseType *node_p, TraverseHandlerType *handler_p) {
-    while(true) {
-      NodeType type = node_p->GetType();
-      switch(type) {
-        case NodeType::LeafBase:
-          handler_p->HandleLeafBase(static_cast<LeafBaseType *>(node_p));
-          assert(handler_p->Finished() == true);
-          break;
-        case NodeType::InnerBase:
-          handler_p->HandleInnerBase(static_cast<InnerBaseType *>(node_p));
-          assert(handler_p->Finished() == true);
-          break;
-        case NodeType::LeafInsert:
-          handler_p->HandleLeafInsert(static_cast<typename DeltaType::LeafInsertType *>(node_p));
-          break;
-        case NodeType::InnerInsert:
-          handler_p->HandleInnerInsert(static_cast<typename DeltaType::InnerInsertType *>(node_p));
-          break;
-        case NodeType::LeafDelete:
-          handler_p->HandleLeafDelete(static_cast<typename DeltaType::LeafDeleteType *>(node_p));
-          break;
-        case NodeType::InnerDelete:
-          handler_p->HandleInnerDelete(static_cast<typename DeltaType::InnerDeleteType *>(node_p));
-          break;
-        case NodeType::LeafSplit:
-          handler_p->HandleLeafSplit(static_cast<typename DeltaType::LeafSplitType *>(node_p));
-          break;
-        case NodeType::InnerSplit:
-          handler_p->HandleInnerSplit(static_cast<typename DeltaType::InnerSplitType *>(node_p));
-          break;
-        case NodeType::LeafMerge: 
-          handler_p->HandleLeafMerge(static_cast<typename DeltaType::LeafMergeType *>(node_p));
-          assert(handler_p->Finished());
-          return;
-        case NodeType::InnerMerge:
-          handler_p->HandleInnerMerge(static_cast<typename DeltaType::InnerMergeType *>(node_p));
-          assert(handler_p->Finished());
-          return;
-        case NodeType::LeafRemove:
-          handler_p->HandleLeafRemove(static_cast<typename DeltaType::LeafRemoveType *>(node_p));
-          break;
-        case NodeType::InnerRemove:
-          handler_p->HandleInnerRemove(static_cast<typename DeltaType::InnerRemoveType *>(node_p));
-          break;
-        default:
-          assert(false && "Unknown node type during traversal");
-      } // switch
+  // * SearchRun() - Searches the run of the key within the narrowed range, or returns -1 if not found
+  inline int SearchRun(LeafBaseType *node_p) {
+    NodeSizeType last = std::min(BaseClassType::last, static_cast<NodeSizeType>(node_p->GetSize() - 1));
+    NodeSizeType run = node_p->SearchRun(BaseClassType::key, BaseClassType::first, last);
+    BaseClassType::SetBaseOffset(node_p->GetRunEnd(run) - 1);
+    return node_p->RunKeyAt(run) == BaseClassType::key ? static_cast<int>(run) : -1;
+  }
 
-      // If the handler says to stop then break
-      if(handler_p->Finished()) {
-        break;
-      } else {
-        node_p = handler_p->GetNext();
+  void HandleLeafBase(LeafBaseType *node_p) { 
+    // Empty leaf nodes could not be searched
+    int run = node_p->GetSize() == 0 ? -1 : SearchRun(node_p);
+    if(run != -1) {
+      NodeSizeType end = node_p->GetRunEnd(static_cast<NodeSizeType>(run));
+      for(NodeSizeType i = node_p->GetRunBegin(static_cast<NodeSizeType>(run));i < end;i++) {
+        ValueType *value_p = &node_p->ValueAt(static_cast<int>(i));
+        if(IsTarget(*value_p) && !IsSeen(*value_p)) { 
+          AddValue(value_p); 
+          if(target_p != nullptr) { break; }
+        }
       }
-    } // while
+    }
 
+    BaseClassType::Finished() = true; 
     return;
   }
+
+  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { 
+    HandleDelta(node_p, node_p->GetInsertKey(), &node_p->GetInsertValue(), true);
+    BaseClassType::FollowLeafDelta(node_p);
+  }
+  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { 
+    HandleDelta(node_p, node_p->GetDeleteKey(), &node_p->GetDeleteValue(), false);
+    BaseClassType::FollowLeafDelta(node_p);
+  }
+
+  // Only the branch that covers the search key is traversed
+  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { 
+    if(BaseClassType::key >= node_p->GetMergeKey()) { 
+      BaseClassType::EnterSibling();
+      DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this); 
+    } else {
+      DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
+    }
+  }
+
+ private:
+  // The value to search, or nullptr if all values are collected
+  const ValueType *target_p;
+  // Values found, in the order of the traversal
+  InlineArray<ValueType *, INLINE_VALUE_NUM> value_list;
+  size_t value_num;
+  // Values of deltas on the key that have been traversed
+  InlineArray<ValueType *, INLINE_VALUE_NUM> seen_list;
+  size_t seen_num;
 };
 
-/*
- * class AppendHelper - Helper class that acts as a proxy for appending deltas
- * 
- * 1. We decouple the appending of deltas from node base or mapping table class
- *    to modularize the design, because this step is largely independent from
- *    the design choices of the mapping table or the node base
- * 2. The appending functions returns nullptr if the CAS succeeds, in which case
- *    the internal node_p is updated to reflect the updated view of the node
- *    The internal node can be accessed using GetNode()
- * 3. If CAS fails, the delta node is returned. The caller could either choose to
- *    destroy it, or retry the CAS
- */
-template <typename KeyType, typename ValueType,
-          typename MappingTableType, typename DeltaChainType>
-class AppendHelper {
+template <typename _KeyType, typename _ValueType, 
+          template <typename, size_t> typename MappingTable, 
+          typename _DeltaChainType, 
+          template <typename, typename, typename> typename BaseNode,
+          template <typename, typename, typename, typename, template <typename, typename, typename> typename, size_t> typename Consolidator,
+          typename _EpochManagerType = DefaultEpochManagerType,
+          typename _StatsType = DefaultNullStatsType,
+          typename _ConfigType = DefaultStaticConfigType,
+          typename _HeightPolicyType = DefaultHeightPolicyType,
+          typename _LogType = DefaultNullLogType,
+          typename _TracerType = DefaultNullTracerType>
+class BwTree {
  public:
-  using NodeIDType = typename MappingTableType::NodeIDType;
-  using DeltaType = Delta<KeyType, ValueType, NodeIDType>;
+  // Argument types
+  using KeyType = _KeyType;
+  using ValueType = _ValueType;
+  using DeltaChainType = _DeltaChainType;
+  using EpochManagerType = _EpochManagerType;
+  using StatsType = _StatsType;
+  using ConfigType = _ConfigType;
+  using HeightPolicyType = _HeightPolicyType;
+  using LogType = _LogType;
+  using TracerType = _TracerType;
+  // Thresholds are given by the config. These are only compile time capacities
+  static constexpr size_t MAPPING_TABLE_SIZE = ConfigType::MAPPING_TABLE_CAPACITY;
+  static constexpr size_t HEIGHT_THREADHOLD = ConfigType::HEIGHT_CAPACITY;
+  // Number of keys whose descents are interleaved by batch operations
+  static constexpr size_t BATCH_GROUP_SIZE = 16;
+  // Background maintenance (StartMaintenance()). Chains reaching MAINTENANCE_HEIGHT_FACTOR
+  // times the threshold are consolidated by traversals even if workers are running. Workers
+  // reclaim garbage when the queue is empty, or after MAINTENANCE_RECLAIM_INTERVAL node IDs
+  static constexpr size_t MAINTENANCE_QUEUE_SIZE = 4096;
+  static constexpr size_t MAINTENANCE_HEIGHT_FACTOR = 2;
+  static constexpr size_t MAINTENANCE_IDLE_US = 100;
+  static constexpr size_t MAINTENANCE_RECLAIM_INTERVAL = 64;
+  // Snapshots (Checkpoint()). Records are aligned such that base nodes could be used in place
+  static constexpr uint64_t SNAPSHOT_MAGIC = 0x31504E5354574275UL;
+  static constexpr size_t SNAPSHOT_ALIGNMENT = 64;
+  // Derived types
   using NodeBaseType = NodeBase<KeyType>;
+  using ExtendedBaseType = ExtendedNodeBase<KeyType, DeltaChainType>;
+  using MappingTableType = MappingTable<NodeBaseType, MAPPING_TABLE_SIZE>;
+  // Metadata variable types
+  using NodeIDType = typename MappingTableType::NodeIDType;
   using NodeSizeType = typename NodeBaseType::NodeSizeType;
   using NodeHeightType = typename NodeBaseType::NodeHeightType;
-  using ExtendedBaseType = ExtendedNodeBase<KeyType, DeltaChainType>;
-  using BoundKeyType = typename ExtendedBaseType::BoundKeyType;
+  using BoundKeyType = typename NodeBaseType::BoundKeyType;
+  // Delta and base node types
+  using DeltaType = Delta<KeyType, ValueType, NodeIDType>;
+  using LeafBaseType = BaseNode<KeyType, ValueType, DeltaChainType>;
+  using InnerBaseType = BaseNode<KeyType, NodeIDType, DeltaChainType>;
   using LeafInsertType = typename DeltaType::LeafInsertType;
   using LeafDeleteType = typename DeltaType::LeafDeleteType;
   using LeafSplitType = typename DeltaType::LeafSplitType;
@@ -872,646 +5693,1622 @@ class AppendHelper {
   using InnerSplitType = typename DeltaType::InnerSplitType;
   using InnerMergeType = typename DeltaType::InnerMergeType;
   using InnerRemoveType = typename DeltaType::InnerRemoveType;
+  // Helper types
+  using AppendHelperType = AppendHelper<KeyType, ValueType, MappingTableType, DeltaChainType, StatsType>;
+  using DeltaChainFreeHelperType = DeltaChainFreeHelper<KeyType, ValueType, MappingTableType, DeltaChainType, BaseNode>;
+  using ConsolidatorType = Consolidator<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, HEIGHT_THREADHOLD>;
+  // Trees with non-unique keys search key value pairs and value runs
+  using ValueSearcherType = typename std::conditional<LeafBaseType::support_non_unique_key,
+    NonUniqueValueSearcher<KeyType, ValueType, MappingTableType, DeltaChainType, BaseNode>,
+    ValueSearcher<KeyType, ValueType, MappingTableType, DeltaChainType, BaseNode>>::type;
+  static_assert(ConsolidatorType::support_non_unique_key == LeafBaseType::support_non_unique_key, "Inconsistent non-unique key support");
+  static_assert(ValueSearcherType::support_non_unique_key == LeafBaseType::support_non_unique_key, "Inconsistent non-unique key support");
+  using DeltaChainFreeTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, DeltaChainFreeHelperType>;
+  using ConsolidationTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, ConsolidatorType>;
+  using ValueSearchTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, ValueSearcherType>;
+  using EpochGuardType = typename EpochManagerType::GuardType;
+  using TraceGuardType = typename TracerType::GuardType;
+  static constexpr NodeIDType INVALID_NODE_ID = MappingTableType::INVALID_NODE_ID;
 
-  // This is required for using the low key to determine the delta chain
-  static constexpr size_t LOW_KEY_OFFSET = offsetof(ExtendedBaseType, low_key_addr);
+  /*
+   * BwTree() - Constructor
+   *
+   * 1. The number of threads is the upper bound of logical thread IDs that can
+   *    access the tree, which is required by the epoch manager
+   * 2. The initial tree has an inner root with a single empty leaf child. The
+   *    first item of inner nodes is always the low key, which is -Inf here
+   * 3. Thresholds of the tree are given by the config, and are checked here
+   */
+  BwTree(size_t thread_num, const ConfigType &pconfig = ConfigType{}) : 
+    BwTree{thread_num, nullptr, nullptr, 0, 1, pconfig} {}
 
-  // * AppendHelper() - Constructor
-  AppendHelper(NodeIDType pnode_id, NodeBaseType *pnode_p, MappingTableType *ptable_p) : 
-    node_id{pnode_id}, node_p{pnode_p}, table_p{ptable_p} {}
+  /*
+   * BwTree() - Constructor for bulk loading
+   * 
+   * 1. The keys must be sorted and unique. Leaves of the leaf load size are built 
+   *    directly, and inner levels of the inner load size are built bottom-up, until
+   *    there is a single inner root. Items are evenly distributed on each level, such
+   *    that no node is smaller than the merge threshold unless the level has one node
+   * 2. Leaves are built by load_thread_num threads in parallel, each on a range of leaves.
+   *    Load threads take IDs 0 to load_thread_num - 1, such that each of them writes its
+   *    own stats. The number of load threads is therefore at most thread_num, and the
+   *    ID of the calling thread is restored afterwards
+   * 3. The tree must not be accessed until the constructor returns
+   */
+  BwTree(size_t thread_num, const KeyType *key_list, const ValueType *value_list, size_t n, 
+         size_t load_thread_num = 1, const ConfigType &pconfig = ConfigType{}) :
+    config{pconfig},
+    table_p{MappingTableType::Get(config.GetMappingTableSize())},
+    snapshot{},
+    epoch_manager{thread_num},
+    stats{thread_num},
+    height_policy{},
+    log{thread_num},
+    tracer{thread_num},
+    maintenance_p{nullptr} {
+    config.Validate();
+#ifndef NDEBUG
+    for(size_t i = 1;i < n;i++) { assert(key_list[i - 1] < key_list[i]); }
+#endif
+    // Index of the first key of each node on the current level, which is also the low key
+    std::vector<size_t> first_list{};
+    std::vector<NodeIDType> id_list{};
+    const size_t leaf_load_size = config.GetLeafLoadSize(), inner_load_size = config.GetInnerLoadSize();
+    size_t leaf_num = std::max(size_t{1}, (n + leaf_load_size - 1) / leaf_load_size);
+    for(size_t i = 0;i < leaf_num;i++) { first_list.push_back(n * i / leaf_num); }
+    first_list.push_back(n);
+    id_list.resize(leaf_num);
+
+    auto load_func = [&](size_t thread_id) {
+      ThreadContext::SetThreadID(thread_id);
+      for(size_t i = leaf_num * thread_id / load_thread_num;i < leaf_num * (thread_id + 1) / load_thread_num;i++) {
+        LeafBaseType *leaf_p = LeafBaseType::Get(NodeType::LeafBase, first_list[i + 1] - first_list[i], 
+          GetLoadBound(key_list, first_list[i], n), GetLoadBound(key_list, first_list[i + 1], n));
+        for(size_t j = first_list[i];j < first_list[i + 1];j++) {
+          leaf_p->KeyAt(j - first_list[i]) = key_list[j];
+          leaf_p->ValueAt(j - first_list[i]) = value_list[j];
+        }
+        CountBaseAlloc(leaf_p);
+        id_list[i] = table_p->AllocateNodeID(leaf_p);
+      }
+    };
+
+    load_thread_num = std::max(size_t{1}, std::min(std::min(load_thread_num, leaf_num), thread_num));
+    size_t caller_id = ThreadContext::GetThreadID();
+    std::vector<std::thread> thread_list{};
+    for(size_t i = 1;i < load_thread_num;i++) { thread_list.emplace_back(load_func, i); }
+    load_func(0);
+    for(std::thread &t : thread_list) { t.join(); }
+    ThreadContext::SetThreadID(caller_id);
+
+    do {
+      size_t child_num = id_list.size();
+      size_t node_num = (child_num + inner_load_size - 1) / inner_load_size;
+      std::vector<size_t> next_first_list{};
+      std::vector<NodeIDType> next_id_list{};
+      for(size_t i = 0;i < node_num;i++) {
+        size_t begin = child_num * i / node_num, end = child_num * (i + 1) / node_num;
+        InnerBaseType *inner_p = InnerBaseType::Get(NodeType::InnerBase, end - begin, 
+          GetLoadBound(key_list, first_list[begin], n), GetLoadBound(key_list, first_list[end], n));
+        for(size_t j = begin;j < end;j++) {
+          if(j != begin || first_list[begin] != 0) { inner_p->KeyAt(j - begin) = key_list[first_list[j]]; }
+          inner_p->ValueAt(j - begin) = id_list[j];
+        }
+        CountBaseAlloc(inner_p);
+        next_first_list.push_back(first_list[begin]);
+        next_id_list.push_back(table_p->AllocateNodeID(inner_p));
+      }
+      next_first_list.push_back(n);
+      first_list.swap(next_first_list);
+      id_list.swap(next_id_list);
+    } while(id_list.size() > 1);
 
-  // * GetBase() - Returns a pointer to the base node of the delta chain
-  inline ExtendedBaseType *GetBase() { return node_p->template GetBase<DeltaChainType>(); }
-  
-  // * DestroyDelta() - Calls the base delta chain to destroy delta record (only applicable to deltas allocated by this class)
+    root_id = id_list[0];
+    return;
+  }
+
+  /*
+   * ~BwTree() - Destructor
+   *
+   * 1. Garbage nodes are freed before the mapping table is destroyed, because
+   *    freeing remove deltas releases node IDs
+   * 2. Nodes in the tree are freed recursively from the root. This must not be
+   *    called concurrently with any other function
+   * 3. Background workers are stopped first
+   */
+  ~BwTree() {
+    if(maintenance_p != nullptr) { StopMaintenance(); }
+    epoch_manager.FreeAllGarbage();
+    // There is no root if Open() fails
+    if(root_id.load() != INVALID_NODE_ID) { FreeSubtree(root_id.load()); }
+    MappingTableType::Destroy(table_p);
+  }
+
+  /*
+   * Open() - Reopens a tree from a snapshot written by Checkpoint()
+   * 
+   * 1. The file is mapped privately (see SnapshotMappingType). Base nodes are constructed
+   *    in place on their images and served from the mapping. Only the node headers and the
+   *    child IDs of inner nodes are written on open. Keys and values are read on access
+   * 2. Deltas are appended to mapped base nodes as usual, and consolidation replaces them
+   *    with nodes on the heap. Writes to the mapping are never written back to the file
+   * 3. Returns nullptr if the file could not be mapped, or is not a snapshot of a tree
+   *    with the same node layout, i.e. key and value sizes, base node header sizes, the
+   *    size of NodeSizeType and the alignment of records (see SnapshotHeaderType)
+   */
+  static BwTree *Open(size_t thread_num, const char *path, const ConfigType &pconfig = ConfigType{}) {
+    static_assert(alignof(LeafBaseType) <= SNAPSHOT_ALIGNMENT && alignof(InnerBaseType) <= SNAPSHOT_ALIGNMENT, 
+                  "Base nodes could not be used in place");
+    SnapshotMappingType mapping{};
+    if(mapping.Map(path) == false || mapping.GetSize() < SNAPSHOT_ALIGNMENT) { return nullptr; }
+    SnapshotHeaderType header = *reinterpret_cast<SnapshotHeaderType *>(mapping.GetBase());
+    if(header.IsCompatible(SnapshotHeaderType::Get(0, 0)) == false || header.node_num == 0) { return nullptr; }
+
+    BwTree *tree_p = new BwTree{thread_num, pconfig, std::move(mapping)};
+    if(tree_p->LoadSnapshot(header.node_num) == false) {
+      delete tree_p;
+      return nullptr;
+    }
+    tree_p->log.SetNextSequence(header.log_sequence);
+    return tree_p;
+  }
+
+  /*
+   * ReplayLog() - Applies the records of the log policy to the tree for recovery
+   * 
+   * 1. Records from the next sequence number of the tree are applied in sequence order,
+   *    i.e. those after the snapshot if the tree is reopened by Open()
+   * 2. The log must not be running, such that replayed mutations are not logged again.
+   *    The sequence number is then set after the last record for Start() to continue
+   * 3. Returns false if the log could not be read, or if a record does not apply, i.e. 
+   *    the key of an insert exists or the key of a delete does not, which means the tree
+   *    is not the one the log was written on. Other records are still applied, and the
+   *    number of those not applied is stored into failed_num_p if it is not nullptr
+   */
+  bool ReplayLog(const char *path, size_t *failed_num_p = nullptr) {
+    assert(log.IsRunning() == false);
+    uint64_t next_sequence;
+    size_t failed_num = 0;
+    auto callback = [this, &failed_num](LogRecordType type, const KeyType &key, const ValueType &value) {
+      bool is_applied;
+      if(type == LogRecordType::Insert) { is_applied = Insert(key, value); }
+      else { is_applied = ReplayDelete(key, value, std::integral_constant<bool, LeafBaseType::support_non_unique_key>{}); }
+      if(is_applied == false) { failed_num++; }
+    };
+    bool success = LogType::template Replay<KeyType, ValueType>(path, log.GetNextSequence(), callback, &next_sequence);
+    if(failed_num_p != nullptr) { *failed_num_p = failed_num; }
+    if(success == false) { return false; }
+    log.SetNextSequence(next_sequence);
+    return failed_num == 0;
+  }
+
+  /*
+   * Checkpoint() - Writes a snapshot of the tree into the file, which is reopened by Open()
+   * 
+   * 1. Leaves are written in key order as consolidated copies, i.e. the pages of scans.
+   *    Inner levels are then built bottom-up like bulk loading, and refer to children by 
+   *    the indices of their records instead of node IDs. The root is the last record
+   * 2. Records are base node images (see StoreImage()) after a SnapshotHeaderType. Each of
+   *    them is aligned to SNAPSHOT_ALIGNMENT
+   * 3. The snapshot is only consistent if the tree is not modified concurrently. The next
+   *    log sequence number is stored, such that ReplayLog() skips records in the snapshot
+   * 4. Returns false if the file could not be written
+   */
+  bool Checkpoint(const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if(fp == nullptr) { return false; }
+    SnapshotHeaderType header = SnapshotHeaderType::Get(0, log.GetNextSequence());
+    bool success = WriteSnapshotRecord(fp, &header, sizeof(header));
+    // Low keys of the nodes on the current level and their record indices. The last 
+    // low key is the high key of the level
+    std::vector<BoundKeyType> low_key_list{};
+    std::vector<NodeIDType> index_list{};
+    LeafBaseType *page_p = GetPageBy(FirstLocator{});
+    while(true) {
+      assert(low_key_list.empty() || page_p->GetLowKey()->IsInf() == false);
+      low_key_list.push_back(*page_p->GetLowKey());
+      index_list.push_back(header.node_num++);
+      // All pages are written, including empty ones, such that ranges are continuous
+      success = success && WriteSnapshotNode(fp, page_p);
+      BoundKeyType high_key = *page_p->GetHighKey();
+      FreeChain(this, page_p);
+      if(high_key.IsInf()) { break; }
+      page_p = GetPage(high_key.key);
+    }
+    low_key_list.push_back(BoundKeyType::GetInf());
+
+    // There is at least one inner level, as in the constructors
+    const size_t inner_load_size = config.GetInnerLoadSize();
+    do {
+      size_t child_num = index_list.size();
+      size_t node_num = (child_num + inner_load_size - 1) / inner_load_size;
+      std::vector<BoundKeyType> next_low_key_list{};
+      std::vector<NodeIDType> next_index_list{};
+      for(size_t i = 0;i < node_num;i++) {
+        size_t begin = child_num * i / node_num, end = child_num * (i + 1) / node_num;
+        InnerBaseType *inner_p = InnerBaseType::Get(NodeType::InnerBase, end - begin, low_key_list[begin], low_key_list[end]);
+        for(size_t j = begin;j < end;j++) {
+          if(low_key_list[j].IsInf() == false) { inner_p->KeyAt(j - begin) = low_key_list[j].key; }
+          inner_p->ValueAt(j - begin) = index_list[j];
+        }
+        next_low_key_list.push_back(low_key_list[begin]);
+        next_index_list.push_back(header.node_num++);
+        success = success && WriteSnapshotNode(fp, inner_p);
+        InnerBaseType::Destroy(inner_p);
+      }
+      next_low_key_list.push_back(BoundKeyType::GetInf());
+      low_key_list.swap(next_low_key_list);
+      index_list.swap(next_index_list);
+    } while(index_list.size() > 1);
+
+    // The header is written again with the number of records
+    success = success && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+    return fclose(fp) == 0 && success;
+  }
+
+  // * GetMappingTable() - Returns the mapping table
+  inline MappingTableType *GetMappingTable() { return table_p; }
+  // * GetEpochManager() - Returns the epoch manager
+  inline EpochManagerType *GetEpochManager() { return &epoch_manager; }
+  // * GetStats() - Returns the stats, which record nothing unless the stats policy is enabled
+  inline StatsType *GetStats() { return &stats; }
+  // * GetConfig() - Returns the thresholds of the tree
+  inline const ConfigType &GetConfig() const { return config; }
+  // * GetHeightPolicy() - Returns the consolidation policy
+  inline HeightPolicyType *GetHeightPolicy() { return &height_policy; }
+  // * GetLog() - Returns the log, which logs nothing unless the log policy is enabled
+  inline LogType *GetLog() { return &log; }
+  // * GetTracer() - Returns the tracer, which traces nothing unless the tracer policy is enabled
+  inline TracerType *GetTracer() { return &tracer; }
+  // * RegisterThread() - Must be called by each thread before accessing the tree
+  inline void RegisterThread(size_t thread_id) { epoch_manager.RegisterThread(thread_id); }
+
+  /*
+   * StartMaintenance() - Starts background workers that consolidate long chains
+   * 
+   * 1. Traversals push the ID of a node whose chain reaches the consolidation threshold
+   *    into a lock-free queue, and continue without consolidating it. Each ID is pushed
+   *    once until it is popped; IDs on the same pending flag are pushed once in total.
+   *    The chain is still consolidated by the traversal if the queue is full, or if it
+   *    reaches MAINTENANCE_HEIGHT_FACTOR times the threshold
+   * 2. Workers use logical thread IDs from first_thread_id to first_thread_id + worker_num - 1,
+   *    which must be smaller than the number of threads of the tree and not used by
+   *    other threads
+   * 3. Offloading of the epoch manager is enabled, such that other threads hand their
+   *    garbage over to the workers instead of freeing it. Workers reclaim it together with
+   *    the chains they retire. It is disabled by StopMaintenance(), after which the rest
+   *    is reclaimed by the next thread calling Reclaim()
+   * 4. Nodes with an SMO on top are skipped, since the SMO is finished by traversals
+   * 5. This and StopMaintenance() must not be called concurrently with other functions
+   */
+  void StartMaintenance(size_t worker_num, size_t first_thread_id) {
+    assert(maintenance_p == nullptr && worker_num > 0);
+    always_assert(first_thread_id + worker_num <= epoch_manager.GetThreadNum());
+    maintenance_p = new MaintenanceType{};
+    epoch_manager.SetOffload(true);
+    for(size_t i = 0;i < worker_num;i++) { 
+      maintenance_p->thread_list.emplace_back(&BwTree::MaintenanceLoop, this, first_thread_id + i); 
+    }
+  }
+
+  // * StopMaintenance() - Stops background workers. Node IDs in the queue are dropped
+  void StopMaintenance() {
+    assert(maintenance_p != nullptr);
+    maintenance_p->stop.store(true);
+    for(std::thread &t : maintenance_p->thread_list) { t.join(); }
+    epoch_manager.SetOffload(false);
+    delete maintenance_p;
+    maintenance_p = nullptr;
+  }
+
+  /*
+   * RetireChain() - Puts a delta chain or base node into the epoch manager
+   *
+   * 1. The chain must already be unlinked from the mapping table, e.g. after
+   *    the consolidated node has been installed
+   * 2. The chain is freed by DeltaChainFreeHelper after all threads that might
+   *    hold a reference have exited. Merged siblings are freed together with
+   *    the chain, and their node IDs are released by the remove delta
+   */
+  inline void RetireChain(NodeBaseType *node_p) { 
+    stats.Count(StatsCounter::Retire);
+    epoch_manager.Retire(node_p, FreeRetiredChain, this); 
+  }
+
+  /*
+   * DiscardDelta() - Destroys the delta of a failed append, if any, when the operation gives up
+   *
+   * The delta has never been seen by other threads. Its base node is not freed before 
+   * the epoch of the caller exits, even if the leaf has been consolidated. Returns false
+   */
   template <typename DeltaNodeType>
-  inline void DestroyDelta(DeltaNodeType *delta_p) { GetBase()->delta_chain.DestroyDelta(delta_p); }
-  
-  // * AppendLeafInsert() - Appends a leaf insert delta
-  inline LeafInsertType *AppendLeafInsert(const KeyType &key, const ValueType &value) {
-    assert(node_p->KeyInNode(key));
-    // NOTE: For some strange reasons the compiler could not deduce the type of this
-    // template function call. We explicitly specify the height type
-    LeafInsertType *delta_p = GetBase()->template AllocateDelta<LeafInsertType, NodeType, NodeHeightType>(
-      NodeType::LeafInsert, node_p->GetHeight() + 1, node_p->GetSize() + 1,
-      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
-      key, value);
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  inline static bool DiscardDelta(DeltaNodeType *delta_p) {
+    if(delta_p != nullptr) { AppendHelperType::DestroyDelta(delta_p); }
+    return false;
   }
 
-  // * AppendLeafDelete() - Appends a leaf delete delta
-  inline LeafDeleteType *AppendLeafDelete(const KeyType &key, const ValueType &value) {
-    assert(node_p->KeyInNode(key));
-    LeafDeleteType *delta_p = GetBase()->template AllocateDelta<LeafDeleteType, NodeType, NodeHeightType>(
-      NodeType::LeafDelete, node_p->GetHeight() + 1, node_p->GetSize() - 1,
-      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
-      key, value);
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  /*
+   * Insert() - Inserts a key value pair
+   * 
+   * Returns false if the key already exists, in which case the tree is not changed.
+   * With non-unique keys, it returns false only if the same pair exists
+   */
+  bool Insert(const KeyType &key, const ValueType &value) {
+    EpochGuardType guard{&epoch_manager};
+    TraceGuardType trace_guard{&tracer, TraceOp::Insert};
+    RetryBackoff backoff{config.GetRetryBackoffLimit()};
+    LeafInsertType *retry_p = nullptr;
+    while(true) {
+      NodeIDType leaf_id;
+      NodeBaseType *leaf_p = TraverseToLeaf(key, &leaf_id);
+      NodeSizeType base_offset;
+      if(HasConflict(leaf_p, key, value, &base_offset)) { return DiscardDelta(retry_p); }
+      AppendHelperType ah{leaf_id, leaf_p, table_p, &stats};
+      uint64_t sequence = log.GetSequence();
+      retry_p = ah.AppendLeafInsert(key, value, base_offset, retry_p);
+      if(retry_p == nullptr) { 
+        log.Log(LogRecordType::Insert, sequence, key, value);
+        height_policy.CountAppend(leaf_id);
+        return true; 
+      }
+      // CAS fails; the delta node has never been seen by other threads, and is
+      // reused by the next append if the leaf is not consolidated
+      log.Abort();
+      tracer.TraceRetry(leaf_id);
+      backoff.Pause();
+    }
   }
 
-  // * AppendLeafSplit() - Appends a leaf split delta
-  inline LeafSplitType *AppendLeafSplit(const KeyType &key, NodeIDType sibling_id, NodeSizeType new_size) {
-    LeafSplitType *delta_p = GetBase()->template AllocateDelta<LeafSplitType, NodeType, NodeHeightType>(
-      NodeType::LeafSplit, node_p->GetHeight(), node_p->GetSize() - new_size,
-      node_p->GetLowKey(), nullptr, node_p,
-      BoundKeyType::Get(key), sibling_id);
-    // Special code here to set the high key of the delta chain to the split key
-    // which itself is a bound key
-    delta_p->SetSplitHighKey();
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  /*
+   * Delete() - Deletes a key and its value
+   * 
+   * Returns false if the key does not exist. Only for unique keys
+   */
+  bool Delete(const KeyType &key) {
+    static_assert(!LeafBaseType::support_non_unique_key, "Non-unique keys must be deleted with the value");
+    EpochGuardType guard{&epoch_manager};
+    TraceGuardType trace_guard{&tracer, TraceOp::Delete};
+    RetryBackoff backoff{config.GetRetryBackoffLimit()};
+    LeafDeleteType *retry_p = nullptr;
+    while(true) {
+      NodeIDType leaf_id;
+      NodeBaseType *leaf_p = TraverseToLeaf(key, &leaf_id);
+      NodeSizeType base_offset;
+      ValueType *value_p = SearchLeaf(leaf_p, key, &base_offset);
+      if(value_p == nullptr) { return DiscardDelta(retry_p); }
+      AppendHelperType ah{leaf_id, leaf_p, table_p, &stats};
+      uint64_t sequence = log.GetSequence();
+      retry_p = ah.AppendLeafDelete(key, *value_p, base_offset, retry_p);
+      if(retry_p == nullptr) { 
+        log.Log(LogRecordType::Delete, sequence, key, *value_p);
+        height_policy.CountAppend(leaf_id);
+        return true; 
+      }
+      log.Abort();
+      tracer.TraceRetry(leaf_id);
+      backoff.Pause();
+    }
   }
 
-  // * AppendLeafMerge() - Appends a leaf merge delta
-  inline LeafMergeType *AppendLeafMerge(const KeyType &key, NodeIDType sibling_id, NodeBaseType *sibling_p) {
-    LeafMergeType *delta_p = GetBase()->template AllocateDelta<LeafMergeType, NodeType, NodeHeightType>(
-      NodeType::LeafMerge, node_p->GetHeight() + sibling_p->GetHeight(), node_p->GetSize() + sibling_p->GetSize(),
-      node_p->GetLowKey(), sibling_p->GetHighKey(), node_p,
-      key, sibling_id, sibling_p);
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  /*
+   * Delete() - Deletes a key value pair. Only for non-unique keys
+   * 
+   * Returns false if the pair does not exist. Other values of the key are not changed
+   */
+  bool Delete(const KeyType &key, const ValueType &value) {
+    static_assert(LeafBaseType::support_non_unique_key, "Unique keys must be deleted without the value");
+    EpochGuardType guard{&epoch_manager};
+    TraceGuardType trace_guard{&tracer, TraceOp::Delete};
+    RetryBackoff backoff{config.GetRetryBackoffLimit()};
+    LeafDeleteType *retry_p = nullptr;
+    while(true) {
+      NodeIDType leaf_id;
+      NodeBaseType *leaf_p = TraverseToLeaf(key, &leaf_id);
+      NodeSizeType base_offset;
+      if(SearchLeafPair(leaf_p, key, value, &base_offset) == nullptr) { return DiscardDelta(retry_p); }
+      AppendHelperType ah{leaf_id, leaf_p, table_p, &stats};
+      uint64_t sequence = log.GetSequence();
+      retry_p = ah.AppendLeafDelete(key, value, base_offset, retry_p);
+      if(retry_p == nullptr) { 
+        log.Log(LogRecordType::Delete, sequence, key, value);
+        height_policy.CountAppend(leaf_id);
+        return true; 
+      }
+      log.Abort();
+      tracer.TraceRetry(leaf_id);
+      backoff.Pause();
+    }
   }
 
-  // * AppendLeafRemove() - Appends a leaf remove delta
-  inline LeafRemoveType *AppendLeafRemove(NodeIDType removed_id) {
-    LeafRemoveType *delta_p = GetBase()->template AllocateDelta<LeafRemoveType, NodeType, NodeHeightType>(
-      NodeType::LeafRemove, node_p->GetHeight(), node_p->GetSize(),
-      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
-      removed_id);
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  /*
+   * Lookup() - Searches a key and copies the value to the given pointer
+   * 
+   * Returns false if the key does not exist, in which case the value is not changed.
+   * With non-unique keys, any one of the values is returned
+   */
+  bool Lookup(const KeyType &key, ValueType *value_p) {
+    EpochGuardType guard{&epoch_manager};
+    TraceGuardType trace_guard{&tracer, TraceOp::Lookup};
+    NodeIDType leaf_id;
+    NodeBaseType *leaf_p = TraverseToLeaf(key, &leaf_id);
+    height_policy.CountRead(leaf_id, leaf_p->GetHeight());
+    ValueType *result_p = SearchLeaf(leaf_p, key);
+    if(result_p == nullptr) { return false; }
+    *value_p = *result_p;
+    return true;
   }
 
-  // * AppendInnerInsert() - Appends inner insert delta
-  inline InnerInsertType *AppendInnerInsert(const KeyType &key, const NodeIDType &value, 
-                                            const BoundKeyType &next_key) {
-    assert(node_p->KeyInNode(key));
-    InnerInsertType *delta_p = GetBase()->template AllocateDelta<InnerInsertType, NodeType, NodeHeightType>(
-      NodeType::InnerInsert, node_p->GetHeight() + 1, node_p->GetSize() + 1,
-      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
-      key, value, next_key);
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  /*
+   * Lookup() - Appends all values of a key to the vector. Only for non-unique keys
+   * 
+   * Returns the number of values appended
+   */
+  size_t Lookup(const KeyType &key, std::vector<ValueType> *value_list_p) {
+    static_assert(LeafBaseType::support_non_unique_key, "Unique keys have at most one value");
+    EpochGuardType guard{&epoch_manager};
+    TraceGuardType trace_guard{&tracer, TraceOp::Lookup};
+    NodeIDType leaf_id;
+    NodeBaseType *leaf_p = TraverseToLeaf(key, &leaf_id);
+    height_policy.CountRead(leaf_id, leaf_p->GetHeight());
+    ValueSearcherType vs{key};
+    ValueSearchTraverserType::Traverse(leaf_p, &vs);
+    for(size_t i = 0;i < vs.GetValueNum();i++) { value_list_p->push_back(*vs.GetValueAt(i)); }
+    return vs.GetValueNum();
   }
 
-  // * AppendInnerDelete() - Appends inner delete delta
-  inline InnerDeleteType *AppendInnerDelete(const KeyType &key, const NodeIDType &value, 
-                                            const BoundKeyType &next_key, 
-                                            const BoundKeyType &prev_key, const NodeIDType &prev_id) {
-    assert(node_p->KeyInNode(key));
-    InnerDeleteType *delta_p = GetBase()->template AllocateDelta<InnerDeleteType, NodeType, NodeHeightType>(
-      NodeType::InnerDelete, node_p->GetHeight() + 1, node_p->GetSize() - 1,
-      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
-      key, value, next_key, prev_key, prev_id);
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  /*
+   * BatchLookup() - Searches a batch of keys
+   * 
+   * 1. found_list[i] is set to whether key_list[i] exists, in which case the value 
+   *    is copied to value_list[i]. Returns the number of keys found
+   * 2. Keys are processed in sorted order, and the descents of BATCH_GROUP_SIZE keys 
+   *    are interleaved to overlap cache misses (TraverseToLeafBatch())
+   */
+  size_t BatchLookup(const KeyType *key_list, size_t n, ValueType *value_list, bool *found_list) {
+    std::vector<size_t> order = GetBatchOrder(key_list, n);
+    NodeIDType leaf_id_list[BATCH_GROUP_SIZE];
+    size_t found = 0;
+    for(size_t begin = 0;begin < n;begin += BATCH_GROUP_SIZE) {
+      EpochGuardType guard{&epoch_manager};
+      size_t group_size = std::min(n - begin, size_t{BATCH_GROUP_SIZE});
+      TraverseToLeafBatch(key_list, &order[begin], group_size, leaf_id_list);
+      for(size_t i = 0;i < group_size;i++) {
+        size_t index = order[begin + i];
+        NodeBaseType *leaf_p = GetBatchLeaf(key_list[index], &leaf_id_list[i]);
+        height_policy.CountRead(leaf_id_list[i], leaf_p->GetHeight());
+        ValueType *value_p = SearchLeaf(leaf_p, key_list[index]);
+        found_list[index] = (value_p != nullptr);
+        if(value_p != nullptr) { 
+          value_list[index] = *value_p; 
+          found++;
+        }
+      }
+    }
+
+    return found;
   }
 
-  // * AppendInnerSplit() - Appends inner split delta
-  inline InnerSplitType *AppendInnerSplit(const KeyType &key, NodeIDType sibling_id, NodeSizeType new_size) {
-    assert(node_p->KeyInNode(key));
-    InnerSplitType *delta_p = GetBase()->template AllocateDelta<InnerSplitType, NodeType, NodeHeightType>(
-      NodeType::InnerSplit, node_p->GetHeight(), node_p->GetSize() - new_size,
-      node_p->GetLowKey(), nullptr, node_p,
-      BoundKeyType::Get(key), sibling_id);
-    delta_p->SetSplitHighKey();
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  /*
+   * BatchInsert() - Inserts a batch of key value pairs
+   * 
+   * 1. result_list[i], if given, is set to whether key_list[i] is inserted. Returns the
+   *    number of keys inserted. If a key appears more than once, the first one is inserted
+   * 2. Keys are grouped like BatchLookup(). The leaf of each key is read again from the 
+   *    mapping table before the insert, because earlier keys in the batch may have 
+   *    appended to the same leaf
+   */
+  size_t BatchInsert(const KeyType *key_list, const ValueType *value_list, size_t n, bool *result_list = nullptr) {
+    std::vector<size_t> order = GetBatchOrder(key_list, n);
+    NodeIDType leaf_id_list[BATCH_GROUP_SIZE];
+    size_t inserted = 0;
+    for(size_t begin = 0;begin < n;begin += BATCH_GROUP_SIZE) {
+      EpochGuardType guard{&epoch_manager};
+      size_t group_size = std::min(n - begin, size_t{BATCH_GROUP_SIZE});
+      TraverseToLeafBatch(key_list, &order[begin], group_size, leaf_id_list);
+      for(size_t i = 0;i < group_size;i++) {
+        size_t index = order[begin + i];
+        bool result = InsertBatchKey(key_list[index], value_list[index], &leaf_id_list[i]);
+        if(result_list != nullptr) { result_list[index] = result; }
+        if(result) { inserted++; }
+      }
+    }
+
+    return inserted;
   }
 
-  // * AppendInnerMerge() - Appends a inner merge delta
-  inline InnerMergeType *AppendInnerMerge(const KeyType &key, NodeIDType sibling_id, NodeBaseType *sibling_p) {
-    InnerMergeType *delta_p = GetBase()->template AllocateDelta<InnerMergeType, NodeType, NodeHeightType>(
-      NodeType::InnerMerge, node_p->GetHeight() + sibling_p->GetHeight(), node_p->GetSize() + sibling_p->GetSize(),
-      node_p->GetLowKey(), sibling_p->GetHighKey(), node_p,
-      key, sibling_id, sibling_p);
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+  /*
+   * class Iterator - Scans the tree in key order in both directions
+   * 
+   * 1. The iterator holds a private copy of the current leaf, which is the delta chain
+   *    merged with the base node (GetConsolidatedNode()). Chains are short because
+   *    TraverseToLeaf() consolidates long chains on demand. No epoch is held between calls
+   * 2. The next leaf is the one covering the high key of the current one, and the 
+   *    previous leaf is the one covering keys right before the low key. Leaves are 
+   *    found from the root, because sibling IDs may be stale after merges. The tree may
+   *    change between two leaves, but keys are always returned in order without duplicates
+   * 3. The iterator is at the end after moving past either end of the tree. The end is
+   *    sticky; call Seek() et al. on the tree to get a new iterator
+   */
+  class Iterator {
+   public:
+    /*
+     * Iterator() - Constructor
+     *
+     * If the index is past the end of the page in the direction of the scan, the 
+     * iterator moves to the next or the previous page
+     */
+    Iterator(BwTree *ptree_p, LeafBaseType *ppage_p, int pindex, bool forward) : 
+      tree_p{ptree_p}, page_p{ppage_p}, index{pindex} {
+      if(forward && index == static_cast<int>(page_p->GetSize())) { NextPage(); }
+      else if(!forward && index < 0) { PrevPage(); }
+    }
+    Iterator(Iterator &&other) : tree_p{other.tree_p}, page_p{other.page_p}, index{other.index} { other.page_p = nullptr; }
+    Iterator(const Iterator &) = delete;
+    Iterator &operator=(const Iterator &) = delete;
+    ~Iterator() { if(page_p != nullptr) { FreeChain(tree_p, page_p); } }
+
+    // * LowerBound() - Returns the index of the first key >= the key in the page
+    static int LowerBound(LeafBaseType *page_p, const KeyType &key) {
+      int low = 0, high = static_cast<int>(page_p->GetSize());
+      while(low < high) {
+        int mid = (low + high) / 2;
+        if(page_p->KeyAt(mid) < key) { low = mid + 1; }
+        else { high = mid; }
+      }
+      return low;
+    }
+    // * UpperBound() - Returns the index of the first key > the key in the page
+    static int UpperBound(LeafBaseType *page_p, const KeyType &key) {
+      int index = LowerBound(page_p, key);
+      return (index < static_cast<int>(page_p->GetSize()) && page_p->KeyAt(index) == key) ? index + 1 : index;
+    }
+
+    // * IsEnd() - Whether the iterator has moved past either end of the tree
+    inline bool IsEnd() const { return page_p == nullptr; }
+    inline typename LeafBaseType::ConstKeyRefType GetKey() { assert(!IsEnd()); return page_p->KeyAt(index); }
+    inline const ValueType &GetValue() { assert(!IsEnd()); return page_p->ValueAt(index); }
+
+    // * Next() - Advances to the next key
+    inline void Next() {
+      assert(!IsEnd());
+      if(++index == static_cast<int>(page_p->GetSize())) { NextPage(); }
+    }
+    // * Prev() - Moves to the previous key
+    inline void Prev() {
+      assert(!IsEnd());
+      if(--index < 0) { PrevPage(); }
+    }
+
+    /*
+     * NextN() - Copies at most n items from the current position forward, and advances
+     *           past them. Returns the number of items copied
+     */
+    size_t NextN(size_t n, KeyType *key_list, ValueType *value_list) {
+      size_t count = 0;
+      while(count < n && !IsEnd()) {
+        size_t batch = std::min(n - count, static_cast<size_t>(page_p->GetSize() - index));
+        for(size_t i = 0;i < batch;i++) {
+          key_list[count + i] = page_p->KeyAt(index + i);
+          value_list[count + i] = page_p->ValueAt(index + i);
+        }
+        count += batch;
+        index += batch;
+        if(index == static_cast<int>(page_p->GetSize())) { NextPage(); }
+      }
+      return count;
+    }
+
+    // * PrevN() - Like NextN(), but copies items from the current position backward
+    size_t PrevN(size_t n, KeyType *key_list, ValueType *value_list) {
+      size_t count = 0;
+      while(count < n && !IsEnd()) {
+        size_t batch = std::min(n - count, static_cast<size_t>(index + 1));
+        for(size_t i = 0;i < batch;i++) {
+          key_list[count + i] = page_p->KeyAt(index - i);
+          value_list[count + i] = page_p->ValueAt(index - i);
+        }
+        count += batch;
+        index -= batch;
+        if(index < 0) { PrevPage(); }
+      }
+      return count;
+    }
+
+   private:
+    // * NextPage() - Moves to the first key of the next non-empty page, or the end
+    void NextPage() {
+      do {
+        BoundKeyType high_key = *page_p->GetHighKey();
+        FreeChain(tree_p, page_p);
+        if(high_key.IsInf()) { page_p = nullptr; return; }
+        page_p = tree_p->GetPage(high_key.key);
+        index = LowerBound(page_p, high_key.key);
+      } while(index == static_cast<int>(page_p->GetSize()));
+    }
+
+    // * PrevPage() - Moves to the last key of the previous non-empty page, or the end
+    void PrevPage() {
+      do {
+        BoundKeyType low_key = *page_p->GetLowKey();
+        FreeChain(tree_p, page_p);
+        if(low_key.IsInf()) { page_p = nullptr; return; }
+        page_p = tree_p->GetPageBy(BeforeLocator{low_key});
+        index = LowerBound(page_p, low_key.key) - 1;
+      } while(index < 0);
+    }
+
+    BwTree *tree_p;
+    LeafBaseType *page_p;
+    int index;
+  };
+
+  /*
+   * Begin() - Returns an iterator on the smallest key
+   * 
+   * The iterator is at the end if the tree is empty. Iterators must be destroyed 
+   * before the tree, and could be used by any registered thread
+   */
+  inline Iterator Begin() { return Iterator{this, GetPageBy(FirstLocator{}), 0, true}; }
+  // * Seek() - Returns an iterator on the first key >= the key
+  inline Iterator Seek(const KeyType &key) { 
+    LeafBaseType *page_p = GetPage(key);
+    return Iterator{this, page_p, Iterator::LowerBound(page_p, key), true}; 
+  }
+  // * RBegin() - Returns an iterator on the largest key for reverse scans
+  inline Iterator RBegin() { 
+    LeafBaseType *page_p = GetPageBy(BeforeLocator{BoundKeyType::GetInf()});
+    return Iterator{this, page_p, static_cast<int>(page_p->GetSize()) - 1, false}; 
+  }
+  // * SeekReverse() - Returns an iterator on the last key <= the key for reverse scans
+  inline Iterator SeekReverse(const KeyType &key) { 
+    LeafBaseType *page_p = GetPage(key);
+    return Iterator{this, page_p, Iterator::UpperBound(page_p, key) - 1, false}; 
   }
 
-  // * AppendInnerRemove() - Appends a inner remove delta
-  inline InnerRemoveType *AppendInnerRemove(NodeIDType removed_id) {
-    InnerRemoveType *delta_p = GetBase()->template AllocateDelta<InnerRemoveType, NodeType, NodeHeightType>(
-      NodeType::InnerRemove, node_p->GetHeight(), node_p->GetSize(),
-      node_p->GetLowKey(), node_p->GetHighKey(), node_p,
-      removed_id);
-    return table_p->CAS(node_id, node_p, delta_p) ? (node_p = delta_p, nullptr) : delta_p;
+ private:
+  // * GetLoadBound() - Returns the low key of the node whose first key is on the index during bulk loading
+  inline static BoundKeyType GetLoadBound(const KeyType *key_list, size_t index, size_t n) {
+    return (index == 0 || index == n) ? BoundKeyType::GetInf() : BoundKeyType::Get(key_list[index]);
+  }
+  // * GetHeightThreshold() - Returns the height threshold of the node's level in the config
+  inline size_t GetHeightThreshold(const NodeBaseType *node_p) const {
+    return node_p->IsLeaf() ? config.GetLeafHeightThreshold() : config.GetInnerHeightThreshold();
+  }
+  // * GetConsolidationThreshold() - Returns the height at which the node is consolidated, given by the height policy
+  inline size_t GetConsolidationThreshold(NodeIDType node_id, const NodeBaseType *node_p) const {
+    return node_p->IsLeaf() ? height_policy.GetLeafHeightThreshold(node_id, config.GetLeafHeightThreshold()) : 
+                              config.GetInnerHeightThreshold();
+  }
+  // * HasSMOOnTop() - Whether the node has an unfinished SMO on top (see TraverseToLeaf())
+  inline static bool HasSMOOnTop(const NodeBaseType *node_p) {
+    NodeType type = node_p->GetType();
+    return type == NodeType::LeafSplit || type == NodeType::InnerSplit || type == NodeType::LeafRemove || 
+           type == NodeType::InnerRemove || type == NodeType::InnerDelete;
+  }
+  // * GetSplitThreshold() - Returns the split threshold of the node's level
+  inline size_t GetSplitThreshold(const NodeBaseType *node_p) const {
+    return node_p->IsLeaf() ? config.GetLeafSplitThreshold() : config.GetInnerSplitThreshold();
+  }
+  // * GetMergeThreshold() - Returns the merge threshold of the node's level
+  inline size_t GetMergeThreshold(const NodeBaseType *node_p) const {
+    return node_p->IsLeaf() ? config.GetLeafMergeThreshold() : config.GetInnerMergeThreshold();
+  }
+
+  /*
+   * TraverseToLeaf() - Finds the leaf node whose range covers the key
+   * 
+   * 1. Returns the current view of the leaf node, and its node ID in the argument
+   * 2. Unfinished SMOs on the path are finished before we continue. No delta is ever
+   *    posted on top of an unfinished split delta or InnerDelete delta, so such
+   *    deltas are always on the top of the chain:
+   *    - Split delta: the separator is posted on the parent (HelpSplit())
+   *    - InnerDelete delta: the removed child is merged into its left sibling
+   *      (FinishInnerDelete())
+   *    - Remove delta: the node is frozen. We restart, and the removal is finished
+   *      when the parent is visited
+   *    The node is then consolidated to get rid of the finished SMO. Finished split
+   *    deltas made by consolidation are unlinked without consolidation (RemoveSplitDelta())
+   * 3. Any node on the path whose delta chain reaches the consolidation threshold is 
+   *    consolidated before we continue (GetConsolidationThreshold()). Appends on the 
+   *    returned leaf will therefore not make chains longer than the threshold at the
+   *    time of the traversal, unless the node is left to background workers
+   *    (NeedsConsolidation())
+   * 4. Base nodes whose size reaches the split threshold are split. Nodes smaller than
+   *    the merge threshold are removed. At most one removal is started per call
+   * 5. If the key is not within the range of a node, we restart from the root
+   * 6. The caller must be in an epoch. Visited nodes are recorded by the tracer
+   */
+  NodeBaseType *TraverseToLeaf(const KeyType &key, NodeIDType *leaf_id_p) {
+    bool remove_tried = false;
+    while(true) {
+      NodeIDType parent_id = INVALID_NODE_ID;
+      NodeBaseType *parent_p = nullptr;
+      NodeIDType node_id = root_id.load();
+      while(true) {
+        NodeBaseType *node_p = table_p->At(node_id);
+        HelpResult result = HelpSMO(parent_id, parent_p, node_id, node_p);
+        if(result == HelpResult::Restart) { break; }
+        else if(result == HelpResult::Retry) { continue; }
+
+        tracer.TraceNode(node_id, node_p->GetHeight());
+        if(node_p->KeyInNode(key) == false) { break; }
+        if(NeedsConsolidation(node_id, node_p)) { 
+          Consolidate(node_id, node_p);
+          continue;
+        }
+
+        // Nodes with a single non-unique key could not be split
+        if(node_p->GetHeight() == 0 && node_p->GetSize() >= GetSplitThreshold(node_p) && SplitNode(node_id, node_p)) {
+          continue;
+        } else if(parent_p != nullptr && remove_tried == false && node_p->GetSize() < GetMergeThreshold(node_p)) {
+          remove_tried = true;
+          RemoveNode(parent_id, parent_p, node_id, node_p);
+          continue;
+        }
+
+        if(node_p->IsLeaf()) {
+          stats.CountHeight(node_p->GetHeight());
+          *leaf_id_p = node_id;
+          return node_p;
+        }
+        
+        parent_id = node_id;
+        parent_p = node_p;
+        node_id = SearchInner(node_p, key);
+      }
+    }
+
+    assert(false);
+    return nullptr;
+  }
+
+  // * enum class HelpResult - What the traversal does after HelpSMO()
+  enum class HelpResult { Ready, Retry, Restart };
+
+  /*
+   * HelpSMO() - Finishes the unfinished SMO on top of the node, if any
+   * 
+   * Returns Ready if there is no SMO on top of the node, Retry if the node should
+   * be read again from the mapping table, or Restart if the traversal should restart 
+   * from the root. See TraverseToLeaf() for the SMOs
+   */
+  HelpResult HelpSMO(NodeIDType parent_id, NodeBaseType *parent_p, NodeIDType node_id, NodeBaseType *node_p) {
+    if(node_p == nullptr) { return HelpResult::Restart; }
+    NodeType type = node_p->GetType();
+    if(type == NodeType::LeafRemove || type == NodeType::InnerRemove) { return HelpResult::Restart; }
+    if(type == NodeType::LeafSplit || type == NodeType::InnerSplit) {
+      stats.Count(StatsCounter::HelpSplit);
+      if(HelpSplit(parent_id, parent_p, node_id, node_p) == false) { return HelpResult::Restart; }
+      RemoveSplitDelta(node_id, node_p);
+      return HelpResult::Retry;
+    } else if(type == NodeType::InnerDelete) {
+      stats.Count(StatsCounter::HelpInnerDelete);
+      if(FinishInnerDelete(node_id, node_p) == true) { Consolidate(node_id, node_p); }
+      return HelpResult::Retry;
+    }
+
+    return HelpResult::Ready;
   }
 
-  // * GetNode() - Returns the node pointer
-  NodeBaseType *GetNode() { return node_p; }
+  /*
+   * TraverseToLeafBy() - Finds the leaf node chosen by the locator
+   * 
+   * 1. Used by scans to find leaf nodes that cannot be described by a single key. The 
+   *    locator provides InNode(), which checks whether the node covers the target, and 
+   *    Search(), which returns the index of the child in a consolidated inner node
+   * 2. Children are searched in a temporary consolidated view of inner nodes, which
+   *    is slower than SearchInner(). SMOs and long chains are handled like 
+   *    TraverseToLeaf(), but nodes are never split or removed
+   * 3. The caller must be in an epoch
+   */
+  template <typename LocatorType>
+  NodeBaseType *TraverseToLeafBy(const LocatorType &locator, NodeIDType *leaf_id_p) {
+    while(true) {
+      NodeIDType parent_id = INVALID_NODE_ID;
+      NodeBaseType *parent_p = nullptr;
+      NodeIDType node_id = root_id.load();
+      while(true) {
+        NodeBaseType *node_p = table_p->At(node_id);
+        HelpResult result = HelpSMO(parent_id, parent_p, node_id, node_p);
+        if(result == HelpResult::Restart) { break; }
+        else if(result == HelpResult::Retry) { continue; }
+
+        if(locator.InNode(node_p) == false) { break; }
+        if(NeedsConsolidation(node_id, node_p)) { 
+          Consolidate(node_id, node_p);
+          continue;
+        }
 
- private:
-  NodeIDType node_id;
-  NodeBaseType *node_p;
-  MappingTableType *table_p;
-};
+        if(node_p->IsLeaf()) {
+          *leaf_id_p = node_id;
+          return node_p;
+        }
 
-/* 
- * class DeltaChainFreeHelper - Frees a delta chain using delta chain's customized free method
- * 
- * 1. This method is usually called within the garbage collector. Delta nodes will be freed 
- *    immediately
- */
-template <typename KeyType, typename ValueType,
-          typename MappingTableType, typename DeltaChainType, 
-          template <typename, typename, typename> typename BaseNode>
-class DeltaChainFreeHelper : 
-  public TraverseHandlerBase<KeyType, ValueType, typename MappingTableType::NodeIDType, DeltaChainType> {
- public:
-  using NodeIDType = typename MappingTableType::NodeIDType;
-  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>;
-  using NodeBaseType = typename BaseClassType::NodeBaseType;
-  using DeltaType = typename BaseClassType::DeltaType;
-  using LeafBaseType = typename BaseClassType::LeafBaseType;
-  using InnerBaseType = typename BaseClassType::InnerBaseType;
-  using ExtendedBaseType = ExtendedNodeBase<KeyType, DeltaChainType>;
-  using DeltaChainTraverserType = \
-    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, DeltaChainFreeHelper>;
+        InnerBaseType *view_p = static_cast<InnerBaseType *>(GetConsolidatedNode(node_p));
+        parent_id = node_id;
+        parent_p = node_p;
+        node_id = view_p->ValueAt(locator.Search(view_p));
+        FreeChain(this, view_p);
+      }
+    }
 
-  // * DeltaChainFreeHelper() - Constructor
-  DeltaChainFreeHelper(MappingTableType *ptable_p) : 
-    TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>{},
-    table_p{ptable_p} {}
+    assert(false);
+    return nullptr;
+  }
 
-  NodeBaseType *&GetNext() { return BaseClassType::next_p; }
-  bool &Finished() { return BaseClassType::finished; }
-  // * GetBase() - Returns a pointer to the base node of the delta chain
-  inline ExtendedBaseType *GetBase(NodeBaseType *node_p) { return node_p->template GetBase<DeltaChainType>(); }
+  // * class BeforeLocator - Locates the leaf covering keys right before the key. Inf means +Inf
+  class BeforeLocator {
+   public:
+    BeforeLocator(const BoundKeyType &pkey) : key{pkey} {}
+    // * InNode() - Whether low key < key <= high key
+    inline bool InNode(NodeBaseType *node_p) const {
+      BoundKeyType *low_key_p = node_p->GetLowKey(), *high_key_p = node_p->GetHighKey();
+      if(low_key_p->IsInf() == false && key.IsInf() == false && *low_key_p >= key.key) { return false; }
+      return high_key_p->IsInf() || (key.IsInf() == false && *high_key_p >= key.key);
+    }
+    // * Search() - Returns the last child whose low key is smaller than the key
+    inline int Search(InnerBaseType *node_p) const {
+      if(key.IsInf() || (node_p->GetHighKey()->IsInf() == false && *node_p->GetHighKey() == key.key)) { 
+        return node_p->GetSize() - 1; 
+      }
+      int index = node_p->Search(key.key);
+      return (index > 0 && node_p->KeyAt(index) == key.key) ? index - 1 : index;
+    }
+   private:
+    BoundKeyType key;
+  };
 
-  void HandleLeafBase(LeafBaseType *node_p) { 
-    LeafBaseType::Destroy(node_p);
-    Finished() = true; 
-  }
-  void HandleInnerBase(InnerBaseType *node_p) { 
-    InnerBaseType::Destroy(node_p);
-    Finished() = true; 
+  // * class FirstLocator - Locates the leftmost leaf
+  class FirstLocator {
+   public:
+    inline bool InNode(NodeBaseType *node_p) const { return node_p->GetLowKey()->IsInf(); }
+    inline int Search(InnerBaseType *) const { return 0; }
+  };
+
+  // * GetPage() - Returns a private consolidated copy of the leaf covering the key
+  LeafBaseType *GetPage(const KeyType &key) {
+    EpochGuardType guard{&epoch_manager};
+    NodeIDType leaf_id;
+    return static_cast<LeafBaseType *>(GetConsolidatedNode(TraverseToLeaf(key, &leaf_id)));
   }
 
-  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { 
-    GetNext() = node_p->GetNext(); 
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafInsertType>(node_p);
+  // * GetPageBy() - Returns a private consolidated copy of the leaf chosen by the locator
+  template <typename LocatorType>
+  LeafBaseType *GetPageBy(const LocatorType &locator) {
+    EpochGuardType guard{&epoch_manager};
+    NodeIDType leaf_id;
+    return static_cast<LeafBaseType *>(GetConsolidatedNode(TraverseToLeafBy(locator, &leaf_id)));
   }
-  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { 
-    GetNext() = node_p->GetNext(); 
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerInsertType>(node_p);
+
+  // * GetBatchOrder() - Returns the indices of the keys sorted by the key
+  static std::vector<size_t> GetBatchOrder(const KeyType *key_list, size_t n) {
+    std::vector<size_t> order{};
+    order.reserve(n);
+    for(size_t i = 0;i < n;i++) { order.push_back(i); }
+    std::stable_sort(order.begin(), order.end(), 
+                     [key_list](size_t a, size_t b) { return key_list[a] < key_list[b]; });
+    return order;
   }
 
-  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { 
-    GetNext() = node_p->GetNext(); 
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafDeleteType>(node_p);
+  /*
+   * IsFastPathNode() - Whether a node could be passed by batch traversals without any SMO
+   * 
+   * The node must cover the key and have no SMO on top. It must not need consolidation
+   * or split either, such that appends on returned leaves keep the chain height below 
+   * the threshold, like TraverseToLeaf(). Nodes are never removed on the fast path
+   */
+  inline bool IsFastPathNode(NodeIDType node_id, NodeBaseType *node_p, const KeyType &key) const {
+    if(node_p == nullptr || HasSMOOnTop(node_p)) { return false; }
+    if(node_p->KeyInNode(key) == false || node_p->GetHeight() >= GetConsolidationThreshold(node_id, node_p)) { return false; }
+    return node_p->GetHeight() != 0 || node_p->GetSize() < GetSplitThreshold(node_p);
   }
-  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { 
-    GetNext() = node_p->GetNext(); 
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerDeleteType>(node_p);
+
+  /*
+   * TraverseToLeafBatch() - Finds the leaf node IDs of a group of keys level by level
+   * 
+   * 1. index_list is the indices of the keys in key_list. leaf_id_list[i] is set to the 
+   *    leaf ID of the i-th key, or INVALID_NODE_ID if the key leaves the fast path
+   * 2. On each level, the mapping table slots of all keys are prefetched before they are
+   *    read, and then the nodes are prefetched before they are searched, such that 
+   *    the cache misses of different keys overlap
+   * 3. Keys leave the fast path on any node that fails IsFastPathNode(). The caller 
+   *    then uses TraverseToLeaf() (GetBatchLeaf())
+   * 4. The caller must be in an epoch
+   */
+  void TraverseToLeafBatch(const KeyType *key_list, const size_t *index_list, size_t count, 
+                           NodeIDType *leaf_id_list) {
+    assert(count <= BATCH_GROUP_SIZE);
+    NodeIDType node_id_list[BATCH_GROUP_SIZE];
+    NodeBaseType *node_list[BATCH_GROUP_SIZE];
+    size_t active_list[BATCH_GROUP_SIZE];
+    size_t active_num = count;
+    NodeIDType root = root_id.load();
+    for(size_t i = 0;i < count;i++) {
+      leaf_id_list[i] = INVALID_NODE_ID;
+      node_id_list[i] = root;
+      active_list[i] = i;
+    }
+
+    while(active_num > 0) {
+      for(size_t i = 0;i < active_num;i++) { table_p->Prefetch(node_id_list[active_list[i]]); }
+      for(size_t i = 0;i < active_num;i++) {
+        NodeBaseType *node_p = table_p->At(node_id_list[active_list[i]]);
+        if(node_p != nullptr) { __builtin_prefetch(node_p); }
+        node_list[active_list[i]] = node_p;
+      }
+
+      size_t next_num = 0;
+      for(size_t i = 0;i < active_num;i++) {
+        size_t slot = active_list[i];
+        NodeBaseType *node_p = node_list[slot];
+        const KeyType &key = key_list[index_list[slot]];
+        if(IsFastPathNode(node_id_list[slot], node_p, key) == false) { continue; }
+        if(node_p->IsLeaf()) {
+          leaf_id_list[slot] = node_id_list[slot];
+          continue;
+        }
+
+        node_id_list[slot] = SearchInner(node_p, key);
+        active_list[next_num++] = slot;
+      }
+      active_num = next_num;
+    }
+
+    return;
   }
 
-  void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { 
-    GetNext() = node_p->GetNext(); 
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafSplitType>(node_p);
+  /*
+   * GetBatchLeaf() - Returns the current view of the leaf covering the key
+   * 
+   * The leaf ID found by TraverseToLeafBatch() is used if the leaf is still on the fast
+   * path. Otherwise we traverse from the root, and update the leaf ID
+   */
+  inline NodeBaseType *GetBatchLeaf(const KeyType &key, NodeIDType *leaf_id_p) {
+    if(*leaf_id_p != INVALID_NODE_ID) {
+      NodeBaseType *leaf_p = table_p->At(*leaf_id_p);
+      if(IsFastPathNode(*leaf_id_p, leaf_p, key)) { return leaf_p; }
+    }
+
+    return TraverseToLeaf(key, leaf_id_p);
   }
-  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { 
-    GetNext() = node_p->GetNext(); 
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerSplitType>(node_p);
+
+  // * InsertBatchKey() - Inserts a key of a batch like Insert(). The caller must be in an epoch
+  bool InsertBatchKey(const KeyType &key, const ValueType &value, NodeIDType *leaf_id_p) {
+    RetryBackoff backoff{config.GetRetryBackoffLimit()};
+    LeafInsertType *retry_p = nullptr;
+    while(true) {
+      NodeBaseType *leaf_p = GetBatchLeaf(key, leaf_id_p);
+      NodeSizeType base_offset;
+      if(HasConflict(leaf_p, key, value, &base_offset)) { return DiscardDelta(retry_p); }
+      AppendHelperType ah{*leaf_id_p, leaf_p, table_p, &stats};
+      uint64_t sequence = log.GetSequence();
+      retry_p = ah.AppendLeafInsert(key, value, base_offset, retry_p);
+      if(retry_p == nullptr) { 
+        log.Log(LogRecordType::Insert, sequence, key, value);
+        height_policy.CountAppend(*leaf_id_p);
+        return true; 
+      }
+      log.Abort();
+      tracer.TraceRetry(*leaf_id_p);
+      backoff.Pause();
+    }
   }
 
-  // Special for merge because we recursively traverse it
-  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { 
-    DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
-    Finished() = false;
-    DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this);
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafMergeType>(node_p);
+  // * GetNextKey() - Returns the upper bound of the item on the index in a base node
+  inline static BoundKeyType GetNextKey(InnerBaseType *node_p, int index) {
+    return static_cast<NodeSizeType>(index + 1) < node_p->GetSize() ? 
+      BoundKeyType::Get(node_p->KeyAt(index + 1)) : *node_p->GetHighKey();
   }
-  void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { 
-    DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
-    Finished() = false;
-    DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this);
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerMergeType>(node_p);
+
+  /*
+   * SplitNode() - Splits a base node and posts the split delta
+   * 
+   * 1. The sibling is allocated a node ID before the CAS. If the CAS fails, the 
+   *    sibling has never been seen by other threads, and is freed immediately
+   * 2. Returns false if the base node could not be split, i.e. Split() returns nullptr
+   */
+  bool SplitNode(NodeIDType node_id, NodeBaseType *node_p) {
+    if(node_p->IsLeaf()) { 
+      return SplitBase(node_id, static_cast<LeafBaseType *>(node_p)); 
+    }
+    return SplitBase(node_id, static_cast<InnerBaseType *>(node_p));
   }
 
-  void HandleLeafRemove(typename DeltaType::LeafRemoveType *node_p) { 
-    GetNext() = node_p->GetNext(); 
-    table_p->ReleaseNodeID(node_p->GetRemoveNodeID());
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::LeafRemoveType>(node_p); 
+  template <typename BaseNodeType>
+  bool SplitBase(NodeIDType node_id, BaseNodeType *node_p) {
+    BaseNodeType *sibling_p = node_p->Split();
+    if(sibling_p == nullptr) { return false; }
+    NodeIDType sibling_id = table_p->AllocateNodeID(sibling_p);
+    AppendHelperType ah{node_id, node_p, table_p, &stats};
+    // The split key is the low key of the sibling
+    LeafSplitType *delta_p = node_p->IsLeaf() ? 
+      ah.AppendLeafSplit(sibling_p->KeyAt(0), sibling_id, sibling_p->GetSize()) :
+      ah.AppendInnerSplit(sibling_p->KeyAt(0), sibling_id, sibling_p->GetSize());
+    if(delta_p == nullptr) { 
+      CountBaseAlloc(sibling_p);
+      stats.Count(StatsCounter::SplitStart);
+      return true; 
+    }
+
+    ah.DestroyDelta(delta_p);
+    table_p->ReleaseNodeID(sibling_id);
+    BaseNodeType::Destroy(sibling_p);
+    return true;
   }
-  void HandleInnerRemove(typename DeltaType::InnerRemoveType *node_p) { 
-    GetNext() = node_p->GetNext(); 
-    table_p->ReleaseNodeID(node_p->GetRemoveNodeID());
-    GetBase(node_p)->template DestroyDelta<typename DeltaType::InnerRemoveType>(node_p); 
+
+  /*
+   * HelpSplit() - Finishes a split by posting the separator on the parent node
+   * 
+   * 1. If the node is the root, a new root with the two halves is installed
+   * 2. The separator is only posted if it is not yet in the parent. A temporary
+   *    consolidated parent is used for the test, and for finding the next separator
+   *    which is the upper bound of the InnerInsert delta
+   * 3. Returns true if the split is finished. Otherwise the parent view is stale and
+   *    the caller should restart from the root
+   */
+  bool HelpSplit(NodeIDType parent_id, NodeBaseType *parent_p, NodeIDType node_id, NodeBaseType *node_p) {
+    // Leaf and inner split deltas are of the same type
+    LeafSplitType *split_p = static_cast<LeafSplitType *>(node_p);
+    const KeyType &split_key = split_p->GetSplitKey();
+    NodeIDType sibling_id = split_p->GetSplitNodeID();
+    if(parent_p == nullptr) { return InstallNewRoot(node_id, split_key, sibling_id); }
+    if(parent_p->KeyInNode(split_key) == false) { return false; }
+
+    InnerBaseType *view_p = static_cast<InnerBaseType *>(GetConsolidatedNode(parent_p));
+    int index = view_p->Search(split_key);
+    bool finished = index > 0 && view_p->KeyAt(index) == split_key;
+    // If not finished, the separator must be within the range of the node
+    bool valid = finished || view_p->ValueAt(index) == node_id;
+    BoundKeyType next_key = GetNextKey(view_p, index);
+    FreeChain(this, view_p);
+    if(finished == true || valid == false) { return finished; }
+
+    AppendHelperType ah{parent_id, parent_p, table_p, &stats};
+    InnerInsertType *delta_p = ah.AppendInnerInsert(split_key, sibling_id, next_key, GetInnerBaseOffset(parent_p, split_key));
+    if(delta_p == nullptr) { return true; }
+    ah.DestroyDelta(delta_p);
+    return false;
   }
 
-  MappingTableType *table_p;
-};
+  /*
+   * InstallNewRoot() - Installs a new root node after the root splits
+   * 
+   * The new root has two items: The old root and the split sibling. Returns false
+   * if the root has been changed by another thread
+   */
+  bool InstallNewRoot(NodeIDType old_root_id, const KeyType &split_key, NodeIDType sibling_id) {
+    if(root_id.load() != old_root_id) { return false; }
+    InnerBaseType *new_root_p = InnerBaseType::Get(NodeType::InnerBase, 2, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+    new_root_p->ValueAt(0) = old_root_id;
+    new_root_p->KeyAt(1) = split_key;
+    new_root_p->ValueAt(1) = sibling_id;
+    NodeIDType new_root_id = table_p->AllocateNodeID(new_root_p);
+    if(root_id.compare_exchange_strong(old_root_id, new_root_id)) { 
+      CountBaseAlloc(new_root_p);
+      return true; 
+    }
 
-// * class BaseNodeIterator - Provides a set of interfaces for iterating on base nodes
-template <typename _BaseNodeType>
-class BaseNodeIterator {
- public:
-  // Referred to by external classes
-  using BaseNodeType = _BaseNodeType;
-  using NodeSizeType = typename BaseNodeType::NodeSizeType;
-  using KeyType = typename BaseNodeType::KeyType;
-  using ValueType = typename BaseNodeType::ValueType;
-  // * BaseNodeIterator() - Constructors
-  BaseNodeIterator(BaseNodeType *pnode_p) : node_p{pnode_p}, index{0} {}
-  BaseNodeIterator() : node_p{nullptr}, index{0} {}
+    table_p->ReleaseNodeID(new_root_id);
+    InnerBaseType::Destroy(new_root_p);
+    return false;
+  }
 
-  // * Inited() - Returns false if the node has not been initialized
-  inline bool Inited() { return node_p != nullptr; }
-  // * IsEnd() - Whether the iterator has finished iterating over the node
-  inline bool IsEnd() { return index == node_p->GetSize(); }
-  inline BaseNodeType *GetNode() { return node_p; }
-  inline KeyType &GetKey() { assert(!IsEnd()); return node_p->KeyAt(index); }
-  inline ValueType &GetValue() { assert(!IsEnd()); return node_p->ValueAt(index); }
-  // * Next() - Advance to the next key
-  inline void Next() { assert(index < node_p->GetSize()); index++; }
-  // * Append() - Appends a key and value to the current position and advance
-  inline void Append(const KeyType &key, const ValueType &value) { GetKey() = key; GetValue() = value; Next(); }
-  
-  BaseNodeType *node_p;
-  NodeSizeType index;
-};
+  /*
+   * RemoveNode() - Starts removing an underfull node by posting InnerDelete on the parent
+   * 
+   * 1. The parent is modified first, such that the range of the removed node is 
+   *    redirected to its left sibling. The node is then frozen and merged into the
+   *    left sibling by FinishInnerDelete()
+   * 2. The leftmost child of a parent is never removed, because its left sibling
+   *    belongs to another parent
+   */
+  void RemoveNode(NodeIDType parent_id, NodeBaseType *parent_p, NodeIDType node_id, NodeBaseType *node_p) {
+    BoundKeyType *low_key_p = node_p->GetLowKey();
+    if(low_key_p->IsInf() || parent_p->KeyInNode(low_key_p->key) == false) { return; }
+    const KeyType &key = low_key_p->key;
+    if(parent_p->GetLowKey()->IsInf() == false && *parent_p->GetLowKey() == key) { return; }
+
+    InnerBaseType *view_p = static_cast<InnerBaseType *>(GetConsolidatedNode(parent_p));
+    int index = view_p->Search(key);
+    bool valid = index > 0 && view_p->KeyAt(index) == key && view_p->ValueAt(index) == node_id;
+    BoundKeyType next_key = BoundKeyType::GetInf(), prev_key = BoundKeyType::GetInf();
+    NodeIDType prev_id = INVALID_NODE_ID;
+    if(valid == true) {
+      next_key = GetNextKey(view_p, index);
+      // Note that item 0 of inner nodes has the low key of the node
+      prev_key = index == 1 ? *view_p->GetLowKey() : BoundKeyType::Get(view_p->KeyAt(index - 1));
+      prev_id = view_p->ValueAt(index - 1);
+    }
 
-/* 
- * class DefaultConsolidator - Implements consolidation algorithm
- * 
- * The consolidation algorithm uses two lists: inserted list and deleted list
- * The routine traverses down the delta chain in the normal order. For insert
- * deltas, the keys are first tested against the deleted list to see if it is 
- * already deleted. If not, then it is added into the inserted list after testing
- * for duplication. For delete deltas, they are tested against the inserted list,
- * and then added to the deleted list after a duplicated key test if both tests 
- * return negative.
- * 
- * On the base level, the inserted list is first sorted, from largest to smallest.
- * Then a two-way merge is performed to derive the new node. Each data item in the
- * base node is also tested against the deleted list.
- * 
- * Split nodes change the current high key of the virtual node. The updated high
- * key should be recorded. When traversing the base node and the delta chain, 
- * keys larger than the current high key will be ignored, as they belong to 
- * the split sibling.
- * 
- * Merge nodes are processed recursively. Contexts should be saved and restored 
- * before and after the recursion. For example, the current high key will be 
- * saved and restored before and after both siblings are traversed. As an optimization,
- * the deleted list could also be restored, as we know the two siblings will not share
- * any deleted item.
- */
-template <typename KeyType, typename ValueType,
-          typename NodeIDType, typename DeltaChainType, 
-          template <typename, typename, typename> typename BaseNode,
-          size_t HEIGHT_THRESHOLD>
-class DefaultConsolidator : 
-  public TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>,
-  public UniqueKeyBase {
- public:
-  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>;
-  using NodeBaseType = typename BaseClassType::NodeBaseType;
-  using DeltaType = typename BaseClassType::DeltaType;
-  using LeafBaseType = typename BaseClassType::LeafBaseType;
-  using InnerBaseType = typename BaseClassType::InnerBaseType;
-  using NodeHeightType = typename NodeBaseType::NodeHeightType;
-  using NodeSizeType = typename NodeBaseType::NodeSizeType;
-  using DeltaChainTraverserType = \
-    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, DefaultConsolidator>;
-  using KeyPtrGreaterType = KeyPtrGreater<KeyType>;
+    FreeChain(this, view_p);
+    if(valid == false) { return; }
 
-  using LeafNodeIteratorType = BaseNodeIterator<LeafBaseType>;
-  using InnerNodeIteratorType = BaseNodeIterator<InnerBaseType>;
+    AppendHelperType ah{parent_id, parent_p, table_p, &stats};
+    InnerDeleteType *delta_p = ah.AppendInnerDelete(key, node_id, next_key, prev_key, prev_id, GetInnerBaseOffset(parent_p, key));
+    if(delta_p != nullptr) {
+      ah.DestroyDelta(delta_p);
+      return;
+    }
 
-  // * DefaultConsolidator() - Constructor
-  DefaultConsolidator(NodeBaseType *pold_node_p) : 
-    TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>{},
-    inserted_num{NodeHeightType{0}},
-    deleted_num{NodeHeightType{0}},
-    current_high_key_p{nullptr},
-    old_node_p{pold_node_p},
-    new_leaf_node_it{} { assert(new_inner_node_it.GetNode() == nullptr); }
+    stats.Count(StatsCounter::RemoveStart);
+    if(FinishInnerDelete(parent_id, ah.GetNode()) == true) { Consolidate(parent_id, ah.GetNode()); }
+    return;
+  }
 
-  NodeBaseType *&GetNext() { return BaseClassType::next_p; }
-  bool &Finished() { return BaseClassType::finished; }
-  /* 
-   * SortInsertedList() - Sorts a given list of keys
+  /*
+   * FinishInnerDelete() - Finishes the removal started by the InnerDelete delta on 
+   *                       top of the parent node
    * 
-   * 1. Keys are sorted from larger to smaller
-   * 2. The reason for reversed ordering is that we could use the inserted list as a stack
-   *    during the merge, without having to adjust the starting point
+   * 1. The left sibling is found using the previous node ID in the delta. If it has
+   *    split, the split siblings are followed until the node whose range ends at the
+   *    deleted key. If the range already covers the deleted key, the merge is finished
+   * 2. Otherwise the removed node is frozen by a remove delta, and a merge delta is
+   *    posted on the left sibling. The remove delta is the sibling branch of the merge
+   * 3. If the removed node has an unfinished SMO, it could not be frozen. The removal
+   *    is aborted by posting the separator back onto the parent
+   * 4. Changes are made only if the parent is not changed after the nodes are read.
+   *    Otherwise a thread with a stale view might merge a node twice
+   * 5. Returns true if the removal is finished. False if the parent has changed
    */
-  inline void SortInsertedList() { std::sort(inserted_list, inserted_list + inserted_num, KeyPtrGreaterType{}); }
-  // * IsInList() - Whether the key is in the inserted set
-  bool IsInList(const KeyType &key, KeyType **key_list_p, NodeHeightType num) {
-    for(NodeHeightType i = 0;i < num;i++) { if(key == *key_list_p[i]) { return true; } }
-    return false;
-  }
-  // * IsInserted() - Whether the key is in the inserted set
-  inline bool IsInserted(const KeyType &key) { return IsInList(key, inserted_list, inserted_num); }
-  // * IsDeleted() - Whether the key is in the deleted set
-  inline bool IsDeleted(const KeyType &key) { return IsInList(key, deleted_list, deleted_num); }
-  // * Insert() - Adds a key into the inserted list
-  void Insert(KeyType *key_p) {
-    if(IsDeleted(*key_p) == false && IsInserted(*key_p) == false) {
-      if(current_high_key_p == nullptr || *key_p < *current_high_key_p) {
-        assert(inserted_num < HEIGHT_THRESHOLD);
-        inserted_list[inserted_num] = key_p;
-        inserted_num++;
+  bool FinishInnerDelete(NodeIDType parent_id, NodeBaseType *parent_p) {
+    InnerDeleteType *delete_p = static_cast<InnerDeleteType *>(parent_p);
+    const KeyType &key = delete_p->GetDeleteKey();
+    NodeIDType removed_id = delete_p->GetDeleteNodeID();
+    NodeIDType left_id = delete_p->GetPrevNodeID();
+    while(true) {
+      NodeBaseType *left_p = table_p->At(left_id);
+      NodeBaseType *removed_p = table_p->At(removed_id);
+      // The removed node ID is only released after the merged chain is freed
+      if(left_p == nullptr || removed_p == nullptr) { return true; }
+      BoundKeyType *high_key_p = left_p->GetHighKey();
+      if(high_key_p->IsInf() || *high_key_p > key) { return true; }
+
+      NodeType left_type = left_p->GetType();
+      if(left_type == NodeType::LeafSplit || left_type == NodeType::InnerSplit) {
+        left_id = static_cast<LeafSplitType *>(left_p)->GetSplitNodeID();
+        continue;
+      } else if(left_type == NodeType::InnerDelete) {
+        if(FinishInnerDelete(left_id, left_p) == true) { Consolidate(left_id, left_p); }
+        continue;
+      } else if(left_type == NodeType::LeafRemove || left_type == NodeType::InnerRemove || *high_key_p != key) {
+        // Only possible if the parent view is stale
+        return false;
       }
-    }
-  }
-  // * Delete() - Adds a key into the deleted list
-  void Delete(KeyType *key_p) {
-    if(IsInserted(*key_p) == false && IsDeleted(*key_p) == false) {
-      if(current_high_key_p == nullptr || *key_p < *current_high_key_p) {
-        assert(deleted_num < HEIGHT_THRESHOLD);
-        deleted_list[deleted_num] = key_p;
-        deleted_num++;
+
+      NodeType removed_type = removed_p->GetType();
+      if(removed_type == NodeType::LeafRemove || removed_type == NodeType::InnerRemove) {
+        // The merge delta must not exceed the height threshold, unless the left sibling 
+        // is already a base node
+        if(left_p->GetHeight() != 0 && size_t{left_p->GetHeight()} + removed_p->GetHeight() + 1 > GetHeightThreshold(left_p)) {
+          Consolidate(left_id, left_p);
+          continue;
+        }
+        if(table_p->At(parent_id) != parent_p) { return false; }
+        AppendHelperType ah{left_id, left_p, table_p, &stats};
+        LeafMergeType *delta_p = left_p->IsLeaf() ? 
+          ah.AppendLeafMerge(key, removed_id, removed_p) : ah.AppendInnerMerge(key, removed_id, removed_p);
+        if(delta_p == nullptr) { return true; }
+        ah.DestroyDelta(delta_p);
+      } else if(removed_type == NodeType::LeafSplit || removed_type == NodeType::InnerSplit || 
+                removed_type == NodeType::InnerDelete) {
+        AppendHelperType ah{parent_id, parent_p, table_p, &stats};
+        // The delete delta is on the same chain, so its base offset is still valid
+        InnerInsertType *delta_p = ah.AppendInnerInsert(key, removed_id, delete_p->GetNextKey(), delete_p->GetBaseOffset());
+        if(delta_p != nullptr) { ah.DestroyDelta(delta_p); }
+        return false;
+      } else {
+        if(table_p->At(parent_id) != parent_p) { return false; }
+        AppendHelperType ah{removed_id, removed_p, table_p, &stats};
+        LeafRemoveType *delta_p = removed_p->IsLeaf() ? 
+          ah.AppendLeafRemove(removed_id) : ah.AppendInnerRemove(removed_id);
+        if(delta_p != nullptr) { ah.DestroyDelta(delta_p); }
       }
     }
+
+    assert(false);
+    return false;
   }
-  // * InInsertedListEmpty() - Returns true if it is empty
-  inline KeyType IsInsertListEmpty() const { return inserted_num == 0; }
-  // * InsertTop() - Returns the key at the top of the inserted list (we maintain it as a stack)
-  inline KeyType &TopKey() { assert(IsInsertListEmpty() == false); return *inserted_list[inserted_num - 1]; }
-  // * TopValue() - Returns the value on the top
-  inline ValueType &TopValue() { 
-    assert(IsInsertListEmpty() == false); 
-    return *DeltaType::LeafInsertType::GetT2FromT1(inserted_list[inserted_num - 1]); 
+
+  /*
+   * SearchLeaf() - Returns the pointer to the value, or nullptr if the key does not exist
+   * 
+   * The offset of the key in the base node is returned for the delta appended next
+   */
+  inline ValueType *SearchLeaf(NodeBaseType *node_p, const KeyType &key, NodeSizeType *base_offset_p = nullptr) {
+    ValueSearcherType vs{key};
+    ValueSearchTraverserType::Traverse(node_p, &vs);
+    if(base_offset_p != nullptr) { *base_offset_p = vs.GetBaseOffset(); }
+    return vs.GetValue();
   }
-  // * TopNodeID() - Returns the NodeID on the top
-  inline NodeIDType &TopNodeID() { 
-    assert(IsInsertListEmpty() == false); 
-    return *DeltaType::InnerInsertType::GetT2FromT1(inserted_list[inserted_num - 1]);   
+
+  // * SearchLeafPair() - Returns the pointer to the value, or nullptr if the pair does not exist. Only for non-unique keys
+  inline ValueType *SearchLeafPair(NodeBaseType *node_p, const KeyType &key, const ValueType &value, 
+                                   NodeSizeType *base_offset_p) {
+    ValueSearcherType vs{key, &value};
+    ValueSearchTraverserType::Traverse(node_p, &vs);
+    *base_offset_p = vs.GetBaseOffset();
+    return vs.GetValue();
   }
-  
-  // * TopPayload() - Returns the payload (node ID for value) based on the key pointer
-  template <typename BaseNodeType, typename DeltaInsertType>
-  inline typename BaseNodeType::ValueType &TopPayload() { 
-    assert(IsInsertListEmpty() == false); 
-    return *DeltaInsertType::GetT2FromT1(inserted_list[inserted_num - 1]);   
+
+  // * HasConflict() - Whether the key exists for unique keys, or the pair exists for non-unique keys
+  inline bool HasConflict(NodeBaseType *leaf_p, const KeyType &key, const ValueType &value, NodeSizeType *base_offset_p) {
+    return HasConflict(leaf_p, key, value, base_offset_p, std::integral_constant<bool, LeafBaseType::support_non_unique_key>{});
+  }
+  inline bool HasConflict(NodeBaseType *leaf_p, const KeyType &key, const ValueType &, NodeSizeType *base_offset_p, std::false_type) {
+    return SearchLeaf(leaf_p, key, base_offset_p) != nullptr;
+  }
+  inline bool HasConflict(NodeBaseType *leaf_p, const KeyType &key, const ValueType &value, NodeSizeType *base_offset_p, std::true_type) {
+    return SearchLeafPair(leaf_p, key, value, base_offset_p) != nullptr;
   }
 
-  // * InsertPop() - Pop an element from the insert list
-  inline void InsertPop() { assert(IsInsertListEmpty() == false); inserted_num--; }
+  // * GetInnerBaseOffset() - Returns the offset of the key in the base node of an inner chain, for the delta appended next
+  inline NodeSizeType GetInnerBaseOffset(NodeBaseType *node_p, const KeyType &key) {
+    InnerBaseType *base_p = static_cast<InnerBaseType *>(node_p->template GetBase<DeltaChainType>());
+    // The key may be in the merge sibling
+    if(base_p->KeyInNode(key) == false) { return NodeBaseType::INVALID_OFFSET; }
+    return static_cast<NodeSizeType>(base_p->Search(key));
+  }
 
-  // * IsTopInBound() * IsBaseInBound() - Whether the key on the top or the base node is still less than the current high key
-  inline bool IsTopInBound() { return current_high_key_p == nullptr || (TopKey() < *current_high_key_p); }
-  template <typename IteratorType>
-  inline bool IsBaseInBound(IteratorType it) { return current_high_key_p == nullptr || (it.GetKey() < *current_high_key_p); }
+  // * SearchInner() - Returns the node ID of the next level
+  inline NodeIDType SearchInner(NodeBaseType *node_p, const KeyType &key) {
+    ValueSearcherType vs{key};
+    ValueSearchTraverserType::Traverse(node_p, &vs);
+    assert(vs.GetNextID() != ValueSearcherType::INVALID_NODE_ID);
+    return vs.GetNextID();
+  }
 
-  // * IsTopStopped() * IsBaseStopped() - Whether the insert list or the base node has been exhausted
-  inline bool IsTopStopped() { return IsInsertListEmpty() || !IsTopInBound(); }
-  template <typename IteratorType>
-  inline bool IsBaseStopped(IteratorType it) { return it.IsEnd() || !IsBaseInBound(it); }
+  /*
+   * Consolidate() - Consolidates a node and installs the new base node
+   * 
+   * 1. Returns true if the CAS succeeds, in which case the old chain is retired.
+   *    Otherwise the new base node is freed immediately since no other thread
+   *    could have seen it
+   * 2. The consolidator is given the split threshold. If it splits the node, both 
+   *    halves are written in one pass, and the lower half is installed with a split
+   *    delta on top. The split is then finished as usual by HelpSplit()
+   */
+  bool Consolidate(NodeIDType node_id, NodeBaseType *node_p) {
+    ConsolidatorType ct{node_p, static_cast<NodeSizeType>(GetSplitThreshold(node_p))};
+    ConsolidationTraverserType::Traverse(node_p, &ct);
+    if(node_p->IsLeaf()) { return InstallBase(node_id, node_p, ct.GetNewLeafBase(), ct.GetNewLeafSibling()); }
+    return InstallBase(node_id, node_p, ct.GetNewInnerBase(), ct.GetNewInnerSibling());
+  }
 
-  /* 
-   * MergeLoop() - Merges an insert list and a base node
+  /*
+   * InstallBase() - Installs a consolidated node, and the split sibling if not nullptr
    * 
-   * 1. IteratorType is the type of the iterator. This argument can be deduced
-   * 2. DeltaInsertType is either leaf insert delta type or inner insert delta type
-   *    It is used to fetch the payload (either node ID or value type) from the key's pointer
-   * 3. For base nodes, since the low key could be -Inf, we ignore the first key-NodeID item.
+   * The split delta is allocated from the heap rather than the delta chain of the 
+   * lower half, because RemoveSplitDelta() frees it separately from the base node.
+   * Delta chains delete deltas that are not allocated by them, so the split delta 
+   * can also be freed together with the chain
    */
-  template <typename DeltaInsertType, typename IteratorType>
-  void MergeLoop(typename IteratorType::BaseNodeType *node_p, IteratorType *target_it_p) {
-    using BaseNodeType = typename IteratorType::BaseNodeType;
-    assert(node_p->GetType() == NodeType::InnerBase || node_p->GetType() == NodeType::LeafBase);
-    // The iterator wrappes an index with the node pointer
-    IteratorType it{node_p};
-    // If the low key is -Inf, and we know it is inner node, then ignore the first item
-    if(node_p->GetType() == NodeType::InnerBase) {
-      assert(it.IsEnd() == false);
-      target_it_p->Append(node_p->KeyAt(0), node_p->ValueAt(0));
-      it.Next();
+  template <typename BaseNodeType>
+  bool InstallBase(NodeIDType node_id, NodeBaseType *node_p, BaseNodeType *new_node_p, BaseNodeType *sibling_p) {
+    StatsCounter counter = node_p->IsLeaf() ? StatsCounter::LeafConsolidation : StatsCounter::InnerConsolidation;
+    if(sibling_p == nullptr) {
+      if(table_p->CAS(node_id, node_p, new_node_p)) {
+        CountBaseAlloc(new_node_p);
+        stats.Count(counter);
+        RetireChain(node_p);
+        return true;
+      }
+
+      stats.Count(StatsCounter::ConsolidationFailure);
+      FreeChain(this, new_node_p);
+      return false;
     }
 
-    while(1) {
-      bool insert_list_stop = IsTopStopped();
-      bool old_base_stop = IsBaseStopped(it);
-      if(insert_list_stop && old_base_stop) {
-        dbg_printf("Both stop\n");
-        // Both are finished
-        break;
-      } else if(insert_list_stop) {
-        dbg_printf("Flush old base\n");
-        // Copy old base items, only if they are not deleted by deltas
-        while(!IsBaseStopped(it)) {
-          if(!IsDeleted(it.GetKey())) {
-            target_it_p->Append(it.GetKey(), it.GetValue());
-          }
+    NodeIDType sibling_id = table_p->AllocateNodeID(sibling_p);
+    LeafSplitType *split_p = new LeafSplitType{
+      new_node_p->IsLeaf() ? NodeType::LeafSplit : NodeType::InnerSplit, NodeHeightType{0}, new_node_p->GetSize(), 
+      new_node_p->GetLowKey(), nullptr, new_node_p, 
+      BoundKeyType::Get(sibling_p->KeyAt(0)), sibling_id};
+    split_p->SetSplitHighKey();
+    if(table_p->CAS(node_id, node_p, split_p)) {
+      CountBaseAlloc(new_node_p);
+      CountBaseAlloc(sibling_p);
+      stats.CountAlloc(new_node_p->IsLeaf() ? NodeType::LeafSplit : NodeType::InnerSplit, sizeof(LeafSplitType));
+      stats.Count(counter);
+      stats.Count(StatsCounter::SplitStart);
+      RetireChain(node_p);
+      return true;
+    }
 
-          it.Next();
-        }
-      } else if(old_base_stop) {
-        dbg_printf("Flush insert stack\n");
-        // Copy insert list
-        while(!IsTopStopped()) {
-          dbg_printf("  key = %d\n", TopKey());
-          target_it_p->Append(TopKey(), TopPayload<BaseNodeType, DeltaInsertType>());
-          InsertPop();
-        }
-      } else {
-        // Only test and try to insert non-deleted keys
-        if(IsDeleted(it.GetKey())) {
-          it.Next();
-        } else {
-          assert(it.GetKey() != TopKey());
-          // Two-way merge
-          if(it.GetKey() > TopKey()) {
-            target_it_p->Append(TopKey(), TopPayload<BaseNodeType, DeltaInsertType>());
-            InsertPop();
-          } else {
-            target_it_p->Append(it.GetKey(), it.GetValue());
-            it.Next();
-          }
-        }
+    stats.Count(StatsCounter::ConsolidationFailure);
+    delete split_p;
+    table_p->ReleaseNodeID(sibling_id);
+    BaseNodeType::Destroy(sibling_p);
+    FreeChain(this, new_node_p);
+    return false;
+  }
+
+  /*
+   * RemoveSplitDelta() - Removes a finished split delta on top of the node
+   * 
+   * If the split was made by consolidation, the node below the split delta is the lower
+   * half, whose high key is already the split key. The split delta is then unlinked 
+   * without copying the lower half again. Otherwise the node is consolidated
+   */
+  void RemoveSplitDelta(NodeIDType node_id, NodeBaseType *node_p) {
+    LeafSplitType *split_p = static_cast<LeafSplitType *>(node_p);
+    NodeBaseType *next_p = split_p->GetNext();
+    BoundKeyType *high_key_p = next_p->GetHighKey();
+    bool is_base = next_p->GetType() == NodeType::LeafBase || next_p->GetType() == NodeType::InnerBase;
+    if(is_base && high_key_p->IsInf() == false && *high_key_p == split_p->GetSplitKey()) {
+      if(table_p->CAS(node_id, node_p, next_p)) { 
+        stats.Count(StatsCounter::Retire);
+        epoch_manager.Retire(split_p, FreeSplitDelta, this); 
       }
+      return;
     }
 
+    Consolidate(node_id, node_p);
     return;
   }
 
-  void HandleLeafBase(LeafBaseType *node_p) { 
-    dbg_printf("Handle leaf base\n");
-    SortInsertedList();
-    if(!new_leaf_node_it.Inited()) {
-      new_leaf_node_it = LeafNodeIteratorType{static_cast<LeafBaseType *>(
-        LeafBaseType::Get(NodeType::LeafBase, old_node_p->GetSize(), *old_node_p->GetLowKey(), *old_node_p->GetHighKey()))};
-      dbg_printf("Creating new leaf node. Size = %lu\n", (uint64_t)old_node_p->GetSize());
-    }
+  // * FreeSplitDelta() - Call back for the epoch manager to free a split delta made by InstallBase()
+  static void FreeSplitDelta(void *tree_p, void *node_p) { 
+    static_cast<BwTree *>(tree_p)->stats.Count(StatsCounter::Free);
+    delete static_cast<LeafSplitType *>(node_p); 
+  }
 
-    MergeLoop<typename DeltaType::LeafInsertType>(node_p, &new_leaf_node_it);
-    Finished() = true; 
-    return;
+  // * GetConsolidatedNode() - Returns a new base node of the virtual node without installing it
+  //                           The node is a private view, and is not counted in the stats
+  NodeBaseType *GetConsolidatedNode(NodeBaseType *node_p) {
+    ConsolidatorType ct{node_p};
+    ConsolidationTraverserType::Traverse(node_p, &ct);
+    if(node_p->IsLeaf()) { return ct.GetNewLeafBase(); }
+    return ct.GetNewInnerBase();
   }
 
-  void HandleInnerBase(InnerBaseType *node_p) { 
-    SortInsertedList();
-    if(!new_inner_node_it.Inited()) {
-      new_inner_node_it = InnerNodeIteratorType{static_cast<InnerBaseType *>(
-        InnerBaseType::Get(NodeType::InnerBase, old_node_p->GetSize(), *old_node_p->GetLowKey(), *old_node_p->GetHighKey()))};
-      dbg_printf("Creating new inner node. Size = %lu\n", (uint64_t)old_node_p->GetSize());
+  // * CountBaseAlloc() - Records the bytes of a new base node in the stats. Only nodes installed in the tree are counted
+  template <typename BaseNodeType>
+  inline void CountBaseAlloc(BaseNodeType *node_p) {
+    stats.CountAlloc(node_p->GetType(), node_p->GetAllocatedSize());
+  }
+
+  /*
+   * FreeSubtree() - Frees all nodes reachable from the given node ID
+   * 
+   * Children of inner nodes are obtained from a temporary consolidated node
+   */
+  void FreeSubtree(NodeIDType node_id) {
+    NodeBaseType *node_p = table_p->At(node_id);
+    if(node_p->IsLeaf() == false) {
+      InnerBaseType *inner_p = static_cast<InnerBaseType *>(GetConsolidatedNode(node_p));
+      for(NodeSizeType i = 0;i < inner_p->GetSize();i++) { FreeSubtree(inner_p->ValueAt(i)); }
+      FreeChain(this, inner_p);
     }
 
-    MergeLoop<typename DeltaType::InnerInsertType>(node_p, &new_inner_node_it);
-    Finished() = true; 
+    FreeChain(this, node_p);
     return;
   }
 
-  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { GetNext() = node_p->GetNext(); Insert(&node_p->GetInsertKey()); }
-  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { GetNext() = node_p->GetNext(); Insert(&node_p->GetInsertKey()); }
+  /*
+   * class SnapshotHeaderType - The first record of snapshots
+   * 
+   * Images are used in place by Open(), so besides the key and value sizes, the header
+   * records the layout of base nodes of the tree. Header sizes depend on the delta chain
+   * type, e.g. DefaultSlabDeltaChainType embeds its slab in the header
+   */
+  class SnapshotHeaderType {
+   public:
+    // * Get() - Returns the header of this tree type
+    static SnapshotHeaderType Get(uint64_t node_num, uint64_t log_sequence) {
+      return SnapshotHeaderType{SNAPSHOT_MAGIC, sizeof(KeyType), sizeof(ValueType), 
+                                static_cast<uint32_t>(LeafBaseType::GetHeaderSize()), 
+                                static_cast<uint32_t>(InnerBaseType::GetHeaderSize()),
+                                sizeof(NodeSizeType), SNAPSHOT_ALIGNMENT, node_num, log_sequence};
+    }
+    // * IsCompatible() - Whether the layouts are the same, regardless of the node number and sequence
+    inline bool IsCompatible(const SnapshotHeaderType &other) const {
+      return magic == other.magic && key_size == other.key_size && value_size == other.value_size && 
+             leaf_header_size == other.leaf_header_size && inner_header_size == other.inner_header_size && 
+             node_size_size == other.node_size_size && alignment == other.alignment;
+    }
 
-  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { GetNext() = node_p->GetNext(); Delete(&node_p->GetDeleteKey()); }
-  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { GetNext() = node_p->GetNext(); Delete(&node_p->GetDeleteKey()); }
+    uint64_t magic;
+    uint32_t key_size;
+    uint32_t value_size;
+    // Offsets of keys in base nodes (GetHeaderSize())
+    uint32_t leaf_header_size;
+    uint32_t inner_header_size;
+    uint32_t node_size_size;
+    // Alignment of records (SNAPSHOT_ALIGNMENT)
+    uint32_t alignment;
+    // Number of node records
+    uint64_t node_num;
+    // Sequence number of the first log record not in the snapshot
+    uint64_t log_sequence;
+  };
+  static_assert(sizeof(SnapshotHeaderType) <= SNAPSHOT_ALIGNMENT, "Header does not fit in the first record");
+
+  // * BwTree() - Constructor of a tree without any node, on which Open() loads the snapshot
+  BwTree(size_t thread_num, const ConfigType &pconfig, SnapshotMappingType &&psnapshot) : 
+    config{pconfig},
+    table_p{MappingTableType::Get(config.GetMappingTableSize())},
+    snapshot{std::move(psnapshot)},
+    epoch_manager{thread_num},
+    stats{thread_num},
+    height_policy{},
+    log{thread_num},
+    tracer{thread_num},
+    maintenance_p{nullptr},
+    root_id{INVALID_NODE_ID} {
+    config.Validate();
+  }
 
-  void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { GetNext() = node_p->GetNext(); current_high_key_p = &node_p->GetSplitKey(); }
-  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { GetNext() = node_p->GetNext(); current_high_key_p = &node_p->GetSplitKey(); }
+  // * ReplayDelete() - Deletes a logged key value pair with the Delete() of the key type
+  inline bool ReplayDelete(const KeyType &key, const ValueType &, std::false_type) { return Delete(key); }
+  inline bool ReplayDelete(const KeyType &key, const ValueType &value, std::true_type) { return Delete(key, value); }
 
-  // Special for merge because we recursively traverse it
-  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { 
-    // Save this such that we do not need to compare
-    NodeHeightType saved_deleted_num = deleted_num;
-    KeyType *saved_high_key_p = current_high_key_p;
-    DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
-    deleted_num = saved_deleted_num;
-    current_high_key_p = saved_high_key_p;
-    Finished() = false;
-    DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this);
-  }
-  void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { 
-    NodeHeightType saved_deleted_num = deleted_num;
-    KeyType *saved_high_key_p = current_high_key_p;
-    DeltaChainTraverserType::Traverse(node_p->GetNext(), this);
-    deleted_num = saved_deleted_num;
-    current_high_key_p = saved_high_key_p;
-    Finished() = false;
-    DeltaChainTraverserType::Traverse(node_p->GetMergeSibling(), this);
+  // * WriteSnapshotRecord() - Writes the bytes and pads them to the alignment of records
+  static bool WriteSnapshotRecord(FILE *fp, const void *p, size_t size) {
+    static const unsigned char padding[SNAPSHOT_ALIGNMENT] = {};
+    size_t padding_size = (SNAPSHOT_ALIGNMENT - size % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT;
+    return fwrite(p, 1, size, fp) == size && fwrite(padding, 1, padding_size, fp) == padding_size;
   }
 
-  // * GetNewLeafBase() * GetNewInnerBase() - Returns the node after consolidation
-  LeafBaseType *GetNewLeafBase() { return new_leaf_node_it.GetNode(); }
-  InnerBaseType *GetNewInnerBase() { return new_inner_node_it.GetNode(); }
+  // * WriteSnapshotNode() - Writes the image of a base node as a record
+  template <typename BaseNodeType>
+  static bool WriteSnapshotNode(FILE *fp, BaseNodeType *node_p) {
+    std::vector<unsigned char> image(node_p->GetAllocatedSize());
+    node_p->StoreImage(image.data());
+    return WriteSnapshotRecord(fp, image.data(), image.size());
+  }
 
- private:
-  // A list of pointers to keys within deltas
-  KeyType *inserted_list[HEIGHT_THRESHOLD];
-  KeyType *deleted_list[HEIGHT_THRESHOLD];
-  NodeHeightType inserted_num;
-  NodeHeightType deleted_num;
-  // The current high key on the branch
-  // If nullptr then did not see a split node yet (can be +Inf),
-  // in which case all elements are processed
-  KeyType *current_high_key_p;
-  // The node before consolidation
-  NodeBaseType *old_node_p;
-  // The node after consolidation
-  union {
-    LeafNodeIteratorType new_leaf_node_it;
-    InnerNodeIteratorType new_inner_node_it;
-  };
-};
+  /*
+   * LoadSnapshot() - Constructs base nodes on the records in the mapping and allocates node IDs
+   * 
+   * Children are written before their parents, so record indices in inner nodes are 
+   * translated into node IDs that have been allocated. Returns false if a record is invalid
+   */
+  bool LoadSnapshot(uint64_t node_num) {
+    std::vector<NodeIDType> id_list{};
+    size_t offset = SNAPSHOT_ALIGNMENT;
+    for(uint64_t i = 0;i < node_num;i++) {
+      if(offset + sizeof(typename ExtendedBaseType::ImageHeaderType) > snapshot.GetSize()) { return false; }
+      unsigned char *p = snapshot.GetBase() + offset;
+      size_t size;
+      if(reinterpret_cast<typename ExtendedBaseType::ImageHeaderType *>(p)->type == NodeType::LeafBase) {
+        LeafBaseType *leaf_p = LeafBaseType::LoadImage(p, snapshot.GetSize() - offset);
+        if(leaf_p == nullptr) { return false; }
+        size = leaf_p->GetAllocatedSize();
+        id_list.push_back(table_p->AllocateNodeID(leaf_p));
+      } else {
+        InnerBaseType *inner_p = InnerBaseType::LoadImage(p, snapshot.GetSize() - offset);
+        if(inner_p == nullptr || inner_p->GetSize() == 0) { return false; }
+        for(NodeSizeType j = 0;j < inner_p->GetSize();j++) {
+          NodeIDType &child_id = inner_p->ValueAt(static_cast<int>(j));
+          if(child_id >= id_list.size()) { return false; }
+          child_id = id_list[child_id];
+        }
+        size = inner_p->GetAllocatedSize();
+        id_list.push_back(table_p->AllocateNodeID(inner_p));
+      }
+      offset += (size + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    }
 
-// * class ValueSearcher - Searches using a key and returns the value or node ID
-template <typename KeyType, typename ValueType,
-          typename MappingTableType, typename DeltaChainType, 
-          template <typename, typename, typename> typename BaseNode>
-class ValueSearcher : 
-  public TraverseHandlerBase<KeyType, ValueType, typename MappingTableType::NodeIDType, DeltaChainType>,
-  public UniqueKeyBase {
- public:
-  using NodeIDType = typename MappingTableType::NodeIDType;
-  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>;
-  using NodeBaseType = typename BaseClassType::NodeBaseType;
-  using DeltaType = typename BaseClassType::DeltaType;
-  using LeafBaseType = typename BaseClassType::LeafBaseType;
-  using InnerBaseType = typename BaseClassType::InnerBaseType;
-  using NodeHeightType = typename NodeBaseType::NodeHeightType;
-  using NodeSizeType = typename NodeBaseType::NodeSizeType;
-  static constexpr NodeIDType INVALID_NODE_ID = MappingTableType::INVALID_NODE_ID;
+    root_id = id_list.back();
+    return true;
+  }
 
-  // * ValueSearcher() - Constructor
-  ValueSearcher(NodeBaseType *pnode_p) : 
-    TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>{},
-    node_p{pnode_p}, next_id{INVALID_NODE_ID}, abort{false} {}
+  // * FreeRetiredChain() - Call back for the epoch manager to free a chain retired by RetireChain()
+  static void FreeRetiredChain(void *tree_p, void *node_p) {
+    static_cast<BwTree *>(tree_p)->stats.Count(StatsCounter::Free);
+    FreeChain(tree_p, node_p);
+  }
 
-  NodeBaseType *&GetNext() { return BaseClassType::next_p; }
-  bool &Finished() { return BaseClassType::finished; }
+  // * class MaintenanceType - Queue of nodes to be consolidated by background workers
+  class MaintenanceType {
+   public:
+    MaintenanceType() : queue{}, stop{false}, thread_list{} {
+      for(size_t i = 0;i < MAINTENANCE_QUEUE_SIZE;i++) { pending_list[i].store(false); }
+    }
+    // * GetPending() - Returns the flag of the node ID, which is set while the ID is in the queue
+    inline std::atomic<bool> *GetPending(NodeIDType node_id) { return &pending_list[node_id % MAINTENANCE_QUEUE_SIZE]; }
+
+    // An ID is only pushed after setting its flag, and the flag is cleared after the ID
+    // is popped. There are as many flags as cells, so the queue is never full
+    BoundedQueue<NodeIDType, MAINTENANCE_QUEUE_SIZE> queue;
+    std::atomic<bool> pending_list[MAINTENANCE_QUEUE_SIZE];
+    std::atomic<bool> stop;
+    std::vector<std::thread> thread_list;
+  };
 
-  void HandleLeafBase(LeafBaseType *node_p) { 
-    Finished() = true; 
-    return;
-  }
+  /*
+   * NeedsConsolidation() - Whether a traversal should consolidate the node before continuing
+   * 
+   * If background workers are running, the node is pushed to them instead, unless the
+   * chain is too long or the queue is full. See StartMaintenance()
+   */
+  inline bool NeedsConsolidation(NodeIDType node_id, NodeBaseType *node_p) {
+    size_t threshold = GetConsolidationThreshold(node_id, node_p);
+    if(node_p->GetHeight() < threshold) { return false; }
+    if(maintenance_p == nullptr || node_p->GetHeight() >= threshold * MAINTENANCE_HEIGHT_FACTOR) { return true; }
+    std::atomic<bool> *pending_p = maintenance_p->GetPending(node_id);
+    if(pending_p->load(std::memory_order_relaxed) == true || pending_p->exchange(true) == true) { return false; }
+    if(maintenance_p->queue.Push(node_id) == false) {
+      pending_p->store(false);
+      return true;
+    }
 
-  void HandleInnerBase(InnerBaseType *node_p) { 
-    Finished() = true; 
-    return;
+    stats.Count(StatsCounter::DeferredConsolidation);
+    return false;
   }
 
-  void HandleLeafInsert(typename DeltaType::LeafInsertType *node_p) { GetNext() = node_p->GetNext();  }
-  void HandleInnerInsert(typename DeltaType::InnerInsertType *node_p) { GetNext() = node_p->GetNext();  }
-
-  void HandleLeafDelete(typename DeltaType::LeafDeleteType *node_p) { GetNext() = node_p->GetNext();  }
-  void HandleInnerDelete(typename DeltaType::InnerDeleteType *node_p) { GetNext() = node_p->GetNext();  }
+  /*
+   * MaintenanceLoop() - Body of background workers
+   * 
+   * A node is consolidated if it still reaches the threshold and has no SMO on top. 
+   * The pending flag is cleared before, such that appends after the consolidation could
+   * push the node again. Garbage handed over by other threads and retired by the worker
+   * is reclaimed if the queue is empty, or after every MAINTENANCE_RECLAIM_INTERVAL IDs
+   */
+  void MaintenanceLoop(size_t thread_id) {
+    epoch_manager.RegisterThread(thread_id);
+    size_t pop_num = 0;
+    while(maintenance_p->stop.load() == false) {
+      NodeIDType node_id;
+      if(maintenance_p->queue.Pop(&node_id) == false) {
+        epoch_manager.Reclaim();
+        std::this_thread::sleep_for(std::chrono::microseconds{size_t{MAINTENANCE_IDLE_US}});
+        continue;
+      }
+      if(++pop_num % MAINTENANCE_RECLAIM_INTERVAL == 0) { epoch_manager.Reclaim(); }
 
-  void HandleLeafSplit(typename DeltaType::LeafSplitType *node_p) { GetNext() = node_p->GetNext(); }
-  void HandleInnerSplit(typename DeltaType::InnerSplitType *node_p) { GetNext() = node_p->GetNext(); }
+      maintenance_p->GetPending(node_id)->store(false);
+      EpochGuardType guard{&epoch_manager};
+      NodeBaseType *node_p = table_p->At(node_id);
+      if(node_p == nullptr || HasSMOOnTop(node_p) || node_p->GetHeight() < GetConsolidationThreshold(node_id, node_p)) { 
+        continue; 
+      }
+      Consolidate(node_id, node_p);
+    }
 
-  void HandleLeafMerge(typename DeltaType::LeafMergeType *node_p) { 
-  }
-  void HandleInnerMerge(typename DeltaType::InnerMergeType *node_p) { 
+    return;
   }
- private:
-  NodeBaseType *node_p;
-  // Node id to the next level
-  NodeIDType next_id;
-  // Value that matches the key
-  ValueType *value_p;
-  bool abort;
-};
 
-template <typename _KeyType, typename _ValueType, 
-          template <typename, size_t> typename MappingTable, 
-          typename _DeltaChainType, 
-          template <typename, typename, typename> typename BaseNode,
-          template <typename, typename, typename, typename, template <typename, typename, typename> typename, size_t> typename Consolidator>
-class BwTree {
- public:
-  static constexpr size_t MAPPING_TABLE_SIZE = 1204 * 1024 * 16;
-  static constexpr size_t LEAF_HEIGHT_THREADHOLD = 24;
-  static constexpr size_t INNER_HEIGHT_THRESHOLD = 2;
-  static constexpr size_t HEIGHT_THREADHOLD = \
-    LEAF_HEIGHT_THREADHOLD > INNER_HEIGHT_THRESHOLD ? LEAF_HEIGHT_THREADHOLD : INNER_HEIGHT_THRESHOLD;
-  // Argument types
-  using KeyType = _KeyType;
-  using ValueType = _ValueType;
-  using DeltaChainType = _DeltaChainType;
-  // Derived types
-  using NodeBaseType = NodeBase<KeyType>;
-  using ExtendedBaseType = ExtendedNodeBase<KeyType, DeltaChainType>;
-  using MappingTableType = MappingTable<NodeBaseType, MAPPING_TABLE_SIZE>;
-  // Metadata variable types
-  using NodeIDType = typename MappingTableType::NodeIDType;
-  using NodeSizeType = typename NodeBaseType::NodeSizeType;
-  using NodeHeightType = typename NodeBaseType::NodeHeightType;
-  using BoundKeyType = typename NodeBaseType::BoundKeyType;
-  // Delta and base node types
-  using DeltaType = Delta<KeyType, ValueType, NodeIDType>;
-  using LeafBaseType = BaseNode<KeyType, ValueType, DeltaChainType>;
-  using InnerBaseType = BaseNode<KeyType, NodeIDType, DeltaChainType>;
-  using LeafInsertType = typename DeltaType::LeafInsertType;
-  using LeafDeleteType = typename DeltaType::LeafDeleteType;
-  using LeafSplitType = typename DeltaType::LeafSplitType;
-  using LeafMergeType = typename DeltaType::LeafMergeType;
-  using LeafRemoveType = typename DeltaType::LeafRemoveType;
-  using InnerInsertType = typename DeltaType::InnerInsertType;
-  using InnerDeleteType = typename DeltaType::InnerDeleteType;
-  using InnerSplitType = typename DeltaType::InnerSplitType;
-  using InnerMergeType = typename DeltaType::InnerMergeType;
-  using InnerRemoveType = typename DeltaType::InnerRemoveType;
-  // Helper types
-  using AppendHelperType = AppendHelper<KeyType, ValueType, MappingTableType, DeltaChainType>;
-  using DeltaChainFreeHelperType = DeltaChainFreeHelper<KeyType, ValueType, MappingTableType, DeltaChainType, BaseNode>;
-  using ConsolidatorType = Consolidator<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, HEIGHT_THREADHOLD>;
-  using ValueSearcherType = ValueSearcher<KeyType, ValueType, MappingTableType, DeltaChainType, BaseNode>;
-  static_assert(ConsolidatorType::support_non_unique_key == LeafBaseType::support_non_unique_key, "Inconsistent non-unique key support");
-  static_assert(ValueSearcherType::support_non_unique_key == LeafBaseType::support_non_unique_key, "Inconsistent non-unique key support");
+  // * FreeChain() - Frees a chain that no thread could access
+  static void FreeChain(void *tree_p, void *node_p) {
+    DeltaChainFreeHelperType dcfh{static_cast<BwTree *>(tree_p)->table_p, &static_cast<BwTree *>(tree_p)->snapshot};
+    DeltaChainFreeTraverserType::Traverse(static_cast<NodeBaseType *>(node_p), &dcfh);
+    return;
+  }
 
+  // Must be initialized before the mapping table, which is sized by the config
+  const ConfigType config;
+  MappingTableType *table_p;
+  // Base nodes of a tree reopened by Open() are in the mapping. It is declared before the epoch
+  // manager, whose destructor may free garbage chains on mapped nodes, so it is unmapped after it
+  SnapshotMappingType snapshot;
+  EpochManagerType epoch_manager;
+  StatsType stats;
+  HeightPolicyType height_policy;
+  LogType log;
+  TracerType tracer;
+  // nullptr if there is no background worker
+  MaintenanceType *maintenance_p;
+  std::atomic<NodeIDType> root_id;
 };
 
 } // namespace bwtree
 } // namespace index_building_block
 } // namespace wangziqi2013
 
+// * std::hash - Hashes encoded keys like byte strings, e.g. for DeltaKeyFilter
+namespace std {
+template <size_t N>
+struct hash<wangziqi2013::index_building_block::bwtree::EncodedKey<N>> {
+  inline size_t operator()(const wangziqi2013::index_building_block::bwtree::EncodedKey<N> &key) const {
+    size_t ret = 0;
+    for(size_t i = 0;i < N;i++) { ret = ret * 131 + key.GetData()[i]; }
+    return ret;
+  }
+};
+} // namespace std
+
 #endif
\ No newline at end of file
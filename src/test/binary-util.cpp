@@ -1,6 +1,9 @@
 
 #include "binary-util.h"
 
+// Words are loaded with memcpy() as the first byte being the lowest
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "BitSequence requires a little-endian host");
+
 namespace wangziqi2013 {
 namespace index_building_block {
 
@@ -57,30 +60,40 @@ void BitSequence::Make(size_t new_size) {
 
 /*
  * operator==() - Compares two bit sequence
+ * 
+ * Unused bits are always zero, so all bytes are compared with memcmp()
  */
 bool BitSequence::operator==(const BitSequence &other) const {
   if(length != other.length) {
     return false;
   }
 
-  // Number of full bytes (i.e. No partial bit)
-  size_t full_byte = BYTE_OFFSET(length);
-  // Note that multiple of 8 this will be 0
-  size_t unused_bit = UNUSED_BITS(length, sizeof(uint8_t));
+  return memcmp(data_p, other.data_p, ALLOC_SIZE(length)) == 0;
+}
 
-  // Compare full bytes using memcmp()
-  if(memcmp(data_p, other.data_p, full_byte) != 0) {
-    return false;
-  }
+/*
+ * LoadWord() - Loads up to 8 bytes from the byte offset
+ * 
+ * Bytes beyond the capacity are read as zero
+ */
+uint64_t BitSequence::LoadWord(size_t byte_offset) const {
+  assert(byte_offset < capacity);
+  uint64_t word = 0x0UL;
+  memcpy(&word, data_p + byte_offset, std::min(sizeof(word), capacity - byte_offset));
 
-  // Then compare partial bytes
-  for(size_t i = 0;i < unused_bit;i++) {
-    if(GetBit(length - i - 1) != other.GetBit(length - i - 1)) {
-      return false;
-    }
-  }
+  return word;
+}
+
+/*
+ * StoreWord() - Stores up to 8 bytes to the byte offset
+ * 
+ * Bytes beyond the capacity are discarded
+ */
+void BitSequence::StoreWord(size_t byte_offset, uint64_t word) {
+  assert(byte_offset < capacity);
+  memcpy(data_p + byte_offset, &word, std::min(sizeof(word), capacity - byte_offset));
 
-  return true;
+  return;
 }
 
 /*
@@ -123,17 +136,31 @@ bool BitSequence::GetBit(size_t pos) const {
  * 
  * Note that we implicit start from the beginning point of the data. If
  * you wish to start from the middle, then you should shift the data first
+ * 
+ * Byte aligned ranges are copied with memcpy() except the last partial byte.
+ * Otherwise the data is read as 64 bit words, each of which is written by
+ * the word version of SetRange()
  */
 void BitSequence::SetRange(size_t range_start, 
                            size_t range_end, 
                            const void *range_data_p) {
   always_assert(range_start < length && range_end <= length);
   size_t range_length = range_end - range_start;
+  const uint8_t *src_p = static_cast<const uint8_t *>(range_data_p);
+  // Number of bytes in the source, which must not be read beyond
+  size_t src_size = ALLOC_SIZE(range_length);
+
+  size_t i = 0;
+  if(BIT_OFFSET(range_start) == 0) {
+    i = BYTE_OFFSET(range_length) * 8;
+    memcpy(data_p + BYTE_OFFSET(range_start), src_p, BYTE_OFFSET(range_length));
+  }
 
-  // Construct a const temp object - note that this will copy the data
-  const BitSequence bs{range_length, range_data_p};
-  for(size_t i = 0;i < range_length;i++) {
-    SetBit(range_start + i, bs.GetBit(i));
+  for(;i < range_length;i += 64) {
+    uint64_t word = 0x0UL;
+    memcpy(&word, src_p + BYTE_OFFSET(i), std::min(sizeof(word), src_size - BYTE_OFFSET(i)));
+    size_t n = std::min(range_length - i, 64UL);
+    SetRange(range_start + i, range_start + i + n, word);
   }
 
   return;
@@ -142,9 +169,9 @@ void BitSequence::SetRange(size_t range_start,
 /*
  * SetRange() - Sets a range in the bit sequence given a 64 bit integer
  * 
- * Since this specialized version uses 64 bit value as the source, we 
- * also check whether all bits in the 64 bit value has effect; if not
- * we return false, otherwise return true
+ * Bits of the value beyond the range are ignored. The range is written
+ * with a read-modify-write on the word that starts from the byte of the 
+ * first bit, and on the next byte if the range crosses the word
  */
 void BitSequence::SetRange(size_t range_start, 
                            size_t range_end, 
@@ -154,18 +181,29 @@ void BitSequence::SetRange(size_t range_start,
   size_t range_length = range_end - range_start;
   always_assert(range_length <= (sizeof(value) * 8));
 
-  for(size_t i = 0;i < range_length;i++) {
-    SetBit(range_start + i, !!(value & 0x1));
-    value >>= 1;
+  size_t byte_offset = BYTE_OFFSET(range_start);
+  size_t shift = BIT_OFFSET(range_start);
+  // Number of bits in the first word
+  size_t first = std::min(range_length, 64 - shift);
+  uint64_t mask = LOW_MASK(first) << shift;
+  uint64_t word = LoadWord(byte_offset);
+  StoreWord(byte_offset, (word & ~mask) | ((value << shift) & mask));
+
+  // The rest has less than 8 bits, which are in one byte
+  if(range_length > first) {
+    uint8_t rest_mask = static_cast<uint8_t>(LOW_MASK(range_length - first));
+    uint8_t rest = static_cast<uint8_t>(value >> first);
+    data_p[byte_offset + 8] = (data_p[byte_offset + 8] & ~rest_mask) | (rest & rest_mask);
   }
 
-  // If there is no active 1 bit in value then this is true; false otherwise
-  // This can only detect part of the problem
   return;
 }
 
 /*
  * GetRange() - Returns a range specified by the parameter
+ * 
+ * This reads the word that starts from the byte of the first bit, and the 
+ * next byte if the range crosses the word
  */
 uint64_t BitSequence::GetRange(size_t range_start, size_t range_end) const {
   always_assert(range_start < length && range_end <= length);
@@ -173,13 +211,14 @@ uint64_t BitSequence::GetRange(size_t range_start, size_t range_end) const {
   size_t range_length = range_end - range_start;
   always_assert(range_length <= (sizeof(uint64_t) * 8));
 
-  uint64_t ret = 0x0UL;
-  for(size_t i = 0;i < range_length;i++) {
-    bool bit = GetBit(range_start + i);
-    ret |= ((bit ? 0x1UL : 0x0UL) << i);
+  size_t byte_offset = BYTE_OFFSET(range_start);
+  size_t shift = BIT_OFFSET(range_start);
+  uint64_t ret = LoadWord(byte_offset) >> shift;
+  if(range_length > 64 - shift) {
+    ret |= static_cast<uint64_t>(data_p[byte_offset + 8]) << (64 - shift);
   }
 
-  return ret;
+  return ret & LOW_MASK(range_length);
 }
 
 /*
@@ -191,29 +230,87 @@ uint64_t BitSequence::GetRange(size_t range_start, size_t range_end) const {
  * 
  * We assume the length of the given buffer could hold at least (length + 7) / 8
  * bytes (i.e. the minimum number of bytes for these bits)
+ * 
+ * Byte aligned ranges are copied with memcpy(). Otherwise the range is read 
+ * 64 bits at a time
  */
 void BitSequence::GetRange(size_t range_start, 
                            size_t range_end, 
                            void *output_p) const {
   always_assert(range_start < length && range_end <= length);
   size_t range_length = range_end - range_start;
+  uint8_t *dest_p = static_cast<uint8_t *>(output_p);
+  size_t dest_size = ALLOC_SIZE(range_length);
+  if(dest_size == 0) {
+    return;
+  }
 
-  // Make a new construct and operates on it. After doing that 
-  BitSequence bs{};
-  // This will zero out all bytes
-  bs.Make(range_length);
-  for(size_t i = 0;i < range_length;i++) {
-    bs.SetBit(i, GetBit(range_start + i));
+  if(BIT_OFFSET(range_start) == 0) {
+    memcpy(dest_p, data_p + BYTE_OFFSET(range_start), dest_size);
+  } else {
+    for(size_t i = 0;i < range_length;i += 64) {
+      size_t n = std::min(range_length - i, 64UL);
+      uint64_t word = GetRange(range_start + i, range_start + i + n);
+      memcpy(dest_p + BYTE_OFFSET(i), &word, std::min(sizeof(word), dest_size - BYTE_OFFSET(i)));
+    }
   }
 
-  assert(bs.capacity == ALLOC_SIZE(range_length));
-  // Copy the entire array into the destination, using minimum
-  // possible bytes
-  memcpy(output_p, bs.GetData(), ALLOC_SIZE(range_length));
+  // Clear bits after the range in the last byte
+  dest_p[dest_size - 1] &= static_cast<uint8_t>(0xFF >> UNUSED_BITS(range_length, sizeof(uint8_t) * 8));
 
   return;
 }
 
+/*
+ * CountOnes() - Returns the number of 1 bits using popcount on words
+ */
+size_t BitSequence::CountOnes() const {
+  size_t ret = 0;
+  for(size_t i = 0;i < capacity;i += sizeof(uint64_t)) {
+    ret += static_cast<size_t>(__builtin_popcountll(LoadWord(i)));
+  }
+
+  return ret;
+}
+
+/*
+ * GetCommonPrefixLength() - Returns the number of equal bits from position 0
+ * 
+ * Words are compared from the lowest, and the lowest set bit of the XOR of
+ * the first different words is the first different position
+ */
+size_t BitSequence::GetCommonPrefixLength(const BitSequence &other) const {
+  size_t min_length = std::min(length, other.length);
+  for(size_t i = 0;i < ALLOC_SIZE(min_length);i += sizeof(uint64_t)) {
+    uint64_t diff = LoadWord(i) ^ other.LoadWord(i);
+    if(diff != 0x0UL) {
+      return std::min(i * 8 + static_cast<size_t>(__builtin_ctzll(diff)), min_length);
+    }
+  }
+
+  return min_length;
+}
+
+/*
+ * GetHighestDifferentBit() - Returns the highest position where two sequences differ
+ * 
+ * This is the bit that decides the order of the sequences as unsigned integers,
+ * i.e. as they are printed by Print(). Words are compared from the highest, and
+ * the position is found by clz on the XOR. Returns the length if they are equal
+ */
+size_t BitSequence::GetHighestDifferentBit(const BitSequence &other) const {
+  always_assert(length == other.length);
+  for(size_t i = (capacity + sizeof(uint64_t) - 1) / sizeof(uint64_t);i > 0;i--) {
+    size_t byte_offset = (i - 1) * sizeof(uint64_t);
+    uint64_t diff = LoadWord(byte_offset) ^ other.LoadWord(byte_offset);
+    if(diff != 0x0UL) {
+      return byte_offset * 8 + 63 - static_cast<size_t>(__builtin_clzll(diff));
+    }
+  }
+
+  return length;
+}
+
 /*
  * Print() - Prints the sequence using digit 0 and 1.
  * 
@@ -72,6 +72,9 @@ class BitField {
  * 
  * This data structure stores any raw bit array as an array of opaque types,
  * and interpret it using small-endian
+ * 
+ * Unused bits in the last byte are always zero. Ranges are read and written
+ * 64 bits at a time, with memcpy() for byte aligned bulk copies
  */
 class BitSequence {
  private:
@@ -209,6 +212,14 @@ class BitSequence {
   uint64_t GetRange(size_t range_start, size_t range_end) const;
   void GetRange(size_t range_start, size_t range_end, void *output_p) const;
 
+  // Number of 1 bits
+  size_t CountOnes() const;
+  // Number of equal bits from position 0, at most the shorter length
+  size_t GetCommonPrefixLength(const BitSequence &other) const;
+  // The highest position where two sequences of the same length differ, 
+  // or the length if they are equal
+  size_t GetHighestDifferentBit(const BitSequence &other) const;
+
   // Print the sequence from MSB to LSB. We print a white space after every
   // "group" digits, and prints a new line after every "line" digits
   void Print(int group=8, int line=32) const;
@@ -216,6 +227,18 @@ class BitSequence {
   static void PrintTitle(int group=8, int line=32);
 
   bool operator==(const BitSequence &other) const;
+
+ private:
+  /*
+   * LOW_MASK() - Returns a word whose low n bits are 1, for n <= 64
+   */
+  static inline uint64_t LOW_MASK(size_t n) {
+    return n >= 64 ? ~0x0UL : ((0x1UL << n) - 1);
+  }
+
+  // Load/Store up to 8 bytes from a byte offset as a little-endian word
+  uint64_t LoadWord(size_t byte_offset) const;
+  void StoreWord(size_t byte_offset, uint64_t word);
 };
 
 } // namespace index_building_block
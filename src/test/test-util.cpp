@@ -4,6 +4,54 @@
  */
 
 #include "test-util.h"
+#include <pthread.h>
+#include <sched.h>
 
 using namespace wangziqi2013;
 using namespace index_building_block;
+
+// The global instance of the test printer
+TestPrint test_out;
+
+/*
+ * PinThread() - Pins the calling thread to a core
+ * 
+ * Cores are numbered by their order in the affinity mask of the calling thread, 
+ * which is inherited from the thread that creates it. Returns false if there are 
+ * not that many cores or the affinity could not be set
+ */
+bool PinThread(size_t core_id) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if(sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    return false;
+  }
+
+  for(size_t cpu = 0;cpu < CPU_SETSIZE;cpu++) {
+    if(CPU_ISSET(cpu, &cpu_set) == 0) {
+      continue;
+    } else if(core_id > 0) {
+      core_id--;
+      continue;
+    }
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+  }
+
+  return false;
+}
+
+/*
+ * GetCoreNum() - Returns the number of cores in the affinity mask of the process
+ */
+size_t GetCoreNum() {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if(sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    return std::max(1U, std::thread::hardware_concurrency());
+  }
+
+  return std::max(1, CPU_COUNT(&cpu_set));
+}
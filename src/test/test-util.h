@@ -35,7 +35,10 @@ class TestPrint {
  public:
   template <typename T>
   inline TestPrint &operator<<(const T &var) { std::cerr << " " << var; return *this; }
-} test_out;
+};
+
+// Defined in test-util.cpp
+extern TestPrint test_out;
 
 // If called this function prints the current function name
 // as the name of the test case - this always prints in any mode
@@ -84,6 +87,11 @@ void StartThread(size_t thread_num,
   return;
 }
 
+// Pins the calling thread to a core. Returns false if the core is not available
+bool PinThread(size_t core_id);
+// Returns the number of cores the process could run on, at least 1
+size_t GetCoreNum();
+
 /*
  * _TestAssertionFail() - This function forks a new process to test whether 
  *                        assertion would fail
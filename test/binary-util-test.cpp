@@ -71,8 +71,97 @@ void TestSetGet() {
 }
 
 
+/*
+ * TestWordRange() - Tests word and bulk range operations against single bits
+ * 
+ * Ranges of all lengths and alignments are written and read back, including
+ * the ones that cross words and the last partial byte
+ */
+void TestWordRange() {
+  PrintTestName();
+
+  constexpr size_t length = 301;
+  uint8_t src[(length + 7) / 8];
+  for(size_t i = 0;i < sizeof(src);i++) {
+    src[i] = static_cast<uint8_t>(i * 37 + 11);
+  }
+
+  size_t range_num = 0;
+  for(size_t range_start = 0;range_start < length;range_start += 7) {
+    for(size_t range_end = range_start + 1;range_end <= length;range_end += 5) {
+      size_t range_length = range_end - range_start;
+      BitSequence bs{};
+      bs.Make(length);
+      bs.SetRange(range_start, range_end, src);
+      BitSequence expected{range_length, src};
+      for(size_t i = 0;i < length;i++) {
+        bool in_range = i >= range_start && i < range_end;
+        always_assert(bs.GetBit(i) == (in_range ? expected.GetBit(i - range_start) : false));
+      }
+
+      uint8_t dest[(length + 7) / 8];
+      memset(dest, 0xFF, sizeof(dest));
+      bs.GetRange(range_start, range_end, dest);
+      always_assert(BitSequence(range_length, dest) == expected);
+      // The last byte is cleared after the range
+      always_assert((dest[BitSequence::ALLOC_SIZE(range_length) - 1] >> 
+                     (range_length - (BitSequence::ALLOC_SIZE(range_length) - 1) * 8)) == 0);
+      if(range_length <= 64) {
+        uint64_t value = bs.GetRange(range_start, range_end);
+        uint64_t expected_value = 0x0UL;
+        memcpy(&expected_value, dest, BitSequence::ALLOC_SIZE(range_length));
+        always_assert(value == expected_value);
+        // Bits of the value beyond the range are ignored
+        bs.SetRange(range_start, range_end, ~value);
+        always_assert(bs.GetRange(range_start, range_end) == (~value & (range_length == 64 ? ~0x0UL : (0x1UL << range_length) - 1)));
+        always_assert(bs.CountOnes() == range_length - expected.CountOnes());
+      }
+      range_num++;
+    }
+  }
+
+  test_printf("Tested %lu ranges\n", range_num);
+  return;
+}
+
+/*
+ * TestPrefix() - Tests popcount, common prefix length and highest different bit
+ */
+void TestPrefix() {
+  PrintTestName();
+
+  uint64_t value_list[] = {0x123456789ABCDEF0UL, 0xFFFFFFFFFFFFFFFFUL, 0x0UL, 0x8000000000000001UL};
+  BitSequence bs{}, zero{};
+  bs.Make(256);
+  zero.Make(256);
+  for(size_t i = 0;i < 4;i++) {
+    bs.SetRange(i * 64, i * 64 + 64, value_list[i]);
+  }
+  always_assert(bs.CountOnes() == 32 + 64 + 0 + 2);
+  always_assert(bs.GetCommonPrefixLength(bs) == 256);
+  always_assert(bs.GetHighestDifferentBit(bs) == 256);
+  // The lowest set bit of the first word is bit 4
+  always_assert(bs.GetCommonPrefixLength(zero) == 4);
+  always_assert(bs.GetHighestDifferentBit(zero) == 255);
+
+  for(size_t pos = 0;pos < 256;pos++) {
+    BitSequence other{bs};
+    other.SetBit(pos, !other.GetBit(pos));
+    always_assert(bs.GetCommonPrefixLength(other) == pos);
+    always_assert(bs.GetHighestDifferentBit(other) == pos);
+    // Prefixes are limited by the shorter sequence
+    BitSequence prefix{pos + 1, other.GetData()};
+    always_assert(bs.GetCommonPrefixLength(prefix) == pos && prefix.GetCommonPrefixLength(bs) == pos);
+    BitSequence short_prefix{pos == 0 ? 1 : pos, bs.GetData()};
+    always_assert(other.GetCommonPrefixLength(short_prefix) == (pos == 0 ? 0 : pos));
+  }
+
+  return;
+}
 
 int main() {
   TestSetGet();
+  TestWordRange();
+  TestPrefix();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,372 @@
+
+/*
+ * bwtree-bench.cpp - Throughput and latency benchmark with YCSB-style workloads
+ *
+ * This file is always compiled in release mode by "make bwtree-bench". Arguments
+ * are given as name=value pairs, and comma separated values run all combinations:
+ *
+ *   ./bwtree-bench-bin workload=A,C dist=zipfian threads=1,4 keys=1000000 ops=1000000
+ *
+ *   workload - A (50% read, 50% update), B (95% read, 5% update), C (read only),
+ *              D (95% read latest, 5% insert), E (95% scan, 5% insert),
+ *              F (50% read, 50% read-modify-write), read, insert, scan
+ *   dist     - uniform, zipfian, monotonic
+ *   threads  - number of worker threads
+ *   keys     - number of keys loaded before the workload starts
+ *   ops      - number of operations per thread
+ *   scan     - maximum scan length (uniform in [1, scan])
+ *   format   - json (one object per line) or csv
+ *
+ * The tree does not have an update operation, so updates are a delete followed by
+ * an insert. Keys are hashed from record IDs, except for the monotonic distribution,
+ * which accesses and inserts records in key order
+ */
+
+#include "bwtree/bwtree.h"
+#include "test-util.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <string>
+
+using namespace wangziqi2013;
+using namespace index_building_block;
+using namespace bwtree;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+using BwTreeType = \
+  BwTree<KeyType, ValueType, DefaultPagedMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultSortedConsolidator,
+         DefaultEpochManagerType>;
+
+// * enum class OpType - Operations in a workload mix
+enum class OpType { Read, Update, Insert, Scan, ReadModifyWrite };
+
+// * enum class DistType - Distribution of record IDs
+enum class DistType { Uniform, Zipfian, Monotonic };
+
+/*
+ * class WorkloadType - Proportions of operations in a workload, which add up to 100
+ *
+ * If read_latest is true, reads prefer recently inserted records (workload D)
+ */
+class WorkloadType {
+ public:
+  std::string name;
+  int read;
+  int update;
+  int insert;
+  int scan;
+  int rmw;
+  bool read_latest;
+};
+
+/*
+ * class Random - xorshift64* generator. Each thread owns one
+ */
+class Random {
+ public:
+  Random(uint64_t seed) : state{seed * 0x9E3779B97F4A7C15UL + 1} {}
+  // * Next() - Returns the next 64 bit random number
+  inline uint64_t Next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DUL;
+  }
+  // * NextDouble() - Returns a random number in [0, 1)
+  inline double NextDouble() { return static_cast<double>(Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+ private:
+  uint64_t state;
+};
+
+/*
+ * class ZipfianGenerator - Generates Zipfian distributed numbers in [0, n)
+ *
+ * This follows YCSB's generator (Gray et al., "Quickly Generating Billion-Record
+ * Synthetic Databases"). Smaller numbers are more popular. Computing zeta(n) is
+ * O(n), and is done once per key count
+ */
+class ZipfianGenerator {
+ public:
+  static constexpr double THETA = 0.99;
+  ZipfianGenerator(uint64_t pn) :
+    n{pn}, zeta_n{Zeta(pn)}, alpha{1.0 / (1.0 - THETA)},
+    eta{(1.0 - std::pow(2.0 / static_cast<double>(pn), 1.0 - THETA)) / (1.0 - Zeta(2) / zeta_n)} {}
+
+  // * Next() - Returns the next number using a random number in [0, 1)
+  inline uint64_t Next(double u) const {
+    double uz = u * zeta_n;
+    if(uz < 1.0) { return 0; }
+    if(uz < 1.0 + std::pow(0.5, THETA)) { return 1; }
+    uint64_t ret = static_cast<uint64_t>(static_cast<double>(n) * std::pow(eta * u - eta + 1.0, alpha));
+    return ret < n ? ret : n - 1;
+  }
+
+ private:
+  // * Zeta() - Returns sum(1 / i^theta) for i in [1, n]
+  static double Zeta(uint64_t n) {
+    double sum = 0.0;
+    for(uint64_t i = 1;i <= n;i++) { sum += 1.0 / std::pow(static_cast<double>(i), THETA); }
+    return sum;
+  }
+
+  uint64_t n;
+  double zeta_n;
+  double alpha;
+  double eta;
+};
+
+/*
+ * class BenchConfig - One combination of arguments
+ */
+class BenchConfig {
+ public:
+  WorkloadType workload;
+  DistType dist;
+  std::string dist_name;
+  size_t thread_num;
+  uint64_t key_num;
+  uint64_t op_num;
+  uint64_t scan_len;
+};
+
+/*
+ * class BenchResult - Throughput and latency percentiles of one run
+ */
+class BenchResult {
+ public:
+  double seconds;
+  double ops_per_sec;
+  uint64_t p50_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;
+};
+
+// * GetKey() - Maps a record ID to a key. Hashing is a bijection, so keys are unique
+inline KeyType GetKey(uint64_t id, DistType dist) {
+  if(dist == DistType::Monotonic) { return id; }
+  id = (id ^ (id >> 30)) * 0xBF58476D1CE4E5B9UL;
+  id = (id ^ (id >> 27)) * 0x94D049BB133111EBUL;
+  return id ^ (id >> 31);
+}
+
+// * GetWorkload() - Returns the workload of the name, or exits if unknown
+WorkloadType GetWorkload(const std::string &name) {
+  static const WorkloadType workload_list[] = {
+    {"A", 50, 50, 0, 0, 0, false}, {"B", 95, 5, 0, 0, 0, false}, {"C", 100, 0, 0, 0, 0, false},
+    {"D", 95, 0, 5, 0, 0, true}, {"E", 0, 0, 5, 95, 0, false}, {"F", 50, 0, 0, 0, 50, false},
+    {"read", 100, 0, 0, 0, 0, false}, {"insert", 0, 0, 100, 0, 0, false}, {"scan", 0, 0, 0, 100, 0, false},
+  };
+  for(const WorkloadType &workload : workload_list) { if(workload.name == name) { return workload; } }
+  err_printf("Unknown workload \"%s\"\n", name.c_str());
+  return workload_list[0];
+}
+
+// * GetDist() - Returns the distribution of the name, or exits if unknown
+DistType GetDist(const std::string &name) {
+  if(name == "uniform") { return DistType::Uniform; }
+  if(name == "zipfian") { return DistType::Zipfian; }
+  if(name == "monotonic") { return DistType::Monotonic; }
+  err_printf("Unknown distribution \"%s\"\n", name.c_str());
+  return DistType::Uniform;
+}
+
+// * Split() - Splits a comma separated list
+std::vector<std::string> Split(const std::string &s) {
+  std::vector<std::string> ret{};
+  size_t begin = 0;
+  while(true) {
+    size_t end = s.find(',', begin);
+    ret.push_back(s.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+    if(end == std::string::npos) { break; }
+    begin = end + 1;
+  }
+  return ret;
+}
+
+/*
+ * Scan() - Reads at most len records starting from the key of the given ID
+ *
+ * Records are fetched in batches from the iterator
+ */
+inline uint64_t Scan(BwTreeType *tree_p, uint64_t id, uint64_t len, DistType dist) {
+  constexpr uint64_t batch = 64;
+  KeyType key_list[batch];
+  ValueType value_list[batch];
+  uint64_t sum = 0;
+  auto it = tree_p->Seek(GetKey(id, dist));
+  while(len > 0 && !it.IsEnd()) {
+    size_t count = it.NextN(std::min(len, batch), key_list, value_list);
+    for(size_t i = 0;i < count;i++) { sum += value_list[i]; }
+    len -= count;
+  }
+  return sum;
+}
+
+/*
+ * RunBench() - Loads the tree, runs the workload and returns the result
+ *
+ * 1. Records are loaded by all threads. Records inserted by the workload get new IDs
+ *    from a shared counter, so that there are no duplicated inserts
+ * 2. The latency of every operation is recorded
+ */
+BenchResult RunBench(const BenchConfig &config, const ZipfianGenerator &zipf) {
+  BwTreeType *tree_p = new BwTreeType{config.thread_num};
+  std::atomic<uint64_t> next_id{config.key_num};
+  auto load_func = [tree_p, &config](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    for(uint64_t id = thread_id;id < config.key_num;id += thread_num) { tree_p->Insert(GetKey(id, config.dist), id); }
+  };
+  StartThread(config.thread_num, load_func, config.thread_num);
+
+  std::vector<std::vector<uint32_t>> latency_list(config.thread_num);
+  std::atomic<uint64_t> checksum{0};
+  auto run_func = [tree_p, &config, &zipf, &next_id, &latency_list, &checksum](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    Random random{thread_id + 1};
+    std::vector<uint32_t> &latency = latency_list[thread_id];
+    latency.reserve(config.op_num);
+    const WorkloadType &workload = config.workload;
+    // Monotonic accesses start at different places for different threads
+    uint64_t mono_id = config.key_num / thread_num * thread_id;
+    uint64_t sum = 0;
+    ValueType value;
+    for(uint64_t i = 0;i < config.op_num;i++) {
+      int op_rand = static_cast<int>(random.Next() % 100);
+      OpType op = OpType::Read;
+      if(op_rand < workload.read) { op = OpType::Read; }
+      else if(op_rand < workload.read + workload.update) { op = OpType::Update; }
+      else if(op_rand < workload.read + workload.update + workload.insert) { op = OpType::Insert; }
+      else if(op_rand < workload.read + workload.update + workload.insert + workload.scan) { op = OpType::Scan; }
+      else { op = OpType::ReadModifyWrite; }
+
+      uint64_t id = 0;
+      if(op != OpType::Insert) {
+        uint64_t max_id = next_id.load(std::memory_order_relaxed);
+        if(workload.read_latest) {
+          id = max_id - 1 - zipf.Next(random.NextDouble()) % max_id;
+        } else if(config.dist == DistType::Zipfian) {
+          id = zipf.Next(random.NextDouble());
+        } else if(config.dist == DistType::Uniform) {
+          id = random.Next() % max_id;
+        } else {
+          id = mono_id++ % max_id;
+        }
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      switch(op) {
+        case OpType::Read:
+          if(tree_p->Lookup(GetKey(id, config.dist), &value)) { sum += value; }
+          break;
+        case OpType::Update:
+          if(tree_p->Delete(GetKey(id, config.dist))) { tree_p->Insert(GetKey(id, config.dist), id + i); }
+          break;
+        case OpType::Insert:
+          id = next_id.fetch_add(1);
+          tree_p->Insert(GetKey(id, config.dist), id);
+          break;
+        case OpType::Scan:
+          sum += Scan(tree_p, id, random.Next() % config.scan_len + 1, config.dist);
+          break;
+        case OpType::ReadModifyWrite:
+          if(tree_p->Lookup(GetKey(id, config.dist), &value) && tree_p->Delete(GetKey(id, config.dist))) {
+            tree_p->Insert(GetKey(id, config.dist), value + 1);
+          }
+          break;
+      }
+      auto end = std::chrono::steady_clock::now();
+      uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+      latency.push_back(ns > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(ns));
+    }
+
+    // Prevents the compiler from eliminating reads
+    checksum.fetch_add(sum);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  StartThread(config.thread_num, run_func, config.thread_num);
+  auto end = std::chrono::steady_clock::now();
+  delete tree_p;
+
+  std::vector<uint32_t> all_latency{};
+  for(std::vector<uint32_t> &latency : latency_list) { all_latency.insert(all_latency.end(), latency.begin(), latency.end()); }
+  std::sort(all_latency.begin(), all_latency.end());
+  auto percentile = [&all_latency](double p) -> uint64_t {
+    if(all_latency.empty()) { return 0; }
+    size_t index = static_cast<size_t>(p * static_cast<double>(all_latency.size() - 1));
+    return all_latency[index];
+  };
+
+  BenchResult result{};
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  result.ops_per_sec = static_cast<double>(config.op_num * config.thread_num) / result.seconds;
+  result.p50_ns = percentile(0.5);
+  result.p99_ns = percentile(0.99);
+  result.p999_ns = percentile(0.999);
+  result.max_ns = all_latency.empty() ? 0 : all_latency.back();
+  dbg_printf("Checksum = %lu\n", checksum.load());
+  return result;
+}
+
+// * PrintResult() - Prints a result as a JSON object or a CSV row on stdout
+void PrintResult(const BenchConfig &config, const BenchResult &result, bool is_csv) {
+  if(is_csv) {
+    printf("%s,%s,%lu,%lu,%lu,%.6f,%.1f,%lu,%lu,%lu,%lu\n",
+           config.workload.name.c_str(), config.dist_name.c_str(), config.thread_num, config.key_num, config.op_num,
+           result.seconds, result.ops_per_sec, result.p50_ns, result.p99_ns, result.p999_ns, result.max_ns);
+  } else {
+    printf("{\"workload\": \"%s\", \"dist\": \"%s\", \"threads\": %lu, \"keys\": %lu, \"ops_per_thread\": %lu, "
+           "\"seconds\": %.6f, \"ops_per_sec\": %.1f, \"p50_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, \"max_ns\": %lu}\n",
+           config.workload.name.c_str(), config.dist_name.c_str(), config.thread_num, config.key_num, config.op_num,
+           result.seconds, result.ops_per_sec, result.p50_ns, result.p99_ns, result.p999_ns, result.max_ns);
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  std::string workload_arg = "A,B,C,D,E,F";
+  std::string dist_arg = "uniform,zipfian,monotonic";
+  std::string thread_arg = "1";
+  uint64_t key_num = 1000000;
+  uint64_t op_num = 1000000;
+  uint64_t scan_len = 100;
+  std::string format = "json";
+  for(int i = 1;i < argc;i++) {
+    std::string arg{argv[i]};
+    size_t pos = arg.find('=');
+    if(pos == std::string::npos) { err_printf("Arguments must be name=value: \"%s\"\n", argv[i]); }
+    std::string name = arg.substr(0, pos);
+    std::string value = arg.substr(pos + 1);
+    if(name == "workload") { workload_arg = value; }
+    else if(name == "dist") { dist_arg = value; }
+    else if(name == "threads") { thread_arg = value; }
+    else if(name == "keys") { key_num = std::stoul(value); }
+    else if(name == "ops") { op_num = std::stoul(value); }
+    else if(name == "scan") { scan_len = std::stoul(value); }
+    else if(name == "format") { format = value; }
+    else { err_printf("Unknown argument \"%s\"\n", name.c_str()); }
+  }
+
+  if(key_num == 0 || scan_len == 0) { err_printf("keys and scan must be positive\n"); }
+  if(format != "json" && format != "csv") { err_printf("Unknown format \"%s\"\n", format.c_str()); }
+  bool is_csv = (format == "csv");
+  if(is_csv) { printf("workload,dist,threads,keys,ops_per_thread,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n"); }
+
+  ZipfianGenerator zipf{key_num};
+  for(const std::string &workload_name : Split(workload_arg)) {
+    for(const std::string &dist_name : Split(dist_arg)) {
+      for(const std::string &thread_num : Split(thread_arg)) {
+        BenchConfig config{GetWorkload(workload_name), GetDist(dist_name), dist_name,
+                           std::stoul(thread_num), key_num, op_num, scan_len};
+        if(config.thread_num == 0) { err_printf("threads must be positive\n"); }
+        PrintResult(config, RunBench(config, zipf), is_csv);
+      }
+    }
+  }
+
+  return 0;
+}
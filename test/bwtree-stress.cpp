@@ -0,0 +1,324 @@
+
+/*
+ * bwtree-stress.cpp - Contention-targeted microbenchmarks of BwTree building blocks
+ *
+ * This file is always compiled in release mode by "make bwtree-stress". Arguments
+ * are given as name=value pairs like bwtree-bench, and comma separated values run
+ * all combinations. Results are printed as CSV on stdout:
+ *
+ *   ./bwtree-stress-bin case=hot_leaf,split threads=scale warmup=200 duration=1000
+ *
+ *   case     - hot_leaf (insert and delete on one leaf), consolidation (appends to a
+ *              few leaves with a small height threshold), split (monotonic inserts on
+ *              the rightmost leaf), alloc (AllocateNodeID() and ReleaseNodeID() on the
+ *              paged mapping table), cas (CAS on one slot of DefaultMappingTable)
+ *   threads  - number of worker threads, or "scale" for 1, 2, 4, ... up to the cores
+ *   warmup   - milliseconds before counters start
+ *   duration - milliseconds during which operations are counted
+ *   pin      - 1 to pin worker i to core i (modulo the cores), 0 otherwise
+ *
+ * Each worker counts its own operations in a padded counter. Workers run the same
+ * loop during warm-up, and take the counter when they first observe the measurement
+ * phase. Tree events are the difference of DefaultTreeStatsType counters between
+ * the beginning and the end of the measurement
+ */
+
+#include "bwtree/bwtree.h"
+#include "test-util.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+
+using namespace wangziqi2013;
+using namespace index_building_block;
+using namespace bwtree;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+using BwTreeType = \
+  BwTree<KeyType, ValueType, DefaultPagedMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultSortedConsolidator,
+         DefaultEpochManagerType, DefaultTreeStatsType, DefaultRuntimeConfigType>;
+using NodeBaseType = typename BwTreeType::NodeBaseType;
+
+// * enum class PhaseType - Phases of a run, which are set by the main thread
+enum class PhaseType { Init, Warmup, Measure, Stop };
+
+/*
+ * class StressConfig - One combination of arguments
+ */
+class StressConfig {
+ public:
+  std::string case_name;
+  size_t thread_num;
+  uint64_t warmup_ms;
+  uint64_t duration_ms;
+  bool pin;
+};
+
+/*
+ * class StressResult - Operations and tree events of one run
+ */
+class StressResult {
+ public:
+  double seconds;
+  uint64_t op_num;
+  // Operations of the slowest and the fastest worker, which show unfairness
+  uint64_t min_thread_op_num;
+  uint64_t max_thread_op_num;
+  uint64_t append_failure;
+  uint64_t consolidation;
+  uint64_t consolidation_failure;
+  uint64_t split;
+  uint64_t help_split;
+};
+
+/*
+ * class ThreadCounterType - Operations of a worker in the measurement phase
+ */
+class ThreadCounterType {
+ public:
+  // Avoid false sharing between the counters of adjacent workers
+  char padding[64];
+  uint64_t op_num;
+};
+
+/*
+ * class ThreadFailureCounterType - Failed CAS of a worker, which is read while the worker runs
+ */
+class ThreadFailureCounterType {
+ public:
+  char padding[64];
+  std::atomic<uint64_t> failure_num{0};
+};
+
+/*
+ * RunStress() - Runs the operation in a loop on all workers and counts operations
+ *
+ * 1. setup_func(thread_id) is called by each worker before warm-up, e.g. to register
+ *    the thread. op_func(thread_id, i) is the i-th operation of the worker
+ * 2. begin_func() and end_func() are called by the main thread when the measurement
+ *    begins and ends, and are used to take tree counters
+ */
+template <typename SetupFunc, typename OpFunc, typename BeginFunc, typename EndFunc>
+StressResult RunStress(const StressConfig &config, SetupFunc setup_func, OpFunc op_func,
+                       BeginFunc begin_func, EndFunc end_func) {
+  std::atomic<PhaseType> phase{PhaseType::Init};
+  std::atomic<size_t> ready_num{0};
+  std::vector<ThreadCounterType> counter_list(config.thread_num);
+  auto worker_func = [&](size_t thread_id) {
+    if(config.pin && PinThread(thread_id % GetCoreNum()) == false) { err_printf("Could not pin worker %lu\n", thread_id); }
+    setup_func(thread_id);
+    ready_num.fetch_add(1);
+    while(phase.load() == PhaseType::Init) { std::this_thread::yield(); }
+    uint64_t i = 0, measure_begin = 0;
+    bool is_measured = false;
+    while(true) {
+      PhaseType current = phase.load(std::memory_order_relaxed);
+      if(current == PhaseType::Stop) { break; }
+      if(current == PhaseType::Measure && is_measured == false) {
+        measure_begin = i;
+        is_measured = true;
+      }
+      op_func(thread_id, i);
+      i++;
+    }
+    counter_list[thread_id].op_num = is_measured ? i - measure_begin : 0;
+  };
+
+  std::vector<std::thread> thread_list{};
+  for(size_t i = 0;i < config.thread_num;i++) { thread_list.emplace_back(worker_func, i); }
+  while(ready_num.load() < config.thread_num) { std::this_thread::yield(); }
+  phase.store(PhaseType::Warmup);
+  std::this_thread::sleep_for(std::chrono::milliseconds{config.warmup_ms});
+  StressResult result{};
+  begin_func(&result);
+  phase.store(PhaseType::Measure);
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds{config.duration_ms});
+  phase.store(PhaseType::Stop);
+  auto end = std::chrono::steady_clock::now();
+  for(std::thread &t : thread_list) { t.join(); }
+  end_func(&result);
+
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  result.min_thread_op_num = UINT64_MAX;
+  for(const ThreadCounterType &counter : counter_list) {
+    result.op_num += counter.op_num;
+    result.min_thread_op_num = std::min(result.min_thread_op_num, counter.op_num);
+    result.max_thread_op_num = std::max(result.max_thread_op_num, counter.op_num);
+  }
+  return result;
+}
+
+/*
+ * RunTreeStress() - Runs an operation on a tree and takes the stats of the measurement
+ *
+ * Stats counters only grow, so the events of the measurement are the differences.
+ * Events of workers that are still finishing warm-up operations are included
+ */
+template <typename OpFunc>
+StressResult RunTreeStress(const StressConfig &config, BwTreeType *tree_p, OpFunc op_func) {
+  DefaultTreeStatsType *stats_p = tree_p->GetStats();
+  auto get_counts = [stats_p](StressResult *result_p, uint64_t sign) {
+    result_p->append_failure += sign * stats_p->GetCount(StatsCounter::AppendFailure);
+    result_p->consolidation += sign * stats_p->GetCount(StatsCounter::LeafConsolidation);
+    result_p->consolidation_failure += sign * stats_p->GetCount(StatsCounter::ConsolidationFailure);
+    result_p->split += sign * stats_p->GetCount(StatsCounter::SplitStart);
+    result_p->help_split += sign * stats_p->GetCount(StatsCounter::HelpSplit);
+  };
+  return RunStress(config, [tree_p](size_t thread_id) { tree_p->RegisterThread(thread_id); }, op_func,
+                   [&get_counts](StressResult *result_p) { get_counts(result_p, static_cast<uint64_t>(-1)); },
+                   [&get_counts](StressResult *result_p) { get_counts(result_p, 1); });
+}
+
+/*
+ * RunCase() - Builds the structure of the case and runs it
+ *
+ * 1. hot_leaf: each worker inserts and deletes its own keys, and all keys are in one
+ *    leaf, so that every append races on the same mapping table slot
+ * 2. consolidation: workers append to a few leaves whose height threshold is 2, so that
+ *    most appends are followed by a consolidation racing with other appends
+ * 3. split: keys are taken from a shared counter, so all inserts go to the rightmost
+ *    leaf, which keeps splitting
+ * 4. alloc and cas operate directly on mapping tables without a tree
+ */
+StressResult RunCase(const StressConfig &config) {
+  const uint64_t thread_num = config.thread_num;
+  if(config.case_name == "hot_leaf" || config.case_name == "consolidation") {
+    bool is_hot = config.case_name == "hot_leaf";
+    DefaultRuntimeConfigType tree_config{};
+    if(is_hot == false) { tree_config.SetLeafHeightThreshold(2); }
+    // The hot leaf never holds more keys than the split threshold, so it never splits
+    const uint64_t key_num = is_hot ? tree_config.GetLeafSplitThreshold() / 2 : tree_config.GetLeafSplitThreshold() * 4;
+    BwTreeType *tree_p = new BwTreeType{thread_num, tree_config};
+    tree_p->RegisterThread(0);
+    for(uint64_t key = 0;key < key_num;key += 2) { tree_p->Insert(key, key); }
+    // Each worker owns the keys that are equal to its ID modulo the number of workers
+    uint64_t per_thread = std::max(uint64_t{1}, key_num / thread_num);
+    StressResult result = RunTreeStress(config, tree_p, [tree_p, thread_num, per_thread](size_t thread_id, uint64_t i) {
+      KeyType key = (i / 2 % per_thread) * thread_num + thread_id;
+      if(i % 2 == 0) { tree_p->Insert(key, i); }
+      else { tree_p->Delete(key); }
+    });
+    delete tree_p;
+    return result;
+  } else if(config.case_name == "split") {
+    BwTreeType *tree_p = new BwTreeType{thread_num};
+    std::atomic<uint64_t> next_key{0};
+    StressResult result = RunTreeStress(config, tree_p, [tree_p, &next_key](size_t, uint64_t i) {
+      tree_p->Insert(next_key.fetch_add(1, std::memory_order_relaxed), i);
+    });
+    delete tree_p;
+    return result;
+  } else if(config.case_name == "alloc") {
+    using TableType = DefaultPagedMappingTable<NodeBaseType, BwTreeType::MAPPING_TABLE_SIZE>;
+    TableType *table_p = TableType::Get();
+    // Each worker keeps a few IDs allocated, and reuses them through its free list
+    constexpr size_t HELD_ID_NUM = 16;
+    std::vector<std::vector<uint64_t>> held_list(thread_num, std::vector<uint64_t>(HELD_ID_NUM, TableType::INVALID_NODE_ID));
+    auto op_func = [table_p, &held_list](size_t thread_id, uint64_t i) {
+      uint64_t &node_id = held_list[thread_id][i % HELD_ID_NUM];
+      if(node_id != TableType::INVALID_NODE_ID) { table_p->ReleaseNodeID(node_id); }
+      node_id = table_p->AllocateNodeID(nullptr);
+    };
+    StressResult result = RunStress(config, [](size_t thread_id) { ThreadContext::SetThreadID(thread_id); }, op_func,
+                                    [](StressResult *) {}, [](StressResult *) {});
+    TableType::Destroy(table_p);
+    return result;
+  } else if(config.case_name == "cas") {
+    using TableType = DefaultMappingTable<NodeBaseType, 1>;
+    TableType *table_p = TableType::Get();
+    uint64_t node_id = table_p->AllocateNodeID(nullptr);
+    // Counts failed CAS like append failures. Values are never dereferenced
+    std::vector<ThreadFailureCounterType> failure_list(thread_num);
+    auto op_func = [table_p, node_id, &failure_list](size_t thread_id, uint64_t i) {
+      NodeBaseType *old_p = table_p->At(node_id);
+      NodeBaseType *new_p = reinterpret_cast<NodeBaseType *>((thread_id << 48) | (i + 1));
+      if(table_p->CAS(node_id, old_p, new_p) == false) { 
+        failure_list[thread_id].failure_num.fetch_add(1, std::memory_order_relaxed); 
+      }
+    };
+    // Failures are taken while workers run, like the tree counters of RunTreeStress()
+    auto get_counts = [&failure_list](StressResult *result_p, uint64_t sign) {
+      for(ThreadFailureCounterType &counter : failure_list) {
+        result_p->append_failure += sign * counter.failure_num.load(std::memory_order_relaxed);
+      }
+    };
+    StressResult result = RunStress(config, [](size_t) {}, op_func,
+      [&get_counts](StressResult *result_p) { get_counts(result_p, static_cast<uint64_t>(-1)); },
+      [&get_counts](StressResult *result_p) { get_counts(result_p, 1); });
+    TableType::Destroy(table_p);
+    return result;
+  }
+
+  err_printf("Unknown case \"%s\"\n", config.case_name.c_str());
+  return StressResult{};
+}
+
+// * Split() - Splits a comma separated list
+std::vector<std::string> Split(const std::string &s) {
+  std::vector<std::string> ret{};
+  size_t begin = 0;
+  while(true) {
+    size_t end = s.find(',', begin);
+    ret.push_back(s.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+    if(end == std::string::npos) { break; }
+    begin = end + 1;
+  }
+  return ret;
+}
+
+// * GetThreadList() - Returns the numbers of workers. "scale" doubles up to the number of cores
+std::vector<size_t> GetThreadList(const std::string &arg) {
+  std::vector<size_t> ret{};
+  for(const std::string &s : Split(arg)) {
+    if(s != "scale") {
+      ret.push_back(std::stoul(s));
+      continue;
+    }
+    size_t core_num = GetCoreNum();
+    for(size_t thread_num = 1;thread_num < core_num;thread_num *= 2) { ret.push_back(thread_num); }
+    ret.push_back(core_num);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  std::string case_arg = "hot_leaf,consolidation,split,alloc,cas";
+  std::string thread_arg = "scale";
+  uint64_t warmup_ms = 200;
+  uint64_t duration_ms = 1000;
+  bool pin = true;
+  for(int i = 1;i < argc;i++) {
+    std::string arg{argv[i]};
+    size_t pos = arg.find('=');
+    if(pos == std::string::npos) { err_printf("Arguments must be name=value: \"%s\"\n", argv[i]); }
+    std::string name = arg.substr(0, pos);
+    std::string value = arg.substr(pos + 1);
+    if(name == "case") { case_arg = value; }
+    else if(name == "threads") { thread_arg = value; }
+    else if(name == "warmup") { warmup_ms = std::stoul(value); }
+    else if(name == "duration") { duration_ms = std::stoul(value); }
+    else if(name == "pin") { pin = (value == "1"); }
+    else { err_printf("Unknown argument \"%s\"\n", name.c_str()); }
+  }
+
+  if(duration_ms == 0) { err_printf("duration must be positive\n"); }
+  printf("case,threads,seconds,ops,ops_per_sec,ops_per_sec_per_thread,min_thread_ops,max_thread_ops,"
+         "append_failure,consolidation,consolidation_failure,split,help_split\n");
+  for(const std::string &case_name : Split(case_arg)) {
+    for(size_t thread_num : GetThreadList(thread_arg)) {
+      if(thread_num == 0) { err_printf("threads must be positive\n"); }
+      StressConfig config{case_name, thread_num, warmup_ms, duration_ms, pin};
+      StressResult result = RunCase(config);
+      double ops_per_sec = static_cast<double>(result.op_num) / result.seconds;
+      printf("%s,%lu,%.6f,%lu,%.1f,%.1f,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+             case_name.c_str(), thread_num, result.seconds, result.op_num, ops_per_sec,
+             ops_per_sec / static_cast<double>(thread_num), result.min_thread_op_num, result.max_thread_op_num,
+             result.append_failure, result.consolidation, result.consolidation_failure, result.split, result.help_split);
+      fflush(stdout);
+    }
+  }
+
+  return 0;
+}
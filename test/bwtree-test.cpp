@@ -1,6 +1,8 @@
 
 #include "bwtree/bwtree.h"
 #include "test-util.h"
+#include <cmath>
+#include <tuple>
 
 using namespace wangziqi2013;
 using namespace index_building_block;
@@ -77,6 +79,86 @@ BEGIN_DEBUG_TEST(MappingTableTest) {
   return;
 } END_TEST
 
+/*
+ * EpochManagerTest() - Tests epoch based memory reclamation
+ *
+ * 1. Garbage is not freed while an older epoch is still active
+ * 2. Garbage is freed after all threads have exited
+ * 3. With offloading, retiring threads do not free garbage, and it is freed by
+ *    the thread calling Reclaim()
+ * 4. Concurrent retirement frees every object exactly once
+ */
+BEGIN_DEBUG_TEST(EpochManagerTest) {
+  using EpochManagerType = DefaultEpochManagerType;
+  constexpr size_t thread_num = 8;
+  constexpr size_t per_thread = 100000;
+  std::atomic<size_t> freed_count{0};
+  EpochManagerType::FreeFuncType free_func = [](void *count_p, void *node_p) {
+    delete static_cast<size_t *>(node_p);
+    static_cast<std::atomic<size_t> *>(count_p)->fetch_add(1);
+  };
+
+  EpochManagerType *em = new EpochManagerType{thread_num};
+  // Thread 1 enters and stays in the epoch, while thread 0 retires garbage
+  em->RegisterThread(1);
+  em->EnterEpoch();
+  em->RegisterThread(0);
+  for(size_t i = 0;i < EpochManagerType::RECLAIM_THRESHOLD * 4;i++) {
+    EpochManagerType::GuardType guard{em};
+    em->Retire(new size_t{i}, free_func, &freed_count);
+  }
+
+  test_printf("Global epoch = %lu; freed = %lu\n", em->GetGlobalEpoch(), freed_count.load());
+  always_assert(freed_count.load() == 0);
+  always_assert(em->GetGlobalEpoch() == EpochManagerType::FIRST_EPOCH + 4);
+
+  // After thread 1 exits everything could be freed
+  em->RegisterThread(1);
+  em->ExitEpoch();
+  em->RegisterThread(0);
+  em->Reclaim();
+  always_assert(freed_count.load() == EpochManagerType::RECLAIM_THRESHOLD * 4);
+  always_assert(em->GetGarbageCount() == 0);
+
+  // Thread 0 hands garbage over without freeing it, even if no thread is active
+  freed_count = 0;
+  em->SetOffload(true);
+  for(size_t i = 0;i < EpochManagerType::RECLAIM_THRESHOLD * 2;i++) {
+    EpochManagerType::GuardType guard{em};
+    em->Retire(new size_t{i}, free_func, &freed_count);
+  }
+  always_assert(freed_count.load() == 0);
+  always_assert(em->GetOffloadCount() == EpochManagerType::RECLAIM_THRESHOLD * 2);
+  always_assert(em->GetGarbageCount() == EpochManagerType::RECLAIM_THRESHOLD * 2);
+  em->RegisterThread(1);
+  em->Reclaim();
+  always_assert(freed_count.load() == EpochManagerType::RECLAIM_THRESHOLD * 2);
+  always_assert(em->GetOffloadCount() == 0 && em->GetGarbageCount() == 0);
+  em->SetOffload(false);
+  em->RegisterThread(0);
+
+  freed_count = 0;
+  auto func = [em, free_func, &freed_count](size_t thread_id, size_t thread_num) {
+    em->RegisterThread(thread_id);
+    for(size_t i = 0;i < per_thread;i++) {
+      EpochManagerType::GuardType guard{em};
+      // Nested enter does not change the announced epoch
+      EpochManagerType::GuardType guard2{em};
+      em->Retire(new size_t{i}, free_func, &freed_count);
+    }
+
+    return;
+  };
+
+  StartThread(thread_num, func, thread_num);
+  test_printf("Freed %lu; Remaining %lu\n", freed_count.load(), em->GetGarbageCount());
+  always_assert(freed_count.load() + em->GetGarbageCount() == thread_num * per_thread);
+  delete em;
+  always_assert(freed_count.load() == thread_num * per_thread);
+
+  return;
+} END_TEST
+
 /*
  * BoundKeyTest() - Tests whether bound key works correctly
  */
@@ -177,9 +259,9 @@ BEGIN_DEBUG_TEST(BaseNodeTest) {
 
 template <typename KeyType, typename ValueType, typename NodeIDType, typename DeltaChainType, 
           template <typename, typename, typename> typename BaseNode>
-class SimpleTraverseHandler : public TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType> {
+class SimpleTraverseHandler : public TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode> {
 public:
-  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>;
+  using BaseClassType = TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>;
   using NodeBaseType = typename BaseClassType::NodeBaseType;
   using DeltaType = typename BaseClassType::DeltaType;
   using LeafBaseType = typename BaseClassType::LeafBaseType;
@@ -187,7 +269,7 @@ public:
   using DeltaChainTraverserType = \
     DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode, SimpleTraverseHandler>;
 
-  SimpleTraverseHandler() : TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType>{} {}
+  SimpleTraverseHandler() : TraverseHandlerBase<KeyType, ValueType, NodeIDType, DeltaChainType, BaseNode>{} {}
 
   // * GetNext() - Interface for accessing next_p
   NodeBaseType *&GetNext() { return BaseClassType::next_p; }
@@ -270,6 +352,7 @@ public:
  * 
  * 1. Tests whether delta node attributes are accessed correctly
  * 2. Tests whether the node traverser works especially for multiple merges
+ * 3. Tests whether the high key is inherited by deltas other than split and merge
  */
 BEGIN_DEBUG_TEST(DeltaNodeTest) {
   using KeyType = int;
@@ -345,6 +428,17 @@ BEGIN_DEBUG_TEST(DeltaNodeTest) {
   always_assert(merge_node_p->GetMergeSibling() == merge_sibling);
   always_assert(remove_node_p->GetRemoveNodeID() == remove_id);
 
+  test_printf("Testing high key inheritance\n");
+
+  // Only the type, size, height, low key and next node pointer are in the header
+  always_assert(sizeof(DeltaNodeBase<KeyType>) == 3 * sizeof(void *));
+  always_assert(insert_node_p->HasBaseHighKey() && delete_node_p->HasBaseHighKey());
+  always_assert(delete_node_p->GetHighKey() == node_p->GetHighKey());
+  always_assert(split_node_p->HasBaseHighKey() == false && merge_node_p->HasBaseHighKey() == false);
+  always_assert(split_node_p->GetHighKey() == node_p->GetHighKey());
+  always_assert(remove_node_p->HasBaseHighKey() == false && remove_node_p->GetHighKey() == merge_node_p->GetHighKey());
+  always_assert(merge_node_2_p->GetLowKey() == node_p->GetLowKey());
+
   test_printf("Testing delta chain traversal\n");
 
   using SimpleTraverseHandlerType = SimpleTraverseHandler<KeyType, ValueType, NodeIDType, DefaultDeltaChainType, DefaultBaseNode>;
@@ -360,8 +454,10 @@ BEGIN_DEBUG_TEST(DeltaNodeTest) {
 using KeyType = int;
 using ValueType = std::string;
 using BwTreeType = \
-  BwTree<KeyType, ValueType, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator>;
+  BwTree<KeyType, ValueType, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+         DefaultEpochManagerType>;
 using NodeSizeType = typename BwTreeType::NodeSizeType;
+using NodeHeightType = typename BwTreeType::NodeHeightType;
 using NodeIDType = typename BwTreeType::NodeIDType;
 using DeltaChainType = typename BwTreeType::DeltaChainType;
 using MappingTableType = typename BwTreeType::MappingTableType;
@@ -477,11 +573,15 @@ BEGIN_DEBUG_TEST(LeafConsolidationTest) {
   always_assert(ah.AppendLeafInsert(400, "this is 400") == nullptr); // 200 300 400
   always_assert(ah.AppendLeafInsert(100, "this is 100") == nullptr); // 100 200 300 400
   always_assert(ah.AppendLeafInsert(600, "this is 600") == nullptr); // 100 200 300 400 600
+  // Deleting a key that does not exist makes the virtual size smaller than the exact size
+  always_assert(ah.AppendLeafDelete(500, "this is 500") == nullptr); // 100 200 300 400 600
+  always_assert(ah.GetNode()->GetSize() == 4);
   
   ConsolidatorType ct{table_p->At(leaf_node_id)};
   ConsolidationTraverserType::Traverse(table_p->At(leaf_node_id), &ct);
   LeafBaseType *new_node_p = ct.GetNewLeafBase();
   PrintBaseNode(new_node_p);
+  always_assert(new_node_p->GetSize() == 5);
 
   // Split it for later use
   LeafBaseType *merge_sibling_p = new_node_p->Split(); // Base Node: 300 400 600 [300, +Inf)
@@ -507,12 +607,13 @@ BEGIN_DEBUG_TEST(LeafConsolidationTest) {
   // This tests whether delta nodes below a split can be processed
   always_assert(ah2.AppendLeafInsert(250, "this is 250") == nullptr); // -50 -40 -30 100 200 250 300 400 600
   always_assert(ah2.AppendLeafSplit(200, NodeIDType{999}, 5) == nullptr); // -50 -40 -30 100 [-Inf, 200)
-  always_assert(ah2.AppendLeafMerge(-999, NodeIDType{999}, merge_sibling_p) == nullptr); // -50 -40 -30 100 + 600 [-Inf, 700)
+  always_assert(ah2.AppendLeafMerge(300, NodeIDType{999}, merge_sibling_p) == nullptr); // -50 -40 -30 100 + 600 [-Inf, 700)
 
   ConsolidatorType ct2{table_p->At(leaf_node_id)};
   ConsolidationTraverserType::Traverse(table_p->At(leaf_node_id), &ct2);
   new_node_p = ct2.GetNewLeafBase();
   PrintBaseNode(new_node_p);
+  always_assert(new_node_p->GetSize() == 5);
 
   // Free the delta chain with merge and split
   FreeDeltaChain(table_p, table_p->At(leaf_node_id));
@@ -552,14 +653,1962 @@ BEGIN_DEBUG_TEST(InnerConsolidationTest) {
   MappingTableType::Destroy(table_p);
 } END_TEST
 
+/*
+ * SearchHintTest() - Tests narrowing the base node search by offsets recorded in deltas
+ * 
+ * 1. Insert and delete deltas record the result of Search() on the base node. Searches 
+ *    return the same results as without offsets (Search() asserts this in debug mode)
+ * 2. The searcher reports the base offset of the search key, either from the base node
+ *    or from the delta on the key
+ */
+BEGIN_DEBUG_TEST(SearchHintTest) {
+  using ValueSearcherType = typename BwTreeType::ValueSearcherType;
+  using ValueSearchTraverserType = typename BwTreeType::ValueSearchTraverserType;
+  LeafBaseType *leaf_node_p = LeafBaseType::Get(NodeType::LeafBase, 100, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+  for(int i = 0;i < 100;i++) { 
+    leaf_node_p->KeyAt(i) = i * 10; 
+    leaf_node_p->ValueAt(i) = std::to_string(i * 10); 
+  }
+  MappingTableType *table_p = MappingTableType::Get();
+  NodeIDType leaf_node_id = table_p->AllocateNodeID(leaf_node_p);
+  AppendHelperType ah{leaf_node_id, leaf_node_p, table_p};
+  // Inserts 5, 105, ... and deletes 20, 120, ...
+  for(int key = 5;key < 1000;key += 100) {
+    NodeSizeType offset = static_cast<NodeSizeType>(leaf_node_p->Search(key));
+    always_assert(ah.AppendLeafInsert(key, std::to_string(key), offset) == nullptr); 
+  }
+  for(int key = 20;key < 1000;key += 100) {
+    NodeSizeType offset = static_cast<NodeSizeType>(leaf_node_p->Search(key));
+    always_assert(ah.AppendLeafDelete(key, std::to_string(key), offset) == nullptr); 
+  }
+  for(int key = -5;key < 1005;key++) {
+    ValueSearcherType vs{key};
+    ValueSearchTraverserType::Traverse(table_p->At(leaf_node_id), &vs);
+    bool is_inserted = key > 0 && key % 100 == 5;
+    bool is_deleted = key > 0 && key % 100 == 20;
+    bool in_base = key >= 0 && key < 1000 && key % 10 == 0;
+    bool is_found = is_inserted || (in_base && !is_deleted);
+    always_assert((vs.GetValue() != nullptr) == is_found);
+    if(is_found) { always_assert(*vs.GetValue() == std::to_string(key)); }
+    always_assert(vs.GetBaseOffset() == static_cast<NodeSizeType>(leaf_node_p->Search(key)));
+  }
+
+  FreeDeltaChain(table_p, table_p->At(leaf_node_id));
+  MappingTableType::Destroy(table_p);
+  return;
+} END_TEST
+
+/*
+ * KeyFilterTest() - Tests the key filter of leaf delta chains
+ * 
+ * 1. Insert and delete deltas add their keys to the filter of the chain below them,
+ *    skipping split deltas. Merge deltas make the filter full
+ * 2. Searches that skip the rest of the chain return the same results
+ */
+BEGIN_DEBUG_TEST(KeyFilterTest) {
+  using ValueSearcherType = typename BwTreeType::ValueSearcherType;
+  using ValueSearchTraverserType = typename BwTreeType::ValueSearchTraverserType;
+  using KeyFilterType = DeltaKeyFilter<KeyType>;
+  using FilterType = typename KeyFilterType::FilterType;
+  LeafBaseType *leaf_node_p = LeafBaseType::Get(NodeType::LeafBase, 100, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+  for(int i = 0;i < 100;i++) { 
+    leaf_node_p->KeyAt(i) = i * 10; 
+    leaf_node_p->ValueAt(i) = std::to_string(i * 10); 
+  }
+  MappingTableType *table_p = MappingTableType::Get();
+  NodeIDType leaf_node_id = table_p->AllocateNodeID(leaf_node_p);
+  AppendHelperType ah{leaf_node_id, leaf_node_p, table_p};
+  always_assert(AppendHelperType::GetKeyFilter(leaf_node_p) == KeyFilterType::EMPTY);
+  // Inserts 1 - 8 and deletes 10
+  FilterType filter = KeyFilterType::EMPTY;
+  for(int key = 1;key <= 8;key++) {
+    always_assert(ah.AppendLeafInsert(key, std::to_string(key)) == nullptr); 
+    filter = KeyFilterType::Add(filter, key);
+    always_assert(AppendHelperType::GetKeyFilter(ah.GetNode()) == filter);
+  }
+  always_assert(ah.AppendLeafDelete(10, "10") == nullptr); 
+  filter = KeyFilterType::Add(filter, 10);
+  always_assert(AppendHelperType::GetKeyFilter(ah.GetNode()) == filter && filter != KeyFilterType::FULL);
+
+  // Split deltas are skipped: 0 - 8, 20 - 490 [-Inf, 500)
+  always_assert(ah.AppendLeafSplit(500, table_p->AllocateNodeID(nullptr), NodeSizeType{50}) == nullptr);
+  always_assert(AppendHelperType::GetKeyFilter(ah.GetNode()) == filter);
+  always_assert(ah.AppendLeafInsert(305, "305") == nullptr); 
+  filter = KeyFilterType::Add(filter, 305);
+  always_assert(AppendHelperType::GetKeyFilter(ah.GetNode()) == filter);
+  int skip_num = 0;
+  for(int key = -5;key < 500;key++) {
+    ValueSearcherType vs{key};
+    ValueSearchTraverserType::Traverse(table_p->At(leaf_node_id), &vs);
+    bool is_inserted = (key >= 1 && key <= 8) || key == 305;
+    bool in_base = key >= 0 && key % 10 == 0 && key != 10;
+    always_assert((vs.GetValue() != nullptr) == (is_inserted || in_base));
+    if(vs.GetValue() != nullptr) { always_assert(*vs.GetValue() == std::to_string(key)); }
+    if(KeyFilterType::MayContain(filter, key) == false) { skip_num++; }
+  }
+  test_printf("%d out of 505 searches skip the chain\n", skip_num);
+  always_assert(skip_num > 0);
+
+  // Merge deltas make the filter full
+  LeafBaseType *sibling_p = LeafBaseType::Get(NodeType::LeafBase, 0, BoundKeyType::Get(500), BoundKeyType::GetInf());
+  always_assert(ah.AppendLeafMerge(500, table_p->AllocateNodeID(sibling_p), sibling_p) == nullptr);
+  always_assert(ah.AppendLeafInsert(600, "600") == nullptr); 
+  always_assert(AppendHelperType::GetKeyFilter(ah.GetNode()) == KeyFilterType::FULL);
+
+  FreeDeltaChain(table_p, table_p->At(leaf_node_id));
+  MappingTableType::Destroy(table_p);
+  return;
+} END_TEST
+
+/*
+ * AppendRetryTest() - Tests whether deltas of failed appends are reused by the retry
+ *
+ * 1. Reused deltas are relinked at the new view with the height, size and key filter
+ *    of a new delta. Values of delete deltas are updated
+ * 2. Deltas are not reused if the base node has been replaced
+ * 3. Backoff spins double from 1 up to the limit and stay there. A limit of 0 does nothing
+ */
+BEGIN_DEBUG_TEST(AppendRetryTest) {
+  using KeyFilterType = DeltaKeyFilter<KeyType>;
+  using LeafInsertType = typename AppendHelperType::LeafInsertType;
+  using LeafDeleteType = typename AppendHelperType::LeafDeleteType;
+  LeafBaseType *leaf_node_p = LeafBaseType::Get(NodeType::LeafBase, 10, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+  for(int i = 0;i < 10;i++) { 
+    leaf_node_p->KeyAt(i) = i * 10; 
+    leaf_node_p->ValueAt(i) = std::to_string(i * 10); 
+  }
+  MappingTableType *table_p = MappingTableType::Get();
+  NodeIDType leaf_node_id = table_p->AllocateNodeID(leaf_node_p);
+  AppendHelperType ah{leaf_node_id, leaf_node_p, table_p};
+  AppendHelperType stale_ah{leaf_node_id, leaf_node_p, table_p};
+  always_assert(ah.AppendLeafInsert(5, "5") == nullptr);
+  NodeBaseType *head_p = ah.GetNode();
+
+  // The failed delta is relinked at the new head
+  LeafInsertType *insert_p = stale_ah.AppendLeafInsert(15, "15");
+  always_assert(insert_p != nullptr && insert_p->GetNext() == leaf_node_p);
+  AppendHelperType retry_ah{leaf_node_id, table_p->At(leaf_node_id), table_p};
+  always_assert(retry_ah.AppendLeafInsert(15, "15", NodeBaseType::INVALID_OFFSET, insert_p) == nullptr);
+  always_assert(retry_ah.GetNode() == insert_p && insert_p->GetNext() == head_p);
+  always_assert(insert_p->GetHeight() == 2 && insert_p->GetSize() == 12);
+  always_assert(insert_p->GetKeyFilter() == KeyFilterType::Add(KeyFilterType::Add(KeyFilterType::EMPTY, 5), 15));
+
+  // Delete deltas take the value of the retry
+  LeafDeleteType *delete_p = stale_ah.AppendLeafDelete(20, "stale");
+  always_assert(delete_p != nullptr);
+  always_assert(retry_ah.AppendLeafDelete(20, "20", NodeBaseType::INVALID_OFFSET, delete_p) == nullptr);
+  always_assert(retry_ah.GetNode() == delete_p && delete_p->GetNext() == insert_p);
+  always_assert(delete_p->GetDeleteValue() == "20" && delete_p->GetHeight() == 3 && delete_p->GetSize() == 11);
+
+  // Replaces the chain with another base node, as consolidation does
+  NodeBaseType *old_chain_p = table_p->At(leaf_node_id);
+  LeafBaseType *new_node_p = LeafBaseType::Get(NodeType::LeafBase, 0, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+  always_assert(table_p->CAS(leaf_node_id, old_chain_p, new_node_p));
+  insert_p = stale_ah.AppendLeafInsert(25, "25");
+  always_assert(insert_p != nullptr);
+  AppendHelperType new_ah{leaf_node_id, new_node_p, table_p};
+  always_assert(new_ah.AppendLeafInsert(25, "25", NodeBaseType::INVALID_OFFSET, insert_p) == nullptr);
+  // The heap could return the address of the destroyed delta, so only the new chain is checked
+  always_assert(new_ah.GetBase() == new_node_p && static_cast<LeafInsertType *>(new_ah.GetNode())->GetNext() == new_node_p);
+  always_assert(new_ah.GetNode()->GetHeight() == 1 && new_ah.GetNode()->GetSize() == 1);
+
+  // Spins are capped by limits that are not powers of two
+  RetryBackoff backoff{6}, no_backoff{0};
+  const size_t spin_list[] = {1, 2, 4, 6, 6, 6};
+  for(size_t spin_num : spin_list) {
+    always_assert(backoff.GetSpinNum() == spin_num);
+    backoff.Pause();
+  }
+  for(int i = 0;i < 4;i++) { 
+    no_backoff.Pause(); 
+    always_assert(no_backoff.GetSpinNum() == 1);
+  }
+  always_assert(DefaultRuntimeConfigType{}.SetRetryBackoffLimit(0).GetRetryBackoffLimit() == 0);
+
+  FreeDeltaChain(table_p, old_chain_p);
+  FreeDeltaChain(table_p, table_p->At(leaf_node_id));
+  MappingTableType::Destroy(table_p);
+  return;
+} END_TEST
+
+/*
+ * RetireChainTest() - Tests whether retired delta chains are freed by the epoch manager
+ */
+BEGIN_DEBUG_TEST(RetireChainTest) {
+  BwTreeType *tree_p = new BwTreeType{1};
+  MappingTableType *table_p = tree_p->GetMappingTable();
+  tree_p->RegisterThread(0);
+
+  LeafBaseType *leaf_node_p = LeafBaseType::Get(NodeType::LeafBase, 0, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+  NodeIDType leaf_node_id = table_p->AllocateNodeID(leaf_node_p);
+  NodeIDType remove_id = table_p->AllocateNodeID(leaf_node_p);
+  AppendHelperType ah{leaf_node_id, leaf_node_p, table_p};
+  always_assert(ah.AppendLeafInsert(100, "this is 100") == nullptr);
+  always_assert(ah.AppendLeafInsert(200, "this is 200") == nullptr);
+  always_assert(ah.AppendLeafRemove(remove_id) == nullptr);
+
+  // Install a new base node, and then retire the old chain
+  NodeBaseType *old_node_p = table_p->At(leaf_node_id);
+  LeafBaseType *new_node_p = LeafBaseType::Get(NodeType::LeafBase, 0, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+  always_assert(table_p->CAS(leaf_node_id, old_node_p, new_node_p) == true);
+  {
+    typename BwTreeType::EpochManagerType::GuardType guard{tree_p->GetEpochManager()};
+    tree_p->RetireChain(old_node_p);
+    tree_p->GetEpochManager()->Reclaim();
+    // We are still in the epoch at which the chain is retired
+    always_assert(tree_p->GetEpochManager()->GetGarbageCount() == 1);
+    always_assert(table_p->At(remove_id) != nullptr);
+  }
+
+  tree_p->GetEpochManager()->Reclaim();
+  always_assert(tree_p->GetEpochManager()->GetGarbageCount() == 0);
+  // The remove delta releases the node ID when it is freed
+  always_assert(table_p->At(remove_id) == nullptr);
+
+  FreeDeltaChain(table_p, table_p->At(leaf_node_id));
+  delete tree_p;
+
+  return;
+} END_TEST
+
+/*
+ * InsertDeleteTest() - Tests single threaded insert, delete and lookup
+ */
+BEGIN_DEBUG_TEST(InsertDeleteTest) {
+  constexpr int key_num = 5000;
+  BwTreeType *tree_p = new BwTreeType{1};
+  tree_p->RegisterThread(0);
+  ValueType value;
+
+  for(int i = 0;i < key_num;i++) { always_assert(tree_p->Insert(i, std::to_string(i)) == true); }
+  // Duplicated keys are rejected
+  for(int i = 0;i < key_num;i++) { always_assert(tree_p->Insert(i, std::to_string(i)) == false); }
+  for(int i = 0;i < key_num;i++) {
+    always_assert(tree_p->Lookup(i, &value) == true);
+    always_assert(value == std::to_string(i));
+  }
+
+  always_assert(tree_p->Lookup(-1, &value) == false);
+  always_assert(tree_p->Lookup(key_num, &value) == false);
+  // Delete even keys
+  for(int i = 0;i < key_num;i += 2) { always_assert(tree_p->Delete(i) == true); }
+  for(int i = 0;i < key_num;i += 2) { always_assert(tree_p->Delete(i) == false); }
+  for(int i = 0;i < key_num;i++) {
+    bool is_odd = (i % 2 == 1);
+    always_assert(tree_p->Lookup(i, &value) == is_odd);
+  }
+
+  // Insert them back with different values
+  for(int i = 0;i < key_num;i += 2) { always_assert(tree_p->Insert(i, std::to_string(-i)) == true); }
+  for(int i = 0;i < key_num;i++) {
+    int expected = (i % 2 == 1) ? i : -i;
+    always_assert(tree_p->Lookup(i, &value) == true);
+    always_assert(value == std::to_string(expected));
+  }
+
+  test_printf("Garbage count = %lu\n", tree_p->GetEpochManager()->GetGarbageCount());
+  delete tree_p;
+
+  return;
+} END_TEST
+
+/*
+ * ConcurrentInsertDeleteTest() - Tests multi-threaded insert, delete and lookup
+ * 
+ * 1. Threads insert disjoint sets of keys into the tree
+ * 2. Threads delete keys inserted by other threads, such that no key is deleted twice
+ */
+BEGIN_DEBUG_TEST(ConcurrentInsertDeleteTest) {
+  constexpr size_t thread_num = 8;
+  constexpr int per_thread = 1000;
+  BwTreeType *tree_p = new BwTreeType{thread_num};
+
+  auto insert_func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    for(int i = 0;i < per_thread;i++) {
+      int key = i * static_cast<int>(thread_num) + static_cast<int>(thread_id);
+      always_assert(tree_p->Insert(key, std::to_string(key)) == true);
+    }
+  };
+
+  auto delete_func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    ValueType value;
+    for(int i = 0;i < per_thread;i++) {
+      int key = i * static_cast<int>(thread_num) + static_cast<int>((thread_id + 1) % thread_num);
+      always_assert(tree_p->Lookup(key, &value) == true);
+      always_assert(value == std::to_string(key));
+      if(i % 2 == 0) { always_assert(tree_p->Delete(key) == true); }
+    }
+  };
+
+  StartThread(thread_num, insert_func, thread_num);
+  StartThread(thread_num, delete_func, thread_num);
+
+  tree_p->RegisterThread(0);
+  ValueType value;
+  for(int key = 0;key < per_thread * static_cast<int>(thread_num);key++) {
+    bool is_deleted = ((key / static_cast<int>(thread_num)) % 2 == 0);
+    always_assert(tree_p->Lookup(key, &value) == !is_deleted);
+  }
+
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * SplitMergeTest() - Tests whether nodes are split and merged correctly
+ * 
+ * Keys are inserted in a scattered order such that splits happen everywhere in the
+ * tree. Deleting most of the keys then triggers merges on both levels
+ */
+BEGIN_DEBUG_TEST(SplitMergeTest) {
+  // This must be a prime number such that the key sequence is a permutation
+  constexpr int key_num = 30011;
+  BwTreeType *tree_p = new BwTreeType{1};
+  tree_p->RegisterThread(0);
+  ValueType value;
+
+  for(int i = 0;i < key_num;i++) {
+    int key = static_cast<int>((static_cast<int64_t>(i) * 7919) % key_num);
+    always_assert(tree_p->Insert(key, std::to_string(key)) == true);
+  }
+  for(int key = 0;key < key_num;key++) {
+    always_assert(tree_p->Lookup(key, &value) == true);
+    always_assert(value == std::to_string(key));
+  }
+
+  // Only keep one key out of a hundred
+  for(int key = 0;key < key_num;key++) {
+    bool is_kept = (key % 100 == 0);
+    if(is_kept == false) { always_assert(tree_p->Delete(key) == true); }
+  }
+  for(int key = 0;key < key_num;key++) {
+    bool is_kept = (key % 100 == 0);
+    always_assert(tree_p->Lookup(key, &value) == is_kept);
+  }
+
+  // Delete everything and insert back
+  for(int key = 0;key < key_num;key += 100) { always_assert(tree_p->Delete(key) == true); }
+  for(int key = 0;key < key_num;key++) { always_assert(tree_p->Lookup(key, &value) == false); }
+  for(int key = key_num - 1;key >= 0;key--) { always_assert(tree_p->Insert(key, std::to_string(key)) == true); }
+  for(int key = 0;key < key_num;key++) { always_assert(tree_p->Lookup(key, &value) == true); }
+
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * ConcurrentSplitMergeTest() - Tests concurrent SMOs
+ * 
+ * Threads insert and delete interleaved keys at the same time, such that nodes
+ * are split and merged by different threads concurrently
+ */
+BEGIN_DEBUG_TEST(ConcurrentSplitMergeTest) {
+  constexpr size_t thread_num = 8;
+  constexpr int per_thread = 10000;
+  BwTreeType *tree_p = new BwTreeType{thread_num};
+
+  auto func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    ValueType value;
+    for(int i = 0;i < per_thread;i++) {
+      int key = i * static_cast<int>(thread_num) + static_cast<int>(thread_id);
+      always_assert(tree_p->Insert(key, std::to_string(key)) == true);
+      // Delete the key inserted a while ago such that the tree both grows and shrinks
+      if(i >= 100 && i % 4 != 0) {
+        int old_key = key - 100 * static_cast<int>(thread_num);
+        always_assert(tree_p->Lookup(old_key, &value) == true);
+        always_assert(tree_p->Delete(old_key) == true);
+      }
+    }
+  };
+
+  StartThread(thread_num, func, thread_num);
+
+  tree_p->RegisterThread(0);
+  ValueType value;
+  for(int key = 0;key < per_thread * static_cast<int>(thread_num);key++) {
+    int i = key / static_cast<int>(thread_num);
+    bool is_kept = (i % 4 == 0) || (i + 100 >= per_thread);
+    always_assert(tree_p->Lookup(key, &value) == is_kept);
+  }
+
+  // Deletes all remaining keys concurrently
+  auto delete_func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    ValueType value;
+    for(int i = 0;i < per_thread;i++) {
+      int key = i * static_cast<int>(thread_num) + static_cast<int>(thread_id);
+      bool is_kept = (i % 4 == 0) || (i + 100 >= per_thread);
+      always_assert(tree_p->Delete(key) == is_kept);
+    }
+  };
+
+  StartThread(thread_num, delete_func, thread_num);
+  tree_p->RegisterThread(0);
+  for(int key = 0;key < per_thread * static_cast<int>(thread_num);key++) {
+    always_assert(tree_p->Lookup(key, &value) == false);
+  }
+
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * ScanTest() - Tests forward and reverse scans
+ * 
+ * 1. Even keys are inserted and a range in the middle is deleted, such that some leaves 
+ *    are merged. Scans, seeks and batched fetches are checked against the expected keys
+ * 2. Stable even keys are scanned while other threads insert and delete odd keys.
+ *    Every scan must return all even keys in order
+ */
+BEGIN_DEBUG_TEST(ScanTest) {
+  constexpr int key_num = 20000;
+  BwTreeType *tree_p = new BwTreeType{1};
+  tree_p->RegisterThread(0);
+  always_assert(tree_p->Begin().IsEnd() && tree_p->RBegin().IsEnd() && tree_p->Seek(0).IsEnd());
+
+  std::vector<int> expected{};
+  for(int key = 0;key < key_num;key += 2) { tree_p->Insert(key, std::to_string(key)); }
+  for(int key = 0;key < key_num;key += 2) {
+    if(key >= 5000 && key < 9000) { always_assert(tree_p->Delete(key) == true); }
+    else { expected.push_back(key); }
+  }
+
+  std::vector<int> result{};
+  for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) {
+    always_assert(it.GetValue() == std::to_string(it.GetKey()));
+    result.push_back(it.GetKey());
+  }
+  always_assert(result == expected);
+  result.clear();
+  for(auto it = tree_p->RBegin();!it.IsEnd();it.Prev()) { result.push_back(it.GetKey()); }
+  always_assert(std::equal(result.rbegin(), result.rend(), expected.begin()) && result.size() == expected.size());
+
+  always_assert(tree_p->Seek(101).GetKey() == 102 && tree_p->Seek(102).GetKey() == 102);
+  always_assert(tree_p->Seek(5000).GetKey() == 9000 && tree_p->Seek(key_num).IsEnd());
+  always_assert(tree_p->SeekReverse(101).GetKey() == 100 && tree_p->SeekReverse(102).GetKey() == 102);
+  always_assert(tree_p->SeekReverse(8999).GetKey() == 4998 && tree_p->SeekReverse(-1).IsEnd());
+  {
+    // Iterators must be destroyed before the tree
+    auto it = tree_p->Seek(9000);
+    it.Prev();
+    always_assert(it.GetKey() == 4998);
+    it.Next();
+    always_assert(it.GetKey() == 9000);
+  }
+
+  // Batched fetches cross leaves
+  constexpr size_t batch = 37;
+  int key_list[batch];
+  ValueType value_list[batch];
+  result.clear();
+  for(auto it = tree_p->Seek(-1);!it.IsEnd();) {
+    size_t count = it.NextN(batch, key_list, value_list);
+    always_assert(count == batch || it.IsEnd());
+    for(size_t i = 0;i < count;i++) { 
+      always_assert(value_list[i] == std::to_string(key_list[i]));
+      result.push_back(key_list[i]); 
+    }
+  }
+  always_assert(result == expected);
+  result.clear();
+  for(auto it = tree_p->SeekReverse(key_num);!it.IsEnd();) {
+    size_t count = it.PrevN(batch, key_list, value_list);
+    result.insert(result.end(), key_list, key_list + count);
+  }
+  always_assert(std::equal(result.rbegin(), result.rend(), expected.begin()) && result.size() == expected.size());
+  delete tree_p;
+
+  constexpr size_t thread_num = 4;
+  tree_p = new BwTreeType{thread_num};
+  tree_p->RegisterThread(0);
+  for(int key = 0;key < key_num;key += 2) { tree_p->Insert(key, std::to_string(key)); }
+  auto func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    if(thread_id % 2 == 0) {
+      for(int round = 0;round < 4;round++) {
+        for(int key = static_cast<int>(thread_id) + 1;key < key_num;key += static_cast<int>(thread_num)) { 
+          always_assert(tree_p->Insert(key, std::to_string(key)) == true); 
+        }
+        for(int key = static_cast<int>(thread_id) + 1;key < key_num;key += static_cast<int>(thread_num)) { 
+          always_assert(tree_p->Delete(key) == true); 
+        }
+      }
+      return;
+    }
+
+    for(int round = 0;round < 10;round++) {
+      bool forward = (round % 2 == 0);
+      int next_even = forward ? 0 : key_num - 2, prev_key = forward ? -1 : key_num;
+      auto it = forward ? tree_p->Begin() : tree_p->RBegin();
+      for(;!it.IsEnd();forward ? it.Next() : it.Prev()) {
+        int key = it.GetKey();
+        always_assert(forward ? key > prev_key : key < prev_key);
+        if(key % 2 == 0) {
+          always_assert(key == next_even);
+          next_even += forward ? 2 : -2;
+        }
+        prev_key = key;
+      }
+      always_assert(next_even == (forward ? key_num : -2));
+    }
+  };
+
+  StartThread(thread_num, func, thread_num);
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * BatchTest() - Tests batched lookup and insert
+ * 
+ * 1. Shuffled keys with duplicates are inserted in batches, such that the tree is split
+ *    while batches are processed. The first duplicate is inserted
+ * 2. Batches of present and absent keys are searched
+ * 3. Threads insert interleaved keys in batches, and look them up concurrently
+ */
+BEGIN_DEBUG_TEST(BatchTest) {
+  constexpr int key_num = 20000;
+  constexpr size_t batch = 1000;
+  BwTreeType *tree_p = new BwTreeType{1};
+  tree_p->RegisterThread(0);
+
+  std::vector<int> key_list{};
+  for(int key = 0;key < key_num;key++) { key_list.push_back(key); }
+  std::random_shuffle(key_list.begin(), key_list.end());
+  // Every batch ends with a duplicate of its first key, whose value is different
+  std::vector<int> batch_key_list{};
+  std::vector<ValueType> value_list{};
+  for(size_t i = 0;i < key_list.size();i++) {
+    batch_key_list.push_back(key_list[i]);
+    value_list.push_back(std::to_string(key_list[i]));
+    if(batch_key_list.size() % batch == batch - 1 || i == key_list.size() - 1) { 
+      int first_key = batch_key_list[batch_key_list.size() / batch * batch];
+      batch_key_list.push_back(first_key);
+      value_list.push_back(std::to_string(first_key) + "dup");
+    }
+  }
+
+  size_t inserted = 0;
+  for(size_t begin = 0;begin < batch_key_list.size();begin += batch) {
+    size_t n = std::min(batch, batch_key_list.size() - begin);
+    bool result_list[batch];
+    size_t count = tree_p->BatchInsert(&batch_key_list[begin], &value_list[begin], n, result_list);
+    for(size_t i = 0;i < n;i++) { always_assert(result_list[i] == (value_list[begin + i].find("dup") == std::string::npos)); }
+    inserted += count;
+  }
+  always_assert(inserted == static_cast<size_t>(key_num));
+  always_assert(tree_p->BatchInsert(&key_list[0], &value_list[0], batch) == 0);
+
+  // Searches keys in [-key_num / 2, key_num * 3 / 2)
+  ValueType out_list[batch];
+  bool found_list[batch];
+  for(int begin = -key_num / 2;begin < key_num * 3 / 2;begin += static_cast<int>(batch)) {
+    int lookup_list[batch];
+    for(size_t i = 0;i < batch;i++) { lookup_list[i] = begin + static_cast<int>((i * 7919) % batch); }
+    size_t found = tree_p->BatchLookup(lookup_list, batch, out_list, found_list);
+    size_t expected = 0;
+    for(size_t i = 0;i < batch;i++) {
+      bool is_present = lookup_list[i] >= 0 && lookup_list[i] < key_num;
+      always_assert(found_list[i] == is_present);
+      if(is_present) { 
+        always_assert(out_list[i] == std::to_string(lookup_list[i])); 
+        expected++;
+      }
+    }
+    always_assert(found == expected);
+  }
+  always_assert(tree_p->BatchLookup(&key_list[0], 0, out_list, found_list) == 0);
+  delete tree_p;
+
+  constexpr size_t thread_num = 8;
+  tree_p = new BwTreeType{thread_num};
+  auto func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    int thread_key_list[batch];
+    ValueType thread_value_list[batch], thread_out_list[batch];
+    bool thread_found_list[batch];
+    for(int round = 0;round < 4;round++) {
+      for(size_t i = 0;i < batch;i++) {
+        thread_key_list[i] = static_cast<int>(((round * batch + i) * thread_num + thread_id));
+        thread_value_list[i] = std::to_string(thread_key_list[i]);
+      }
+      always_assert(tree_p->BatchInsert(thread_key_list, thread_value_list, batch) == batch);
+      always_assert(tree_p->BatchLookup(thread_key_list, batch, thread_out_list, thread_found_list) == batch);
+      for(size_t i = 0;i < batch;i++) { always_assert(thread_out_list[i] == thread_value_list[i]); }
+    }
+  };
+
+  StartThread(thread_num, func, thread_num);
+  tree_p->RegisterThread(0);
+  ValueType value;
+  for(int key = 0;key < static_cast<int>(4 * batch * thread_num);key++) { 
+    always_assert(tree_p->Lookup(key, &value) && value == std::to_string(key)); 
+  }
+
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * BulkLoadTest() - Tests building the tree from sorted keys
+ * 
+ * 1. Trees of different sizes are loaded, including an empty tree and trees with 
+ *    one leaf. Leaves of the largest one are built by multiple threads
+ * 2. All keys are found and scanned in order. Keys are then inserted into the gaps 
+ *    and deleted, such that the tree is split and merged as usual
+ */
+BEGIN_DEBUG_TEST(BulkLoadTest) {
+  for(int key_num : {0, 1, 50, 100000}) {
+    std::vector<int> key_list{};
+    std::vector<ValueType> value_list{};
+    for(int i = 0;i < key_num;i++) { 
+      key_list.push_back(i * 2);
+      value_list.push_back(std::to_string(i * 2));
+    }
+    BwTreeType *tree_p = new BwTreeType{4, key_list.data(), value_list.data(), key_list.size(), 4};
+    tree_p->RegisterThread(0);
+
+    ValueType value;
+    for(int key = -1;key < key_num * 2;key++) {
+      bool is_loaded = key >= 0 && key % 2 == 0;
+      always_assert(tree_p->Lookup(key, &value) == is_loaded);
+      if(is_loaded) { always_assert(value == std::to_string(key)); }
+    }
+    int next_key = 0;
+    for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) {
+      always_assert(it.GetKey() == next_key);
+      next_key += 2;
+    }
+    always_assert(next_key == key_num * 2);
+
+    for(int key = 1;key < key_num * 2;key += 2) { always_assert(tree_p->Insert(key, std::to_string(key)) == true); }
+    for(int key = 0;key < key_num * 2;key++) {
+      if(key % 3 != 0) { always_assert(tree_p->Delete(key) == true); }
+    }
+    for(int key = 0;key < key_num * 2;key++) { 
+      bool is_kept = key % 3 == 0;
+      always_assert(tree_p->Lookup(key, &value) == is_kept); 
+    }
+
+    delete tree_p;
+  }
+
+  return;
+} END_TEST
+
+/*
+ * StatsTest() - Tests the stats policy
+ * 
+ * 1. Single thread inserts and deletes are counted exactly, including the bytes of 
+ *    deltas. SMOs and consolidations happen, and every traversal records the height
+ * 2. Counters of concurrent threads are aggregated
+ */
+BEGIN_DEBUG_TEST(StatsTest) {
+  using StatsBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+           DefaultEpochManagerType, DefaultTreeStatsType>;
+  constexpr int key_num = 20011;
+  StatsBwTreeType *tree_p = new StatsBwTreeType{1};
+  tree_p->RegisterThread(0);
+  DefaultTreeStatsType *stats_p = tree_p->GetStats();
+  for(int key = 0;key < key_num;key++) { tree_p->Insert(key, std::to_string(key)); }
+  always_assert(stats_p->GetAllocBytes(NodeType::LeafInsert) == key_num * sizeof(typename StatsBwTreeType::LeafInsertType));
+  always_assert(stats_p->GetCount(StatsCounter::AppendFailure) == 0);
+  always_assert(stats_p->GetCount(StatsCounter::LeafConsolidation) > 0);
+  always_assert(stats_p->GetCount(StatsCounter::SplitStart) > 0);
+  always_assert(stats_p->GetCount(StatsCounter::HelpSplit) > 0);
+  always_assert(stats_p->GetAllocBytes(NodeType::LeafBase) > 0 && stats_p->GetAllocBytes(NodeType::InnerInsert) > 0);
+  uint64_t height_count = 0;
+  for(size_t height = 0;height < DefaultTreeStatsType::HEIGHT_BUCKET_NUM;height++) { 
+    height_count += stats_p->GetHeightCount(height); 
+  }
+  // Heights are recorded after consolidation, so they are below the threshold
+  always_assert(height_count >= key_num);
+  always_assert(stats_p->GetHeightCount(tree_p->GetConfig().GetLeafHeightThreshold()) == 0);
+  // Private views of leaves made by scans are not counted
+  uint64_t leaf_bytes = stats_p->GetAllocBytes(NodeType::LeafBase);
+  for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) {}
+  always_assert(stats_p->GetAllocBytes(NodeType::LeafBase) == leaf_bytes);
+
+  uint64_t append_count = stats_p->GetCount(StatsCounter::Append);
+  for(int key = 0;key < key_num;key++) { tree_p->Delete(key); }
+  always_assert(stats_p->GetCount(StatsCounter::Append) >= append_count + key_num);
+  always_assert(stats_p->GetCount(StatsCounter::RemoveStart) > 0);
+  always_assert(stats_p->GetCount(StatsCounter::Retire) >= stats_p->GetGarbageBacklog());
+  tree_p->GetEpochManager()->FreeAllGarbage();
+  always_assert(stats_p->GetGarbageBacklog() == 0);
+  test_printf("%s\n", stats_p->ToString().c_str());
+
+  stats_p->Reset();
+  always_assert(stats_p->GetCount(StatsCounter::Append) == 0);
+  delete tree_p;
+
+  // Load threads count their nodes in their own stats, so no update is lost
+  std::vector<int> key_list{};
+  std::vector<ValueType> value_list{};
+  for(int key = 0;key < key_num;key++) { key_list.push_back(key); value_list.push_back(""); }
+  uint64_t load_bytes[2];
+  for(size_t load_thread_num : {1, 4}) {
+    tree_p = new StatsBwTreeType{4, key_list.data(), value_list.data(), key_list.size(), load_thread_num};
+    load_bytes[load_thread_num == 1 ? 0 : 1] = tree_p->GetStats()->GetAllocBytes(NodeType::LeafBase);
+    delete tree_p;
+  }
+  always_assert(load_bytes[0] > 0 && load_bytes[0] == load_bytes[1]);
+
+  constexpr size_t thread_num = 4;
+  tree_p = new StatsBwTreeType{thread_num};
+  auto func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    for(int i = 0;i < key_num;i++) { tree_p->Insert(i * static_cast<int>(thread_num) + static_cast<int>(thread_id), ""); }
+  };
+
+  StartThread(thread_num, func, thread_num);
+  stats_p = tree_p->GetStats();
+  always_assert(stats_p->GetCount(StatsCounter::Append) - stats_p->GetCount(StatsCounter::AppendFailure) >= key_num * thread_num);
+  test_printf("%s\n", stats_p->ToString().c_str());
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * ConfigTestHelper() - Inserts, deletes and scans a tree of the given config
+ * 
+ * Returns the number of traversals that found a leaf chain of at least the height
+ */
+template <typename ConfigBwTreeType>
+uint64_t ConfigTestHelper(const typename ConfigBwTreeType::ConfigType &config, size_t height) {
+  constexpr int key_num = 30011;
+  ConfigBwTreeType *tree_p = new ConfigBwTreeType{1, config};
+  tree_p->RegisterThread(0);
+  for(int key = 0;key < key_num;key++) { always_assert(tree_p->Insert(key, std::to_string(key)) == true); }
+  for(int key = 0;key < key_num;key += 2) { always_assert(tree_p->Delete(key) == true); }
+  int next_key = 1;
+  for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) {
+    always_assert(it.GetKey() == next_key && it.GetValue() == std::to_string(next_key));
+    next_key += 2;
+  }
+  always_assert(next_key == key_num);
+
+  uint64_t count = 0;
+  for(size_t i = height;i < DefaultTreeStatsType::HEIGHT_BUCKET_NUM;i++) { count += tree_p->GetStats()->GetHeightCount(i); }
+  delete tree_p;
+  return count;
+}
+
+/*
+ * ConfigTest() - Tests trees with non-default thresholds
+ * 
+ * 1. Thresholds fixed at compile time are used by the tree
+ * 2. Thresholds set at run time are used by the tree, including heights above the 
+ *    inline capacity of consolidators
+ * 3. The mapping table is sized by the config
+ */
+BEGIN_DEBUG_TEST(ConfigTest) {
+  using SmallConfigType = StaticConfig<4, 2, 32, 4, 16, 2, 1024 * 1024>;
+  using StaticBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+           DefaultEpochManagerType, DefaultTreeStatsType, SmallConfigType>;
+  static_assert(StaticBwTreeType::MAPPING_TABLE_SIZE == 1024 * 1024, "Mapping table size is not from the config");
+  always_assert(ConfigTestHelper<StaticBwTreeType>(SmallConfigType{}, 4) == 0);
+  always_assert(ConfigTestHelper<StaticBwTreeType>(SmallConfigType{}, 3) > 0);
+
+  using RuntimeBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultPagedMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+           DefaultEpochManagerType, DefaultTreeStatsType, DefaultRuntimeConfigType>;
+  using RuntimeSortedBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultPagedMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultSortedConsolidator, 
+           DefaultEpochManagerType, DefaultTreeStatsType, DefaultRuntimeConfigType>;
+  DefaultRuntimeConfigType config{};
+  always_assert(config.GetLeafHeightThreshold() == DefaultStaticConfigType::GetLeafHeightThreshold());
+  config.SetLeafHeightThreshold(3).SetInnerHeightThreshold(1).SetLeafNodeSize(16, 2).SetInnerNodeSize(8, 1);
+  always_assert(ConfigTestHelper<RuntimeBwTreeType>(config, 3) == 0);
+  always_assert(ConfigTestHelper<RuntimeSortedBwTreeType>(config, 3) == 0);
+
+  // Leaf chains grow beyond the largest recorded height
+  static_assert(DefaultRuntimeConfigType::HEIGHT_CAPACITY < DefaultTreeStatsType::HEIGHT_BUCKET_NUM, "Height is not recorded");
+  config.SetLeafHeightThreshold(200).SetInnerHeightThreshold(50).SetLeafNodeSize(512, 64).SetInnerNodeSize(256, 32);
+  always_assert(ConfigTestHelper<RuntimeBwTreeType>(config, DefaultTreeStatsType::HEIGHT_BUCKET_NUM - 1) > 0);
+  always_assert(ConfigTestHelper<RuntimeSortedBwTreeType>(config, DefaultTreeStatsType::HEIGHT_BUCKET_NUM - 1) > 0);
+
+  config = DefaultRuntimeConfigType{}.SetMappingTableSize(1 << 16);
+  RuntimeBwTreeType *tree_p = new RuntimeBwTreeType{1, config};
+  tree_p->RegisterThread(0);
+  for(int key = 0;key < 10000;key++) { tree_p->Insert(key, ""); }
+  always_assert(tree_p->GetMappingTable()->GetPageCount() <= (1 << 16) / RuntimeBwTreeType::MappingTableType::PAGE_SIZE);
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * AdaptiveConsolidationTest() - Tests the adaptive height policy
+ * 
+ * 1. Thresholds of write-hot leaves are raised, and those of read-hot leaves are lowered.
+ *    Counters decay, so the threshold follows the workload
+ * 2. Inserts make chains longer than the threshold of the config, and lookups then 
+ *    consolidate them eagerly
+ */
+BEGIN_DEBUG_TEST(AdaptiveConsolidationTest) {
+  using PolicyType = DefaultAdaptiveHeightPolicyType;
+  constexpr size_t threshold = DefaultStaticConfigType::GetLeafHeightThreshold();
+  constexpr size_t write_hot_threshold = threshold * PolicyType::THRESHOLD_FACTOR;
+  constexpr size_t read_hot_threshold = threshold / PolicyType::THRESHOLD_FACTOR;
+  PolicyType policy{};
+  always_assert(policy.GetLeafHeightThreshold(1, threshold) == threshold);
+  for(int i = 0;i < 100;i++) { policy.CountAppend(1); }
+  always_assert(policy.GetLeafHeightThreshold(1, threshold) == write_hot_threshold);
+  for(int i = 0;i < 100;i++) { policy.CountRead(2, 10); }
+  always_assert(policy.GetLeafHeightThreshold(2, threshold) == read_hot_threshold);
+  for(int i = 0;i < 100;i++) { policy.CountRead(3, 0); }
+  always_assert(policy.GetLeafHeightThreshold(3, threshold) == threshold);
+  for(int i = 0;i < 10000;i++) { policy.CountRead(1, 10); }
+  always_assert(policy.GetLeafHeightThreshold(1, threshold) == read_hot_threshold);
+  policy.Reset();
+  always_assert(policy.GetLeafHeightThreshold(1, threshold) == threshold);
+
+  using AdaptiveBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+           DefaultEpochManagerType, DefaultTreeStatsType, DefaultStaticConfigType, PolicyType>;
+  constexpr int key_num = 20011;
+  AdaptiveBwTreeType *tree_p = new AdaptiveBwTreeType{1};
+  tree_p->RegisterThread(0);
+  DefaultTreeStatsType *stats_p = tree_p->GetStats();
+  auto count_func = [stats_p](size_t height) {
+    uint64_t count = 0;
+    for(size_t i = height;i < DefaultTreeStatsType::HEIGHT_BUCKET_NUM;i++) { count += stats_p->GetHeightCount(i); }
+    return count;
+  };
+  for(int key = 0;key < key_num;key++) { always_assert(tree_p->Insert(key, std::to_string(key)) == true); }
+  always_assert(count_func(threshold) > 0);
+  always_assert(count_func(write_hot_threshold) == 0);
+
+  ValueType value;
+  for(int round = 0;round < 4;round++) {
+    for(int key = 0;key < key_num;key++) { always_assert(tree_p->Lookup(key, &value) == true); }
+  }
+  stats_p->Reset();
+  for(int key = 0;key < key_num;key++) { 
+    always_assert(tree_p->Lookup(key, &value) == true && value == std::to_string(key)); 
+  }
+  always_assert(count_func(0) == key_num);
+  always_assert(count_func(read_hot_threshold) == 0);
+  test_printf("%s\n", stats_p->ToString().c_str());
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * MaintenanceTest() - Tests background consolidation
+ * 
+ * 1. The bounded queue is FIFO, fails when full or empty, and does not lose elements
+ *    under concurrent producers and consumers
+ * 2. Traversals defer consolidations to workers, and chains stay below the hard limit
+ * 3. The tree is correct with concurrent workers, and can be destroyed while they run
+ */
+BEGIN_DEBUG_TEST(MaintenanceTest) {
+  constexpr size_t queue_size = 1024;
+  using QueueType = BoundedQueue<size_t, queue_size>;
+  QueueType *queue_p = new QueueType{};
+  size_t item;
+  always_assert(queue_p->Pop(&item) == false);
+  for(size_t i = 0;i < queue_size;i++) { always_assert(queue_p->Push(i) == true); }
+  always_assert(queue_p->Push(queue_size) == false);
+  for(size_t i = 0;i < queue_size;i++) { always_assert(queue_p->Pop(&item) == true && item == i); }
+  always_assert(queue_p->Pop(&item) == false);
+
+  constexpr size_t item_num = 100000;
+  std::atomic<size_t> pop_sum{0}, pop_count{0};
+  auto queue_func = [queue_p, &pop_sum, &pop_count](size_t thread_id, size_t thread_num) {
+    if(thread_id % 2 == 0) {
+      for(size_t i = thread_id / 2;i < item_num;i += thread_num / 2) { while(queue_p->Push(i) == false) {} }
+    } else {
+      size_t value;
+      while(pop_count.load() < item_num) {
+        if(queue_p->Pop(&value)) {
+          pop_sum.fetch_add(value);
+          pop_count.fetch_add(1);
+        }
+      }
+    }
+  };
+  StartThread(4, queue_func, 4);
+  always_assert(pop_sum.load() == item_num * (item_num - 1) / 2);
+  delete queue_p;
+
+  // The hard limit of chain heights must be recorded by the stats
+  using MaintenanceConfigType = StaticConfig<8>;
+  using MaintenanceBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+           DefaultEpochManagerType, DefaultTreeStatsType, MaintenanceConfigType>;
+  static_assert(MaintenanceConfigType::GetLeafHeightThreshold() * MaintenanceBwTreeType::MAINTENANCE_HEIGHT_FACTOR < 
+                DefaultTreeStatsType::HEIGHT_BUCKET_NUM, "Hard limit is not recorded");
+  constexpr size_t thread_num = 4;
+  constexpr size_t worker_num = 2;
+  constexpr int key_num = 50000;
+  MaintenanceBwTreeType *tree_p = new MaintenanceBwTreeType{thread_num + worker_num};
+  tree_p->StartMaintenance(worker_num, thread_num);
+  auto insert_func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    for(int i = 0;i < key_num;i++) { 
+      int key = i * static_cast<int>(thread_num) + static_cast<int>(thread_id);
+      always_assert(tree_p->Insert(key, std::to_string(key)) == true); 
+    }
+  };
+  StartThread(thread_num, insert_func, thread_num);
+
+  DefaultTreeStatsType *stats_p = tree_p->GetStats();
+  always_assert(stats_p->GetCount(StatsCounter::DeferredConsolidation) > 0);
+  size_t hard_limit = tree_p->GetConfig().GetLeafHeightThreshold() * MaintenanceBwTreeType::MAINTENANCE_HEIGHT_FACTOR;
+  for(size_t height = hard_limit;height < DefaultTreeStatsType::HEIGHT_BUCKET_NUM;height++) {
+    always_assert(stats_p->GetHeightCount(height) == 0);
+  }
+  test_printf("%s\n", stats_p->ToString().c_str());
+
+  auto delete_func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    ValueType value;
+    for(int i = 0;i < key_num;i++) { 
+      int key = i * static_cast<int>(thread_num) + static_cast<int>(thread_id);
+      always_assert(tree_p->Lookup(key, &value) == true && value == std::to_string(key)); 
+      if(i % 2 == 0) { always_assert(tree_p->Delete(key) == true); }
+    }
+  };
+  StartThread(thread_num, delete_func, thread_num);
+  tree_p->StopMaintenance();
+
+  tree_p->RegisterThread(0);
+  ValueType value;
+  for(int key = 0;key < key_num * static_cast<int>(thread_num);key++) {
+    bool is_kept = (key / static_cast<int>(thread_num)) % 2 == 1;
+    always_assert(tree_p->Lookup(key, &value) == is_kept);
+  }
+  tree_p->StartMaintenance(worker_num, thread_num);
+  for(int key = 0;key < key_num;key++) { tree_p->Delete(key); }
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * SlabDeltaChainTest() - Tests the slab delta chain allocator
+ * 
+ * 1. Deltas are allocated from the slab until it is full, then from the heap
+ * 2. The tree works with the slab allocator, including SMOs
+ */
+BEGIN_DEBUG_TEST(SlabDeltaChainTest) {
+  using SlabBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultMappingTable, DefaultSlabDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+           DefaultEpochManagerType>;
+  using SlabLeafBaseType = typename SlabBwTreeType::LeafBaseType;
+  using SlabLeafInsertType = typename SlabBwTreeType::LeafInsertType;
+  constexpr int delta_num = 64;
+
+  SlabLeafBaseType *leaf_node_p = SlabLeafBaseType::Get(NodeType::LeafBase, 0, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+  NodeBaseType *node_p = leaf_node_p;
+  std::vector<SlabLeafInsertType *> delta_list{};
+  int slab_num = 0;
+  for(int i = 0;i < delta_num;i++) {
+    SlabLeafInsertType *delta_p = leaf_node_p->AllocateDelta<SlabLeafInsertType>(
+      NodeType::LeafInsert, static_cast<NodeHeightType>(node_p->GetHeight() + 1), static_cast<NodeSizeType>(node_p->GetSize() + 1), 
+      node_p->GetLowKey(), node_p->GetHighKey(), node_p, i, std::to_string(i));
+    bool in_slab = leaf_node_p->GetDeltaChain()->IsInSlab(delta_p);
+    // Once the slab is full, all later deltas are from the heap
+    always_assert(in_slab == false || slab_num == i);
+    if(in_slab) { slab_num++; }
+    delta_list.push_back(delta_p);
+    node_p = delta_p;
+  }
+
+  test_printf("Slab deltas = %d; Heap deltas = %d\n", slab_num, delta_num - slab_num);
+  always_assert(slab_num > 0 && slab_num < delta_num);
+  for(int i = 0;i < delta_num;i++) { always_assert(delta_list[i]->GetInsertValue() == std::to_string(i)); }
+  for(SlabLeafInsertType *delta_p : delta_list) { leaf_node_p->DestroyDelta(delta_p); }
+  SlabLeafBaseType::Destroy(leaf_node_p);
+
+  constexpr int key_num = 20011;
+  SlabBwTreeType *tree_p = new SlabBwTreeType{1};
+  tree_p->RegisterThread(0);
+  ValueType value;
+  for(int i = 0;i < key_num;i++) {
+    int key = static_cast<int>((static_cast<int64_t>(i) * 7919) % key_num);
+    always_assert(tree_p->Insert(key, std::to_string(key)) == true);
+  }
+  for(int key = 0;key < key_num;key += 3) { always_assert(tree_p->Delete(key) == true); }
+  for(int key = 0;key < key_num;key++) {
+    bool is_deleted = (key % 3 == 0);
+    always_assert(tree_p->Lookup(key, &value) == !is_deleted);
+    if(!is_deleted) { always_assert(value == std::to_string(key)); }
+  }
+
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * PagedMappingTableTest() - Tests the paged mapping table
+ * 
+ * 1. Pages are allocated on demand by concurrent threads
+ * 2. Released node IDs are reused
+ * 3. The tree works with the paged mapping table, and node IDs of removed 
+ *    nodes are recycled
+ */
+BEGIN_DEBUG_TEST(PagedMappingTableTest) {
+  constexpr size_t size = 1024 * 1024;
+  constexpr size_t thread_num = 4;
+  using PagedMappingTableType = DefaultPagedMappingTable<char, size>;
+  using PagedNodeIDType = typename PagedMappingTableType::NodeIDType;
+  constexpr size_t page_size = PagedMappingTableType::PAGE_SIZE;
+  constexpr size_t per_thread = page_size * 3 / 4;
+  PagedMappingTableType *table_p = PagedMappingTableType::Get();
+  always_assert(table_p->GetPageCount() == 0);
+
+  auto func = [table_p](size_t thread_id, size_t thread_num) {
+    ThreadContext::SetThreadID(thread_id);
+    for(size_t i = 0;i < per_thread;i++) {
+      char *p = reinterpret_cast<char *>(thread_id * per_thread + i + 1);
+      PagedNodeIDType node_id = table_p->AllocateNodeID(p);
+      always_assert(table_p->At(node_id) == p);
+    }
+  };
+
+  StartThread(thread_num, func, thread_num);
+  always_assert(table_p->GetPageCount() == 3);
+
+  ThreadContext::SetThreadID(0);
+  char *p = reinterpret_cast<char *>(0x1234);
+  always_assert(table_p->CAS(100, table_p->At(100), p) == true);
+  always_assert(table_p->CAS(100, nullptr, p) == false);
+  always_assert(table_p->At(100) == p);
+  // The most recently released ID is reused first
+  table_p->ReleaseNodeID(100);
+  table_p->ReleaseNodeID(200);
+  always_assert(table_p->At(100) == nullptr);
+  always_assert(table_p->GetFreeCount() == 2);
+  always_assert(table_p->AllocateNodeID(p) == 200);
+  always_assert(table_p->AllocateNodeID(p) == 100);
+  always_assert(table_p->AllocateNodeID(p) == thread_num * per_thread);
+  always_assert(table_p->GetFreeCount() == 0);
+
+  table_p->Reset();
+  always_assert(table_p->GetPageCount() == 0);
+  always_assert(table_p->AllocateNodeID(p) == 0);
+  PagedMappingTableType::Destroy(table_p);
+
+  using PagedBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultPagedMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+           DefaultEpochManagerType>;
+  constexpr int key_num = 20011;
+  PagedBwTreeType *tree_p = new PagedBwTreeType{1};
+  tree_p->RegisterThread(0);
+  ValueType value;
+  for(int round = 0;round < 3;round++) {
+    for(int key = 0;key < key_num;key++) { always_assert(tree_p->Insert(key, std::to_string(key)) == true); }
+    for(int key = 0;key < key_num;key++) { always_assert(tree_p->Lookup(key, &value) == true); }
+    for(int key = 0;key < key_num;key++) { always_assert(tree_p->Delete(key) == true); }
+    tree_p->GetEpochManager()->Reclaim();
+    test_printf("Round %d: pages = %lu; free IDs = %lu\n", round, 
+                tree_p->GetMappingTable()->GetPageCount(), tree_p->GetMappingTable()->GetFreeCount());
+  }
+
+  always_assert(tree_p->GetMappingTable()->GetPageCount() == 1);
+  delete tree_p;
+  return;
+} END_TEST
+
+// * BlockMappingTableTestHelper() - Tests a layout of BlockMappingTable
+template <template <typename, size_t> class MappingTable>
+void BlockMappingTableTestHelper() {
+  constexpr size_t size = 1024 * 1024;
+  constexpr size_t thread_num = 4;
+  using BlockMappingTableType = MappingTable<char, size>;
+  using BlockNodeIDType = typename BlockMappingTableType::NodeIDType;
+  constexpr size_t block_size = BlockMappingTableType::BLOCK_SIZE;
+  constexpr size_t per_thread = block_size * 3 / 2;
+  BlockMappingTableType *table_p = BlockMappingTableType::Get();
+
+  // IDs of the same block are allocated by the same thread
+  std::vector<BlockNodeIDType> id_list[thread_num];
+  auto func = [table_p, &id_list](size_t thread_id, size_t) {
+    ThreadContext::SetThreadID(thread_id);
+    for(size_t i = 0;i < per_thread;i++) {
+      char *p = reinterpret_cast<char *>(thread_id * per_thread + i + 1);
+      BlockNodeIDType node_id = table_p->AllocateNodeID(p);
+      always_assert(table_p->At(node_id) == p);
+      bool is_block_begin = (i % block_size == 0);
+      always_assert(is_block_begin || node_id == id_list[thread_id].back() + 1);
+      id_list[thread_id].push_back(node_id);
+    }
+  };
+
+  StartThread(thread_num, func, thread_num);
+  std::vector<BlockNodeIDType> all_id_list{};
+  for(size_t i = 0;i < thread_num;i++) { all_id_list.insert(all_id_list.end(), id_list[i].begin(), id_list[i].end()); }
+  std::sort(all_id_list.begin(), all_id_list.end());
+  always_assert(std::unique(all_id_list.begin(), all_id_list.end()) == all_id_list.end());
+
+  // Slots are distinct, and consecutive IDs are never on the same line
+  constexpr size_t line_size = BlockMappingTableType::CACHE_LINE_SIZE;
+  std::vector<size_t> offset_list{};
+  for(BlockNodeIDType node_id = 0;node_id < block_size * 2;node_id++) {
+    size_t offset = BlockMappingTableType::GetSlotOffset(node_id);
+    bool is_aligned = (offset % sizeof(typename BlockMappingTableType::SlotType) == 0);
+    always_assert(is_aligned);
+    always_assert(node_id == 0 || offset_list.back() / line_size != offset / line_size);
+    offset_list.push_back(offset);
+  }
+  std::sort(offset_list.begin(), offset_list.end());
+  always_assert(std::unique(offset_list.begin(), offset_list.end()) == offset_list.end());
+
+  ThreadContext::SetThreadID(0);
+  char *p = reinterpret_cast<char *>(0x1234);
+  always_assert(table_p->CAS(id_list[1][3], table_p->At(id_list[1][3]), p) == true);
+  always_assert(table_p->CAS(id_list[1][3], nullptr, p) == false);
+  table_p->ReleaseNodeID(id_list[1][3]);
+  table_p->ReleaseNodeID(id_list[2][5]);
+  always_assert(table_p->At(id_list[1][3]) == nullptr);
+  always_assert(table_p->AllocateNodeID(p) == id_list[2][5]);
+  always_assert(table_p->AllocateNodeID(p) == id_list[1][3]);
+  always_assert(table_p->AllocateNodeID(p) == id_list[0].back() + 1);
+
+  table_p->Reset();
+  always_assert(table_p->AllocateNodeID(nullptr) == 0);
+  always_assert(table_p->At(id_list[1][0]) == nullptr);
+  BlockMappingTableType::Destroy(table_p);
+
+  using BlockBwTreeType = \
+    BwTree<KeyType, ValueType, MappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator, 
+           DefaultEpochManagerType>;
+  constexpr int per_thread_key = 10000;
+  BlockBwTreeType *tree_p = new BlockBwTreeType{thread_num};
+  auto tree_func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    ValueType value;
+    for(int i = 0;i < per_thread_key;i++) {
+      int key = i * static_cast<int>(thread_num) + static_cast<int>(thread_id);
+      always_assert(tree_p->Insert(key, std::to_string(key)) == true);
+    }
+    for(int i = 0;i < per_thread_key;i++) {
+      int key = i * static_cast<int>(thread_num) + static_cast<int>(thread_id);
+      always_assert(tree_p->Lookup(key, &value) == true && value == std::to_string(key));
+      if(i & 1) { always_assert(tree_p->Delete(key) == true); }
+    }
+  };
+
+  StartThread(thread_num, tree_func, thread_num);
+  delete tree_p;
+  return;
+}
+
+/*
+ * BlockMappingTableTest() - Tests the mapping table with per-thread ID blocks
+ * 
+ * 1. Threads allocate consecutive IDs from their own blocks
+ * 2. Slots of different IDs are distinct, and are laid out as specified
+ * 3. Released node IDs are reused
+ * 4. The tree works with all layouts and memory placements
+ */
+BEGIN_DEBUG_TEST(BlockMappingTableTest) {
+  BlockMappingTableTestHelper<DefaultStripedMappingTable>();
+  BlockMappingTableTestHelper<DefaultPaddedMappingTable>();
+  BlockMappingTableTestHelper<DefaultInterleavedMappingTable>();
+  return;
+} END_TEST
+
+/*
+ * SortedConsolidationTest() - Tests DefaultSortedConsolidator
+ * 
+ * 1. Random insert and delete deltas, including repeated operations on the same key,
+ *    are consolidated by both consolidators, and the results must agree with a reference
+ * 2. The new node has the exact size, even if the virtual size is inaccurate
+ * 3. The node is split while consolidating if it reaches the split size
+ * 4. The tree works with the sorted consolidator, including SMOs
+ */
+BEGIN_DEBUG_TEST(SortedConsolidationTest) {
+  using SortedConsolidatorType = \
+    DefaultSortedConsolidator<KeyType, ValueType, NodeIDType, DeltaChainType, DefaultBaseNode, BwTreeType::HEIGHT_THREADHOLD>;
+  using SortedTraverserType = \
+    DeltaChainTraverser<KeyType, ValueType, NodeIDType, DeltaChainType, DefaultBaseNode, SortedConsolidatorType>;
+  constexpr int key_num = 64;
+  constexpr int round_num = 200;
+  MappingTableType *table_p = MappingTableType::Get();
+  srand(1234);
+
+  for(int round = 0;round < round_num;round++) {
+    std::vector<std::string> expected(key_num, std::string{});
+    // Base node has even keys
+    LeafBaseType *leaf_node_p = LeafBaseType::Get(NodeType::LeafBase, key_num / 2, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+    for(int i = 0;i < key_num / 2;i++) {
+      leaf_node_p->KeyAt(i) = i * 2;
+      leaf_node_p->ValueAt(i) = expected[i * 2] = "base " + std::to_string(i * 2);
+    }
+
+    NodeIDType leaf_node_id = table_p->AllocateNodeID(leaf_node_p);
+    AppendHelperType ah{leaf_node_id, leaf_node_p, table_p};
+    for(int i = 0;i < 20;i++) {
+      // Keys are chosen from a small range to make conflicts likely
+      int key = rand() % 16;
+      if(expected[key].empty()) {
+        expected[key] = "delta " + std::to_string(i);
+        always_assert(ah.AppendLeafInsert(key, expected[key]) == nullptr);
+      } else {
+        always_assert(ah.AppendLeafDelete(key, expected[key]) == nullptr);
+        expected[key].clear();
+      }
+    }
+
+    ConsolidatorType ct{table_p->At(leaf_node_id)};
+    ConsolidationTraverserType::Traverse(table_p->At(leaf_node_id), &ct);
+    SortedConsolidatorType sct{table_p->At(leaf_node_id)};
+    SortedTraverserType::Traverse(table_p->At(leaf_node_id), &sct);
+    LeafBaseType *new_node_p = ct.GetNewLeafBase();
+    LeafBaseType *sorted_node_p = sct.GetNewLeafBase();
+    always_assert(new_node_p->GetSize() == sorted_node_p->GetSize());
+
+    NodeSizeType index = 0;
+    for(int key = 0;key < key_num;key++) {
+      if(expected[key].empty()) { continue; }
+      always_assert(sorted_node_p->KeyAt(index) == key && sorted_node_p->ValueAt(index) == expected[key]);
+      always_assert(new_node_p->KeyAt(index) == key && new_node_p->ValueAt(index) == expected[key]);
+      index++;
+    }
+    always_assert(index == sorted_node_p->GetSize());
+
+    FreeDeltaChain(table_p, table_p->At(leaf_node_id));
+    FreeDeltaChain(table_p, new_node_p);
+    FreeDeltaChain(table_p, sorted_node_p);
+  }
+
+  // The virtual size is inaccurate after inserting an existing key, and the 
+  // split, merge and the deltas above the merge are counted exactly
+  LeafBaseType *left_p = LeafBaseType::Get(NodeType::LeafBase, 20, BoundKeyType::GetInf(), BoundKeyType::GetInf());
+  LeafBaseType *right_p = LeafBaseType::Get(NodeType::LeafBase, 20, BoundKeyType::Get(10), BoundKeyType::GetInf());
+  for(int i = 0;i < 20;i++) {
+    left_p->KeyAt(i) = i;
+    left_p->ValueAt(i) = std::to_string(i);
+    right_p->KeyAt(i) = i + 10;
+    right_p->ValueAt(i) = std::to_string(i + 10);
+  }
+  NodeIDType left_id = table_p->AllocateNodeID(left_p);
+  NodeIDType right_id = table_p->AllocateNodeID(right_p);
+  AppendHelperType left_ah{left_id, left_p, table_p};
+  AppendHelperType right_ah{right_id, right_p, table_p};
+  always_assert(left_ah.AppendLeafSplit(10, right_id, 10) == nullptr); // 0 - 9 [-Inf, 10)
+  always_assert(left_ah.AppendLeafInsert(5, "new 5") == nullptr);
+  always_assert(left_ah.AppendLeafDelete(7, "7") == nullptr); // 0 - 9 except 7
+  always_assert(right_ah.AppendLeafDelete(12, "12") == nullptr);
+  always_assert(right_ah.AppendLeafInsert(100, "100") == nullptr); // 10 - 29 except 12, 100
+  always_assert(right_ah.AppendLeafRemove(right_id) == nullptr); 
+  always_assert(left_ah.AppendLeafMerge(10, right_id, right_ah.GetNode()) == nullptr);
+  always_assert(left_ah.AppendLeafInsert(50, "50") == nullptr);
+  always_assert(left_ah.AppendLeafDelete(20, "20") == nullptr);
+  always_assert(left_ah.AppendLeafInsert(2, "new 2") == nullptr);
+  always_assert(left_ah.GetNode()->GetSize() == 31);
+
+  SortedConsolidatorType sct{left_ah.GetNode()};
+  SortedTraverserType::Traverse(left_ah.GetNode(), &sct);
+  LeafBaseType *sorted_node_p = sct.GetNewLeafBase();
+  PrintBaseNode(sorted_node_p);
+  always_assert(sct.GetNewSize() == 29 && sorted_node_p->GetSize() == 29);
+  always_assert(sorted_node_p->ValueAt(2) == "new 2" && sorted_node_p->ValueAt(5) == "new 5");
+  always_assert(sorted_node_p->KeyAt(7) == 8 && sorted_node_p->KeyAt(9) == 10 && sorted_node_p->KeyAt(10) == 11);
+  always_assert(sorted_node_p->KeyAt(27) == 50 && sorted_node_p->KeyAt(28) == 100);
+
+  // Splits while consolidating. The lower half takes 14 items, the same as Split()
+  SortedConsolidatorType split_sct{left_ah.GetNode(), 29};
+  SortedTraverserType::Traverse(left_ah.GetNode(), &split_sct);
+  LeafBaseType *lower_p = split_sct.GetNewLeafBase();
+  LeafBaseType *upper_p = split_sct.GetNewLeafSibling();
+  PrintBaseNode(lower_p);
+  PrintBaseNode(upper_p);
+  always_assert(upper_p != nullptr && lower_p->GetSize() == 14 && upper_p->GetSize() == 15);
+  always_assert(*lower_p->GetHighKey() == 16 && *upper_p->GetLowKey() == 16 && upper_p->GetHighKey()->IsInf());
+  for(int i = 0;i < 29;i++) {
+    LeafBaseType *half_p = i < 14 ? lower_p : upper_p;
+    int index = i < 14 ? i : i - 14;
+    always_assert(half_p->KeyAt(index) == sorted_node_p->KeyAt(i) && half_p->ValueAt(index) == sorted_node_p->ValueAt(i));
+  }
+  SortedConsolidatorType no_split_sct{left_ah.GetNode(), 30};
+  SortedTraverserType::Traverse(left_ah.GetNode(), &no_split_sct);
+  always_assert(no_split_sct.GetNewLeafSibling() == nullptr);
+
+  FreeDeltaChain(table_p, left_ah.GetNode());
+  FreeDeltaChain(table_p, sorted_node_p);
+  FreeDeltaChain(table_p, lower_p);
+  FreeDeltaChain(table_p, upper_p);
+  FreeDeltaChain(table_p, no_split_sct.GetNewLeafBase());
+  MappingTableType::Destroy(table_p);
+
+  using SortedBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultSortedConsolidator, 
+           DefaultEpochManagerType>;
+  constexpr int tree_key_num = 20011;
+  SortedBwTreeType *tree_p = new SortedBwTreeType{1};
+  tree_p->RegisterThread(0);
+  ValueType value;
+  for(int i = 0;i < tree_key_num;i++) {
+    int key = static_cast<int>((static_cast<int64_t>(i) * 7919) % tree_key_num);
+    always_assert(tree_p->Insert(key, std::to_string(key)) == true);
+  }
+  for(int key = 0;key < tree_key_num;key++) { 
+    always_assert(tree_p->Lookup(key, &value) == true); 
+    always_assert(value == std::to_string(key));
+  }
+  for(int key = 0;key < tree_key_num;key++) { 
+    bool is_kept = (key % 50 == 0);
+    if(is_kept == false) { always_assert(tree_p->Delete(key) == true); }
+  }
+  for(int key = 0;key < tree_key_num;key++) { 
+    bool is_kept = (key % 50 == 0);
+    always_assert(tree_p->Lookup(key, &value) == is_kept); 
+  }
+
+  delete tree_p;
+  return;
+} END_TEST
+
+/*
+ * VarKeyBaseNodeTest() - Tests the variable-length key base node
+ * 
+ * 1. The prefix is shared by the low and high keys, and is empty with an Inf bound.
+ *    Keys whose heads are equal are ordered by the key heap, and short keys by length
+ * 2. The first key of inner nodes may be out of the node's range
+ * 3. Trees with 20 - 60 byte string keys work with both consolidators, including
+ *    bulk loading, SMOs and scans
+ */
+template <template <typename, typename, typename, typename, 
+                    template <typename, typename, typename> typename, size_t> typename Consolidator>
+void VarKeyTreeTestHelper(const std::vector<std::string> &key_list) {
+  using VarKeyBwTreeType = \
+    BwTree<std::string, std::string, DefaultMappingTable, DefaultDeltaChainType, DefaultVarKeyBaseNode, Consolidator>;
+  std::vector<std::string> sorted_list{key_list};
+  std::sort(sorted_list.begin(), sorted_list.end());
+  VarKeyBwTreeType *tree_p = new VarKeyBwTreeType{1};
+  tree_p->RegisterThread(0);
+  std::string value;
+  for(const std::string &key : key_list) { always_assert(tree_p->Insert(key, "value " + key) == true); }
+  for(const std::string &key : key_list) { 
+    always_assert(tree_p->Lookup(key, &value) == true && value == "value " + key);
+    always_assert(tree_p->Lookup(key + "!", &value) == false);
+  }
+  size_t index = 0;
+  for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) { always_assert(it.GetKey() == sorted_list[index++]); }
+  always_assert(index == sorted_list.size());
+  for(size_t i = 0;i < key_list.size();i++) {
+    if(i % 4 != 0) { always_assert(tree_p->Delete(key_list[i]) == true); }
+  }
+  for(size_t i = 0;i < key_list.size();i++) { 
+    bool is_kept = i % 4 == 0;
+    always_assert(tree_p->Lookup(key_list[i], &value) == is_kept); 
+  }
+  delete tree_p;
+
+  // Bulk loading
+  std::vector<std::string> value_list{};
+  for(const std::string &key : sorted_list) { value_list.push_back("value " + key); }
+  tree_p = new VarKeyBwTreeType{1, sorted_list.data(), value_list.data(), sorted_list.size(), 2};
+  tree_p->RegisterThread(0);
+  for(const std::string &key : key_list) { always_assert(tree_p->Lookup(key, &value) == true && value == "value " + key); }
+  index = 0;
+  for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) { always_assert(it.GetKey() == sorted_list[index++]); }
+  always_assert(index == sorted_list.size());
+  delete tree_p;
+
+  return;
+}
+
+BEGIN_DEBUG_TEST(VarKeyBaseNodeTest) {
+  using VarKeyBaseNodeType = DefaultVarKeyBaseNode<std::string, int, DefaultDeltaChainType>;
+  using VarKeyBoundType = BoundKey<std::string>;
+  std::vector<std::string> node_key_list{
+    "tenant/0001/a", "tenant/0001/abcdefgh", "tenant/0001/abcdefgh1", "tenant/0001/abcdefgh12345678", 
+    "tenant/0001/abcdefgi", "tenant/0001/b", "tenant/0001/b1"};
+  VarKeyBaseNodeType *node_p = \
+    VarKeyBaseNodeType::Get(NodeType::LeafBase, static_cast<uint32_t>(node_key_list.size()), 
+                            VarKeyBoundType::Get("tenant/0001/a"), VarKeyBoundType::Get("tenant/0001/m"));
+  always_assert(node_p->GetPrefixLength() == 12);
+  for(size_t i = 0;i < node_key_list.size();i++) {
+    node_p->KeyAt(static_cast<int>(i)) = node_key_list[i];
+    node_p->ValueAt(static_cast<int>(i)) = static_cast<int>(i);
+  }
+  for(size_t i = 0;i < node_key_list.size();i++) {
+    int index = static_cast<int>(i);
+    always_assert(static_cast<std::string>(node_p->KeyAt(index)) == node_key_list[i]);
+    always_assert(node_p->KeyAt(index) == node_key_list[i] && node_key_list[i] == node_p->KeyAt(index));
+    always_assert(node_p->PointSearch(node_key_list[i]) == index && node_p->Search(node_key_list[i] + "0") == index);
+    if(i > 0) { always_assert(node_p->KeyAt(index) > node_key_list[i - 1] && node_key_list[i - 1] < node_p->KeyAt(index)); }
+  }
+  // Out of the node and within the prefix
+  always_assert(node_p->KeyAt(1) > "tenant/0001" && node_p->KeyAt(1) > "tenant/0000/z" && node_p->KeyAt(1) < "tenant/0002");
+  always_assert(node_p->PointSearch("tenant/0001/abcdefg") == -1 && node_p->Search("tenant/0001/abcdefg") == 0);
+  always_assert(node_p->PointSearch("tenant/0001/abcdefgh2") == -1 && node_p->Search("tenant/0001/abcdefgh2") == 3);
+
+  VarKeyBaseNodeType *sibling_p = node_p->Split();
+  always_assert(sibling_p->GetSize() == 4 && *sibling_p->GetLowKey() == "tenant/0001/abcdefgh12345678");
+  always_assert(sibling_p->GetPrefixLength() == 12);
+  for(int i = 0;i < 4;i++) { 
+    always_assert(sibling_p->KeyAt(i) == node_key_list[i + 3] && sibling_p->ValueAt(i) == i + 3); 
+  }
+  VarKeyBaseNodeType::Destroy(node_p);
+  VarKeyBaseNodeType::Destroy(sibling_p);
+
+  // The prefix is empty with Inf bounds, and the first key of inner nodes is never searched
+  node_p = VarKeyBaseNodeType::Get(NodeType::InnerBase, 2, VarKeyBoundType::Get("key/1"), VarKeyBoundType::GetInf());
+  always_assert(node_p->GetPrefixLength() == 0);
+  node_p->KeyAt(0) = "";
+  node_p->KeyAt(1) = "key/5";
+  always_assert(node_p->Search("key/3") == 0 && node_p->Search("key/5") == 1 && node_p->Search("key/9") == 1);
+  VarKeyBaseNodeType::Destroy(node_p);
+  node_p = VarKeyBaseNodeType::Get(NodeType::InnerBase, 2, VarKeyBoundType::Get("key/1"), VarKeyBoundType::Get("key/7"));
+  always_assert(node_p->GetPrefixLength() == 4);
+  node_p->KeyAt(0) = "";
+  node_p->KeyAt(1) = "key/5";
+  always_assert(node_p->KeyAt(0) == "" && node_p->Search("key/3") == 0 && node_p->Search("key/5") == 1);
+  VarKeyBaseNodeType::Destroy(node_p);
+
+  std::vector<std::string> key_list{};
+  const char *region_list[] = {"east", "west", "north", "south"};
+  char buffer[16];
+  for(int i = 0;i < 20000;i++) {
+    int id = static_cast<int>((static_cast<int64_t>(i) * 7919) % 20000);
+    snprintf(buffer, sizeof(buffer), "%08d", id);
+    key_list.push_back(std::string{"warehouse/"} + region_list[id % 4] + "/order/" + buffer + std::string(id % 31, 'x'));
+  }
+  VarKeyTreeTestHelper<DefaultConsolidator>(key_list);
+  VarKeyTreeTestHelper<DefaultSortedConsolidator>(key_list);
+
+  return;
+} END_TEST
+
+/*
+ * NonUniqueTest() - Tests the non-unique base node, consolidator and searcher
+ * 
+ * 1. Values of a key are stored in a run, and nodes are only split between runs.
+ *    A node with a single key could not be split
+ * 2. Delete deltas are matched on both the key and the value during consolidation
+ * 3. Trees allow duplicated keys but not duplicated pairs. Pairs are deleted by key
+ *    and value, and all values of a key are returned by lookups and scans. A long run 
+ *    of one key stays in one leaf
+ */
+BEGIN_DEBUG_TEST(NonUniqueTest) {
+  using NonUniqueBwTreeType = \
+    BwTree<int, int, DefaultMappingTable, DefaultDeltaChainType, DefaultNonUniqueBaseNode, DefaultNonUniqueConsolidator>;
+  using NonUniqueLeafType = typename NonUniqueBwTreeType::LeafBaseType;
+  using NonUniqueBoundType = typename NonUniqueBwTreeType::BoundKeyType;
+  using NonUniqueTableType = typename NonUniqueBwTreeType::MappingTableType;
+  using NonUniqueAppendHelperType = typename NonUniqueBwTreeType::AppendHelperType;
+  using NonUniqueConsolidatorType = typename NonUniqueBwTreeType::ConsolidatorType;
+  using NonUniqueFreeHelperType = typename NonUniqueBwTreeType::DeltaChainFreeHelperType;
+  using NonUniqueNodeIDType = typename NonUniqueBwTreeType::NodeIDType;
+  // Runs: 1 -> [10, 11], 3 -> [30, 31, 32], 5 -> [50, 51]
+  NonUniqueLeafType *node_p = \
+    NonUniqueLeafType::Get(NodeType::LeafBase, 7, NonUniqueBoundType::GetInf(), NonUniqueBoundType::GetInf(), 3);
+  int pair_list[][2] = {{1, 10}, {1, 11}, {3, 30}, {3, 31}, {3, 32}, {5, 50}, {5, 51}};
+  for(auto &pair : pair_list) { node_p->Append(pair[0], pair[1]); }
+  always_assert(node_p->GetRunNum() == 3 && node_p->GetRunEnd(1) == 5);
+  for(int i = 0;i < 7;i++) { always_assert(node_p->KeyAt(i) == pair_list[i][0] && node_p->ValueAt(i) == pair_list[i][1]); }
+  always_assert(node_p->PointSearch(3) == 2 && node_p->PointSearch(4) == -1 && node_p->Search(4) == 4);
+  NonUniqueLeafType *sibling_p = node_p->Split();
+  always_assert(sibling_p->GetSize() == 5 && sibling_p->GetRunNum() == 2 && *sibling_p->GetLowKey() == 3);
+  for(int i = 0;i < 5;i++) { always_assert(sibling_p->KeyAt(i) == pair_list[i + 2][0] && sibling_p->ValueAt(i) == pair_list[i + 2][1]); }
+  NonUniqueLeafType::Destroy(sibling_p);
+  NonUniqueLeafType *single_p = \
+    NonUniqueLeafType::Get(NodeType::LeafBase, 3, NonUniqueBoundType::GetInf(), NonUniqueBoundType::GetInf(), 1);
+  for(int i = 0;i < 3;i++) { single_p->Append(7, i); }
+  always_assert(single_p->Split() == nullptr);
+  NonUniqueLeafType::Destroy(single_p);
+
+  NonUniqueTableType *table_p = NonUniqueTableType::Get();
+  NonUniqueNodeIDType node_id = table_p->AllocateNodeID(node_p);
+  NonUniqueAppendHelperType ah{node_id, node_p, table_p};
+  always_assert(ah.AppendLeafDelete(3, 30) == nullptr);
+  always_assert(ah.AppendLeafInsert(3, 33) == nullptr);
+  always_assert(ah.AppendLeafDelete(1, 10) == nullptr);
+  always_assert(ah.AppendLeafInsert(1, 10) == nullptr);
+  always_assert(ah.AppendLeafInsert(4, 40) == nullptr);
+  always_assert(ah.AppendLeafDelete(5, 50) == nullptr);
+  always_assert(ah.AppendLeafDelete(5, 51) == nullptr);
+  always_assert(ah.AppendLeafInsert(0, 1) == nullptr);
+  NonUniqueConsolidatorType ct{table_p->At(node_id)};
+  DeltaChainTraverser<int, int, NonUniqueNodeIDType, DefaultDeltaChainType, DefaultNonUniqueBaseNode, NonUniqueConsolidatorType>::Traverse(
+    table_p->At(node_id), &ct);
+  NonUniqueLeafType *new_node_p = ct.GetNewLeafBase();
+  int expected_list[][2] = {{0, 1}, {1, 11}, {1, 10}, {3, 31}, {3, 32}, {3, 33}, {4, 40}};
+  always_assert(new_node_p->GetSize() == 7 && new_node_p->GetRunNum() == 4);
+  for(int i = 0;i < 7;i++) { 
+    always_assert(new_node_p->KeyAt(i) == expected_list[i][0] && new_node_p->ValueAt(i) == expected_list[i][1]); 
+  }
+  NonUniqueFreeHelperType dcfh{table_p};
+  DeltaChainTraverser<int, int, NonUniqueNodeIDType, DefaultDeltaChainType, DefaultNonUniqueBaseNode, NonUniqueFreeHelperType>::Traverse(
+    table_p->At(node_id), &dcfh);
+  NonUniqueLeafType::Destroy(new_node_p);
+  NonUniqueTableType::Destroy(table_p);
+
+  // Key k has k % 5 + 1 values, and key 500 has a run longer than the split threshold
+  constexpr int key_num = 2000;
+  constexpr int long_run_key = 500;
+  constexpr int long_run_size = 1000;
+  NonUniqueBwTreeType *tree_p = new NonUniqueBwTreeType{1};
+  tree_p->RegisterThread(0);
+  for(int j = 0;j < 5;j++) {
+    for(int key = 0;key < key_num;key++) { 
+      if(j <= key % 5) { always_assert(tree_p->Insert(key, key * 10000 + j) == true); }
+    }
+  }
+  for(int j = 1;j < long_run_size;j++) { always_assert(tree_p->Insert(long_run_key, long_run_key * 10000 + j) == true); }
+  always_assert(tree_p->Insert(7, 70001) == false && tree_p->Insert(7, 70009) == true && tree_p->Delete(7, 70009) == true);
+  // Deletes the even values
+  for(int key = 0;key < key_num;key++) {
+    int value_num = key == long_run_key ? long_run_size : key % 5 + 1;
+    for(int j = 0;j < value_num;j += 2) { always_assert(tree_p->Delete(key, key * 10000 + j) == true); }
+    always_assert(tree_p->Delete(key, key * 10000 + 9999) == false);
+  }
+  std::vector<int> value_list{};
+  int value = -1;
+  for(int key = 0;key < key_num;key++) {
+    int value_num = key == long_run_key ? long_run_size : key % 5 + 1;
+    value_list.clear();
+    always_assert(tree_p->Lookup(key, &value_list) == static_cast<size_t>(value_num / 2));
+    std::sort(value_list.begin(), value_list.end());
+    for(size_t i = 0;i < value_list.size();i++) { always_assert(value_list[i] == key * 10000 + static_cast<int>(i) * 2 + 1); }
+    bool is_found = value_num > 1;
+    always_assert(tree_p->Lookup(key, &value) == is_found);
+  }
+  int prev_key = -1;
+  size_t pair_num = 0, long_run_num = 0;
+  for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) {
+    always_assert(it.GetKey() >= prev_key && it.GetValue() / 10000 == it.GetKey());
+    if(it.GetKey() == long_run_key) { long_run_num++; }
+    prev_key = it.GetKey();
+    pair_num++;
+  }
+  always_assert(pair_num == size_t{key_num / 5 * (0 + 1 + 1 + 2 + 2) + long_run_size / 2} && long_run_num == long_run_size / 2);
+  delete tree_p;
+
+  return;
+} END_TEST
+
+/*
+ * SnapshotTest() - Tests checkpoints and reopening trees from snapshots
+ * 
+ * 1. Reopened trees have the same items and scan order as the checkpointed tree
+ * 2. Mapped base nodes are modified and consolidated without changing the file, and
+ *    reopened trees are checkpointed again
+ * 3. Missing files and snapshots of other value sizes or node layouts are not opened
+ */
+BEGIN_DEBUG_TEST(SnapshotTest) {
+  using SnapshotBwTreeType = \
+    BwTree<int, int64_t, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator>;
+  using OtherBwTreeType = \
+    BwTree<int, int32_t, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator>;
+  // Same key and value sizes, but base nodes embed the slab
+  using SlabBwTreeType = \
+    BwTree<int, int64_t, DefaultMappingTable, DefaultSlabDeltaChainType, DefaultBaseNode, DefaultConsolidator>;
+  const char *path = "bwtree-test-snapshot.bin";
+  const char *second_path = "bwtree-test-snapshot-2.bin";
+  constexpr int key_num = 10000;
+  // Keys that are multiples of 7 are deleted before the checkpoint
+  auto is_kept = [](int key) { return key % 7 != 0; };
+
+  SnapshotBwTreeType *tree_p = new SnapshotBwTreeType{1};
+  tree_p->RegisterThread(0);
+  for(int key = 0;key < key_num;key++) { always_assert(tree_p->Insert(key, key * 3L) == true); }
+  for(int key = 0;key < key_num;key += 7) { always_assert(tree_p->Delete(key) == true); }
+  always_assert(tree_p->Checkpoint(path) == true);
+  delete tree_p;
+
+  tree_p = SnapshotBwTreeType::Open(1, path);
+  always_assert(tree_p != nullptr);
+  tree_p->RegisterThread(0);
+  int64_t value;
+  for(int key = -1;key <= key_num;key++) {
+    bool is_found = key >= 0 && key < key_num && is_kept(key);
+    always_assert(tree_p->Lookup(key, &value) == is_found);
+    if(is_found) { always_assert(value == key * 3L); }
+  }
+  int next_key = 1;
+  for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) {
+    always_assert(it.GetKey() == next_key && it.GetValue() == next_key * 3L);
+    do { next_key++; } while(is_kept(next_key) == false);
+  }
+  always_assert(next_key == key_num);
+
+  // Deleted keys are inserted back, and the even keys are deleted
+  for(int key = 0;key < key_num;key += 7) { always_assert(tree_p->Insert(key, key * 3L) == true); }
+  for(int key = 0;key < key_num;key += 2) { always_assert(tree_p->Delete(key) == true); }
+  always_assert(tree_p->Checkpoint(second_path) == true);
+  delete tree_p;
+
+  // The first snapshot is not changed by the modifications
+  tree_p = SnapshotBwTreeType::Open(1, path);
+  always_assert(tree_p != nullptr);
+  tree_p->RegisterThread(0);
+  for(int key = 0;key < key_num;key++) { always_assert(tree_p->Lookup(key, &value) == is_kept(key)); }
+  delete tree_p;
+  tree_p = SnapshotBwTreeType::Open(1, second_path);
+  always_assert(tree_p != nullptr);
+  tree_p->RegisterThread(0);
+  for(int key = 0;key < key_num;key++) { 
+    bool is_found = key % 2 == 1;
+    always_assert(tree_p->Lookup(key, &value) == is_found);
+    if(is_found) { always_assert(value == key * 3L); }
+  }
+  delete tree_p;
+
+  always_assert(SnapshotBwTreeType::Open(1, "bwtree-test-snapshot-missing.bin") == nullptr);
+  always_assert(OtherBwTreeType::Open(1, path) == nullptr);
+  always_assert(SlabBwTreeType::LeafBaseType::GetHeaderSize() != SnapshotBwTreeType::LeafBaseType::GetHeaderSize());
+  always_assert(SlabBwTreeType::Open(1, path) == nullptr);
+  std::remove(path);
+  std::remove(second_path);
+
+  return;
+} END_TEST
+
+/*
+ * LogTest() - Tests the group commit log and recovery from a snapshot and the log
+ * 
+ * 1. Threads insert and delete concurrently, and wait for their records to be synced
+ * 2. Replaying the log onto the snapshot, or onto an empty tree, recovers the tree.
+ *    Records in the snapshot are skipped by the sequence number
+ * 3. Replaying onto a tree with other items reports the records that do not apply
+ * 4. Logs of other value sizes are not replayed
+ * 5. Records are not durable while another thread holds a smaller sequence number
+ */
+BEGIN_DEBUG_TEST(LogTest) {
+  using LogBwTreeType = \
+    BwTree<int, int64_t, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator,
+           DefaultEpochManagerType, DefaultNullStatsType, DefaultStaticConfigType, DefaultHeightPolicyType, 
+           DefaultGroupCommitLogType>;
+  using OtherBwTreeType = \
+    BwTree<int, int32_t, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator,
+           DefaultEpochManagerType, DefaultNullStatsType, DefaultStaticConfigType, DefaultHeightPolicyType, 
+           DefaultGroupCommitLogType>;
+  const char *snapshot_path = "bwtree-test-log-snapshot.bin";
+  const char *log_path = "bwtree-test-log.bin";
+  constexpr size_t thread_num = 4;
+  constexpr int per_thread = 5000;
+  constexpr int key_num = per_thread * static_cast<int>(thread_num);
+  std::remove(log_path);
+
+  // Keys [0, key_num) are in the snapshot. Then multiples of 3 are deleted, and 
+  // [key_num, 2 * key_num) are inserted with a small flush size
+  LogBwTreeType *tree_p = new LogBwTreeType{thread_num};
+  always_assert(tree_p->GetLog()->Start(log_path, 200, 1024) == true);
+  int begin = 0;
+  auto insert_func = [tree_p, &begin](size_t thread_id, size_t) {
+    tree_p->RegisterThread(thread_id);
+    for(int i = 0;i < per_thread;i++) {
+      int key = begin + i * static_cast<int>(thread_num) + static_cast<int>(thread_id);
+      always_assert(tree_p->Insert(key, key * 5L) == true);
+    }
+    tree_p->GetLog()->WaitDurable();
+  };
+  auto delete_func = [tree_p](size_t thread_id, size_t) {
+    tree_p->RegisterThread(thread_id);
+    for(int key = static_cast<int>(thread_id) * 3;key < key_num;key += static_cast<int>(thread_num) * 3) { 
+      always_assert(tree_p->Delete(key) == true); 
+    }
+    tree_p->GetLog()->WaitDurable();
+  };
+  StartThread(thread_num, insert_func, thread_num);
+  // Failed CAS also take sequence numbers
+  uint64_t snapshot_sequence = tree_p->GetLog()->GetNextSequence();
+  always_assert(snapshot_sequence >= static_cast<uint64_t>(key_num));
+  always_assert(tree_p->Checkpoint(snapshot_path) == true);
+  begin = key_num;
+  StartThread(thread_num, delete_func, thread_num);
+  StartThread(thread_num, insert_func, thread_num);
+  uint64_t next_sequence = tree_p->GetLog()->GetNextSequence();
+  tree_p->GetLog()->Stop();
+  delete tree_p;
+
+  auto verify_func = [next_sequence](LogBwTreeType *recovered_p) {
+    always_assert(recovered_p->GetLog()->GetNextSequence() <= next_sequence);
+    int64_t value;
+    for(int key = 0;key < key_num * 2;key++) {
+      bool is_found = key >= key_num || key % 3 != 0;
+      always_assert(recovered_p->Lookup(key, &value) == is_found);
+      if(is_found) { always_assert(value == key * 5L); }
+    }
+  };
+  tree_p = LogBwTreeType::Open(1, snapshot_path);
+  always_assert(tree_p != nullptr);
+  tree_p->RegisterThread(0);
+  always_assert(tree_p->GetLog()->GetNextSequence() == snapshot_sequence);
+  always_assert(tree_p->ReplayLog(log_path) == true);
+  verify_func(tree_p);
+  // Mutations after recovery continue the sequence numbers in the same log
+  always_assert(tree_p->GetLog()->Start(log_path) == true);
+  always_assert(tree_p->Delete(key_num) == true);
+  next_sequence = tree_p->GetLog()->GetNextSequence();
+  tree_p->GetLog()->Stop();
+  delete tree_p;
+
+  tree_p = new LogBwTreeType{1};
+  tree_p->RegisterThread(0);
+  always_assert(tree_p->ReplayLog(log_path) == true);
+  int64_t value;
+  always_assert(tree_p->Lookup(key_num, &value) == false && tree_p->Lookup(key_num + 1, &value) == true);
+  always_assert(tree_p->Lookup(3, &value) == false && tree_p->Lookup(4, &value) == true);
+  always_assert(tree_p->GetLog()->GetNextSequence() == next_sequence);
+  delete tree_p;
+
+  // Inserts of both keys do not apply, and the other records do
+  tree_p = new LogBwTreeType{1};
+  tree_p->RegisterThread(0);
+  always_assert(tree_p->Insert(4, 0L) == true && tree_p->Insert(key_num + 1, 0L) == true);
+  size_t failed_num = 0;
+  always_assert(tree_p->ReplayLog(log_path, &failed_num) == false);
+  always_assert(failed_num == 2);
+  always_assert(tree_p->Lookup(3, &value) == false && tree_p->Lookup(5, &value) == true && value == 25L);
+  delete tree_p;
+
+  OtherBwTreeType *other_p = new OtherBwTreeType{1};
+  always_assert(other_p->ReplayLog(log_path) == false);
+  always_assert(other_p->ReplayLog("bwtree-test-log-missing.bin") == false);
+  delete other_p;
+  std::remove(snapshot_path);
+  std::remove(log_path);
+
+  // Thread 1 holds a sequence number before the record of thread 0, which is hence 
+  // synced but not durable until thread 1 aborts
+  DefaultGroupCommitLogType *log_p = new DefaultGroupCommitLogType{2};
+  always_assert(log_p->Start(log_path, 100, 1024) == true);
+  ThreadContext::SetThreadID(1);
+  uint64_t held_sequence = log_p->GetSequence();
+  ThreadContext::SetThreadID(0);
+  uint64_t sequence = log_p->GetSequence();
+  log_p->Log(LogRecordType::Insert, sequence, 1, 1L);
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  always_assert(log_p->GetDurableSequence() == held_sequence);
+  ThreadContext::SetThreadID(1);
+  log_p->Abort();
+  ThreadContext::SetThreadID(0);
+  log_p->WaitDurable();
+  always_assert(log_p->GetDurableSequence() == sequence + 1);
+  log_p->Stop();
+  delete log_p;
+  std::remove(log_path);
+
+  return;
+} END_TEST
+
+/*
+ * TracerTest() - Tests the sampling tracer and the heatmap
+ * 
+ * 1. One in N operations is traced with the path from the root to the leaf, and the
+ *    last traces of each thread are kept
+ * 2. The heatmap counts the visits of sampled operations, and is sorted with the 
+ *    hottest node first. The root is visited by all traversals
+ * 3. Threads inserting into the same leaves fail CAS, which are counted in the heatmap
+ */
+BEGIN_DEBUG_TEST(TracerTest) {
+  using TracerBwTreeType = \
+    BwTree<KeyType, ValueType, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator,
+           DefaultEpochManagerType, DefaultNullStatsType, DefaultStaticConfigType, DefaultHeightPolicyType, 
+           DefaultNullLogType, DefaultSamplingTracerType>;
+  using TraceType = typename DefaultSamplingTracerType::TraceType;
+  constexpr int key_num = 10000;
+  constexpr size_t sample_interval = 4;
+  TracerBwTreeType *tree_p = new TracerBwTreeType{1};
+  tree_p->RegisterThread(0);
+  DefaultSamplingTracerType *tracer_p = tree_p->GetTracer();
+  tracer_p->SetSampleInterval(sample_interval);
+  // The tree is not split by the first few inserts
+  for(int key = 0;key < 40;key++) { always_assert(tree_p->Insert(key, std::to_string(key)) == true); }
+  std::vector<TraceType> trace_list = tracer_p->GetTraceList();
+  always_assert(trace_list.size() == 40 / sample_interval && trace_list[0].op == TraceOp::Insert);
+  // The leaf is visited again after it is consolidated
+  uint64_t visit_num = 0;
+  for(const TraceType &trace : trace_list) { 
+    always_assert(trace.visit_num >= 2 && trace.retry_num == 0 && trace.node_id_list[0] == trace_list[0].node_id_list[0]); 
+    visit_num += trace.visit_num;
+  }
+  auto heatmap = tracer_p->GetHeatmap();
+  always_assert(heatmap.size() == 2 && heatmap[0].second.visit_num + heatmap[1].second.visit_num == visit_num);
+
+  tracer_p->Reset();
+  ValueType value;
+  for(int key = 0;key < key_num;key++) { tree_p->Insert(key, std::to_string(key)); }
+  for(int key = 0;key < key_num;key++) { always_assert(tree_p->Lookup(key, &value) == true); }
+  trace_list = tracer_p->GetTraceList();
+  always_assert(trace_list.size() == DefaultSamplingTracerType::TRACE_BUFFER_SIZE);
+  // The oldest traces are overwritten
+  always_assert(trace_list.front().op == TraceOp::Lookup && trace_list.back().op == TraceOp::Lookup);
+  heatmap = tracer_p->GetHeatmap();
+  for(size_t i = 1;i < heatmap.size();i++) { always_assert(heatmap[i - 1].second.GetWeight() >= heatmap[i].second.GetWeight()); }
+  std::string csv = tracer_p->ToHeatmapCSV();
+  always_assert(static_cast<size_t>(std::count(csv.begin(), csv.end(), '\n')) == heatmap.size() + 1);
+  always_assert(tracer_p->ToHeatmapJSON().substr(0, 13) == "[{\"node_id\": ");
+  always_assert(tracer_p->ToTraceJSON().substr(0, 16) == "[{\"op\": \"lookup\"");
+  delete tree_p;
+
+  constexpr size_t thread_num = 4;
+  tree_p = new TracerBwTreeType{thread_num};
+  auto func = [tree_p](size_t thread_id, size_t thread_num) {
+    tree_p->RegisterThread(thread_id);
+    for(int i = 0;i < key_num;i++) { tree_p->Insert(i * static_cast<int>(thread_num) + static_cast<int>(thread_id), ""); }
+  };
+  StartThread(thread_num, func, thread_num);
+  uint64_t retry_num = 0;
+  for(const auto &item : tree_p->GetTracer()->GetHeatmap()) { retry_num += item.second.retry_num; }
+  std::string hot_list = tree_p->GetTracer()->ToHeatmapCSV();
+  hot_list = hot_list.substr(0, hot_list.find('\n', hot_list.find('\n', hot_list.find('\n') + 1) + 1));
+  test_printf("%lu failed CAS; hottest nodes:\n%s\n", retry_num, hot_list.c_str());
+  delete tree_p;
+
+  return;
+} END_TEST
+
+/*
+ * KeyEncoderTest() - Tests order-preserving key encoding and encoded key trees
+ * 
+ * 1. memcmp() order of encodings is the order of integers, floats and strings, including
+ *    negative values and strings with zero bytes
+ * 2. Composite keys are ordered field by field, and are decoded back
+ * 3. Trees of EncodedKey scan composite keys in order
+ */
+BEGIN_DEBUG_TEST(KeyEncoderTest) {
+  auto encode_int = [](int64_t value) { return KeyEncoder{}.AppendInt(value).GetString(); };
+  std::vector<int64_t> int_list = {INT64_MIN, -0x100000000L, -256, -1, 0, 1, 255, 256, 0x100000000L, INT64_MAX};
+  for(size_t i = 1;i < int_list.size();i++) { always_assert(encode_int(int_list[i - 1]) < encode_int(int_list[i])); }
+  always_assert(KeyEncoder{}.AppendInt(uint16_t{0x1234}).GetString() == std::string("\x12\x34", 2));
+  always_assert(KeyEncoder{}.AppendInt(int8_t{-1}).GetString() < KeyEncoder{}.AppendInt(int8_t{0}).GetString());
+
+  auto encode_double = [](double value) { return KeyEncoder{}.AppendFloat(value).GetString(); };
+  std::vector<double> double_list = {-INFINITY, -1e300, -2.5, -1.0, -1e-300, -0.0, 0.0, 1e-300, 1.0, 2.5, 1e300, INFINITY};
+  for(size_t i = 1;i < double_list.size();i++) { always_assert(encode_double(double_list[i - 1]) < encode_double(double_list[i])); }
+  always_assert(KeyEncoder{}.AppendFloat(-1.5f).GetString() < KeyEncoder{}.AppendFloat(0.25f).GetString());
+
+  std::vector<std::string> string_list = {"", std::string("\0", 1), std::string("\0\0", 2), std::string("\0a", 2), 
+                                          "a", std::string("a\0", 2), "ab", "b", "\xFF"};
+  for(size_t i = 1;i < string_list.size();i++) { 
+    // The next field never changes the order
+    always_assert(KeyEncoder{}.AppendString(string_list[i - 1]).AppendInt(INT32_MAX).GetString() < 
+                  KeyEncoder{}.AppendString(string_list[i]).AppendInt(INT32_MIN).GetString()); 
+  }
+
+  // Composite keys (int32, string, double) compared as tuples
+  using CompositeType = std::tuple<int32_t, std::string, double>;
+  using EncodedKeyType = EncodedKey<32>;
+  auto encode = [](const CompositeType &t) {
+    KeyEncoder encoder{};
+    encoder.AppendInt(std::get<0>(t)).AppendString(std::get<1>(t)).AppendFloat(std::get<2>(t));
+    return EncodedKeyType{encoder};
+  };
+  auto decode = [](const EncodedKeyType &key) {
+    CompositeType t{};
+    KeyDecoder decoder = key.GetDecoder();
+    always_assert(decoder.ReadInt(&std::get<0>(t)) && decoder.ReadString(&std::get<1>(t)) && decoder.ReadFloat(&std::get<2>(t)));
+    return t;
+  };
+  std::vector<CompositeType> composite_list{};
+  for(int32_t i = -5;i < 5;i++) {
+    for(const std::string &s : {std::string{""}, std::string{"x"}, std::string("x\0y", 3), std::string{"xy"}}) {
+      for(double d : {-1.5, 0.0, 3.25}) { composite_list.emplace_back(i * 1000, s, d); }
+    }
+  }
+  for(const CompositeType &a : composite_list) {
+    always_assert(decode(encode(a)) == a);
+    for(const CompositeType &b : composite_list) { always_assert((a < b) == (encode(a) < encode(b))); }
+  }
+
+  using EncodedBwTreeType = \
+    BwTree<EncodedKeyType, int, DefaultMappingTable, DefaultDeltaChainType, DefaultBaseNode, DefaultConsolidator>;
+  EncodedBwTreeType *tree_p = new EncodedBwTreeType{1};
+  tree_p->RegisterThread(0);
+  std::vector<size_t> order{};
+  for(size_t i = 0;i < composite_list.size();i++) { order.push_back(i * 7 % composite_list.size()); }
+  for(size_t index : order) { always_assert(tree_p->Insert(encode(composite_list[index]), static_cast<int>(index)) == true); }
+  always_assert(tree_p->Insert(encode(composite_list[3]), 0) == false);
+  std::vector<CompositeType> sorted_list{composite_list};
+  std::sort(sorted_list.begin(), sorted_list.end());
+  size_t next = 0;
+  for(auto it = tree_p->Begin();!it.IsEnd();it.Next()) {
+    always_assert(decode(it.GetKey()) == sorted_list[next]);
+    always_assert(composite_list[static_cast<size_t>(it.GetValue())] == sorted_list[next]);
+    next++;
+  }
+  always_assert(next == composite_list.size());
+  delete tree_p;
+
+  return;
+} END_TEST
+
+/*
+ * ArraySearchTest() - Tests ArraySearch against std::upper_bound
+ * 
+ * 1. Array sizes cover both the linear and the binary search path
+ * 2. Keys contain duplicates, negative numbers and large unsigned numbers
+ * 3. Build with SIMD=AVX2 or SIMD=AVX512 to test SIMD versions
+ */
+template <typename KeyType>
+void ArraySearchTestHelper(KeyType base, KeyType step) {
+  std::vector<KeyType> keys{};
+  for(size_t size = 0;size < 300;size++) {
+    keys.clear();
+    for(size_t i = 0;i < size;i++) { keys.push_back(base + static_cast<KeyType>(i / 2) * step); }
+    // Duplicated keys make the upper bound differ from the lower bound
+    for(size_t i = 0;i < size + 2;i++) {
+      KeyType key = base + static_cast<KeyType>(i / 2) * step - static_cast<KeyType>(i % 2);
+      KeyType *expected = std::upper_bound(keys.data(), keys.data() + size, key);
+      KeyType *actual = ArraySearch<KeyType>::UpperBound(keys.data(), keys.data() + size, key);
+      always_assert(expected == actual);
+    }
+  }
+
+  return;
+}
+
+BEGIN_DEBUG_TEST(ArraySearchTest) {
+#ifdef __AVX2__
+  test_printf("SIMD search enabled\n");
+#endif
+  ArraySearchTestHelper<int32_t>(-1000, 3);
+  ArraySearchTestHelper<int64_t>(-0x100000000L, 0x10000000L);
+  // Crosses the sign bit to check unsigned comparison
+  ArraySearchTestHelper<uint64_t>(0x7FFFFFFFFFFFFF00UL, 5);
+  ArraySearchTestHelper<uint64_t>(0, 7);
+  ArraySearchTestHelper<double>(-1.5, 0.25);
+  return;
+} END_TEST
+
 int main() {
   //MappingTableTest();
   //BoundKeyTest();
   //BaseNodeTest();
+  EpochManagerTest();
   DeltaNodeTest();
   AppendTest();
   LeafConsolidationTest();
   InnerConsolidationTest();
+  SearchHintTest();
+  KeyFilterTest();
+  AppendRetryTest();
+  RetireChainTest();
+  InsertDeleteTest();
+  ConcurrentInsertDeleteTest();
+  SplitMergeTest();
+  ConcurrentSplitMergeTest();
+  ScanTest();
+  BatchTest();
+  BulkLoadTest();
+  StatsTest();
+  ConfigTest();
+  AdaptiveConsolidationTest();
+  MaintenanceTest();
+  SlabDeltaChainTest();
+  PagedMappingTableTest();
+  BlockMappingTableTest();
+  SortedConsolidationTest();
+  VarKeyBaseNodeTest();
+  NonUniqueTest();
+  SnapshotTest();
+  LogTest();
+  TracerTest();
+  KeyEncoderTest();
+  ArraySearchTest();
 
   return 0;
 }
\ No newline at end of file